@@ -0,0 +1,138 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "divulge.h"
+
+#define BENCHMARK_REQUESTS_PER_THREAD (200000)
+#define BENCHMARK_MAX_THREADS (16)
+#define ALLOCATIONS_PER_REQUEST (16)
+
+typedef struct benchmark_thread {
+    pthread_t thread;
+    divulge_t* divulge;
+    size_t failures;
+} benchmark_thread_t;
+
+static const char* request =
+    "GET /api/v1/items HTTP/1.1\r\n"
+    "Host: bench.example.com\r\n"
+    "Accept: application/json\r\n"
+    "\r\n";
+
+static double now_in_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void socket_send(void* connection_context, const char* data, size_t data_size) {}
+
+static void socket_close(void* connection_context) {}
+
+/*
+ * Formats a small JSON document from pieces, the way handlers typically build headers and bodies.
+ */
+static bool build_body(divulge_request_t* request, bool is_using_arena) {
+    char* pieces[ALLOCATIONS_PER_REQUEST];
+    size_t body_size = 2;
+    for (size_t i = 0; i < ALLOCATIONS_PER_REQUEST; i++) {
+        size_t size = 32 + (i * 13) % 200;
+        pieces[i] = is_using_arena ? divulge_request_alloc(request, size) : malloc(size);
+        if (!pieces[i]) {
+            return false;
+        }
+        body_size += (size_t)snprintf(pieces[i], size, "\"item%zu\":%zu,", i, i * 7);
+    }
+    char* body = is_using_arena ? divulge_request_alloc(request, body_size + 1) : malloc(body_size + 1);
+    size_t offset = 0;
+    body[offset++] = '{';
+    for (size_t i = 0; i < ALLOCATIONS_PER_REQUEST; i++) {
+        size_t size = strlen(pieces[i]);
+        memcpy(body + offset, pieces[i], size);
+        offset += size;
+    }
+    body[offset - 1] = '}';
+    divulge_response_t response = {.return_code = 200, .payload = body, .payload_size = offset};
+    bool result = divulge_respond(request, &response);
+    if (!is_using_arena) {
+        for (size_t i = 0; i < ALLOCATIONS_PER_REQUEST; i++) {
+            free(pieces[i]);
+        }
+        free(body);
+    }
+    return result;
+}
+
+static bool malloc_handler(divulge_request_t* request, void* context) {
+    return build_body(request, false);
+}
+
+static bool arena_handler(divulge_request_t* request, void* context) {
+    return build_body(request, true);
+}
+
+static void* run_thread(void* argument) {
+    benchmark_thread_t* thread = argument;
+    char response_buffer[1024];
+    size_t request_size = strlen(request);
+    for (size_t i = 0; i < BENCHMARK_REQUESTS_PER_THREAD; i++) {
+        divulge_process_request(thread->divulge, NULL, request, request_size, response_buffer,
+                                sizeof(response_buffer));
+    }
+    return NULL;
+}
+
+static double run_benchmark(divulge_uri_handler_t handler, size_t thread_count) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_uri_t uri = {.uri = "/api/v1/items", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = handler}};
+    divulge_register_uri(divulge, &uri);
+    benchmark_thread_t threads[BENCHMARK_MAX_THREADS] = {0};
+    double start = now_in_seconds();
+    for (size_t i = 0; i < thread_count; i++) {
+        threads[i].divulge = divulge;
+        pthread_create(&threads[i].thread, NULL, run_thread, threads + i);
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    double elapsed = now_in_seconds() - start;
+    return (double)(BENCHMARK_REQUESTS_PER_THREAD * thread_count) / elapsed;
+}
+
+int main(void) {
+    printf("%zu handler allocations per request; heap calls per request: malloc %d, arena 0 once warm\n",
+           (size_t)ALLOCATIONS_PER_REQUEST + 1, 2 * (ALLOCATIONS_PER_REQUEST + 1));
+    for (size_t thread_count = 1; thread_count <= BENCHMARK_MAX_THREADS; thread_count *= 4) {
+        double malloc_rate = run_benchmark(malloc_handler, thread_count);
+        double arena_rate = run_benchmark(arena_handler, thread_count);
+        printf("%2zu threads: malloc %12.0f requests/s, arena %12.0f requests/s (%.2fx)\n", thread_count,
+               malloc_rate, arena_rate, arena_rate / malloc_rate);
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "divulge-metrics.h"
+
+#define BENCHMARK_REQUESTS_PER_THREAD (1000000)
+#define BENCHMARK_PIPELINE_DEPTH (16)
+#define BENCHMARK_MAX_THREADS (4)
+#define BENCHMARK_ROUNDS (5)
+
+typedef struct benchmark_thread {
+    pthread_t thread;
+    divulge_t* divulge;
+} benchmark_thread_t;
+
+static const char* request =
+    "GET /api/v1/items/42 HTTP/1.1\r\n"
+    "Host: bench.example.com\r\n"
+    "Accept: application/json\r\n"
+    "\r\n";
+
+static const char* body = "{\"items\":[1,2,3,4,5,6,7,8]}";
+
+static double now_in_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void socket_send(void* connection_context, const char* data, size_t data_size) {}
+
+static void socket_close(void* connection_context) {}
+
+static bool items_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {.return_code = 200, .payload = body, .payload_size = strlen(body)};
+    return divulge_respond(request, &response);
+}
+
+/*
+ * Feeds pipelined batches into a persistent connection whose transport discards the output, so the numbers are
+ * the request handling cost alone, where the recording overhead weighs most.
+ */
+static void* run_thread(void* argument) {
+    benchmark_thread_t* thread = argument;
+    divulge_connection_t* connection = divulge_connection_create(thread->divulge, NULL);
+    size_t request_size = strlen(request);
+    for (size_t sent = 0; sent < BENCHMARK_REQUESTS_PER_THREAD; sent += BENCHMARK_PIPELINE_DEPTH) {
+        size_t buffer_size = 0;
+        char* buffer = divulge_connection_get_receive_buffer(connection, &buffer_size);
+        for (size_t i = 0; i < BENCHMARK_PIPELINE_DEPTH; i++) {
+            memcpy(buffer + i * request_size, request, request_size);
+        }
+        divulge_connection_receive(connection, BENCHMARK_PIPELINE_DEPTH * request_size);
+    }
+    divulge_connection_destroy(connection);
+    return NULL;
+}
+
+static double run_benchmark(divulge_metrics_t* metrics, size_t thread_count) {
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .close = socket_close,
+        .max_requests_per_connection = SIZE_MAX,
+        .metrics = metrics,
+    };
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_uri_t uri = {
+        .uri = "/api/v1/items/:id", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = items_handler}};
+    divulge_register_uri(divulge, &uri);
+    benchmark_thread_t threads[BENCHMARK_MAX_THREADS] = {0};
+    double start = now_in_seconds();
+    for (size_t i = 0; i < thread_count; i++) {
+        threads[i].divulge = divulge;
+        pthread_create(&threads[i].thread, NULL, run_thread, threads + i);
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+    double elapsed = now_in_seconds() - start;
+    return (double)(BENCHMARK_REQUESTS_PER_THREAD * thread_count) / elapsed;
+}
+
+static int compare_rates(const void* a, const void* b) {
+    double left = *(const double*)a;
+    double right = *(const double*)b;
+    return (left > right) - (left < right);
+}
+
+int main(void) {
+    printf("%d pipelined requests per read, median of %d alternating rounds\n", BENCHMARK_PIPELINE_DEPTH,
+           BENCHMARK_ROUNDS);
+    for (size_t thread_count = 1; thread_count <= BENCHMARK_MAX_THREADS; thread_count *= 4) {
+        double off_rates[BENCHMARK_ROUNDS];
+        double on_rates[BENCHMARK_ROUNDS];
+        divulge_metrics_t* metrics = divulge_metrics_create();
+        for (size_t round = 0; round < BENCHMARK_ROUNDS; round++) {
+            off_rates[round] = run_benchmark(NULL, thread_count);
+            on_rates[round] = run_benchmark(metrics, thread_count);
+        }
+        qsort(off_rates, BENCHMARK_ROUNDS, sizeof(double), compare_rates);
+        qsort(on_rates, BENCHMARK_ROUNDS, sizeof(double), compare_rates);
+        double off_rate = off_rates[BENCHMARK_ROUNDS / 2];
+        double on_rate = on_rates[BENCHMARK_ROUNDS / 2];
+        printf("%zu threads: metrics off %10.0f requests/s (%5.0f ns), on %10.0f requests/s (%5.0f ns), cost %.1f%%\n",
+               thread_count, off_rate, 1e9 / off_rate, on_rate, 1e9 / on_rate, 100.0 * (1.0 - on_rate / off_rate));
+        divulge_metrics_destroy(metrics);
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "divulge-parser.h"
+
+#define BENCHMARK_ITERATIONS (1000000)
+
+static const char* browser_request =
+    "GET /api/v1/dashboard/widgets?range=24h&refresh=true HTTP/1.1\r\n"
+    "Host: dashboard.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: application/json, text/plain, */*\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9,pl;q=0.8\r\n"
+    "Referer: https://dashboard.example.com/overview\r\n"
+    "Cookie: session=3f9a8b7c6d5e4f3a2b1c0d9e8f7a6b5c; theme=dark; tz=Europe%2FWarsaw\r\n"
+    "Authorization: Basic ZzI6ZzM=\r\n"
+    "\r\n";
+
+static double now_in_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void run_benchmark(const char* name, size_t fragment_size) {
+    size_t request_size = strlen(browser_request);
+    size_t failures = 0;
+    divulge_parser_t parser;
+    double start = now_in_seconds();
+    for (size_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        divulge_parser_initialize(&parser, NULL);
+        divulge_parser_status_t status = DIVULGE_PARSER_STATUS_INCOMPLETE;
+        for (size_t available = 0; (status == DIVULGE_PARSER_STATUS_INCOMPLETE) && (available < request_size);) {
+            available += fragment_size;
+            available = (available > request_size) ? request_size : available;
+            status = divulge_parser_feed(&parser, browser_request, available);
+        }
+        failures += (status == DIVULGE_PARSER_STATUS_COMPLETE) ? 0 : 1;
+    }
+    double elapsed = now_in_seconds() - start;
+    printf("%-20s %zu bytes: %12.0f requests/s, %8.1f MB/s%s\n", name, request_size,
+           BENCHMARK_ITERATIONS / elapsed, (double)(request_size * BENCHMARK_ITERATIONS) / elapsed / 1e6,
+           failures ? " (FAILURES!)" : "");
+}
+
+int main(void) {
+    run_benchmark("whole buffer", strlen(browser_request));
+    run_benchmark("64 byte fragments", 64);
+    run_benchmark("1 byte fragments", 1);
+    return 0;
+}
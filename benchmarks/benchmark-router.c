@@ -0,0 +1,101 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "divulge-router.h"
+
+#define BENCHMARK_LOOKUPS (1000000)
+
+typedef struct linear_route {
+    divulge_route_method_t method;
+    char uri[64];
+} linear_route_t;
+
+static double now_in_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void format_route(char* buffer, size_t buffer_size, size_t index) {
+    snprintf(buffer, buffer_size, "/api/v1/service%zu/resource%zu", index / 100, index);
+}
+
+static void* linear_lookup(linear_route_t* routes, size_t count, divulge_route_method_t method, const char* path) {
+    void* result = NULL;
+    for (size_t i = 0; i < count; i++) {
+        if ((routes[i].method == method) && (strcmp(path, routes[i].uri) == 0) &&
+            (strlen(path) == strlen(routes[i].uri))) {
+            result = routes + i;
+        }
+    }
+    return result;
+}
+
+static void run_benchmark(size_t route_count) {
+    linear_route_t* routes = calloc(route_count, sizeof(linear_route_t));
+    divulge_router_t* router = divulge_router_create();
+    for (size_t i = 0; i < route_count; i++) {
+        routes[i].method = DIVULGE_ROUTE_METHOD_GET;
+        format_route(routes[i].uri, sizeof(routes[i].uri), i);
+        divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, routes[i].uri, routes + i);
+    }
+    size_t lookups = (route_count >= 1000) ? BENCHMARK_LOOKUPS / 100 : BENCHMARK_LOOKUPS;
+    size_t misses = 0;
+    divulge_route_parameter_t parameters[DIVULGE_MAX_ROUTE_PARAMETERS];
+    size_t parameter_count = 0;
+
+    double start = now_in_seconds();
+    for (size_t i = 0; i < lookups; i++) {
+        const char* path = routes[(i * 7919) % route_count].uri;
+        misses += linear_lookup(routes, route_count, DIVULGE_ROUTE_METHOD_GET, path) ? 0 : 1;
+    }
+    double linear_time = now_in_seconds() - start;
+
+    start = now_in_seconds();
+    for (size_t i = 0; i < lookups; i++) {
+        const char* path = routes[(i * 7919) % route_count].uri;
+        misses += divulge_router_lookup(router, DIVULGE_ROUTE_METHOD_GET, path, strlen(path), parameters,
+                                        &parameter_count)
+                      ? 0
+                      : 1;
+    }
+    double trie_time = now_in_seconds() - start;
+
+    printf("%6zu routes: linear %10.1f ns/lookup, trie %8.1f ns/lookup, speedup %8.1fx%s\n", route_count,
+           linear_time * 1e9 / (double)lookups, trie_time * 1e9 / (double)lookups, linear_time / trie_time,
+           misses ? " (MISSES!)" : "");
+    divulge_router_destroy(router);
+    free(routes);
+}
+
+int main(void) {
+    size_t route_counts[] = {10, 1000, 10000};
+    for (size_t i = 0; i < sizeof(route_counts) / sizeof(route_counts[0]); i++) {
+        run_benchmark(route_counts[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "divulge-scan.h"
+
+#define BENCHMARK_BYTES (1000000000)
+
+static const divulge_scan_implementation_t implementations[] = {
+    DIVULGE_SCAN_IMPLEMENTATION_SCALAR,
+    DIVULGE_SCAN_IMPLEMENTATION_SSE42,
+    DIVULGE_SCAN_IMPLEMENTATION_AVX2,
+};
+
+static const size_t header_block_sizes[] = {500, 2000, 8000};
+
+static double now_in_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void fill_header_block(char* buffer, size_t size) {
+    static const char* header = "Cookie: session=3f9a8b7c6d5e4f3a2b1c0d9e8f7a6b5c; theme=dark; tz=Europe%2FWarsaw\r\n";
+    size_t header_size = strlen(header);
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = header[i % header_size];
+    }
+}
+
+/*
+ * Scans every header line the way the parser does: the name as a token, the value up to CR.
+ */
+static size_t scan_header_block(const char* buffer, size_t size) {
+    size_t lines = 0;
+    for (size_t p = 0; p < size; lines++) {
+        p += divulge_scan(DIVULGE_SCAN_CLASS_TOKEN, buffer + p, size - p) + 1;
+        if (p < size) {
+            p += divulge_scan(DIVULGE_SCAN_CLASS_VALUE, buffer + p, size - p) + 2;
+        }
+    }
+    return lines;
+}
+
+static void run_benchmark(divulge_scan_implementation_t implementation, const char* buffer, size_t size) {
+    size_t iterations = BENCHMARK_BYTES / size;
+    size_t lines = 0;
+    double start = now_in_seconds();
+    for (size_t i = 0; i < iterations; i++) {
+        lines += scan_header_block(buffer, size);
+    }
+    double elapsed = now_in_seconds() - start;
+    printf("%-8s %5zu bytes: %8.1f MB/s (%zu lines)\n", divulge_scan_get_implementation_name(implementation), size,
+           (double)(size * iterations) / elapsed / 1e6, lines / iterations);
+}
+
+int main(void) {
+    static char buffer[8000];
+    for (size_t i = 0; i < sizeof(header_block_sizes) / sizeof(header_block_sizes[0]); i++) {
+        fill_header_block(buffer, header_block_sizes[i]);
+        for (size_t j = 0; j < sizeof(implementations) / sizeof(implementations[0]); j++) {
+            if (divulge_scan_select_implementation(implementations[j])) {
+                run_benchmark(implementations[j], buffer, header_block_sizes[i]);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,341 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "divulge-epoll.h"
+#include "divulge-listener.h"
+#include "divulge-metrics.h"
+#include "divulge-uring.h"
+
+#define BENCHMARK_DURATION_SECONDS (2.0)
+#define BENCHMARK_CLIENT_THREADS (16)
+#define BENCHMARK_MAX_SERVER_THREADS (8)
+#define BENCHMARK_MAX_SAMPLES (1 << 20)
+#define BENCHMARK_METRICS_ROUNDS (3)
+
+typedef struct benchmark_client {
+    pthread_t thread;
+    uint16_t port;
+    double* latencies;
+    size_t request_count;
+    size_t failures;
+} benchmark_client_t;
+
+static const char* request =
+    "GET /api/v1/items HTTP/1.1\r\n"
+    "Host: bench.example.com\r\n"
+    "Accept: application/json\r\n"
+    "\r\n";
+
+static const char* body = "{\"items\":[1,2,3,4,5,6,7,8]}";
+
+static double now_in_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static bool items_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {.return_code = 200, .payload = body, .payload_size = strlen(body)};
+    return divulge_respond(request, &response);
+}
+
+static int connect_to(uint16_t port) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    int is_enabled = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &is_enabled, sizeof(is_enabled));
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(port)};
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    if (connect(client, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(client);
+        return -1;
+    }
+    return client;
+}
+
+/*
+ * Closed loop over one keep-alive connection: the next request leaves only after the whole response arrived.
+ */
+static void* run_client(void* argument) {
+    benchmark_client_t* client = argument;
+    int connection = connect_to(client->port);
+    if (connection < 0) {
+        client->failures++;
+        return NULL;
+    }
+    size_t request_size = strlen(request);
+    char response[512];
+    size_t response_size = 0;
+    double end = now_in_seconds() + BENCHMARK_DURATION_SECONDS;
+    while (client->request_count < BENCHMARK_MAX_SAMPLES) {
+        double start = now_in_seconds();
+        if (start >= end) {
+            break;
+        }
+        if (send(connection, request, request_size, MSG_NOSIGNAL) != (ssize_t)request_size) {
+            client->failures++;
+            break;
+        }
+        size_t received = 0;
+        while (!response_size || received < response_size) {
+            ssize_t result = recv(connection, response + received, sizeof(response) - received, 0);
+            if (result <= 0) {
+                client->failures++;
+                close(connection);
+                return NULL;
+            }
+            received += (size_t)result;
+            const char* end_of_headers = response_size ? NULL : memmem(response, received, "\r\n\r\n", 4);
+            if (end_of_headers) {
+                response_size = (size_t)(end_of_headers - response) + 4 + strlen(body);
+            }
+        }
+        client->latencies[client->request_count++] = now_in_seconds() - start;
+    }
+    close(connection);
+    return NULL;
+}
+
+static int compare_latencies(const void* a, const void* b) {
+    double difference = *(const double*)a - *(const double*)b;
+    return (difference > 0) - (difference < 0);
+}
+
+/*
+ * Thread per connection with blocking reads and writes, the way a stream-server based transport serves requests.
+ */
+typedef struct blocking_server {
+    divulge_t* divulge;
+    int listener;
+    pthread_t thread;
+} blocking_server_t;
+
+static void blocking_send(void* connection_context, const char* data, size_t data_size) {
+    int connection = (int)(intptr_t)connection_context;
+    while (data_size > 0) {
+        ssize_t sent = send(connection, data, data_size, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return;
+        }
+        data += sent;
+        data_size -= (size_t)sent;
+    }
+}
+
+static void blocking_close(void* connection_context) {
+    shutdown((int)(intptr_t)connection_context, SHUT_RDWR);
+}
+
+static void* serve_blocking_connection(void* argument) {
+    blocking_server_t* server = ((void**)argument)[0];
+    int connection = (int)(intptr_t)((void**)argument)[1];
+    free(argument);
+    divulge_connection_t* divulge_connection = divulge_connection_create(server->divulge, (void*)(intptr_t)connection);
+    bool is_open = divulge_connection != NULL;
+    while (is_open) {
+        size_t buffer_size = 0;
+        char* buffer = divulge_connection_get_receive_buffer(divulge_connection, &buffer_size);
+        ssize_t bytes_read = recv(connection, buffer, buffer_size, 0);
+        is_open = (bytes_read > 0) && divulge_connection_receive(divulge_connection, (size_t)bytes_read);
+    }
+    divulge_connection_destroy(divulge_connection);
+    close(connection);
+    return NULL;
+}
+
+static void* accept_blocking_connections(void* argument) {
+    blocking_server_t* server = argument;
+    for (;;) {
+        int connection = accept(server->listener, NULL, NULL);
+        if (connection < 0) {
+            return NULL;
+        }
+        void** connection_argument = malloc(2 * sizeof(void*));
+        pthread_t thread;
+        connection_argument[0] = server;
+        connection_argument[1] = (void*)(intptr_t)connection;
+        if (pthread_create(&thread, NULL, serve_blocking_connection, connection_argument) == 0) {
+            pthread_detach(thread);
+        } else {
+            free(connection_argument);
+            close(connection);
+        }
+    }
+}
+
+typedef enum benchmark_transport {
+    BENCHMARK_TRANSPORT_BLOCKING,
+    BENCHMARK_TRANSPORT_EPOLL,
+    BENCHMARK_TRANSPORT_URING,
+} benchmark_transport_t;
+
+static const char* transport_names[] = {"blocking", "epoll", "io_uring"};
+
+typedef struct benchmark_server {
+    benchmark_transport_t transport;
+    blocking_server_t blocking;
+    divulge_epoll_t* epoll;
+    divulge_uring_t* uring;
+    divulge_metrics_t* metrics;
+    uint16_t port;
+} benchmark_server_t;
+
+static bool start_server(benchmark_server_t* server, size_t thread_count) {
+    divulge_configuration_t configuration = {.max_requests_per_connection = SIZE_MAX, .metrics = server->metrics};
+    if (server->transport == BENCHMARK_TRANSPORT_BLOCKING) {
+        configuration.send = blocking_send;
+        configuration.close = blocking_close;
+    } else if (server->transport == BENCHMARK_TRANSPORT_EPOLL) {
+        divulge_epoll_prepare_configuration(&configuration);
+    } else {
+        divulge_uring_prepare_configuration(&configuration);
+    }
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_uri_t uri = {
+        .uri = "/api/v1/items", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = items_handler}};
+    divulge_register_uri(divulge, &uri);
+    if (server->transport == BENCHMARK_TRANSPORT_BLOCKING) {
+        server->blocking = (blocking_server_t){.divulge = divulge};
+        server->blocking.listener = divulge_listener_create("127.0.0.1", 0, SOMAXCONN);
+        if (server->blocking.listener < 0) {
+            return false;
+        }
+        fcntl(server->blocking.listener, F_SETFL, fcntl(server->blocking.listener, F_GETFL) & ~O_NONBLOCK);
+        server->port = divulge_listener_get_port(server->blocking.listener);
+        return pthread_create(&server->blocking.thread, NULL, accept_blocking_connections, &server->blocking) == 0;
+    }
+    if (server->transport == BENCHMARK_TRANSPORT_EPOLL) {
+        divulge_epoll_configuration_t epoll_configuration = {
+            .address = "127.0.0.1", .reactor_count = thread_count, .is_pinning_reactors = true};
+        server->epoll = divulge_epoll_create(divulge, &epoll_configuration);
+        server->port = divulge_epoll_get_port(server->epoll);
+        return server->epoll && divulge_epoll_start(server->epoll);
+    }
+    divulge_uring_configuration_t uring_configuration = {
+        .address = "127.0.0.1", .ring_count = thread_count, .is_pinning_rings = true};
+    server->uring = divulge_uring_create(divulge, &uring_configuration);
+    server->port = divulge_uring_get_port(server->uring);
+    return server->uring && divulge_uring_start(server->uring);
+}
+
+static void stop_server(benchmark_server_t* server) {
+    if (server->transport == BENCHMARK_TRANSPORT_BLOCKING) {
+        if (server->blocking.listener >= 0) {
+            shutdown(server->blocking.listener, SHUT_RDWR);
+            pthread_join(server->blocking.thread, NULL);
+            close(server->blocking.listener);
+        }
+    }
+    divulge_epoll_destroy(server->epoll);
+    divulge_uring_destroy(server->uring);
+}
+
+static double run_benchmark(benchmark_transport_t transport, size_t thread_count, divulge_metrics_t* metrics) {
+    benchmark_server_t server = {.transport = transport, .metrics = metrics};
+    const char* name = transport_names[transport];
+    if (!start_server(&server, thread_count)) {
+        printf("%-8s %2zu threads: failed to start\n", name, thread_count);
+        stop_server(&server);
+        return 0.0;
+    }
+    benchmark_client_t clients[BENCHMARK_CLIENT_THREADS] = {0};
+    double start = now_in_seconds();
+    for (size_t i = 0; i < BENCHMARK_CLIENT_THREADS; i++) {
+        clients[i].port = server.port;
+        clients[i].latencies = malloc(BENCHMARK_MAX_SAMPLES * sizeof(double));
+        pthread_create(&clients[i].thread, NULL, run_client, clients + i);
+    }
+    size_t total = 0;
+    size_t failures = 0;
+    for (size_t i = 0; i < BENCHMARK_CLIENT_THREADS; i++) {
+        pthread_join(clients[i].thread, NULL);
+        total += clients[i].request_count;
+        failures += clients[i].failures;
+    }
+    double elapsed = now_in_seconds() - start;
+    double* latencies = malloc((total ? total : 1) * sizeof(double));
+    size_t offset = 0;
+    for (size_t i = 0; i < BENCHMARK_CLIENT_THREADS; i++) {
+        memcpy(latencies + offset, clients[i].latencies, clients[i].request_count * sizeof(double));
+        offset += clients[i].request_count;
+        free(clients[i].latencies);
+    }
+    qsort(latencies, total, sizeof(double), compare_latencies);
+    double p50 = total ? latencies[total / 2] : 0.0;
+    double p99 = total ? latencies[total * 99 / 100] : 0.0;
+    printf("%-8s %2zu threads%s: %10.0f requests/s, p50 %7.1f us, p99 %7.1f us, %zu failures\n", name,
+           thread_count, metrics ? " with metrics" : "", (double)total / elapsed, p50 * 1e6, p99 * 1e6, failures);
+    free(latencies);
+    stop_server(&server);
+    return (double)total / elapsed;
+}
+
+/*
+ * Alternates runs without and with metrics and compares the best of each.
+ */
+static void compare_metrics_overhead(size_t thread_count) {
+    divulge_metrics_t* metrics = divulge_metrics_create();
+    double best_without = 0.0;
+    double best_with = 0.0;
+    for (size_t round = 0; round < BENCHMARK_METRICS_ROUNDS; round++) {
+        double without = run_benchmark(BENCHMARK_TRANSPORT_EPOLL, thread_count, NULL);
+        double with = run_benchmark(BENCHMARK_TRANSPORT_EPOLL, thread_count, metrics);
+        best_without = (without > best_without) ? without : best_without;
+        best_with = (with > best_with) ? with : best_with;
+    }
+    printf("epoll    %2zu threads: metrics cost %.1f%% of throughput\n", thread_count,
+           (best_without > 0.0) ? 100.0 * (1.0 - best_with / best_without) : 0.0);
+    divulge_metrics_destroy(metrics);
+}
+
+int main(void) {
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("%d keep-alive clients, %.0f s per run, %ld CPUs online\n", BENCHMARK_CLIENT_THREADS,
+           BENCHMARK_DURATION_SECONDS, cpu_count);
+    run_benchmark(BENCHMARK_TRANSPORT_BLOCKING, BENCHMARK_CLIENT_THREADS, NULL);
+    for (size_t thread_count = 1; thread_count <= BENCHMARK_MAX_SERVER_THREADS; thread_count *= 2) {
+        run_benchmark(BENCHMARK_TRANSPORT_EPOLL, thread_count, NULL);
+    }
+    if (divulge_uring_is_supported()) {
+        for (size_t thread_count = 1; thread_count <= BENCHMARK_MAX_SERVER_THREADS; thread_count *= 2) {
+            run_benchmark(BENCHMARK_TRANSPORT_URING, thread_count, NULL);
+        }
+    } else {
+        printf("io_uring is not supported by this kernel\n");
+    }
+    compare_metrics_overhead(1);
+    compare_metrics_overhead(4);
+    return 0;
+}
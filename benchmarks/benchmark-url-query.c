@@ -0,0 +1,131 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "divulge-url-query.h"
+
+#define BENCHMARK_ITERATIONS (200000)
+#define LOOKUP_COUNT (8)
+
+static const char* lookup_keys[LOOKUP_COUNT] = {"tid", "cid", "dl", "dt", "ul", "sr", "cd5", "missing"};
+
+static double now_in_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * An analytics beacon: short keys, a few long percent-encoded values and custom dimensions.
+ */
+static size_t build_query(char* buffer, size_t size, size_t custom_dimensions) {
+    int length = snprintf(buffer, size,
+                          "v=1&_v=j101&a=1460781838&t=pageview&_s=1&dl=https%%3A%%2F%%2Fshop.example.com%%2Fproducts"
+                          "%%2Fblue-widget%%3Fcolor%%3Dblue%%26size%%3Dxl&dr=https%%3A%%2F%%2Fwww.search.example%%2F"
+                          "&ul=en-us&de=UTF-8&dt=Blue+Widget+%%7C+Example+Shop&sd=24-bit&sr=2560x1440&vp=1280x1305"
+                          "&je=0&_u=QACAAEABAAAAAC~&jid=&gjid=&cid=1780513587.1712345678&tid=UA-12345678-1"
+                          "&_gid=1122334455.1712345678&gtm=45je44o0&z=1918836514");
+    for (size_t i = 1; (i <= custom_dimensions) && (length > 0) && ((size_t)length < size); i++) {
+        length += snprintf(buffer + length, size - (size_t)length, "&cd%zu=segment+%zu%%2Fvariant", i, i * 7);
+    }
+    return (length > 0) ? (size_t)length : 0;
+}
+
+/*
+ * What handlers did before: a scan of the whole query per key and a malloc per decoded value.
+ */
+static bool find_naively(const char* query, size_t size, const char* key, char** value) {
+    size_t key_size = strlen(key);
+    for (size_t i = 0; i < size;) {
+        size_t end = i;
+        while ((end < size) && (query[end] != '&')) {
+            end++;
+        }
+        if (((end - i) > key_size) && (memcmp(query + i, key, key_size) == 0) && (query[i + key_size] == '=')) {
+            size_t value_size = end - i - key_size - 1;
+            *value = malloc(value_size + 1);
+            size_t decoded_size = divulge_url_query_decode(query + i + key_size + 1, value_size, *value);
+            (*value)[decoded_size] = '\0';
+            return true;
+        }
+        i = end + 1;
+    }
+    return false;
+}
+
+static void run_benchmark(const char* query, size_t size) {
+    static divulge_url_query_t index;
+    size_t checksum = 0;
+    double start = now_in_seconds();
+    for (size_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        divulge_url_query_parse(&index, query, size);
+        checksum += index.count;
+    }
+    double parse_time = now_in_seconds() - start;
+
+    char buffer[512];
+    start = now_in_seconds();
+    for (size_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        divulge_url_query_parse(&index, query, size);
+        for (size_t j = 0; j < LOOKUP_COUNT; j++) {
+            size_t found = divulge_url_query_find(&index, lookup_keys[j], strlen(lookup_keys[j]));
+            divulge_slice_t value;
+            if ((found != DIVULGE_URL_QUERY_NONE) &&
+                divulge_url_query_get_value(&index, found, buffer, sizeof(buffer), &value)) {
+                checksum += value.size;
+            }
+        }
+    }
+    double lookup_time = now_in_seconds() - start;
+
+    start = now_in_seconds();
+    for (size_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        for (size_t j = 0; j < LOOKUP_COUNT; j++) {
+            char* value = NULL;
+            if (find_naively(query, size, lookup_keys[j], &value)) {
+                checksum += strlen(value);
+                free(value);
+            }
+        }
+    }
+    double naive_time = now_in_seconds() - start;
+
+    printf("%4zu parameters, %5zu bytes: parse %7.1f ns (%6.1f MB/s), parse + %d lookups %7.1f ns, "
+           "scan + malloc per lookup %7.1f ns (checksum %zu)\n",
+           index.count, size, parse_time / BENCHMARK_ITERATIONS * 1e9,
+           (double)size * BENCHMARK_ITERATIONS / parse_time / 1e6, LOOKUP_COUNT,
+           lookup_time / BENCHMARK_ITERATIONS * 1e9, naive_time / BENCHMARK_ITERATIONS * 1e9, checksum);
+}
+
+int main(void) {
+    static const size_t custom_dimensions[] = {0, 30, 100};
+    static char query[8192];
+    for (size_t i = 0; i < sizeof(custom_dimensions) / sizeof(custom_dimensions[0]); i++) {
+        run_benchmark(query, build_query(query, sizeof(query), custom_dimensions[i]));
+    }
+    return 0;
+}
@@ -0,0 +1,622 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "divulge-bench.h"
+#include "divulge-epoll.h"
+
+#define LOAD_SUB_BUCKET_BITS (6)
+#define LOAD_SUB_BUCKET_COUNT (1 << LOAD_SUB_BUCKET_BITS)
+#define LOAD_MAX_SHIFT (40)
+#define LOAD_BUCKET_COUNT ((LOAD_MAX_SHIFT + 2) * LOAD_SUB_BUCKET_COUNT)
+#define LOAD_MAX_PIPELINE (256)
+#define LOAD_SEND_BATCH (16)
+#define LOAD_RECEIVE_BUFFER_SIZE (65536)
+#define LOAD_MAX_REQUEST_SIZE (1024)
+#define LOAD_MAX_EVENTS (64)
+
+/*
+ * Log-linear latency histogram in nanoseconds: 64 sub-buckets per power of two keep every recorded value within
+ * 1.6% while the whole range up to hours takes 21 KiB per thread.
+ */
+typedef struct load_histogram {
+    uint64_t counts[LOAD_BUCKET_COUNT];
+    uint64_t count;
+    uint64_t max;
+    double sum;
+} load_histogram_t;
+
+typedef struct load_run {
+    struct sockaddr_storage address;
+    socklen_t address_size;
+    char requests[LOAD_SEND_BATCH * LOAD_MAX_REQUEST_SIZE];
+    size_t request_size;
+    double start;
+    double measure_from;
+    double end;
+    double interval; /**< time between requests of one thread in an open loop, 0 for a closed loop */
+} load_run_t;
+
+typedef struct load_connection {
+    int fd;
+    double intended[LOAD_MAX_PIPELINE]; /**< when each queued request was due, oldest first */
+    size_t head;
+    size_t queued;
+    size_t unsent;  /**< the last `unsent` queued requests are not completely sent */
+    size_t partial; /**< bytes of the first unsent request already sent */
+    bool is_waiting_for_output;
+    char* received;
+    size_t received_size;
+} load_connection_t;
+
+typedef struct load_thread {
+    pthread_t thread;
+    const load_run_t* run;
+    load_connection_t* connections;
+    size_t connection_count;
+    size_t next_connection;
+    int epoll;
+    load_histogram_t histogram;
+    uint64_t requests;
+    uint64_t non_2xx;
+    uint64_t errors;
+    uint64_t dropped;
+    uint64_t incomplete;
+    uint64_t reconnects;
+} load_thread_t;
+
+typedef enum load_parse_result {
+    LOAD_PARSE_INCOMPLETE,
+    LOAD_PARSE_COMPLETE,
+    LOAD_PARSE_ERROR,
+} load_parse_result_t;
+
+static const char* body = "{\"items\":[1,2,3,4,5,6,7,8]}";
+
+static size_t get_bucket(uint64_t value) {
+    if (value < 2 * LOAD_SUB_BUCKET_COUNT) {
+        return (size_t)value;
+    }
+    size_t shift = (size_t)(63 - __builtin_clzll(value)) - LOAD_SUB_BUCKET_BITS;
+    if (shift > LOAD_MAX_SHIFT) {
+        return LOAD_BUCKET_COUNT - 1;
+    }
+    return shift * LOAD_SUB_BUCKET_COUNT + (size_t)(value >> shift);
+}
+
+static uint64_t get_bucket_value(size_t bucket) {
+    if (bucket < 2 * LOAD_SUB_BUCKET_COUNT) {
+        return bucket;
+    }
+    size_t shift = bucket / LOAD_SUB_BUCKET_COUNT - 1;
+    uint64_t mantissa = bucket - shift * LOAD_SUB_BUCKET_COUNT;
+    return (mantissa << shift) + (((uint64_t)1 << shift) >> 1);
+}
+
+static void record_latency(load_histogram_t* histogram, double latency) {
+    uint64_t nanoseconds = (latency > 0.0) ? (uint64_t)(latency * 1e9) : 0;
+    histogram->counts[get_bucket(nanoseconds)]++;
+    histogram->count++;
+    histogram->sum += (double)nanoseconds;
+    histogram->max = (nanoseconds > histogram->max) ? nanoseconds : histogram->max;
+}
+
+static void merge_histogram(load_histogram_t* into, const load_histogram_t* histogram) {
+    for (size_t i = 0; i < LOAD_BUCKET_COUNT; i++) {
+        into->counts[i] += histogram->counts[i];
+    }
+    into->count += histogram->count;
+    into->sum += histogram->sum;
+    into->max = (histogram->max > into->max) ? histogram->max : into->max;
+}
+
+static double get_quantile_us(const load_histogram_t* histogram, double quantile) {
+    uint64_t rank = (uint64_t)(quantile * (double)histogram->count + 0.5);
+    rank = rank ? rank : 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LOAD_BUCKET_COUNT; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = get_bucket_value(i);
+            return (double)((value < histogram->max) ? value : histogram->max) / 1e3;
+        }
+    }
+    return (double)histogram->max / 1e3;
+}
+
+static bool is_header(const char* line, size_t line_size, const char* name, const char** value) {
+    size_t name_size = strlen(name);
+    if ((line_size <= name_size) || (strncasecmp(line, name, name_size) != 0) || (line[name_size] != ':')) {
+        return false;
+    }
+    for (*value = line + name_size + 1; (**value == ' ') || (**value == '\t'); (*value)++) {
+    }
+    return true;
+}
+
+static load_parse_result_t find_chunked_end(const char* data, size_t size, size_t offset, size_t* response_size) {
+    for (;;) {
+        const char* line_end = memmem(data + offset, size - offset, "\r\n", 2);
+        if (!line_end) {
+            return LOAD_PARSE_INCOMPLETE;
+        }
+        char* digits_end = NULL;
+        unsigned long long chunk_size = strtoull(data + offset, &digits_end, 16);
+        if (digits_end == data + offset) {
+            return LOAD_PARSE_ERROR;
+        }
+        offset = (size_t)(line_end - data) + 2;
+        if (chunk_size == 0) {
+            const char* end = memmem(data + offset, size - offset, "\r\n", 2);
+            if (!end) {
+                return LOAD_PARSE_INCOMPLETE;
+            }
+            if (end != data + offset) {
+                return LOAD_PARSE_ERROR;
+            }
+            *response_size = offset + 2;
+            return LOAD_PARSE_COMPLETE;
+        }
+        if (size - offset < chunk_size + 2) {
+            return LOAD_PARSE_INCOMPLETE;
+        }
+        offset += (size_t)chunk_size + 2;
+    }
+}
+
+/*
+ * Only what is needed to find where a response ends: the status code and the Content-Length, chunked
+ * Transfer-Encoding and Connection headers.
+ */
+static load_parse_result_t parse_response(const char* data,
+                                          size_t size,
+                                          size_t* response_size,
+                                          int* status,
+                                          bool* is_closing) {
+    const char* headers_end = memmem(data, size, "\r\n\r\n", 4);
+    if (!headers_end) {
+        return LOAD_PARSE_INCOMPLETE;
+    }
+    if ((size < 12) || (strncmp(data, "HTTP/1.", 7) != 0)) {
+        return LOAD_PARSE_ERROR;
+    }
+    *status = atoi(data + 9);
+    *is_closing = strncmp(data, "HTTP/1.0", 8) == 0;
+    size_t content_length = 0;
+    bool is_chunked = false;
+    const char* line = memmem(data, size, "\r\n", 2) + 2;
+    while (line < headers_end + 2) {
+        const char* line_end = memmem(line, (size_t)(headers_end + 2 - line), "\r\n", 2);
+        size_t line_size = (size_t)(line_end - line);
+        const char* value = NULL;
+        if (is_header(line, line_size, "Content-Length", &value)) {
+            content_length = (size_t)strtoull(value, NULL, 10);
+        } else if (is_header(line, line_size, "Transfer-Encoding", &value)) {
+            is_chunked = strncasecmp(value, "chunked", 7) == 0;
+        } else if (is_header(line, line_size, "Connection", &value)) {
+            *is_closing = strncasecmp(value, "close", 5) == 0;
+        }
+        line = line_end + 2;
+    }
+    size_t header_size = (size_t)(headers_end - data) + 4;
+    if (is_chunked) {
+        return find_chunked_end(data, size, header_size, response_size);
+    }
+    if (size - header_size < content_length) {
+        return LOAD_PARSE_INCOMPLETE;
+    }
+    *response_size = header_size + content_length;
+    return LOAD_PARSE_COMPLETE;
+}
+
+static bool watch_output(load_thread_t* thread, load_connection_t* connection, bool is_waiting) {
+    if (connection->is_waiting_for_output == is_waiting) {
+        return true;
+    }
+    struct epoll_event event = {.events = EPOLLIN | (is_waiting ? EPOLLOUT : 0), .data.ptr = connection};
+    connection->is_waiting_for_output = is_waiting;
+    return epoll_ctl(thread->epoll, EPOLL_CTL_MOD, connection->fd, &event) == 0;
+}
+
+static bool connect_connection(load_thread_t* thread, load_connection_t* connection) {
+    const load_run_t* run = thread->run;
+    connection->fd = socket(run->address.ss_family, SOCK_STREAM, 0);
+    if (connection->fd < 0) {
+        return false;
+    }
+    int is_enabled = 1;
+    setsockopt(connection->fd, IPPROTO_TCP, TCP_NODELAY, &is_enabled, sizeof(is_enabled));
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = connection};
+    if ((connect(connection->fd, (const struct sockaddr*)&run->address, run->address_size) != 0) ||
+        (fcntl(connection->fd, F_SETFL, fcntl(connection->fd, F_GETFL) | O_NONBLOCK) != 0) ||
+        (epoll_ctl(thread->epoll, EPOLL_CTL_ADD, connection->fd, &event) != 0)) {
+        close(connection->fd);
+        connection->fd = -1;
+        return false;
+    }
+    connection->is_waiting_for_output = false;
+    connection->received_size = 0;
+    return true;
+}
+
+static bool flush_connection(load_thread_t* thread, load_connection_t* connection) {
+    size_t request_size = thread->run->request_size;
+    while (connection->unsent > 0) {
+        size_t count = (connection->unsent < LOAD_SEND_BATCH) ? connection->unsent : LOAD_SEND_BATCH;
+        ssize_t sent = send(connection->fd, thread->run->requests + connection->partial,
+                            count * request_size - connection->partial, MSG_NOSIGNAL);
+        if (sent < 0) {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) && watch_output(thread, connection, true);
+        }
+        size_t total = connection->partial + (size_t)sent;
+        connection->unsent -= total / request_size;
+        connection->partial = total % request_size;
+    }
+    return watch_output(thread, connection, false);
+}
+
+/*
+ * Requests queued on a connection that went away are sent again on a new one, still due at their original time.
+ */
+static void reconnect(load_thread_t* thread, load_connection_t* connection, bool is_error) {
+    close(connection->fd);
+    thread->errors += is_error ? 1 : 0;
+    thread->reconnects++;
+    connection->unsent = connection->queued;
+    connection->partial = 0;
+    if (!connect_connection(thread, connection) || !flush_connection(thread, connection)) {
+        if (connection->fd >= 0) {
+            close(connection->fd);
+            connection->fd = -1;
+        }
+        thread->errors++;
+        thread->dropped += connection->queued;
+        connection->queued = 0;
+        connection->unsent = 0;
+    }
+}
+
+static bool enqueue_request(load_connection_t* connection, double intended) {
+    if ((connection->fd < 0) || (connection->queued == LOAD_MAX_PIPELINE)) {
+        return false;
+    }
+    connection->intended[(connection->head + connection->queued) % LOAD_MAX_PIPELINE] = intended;
+    connection->queued++;
+    connection->unsent++;
+    return true;
+}
+
+static void complete_request(load_thread_t* thread, load_connection_t* connection, int status) {
+    double now = divulge_bench_now();
+    double intended = connection->intended[connection->head];
+    connection->head = (connection->head + 1) % LOAD_MAX_PIPELINE;
+    connection->queued--;
+    if ((intended >= thread->run->measure_from) && (now < thread->run->end)) {
+        record_latency(&thread->histogram, now - intended);
+        thread->requests++;
+        thread->non_2xx += ((status >= 200) && (status < 300)) ? 0 : 1;
+    }
+    if ((thread->run->interval == 0.0) && (now < thread->run->end)) {
+        enqueue_request(connection, now);
+    }
+}
+
+/*
+ * Reads whatever arrived and completes the responses it finishes.
+ * @return false when the connection has to be replaced, `is_error` telling whether that is a failure
+ */
+static bool receive_responses(load_thread_t* thread, load_connection_t* connection, bool* is_error) {
+    *is_error = true;
+    for (;;) {
+        ssize_t received = recv(connection->fd, connection->received + connection->received_size,
+                                LOAD_RECEIVE_BUFFER_SIZE - connection->received_size, 0);
+        if (received < 0) {
+            return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) && flush_connection(thread, connection);
+        }
+        if (received == 0) {
+            *is_error = connection->queued > 0;
+            return false;
+        }
+        connection->received_size += (size_t)received;
+        size_t response_size = 0;
+        int status = 0;
+        bool is_closing = false;
+        load_parse_result_t result;
+        while ((result = parse_response(connection->received, connection->received_size, &response_size, &status,
+                                        &is_closing)) == LOAD_PARSE_COMPLETE) {
+            if (connection->queued == 0) {
+                return false;
+            }
+            complete_request(thread, connection, status);
+            connection->received_size -= response_size;
+            memmove(connection->received, connection->received + response_size, connection->received_size);
+            if (is_closing) {
+                *is_error = false;
+                return false;
+            }
+        }
+        if ((result == LOAD_PARSE_ERROR) || (connection->received_size == LOAD_RECEIVE_BUFFER_SIZE)) {
+            return false;
+        }
+    }
+}
+
+/*
+ * Open loop: requests are due at a fixed rate whatever the server does, and their latency counts from when they
+ * were due, so a stalled server is not hidden by requests that were never sent (coordinated omission).
+ */
+static void send_due_requests(load_thread_t* thread, double* next_due) {
+    double now = divulge_bench_now();
+    for (; (*next_due <= now) && (*next_due < thread->run->end); *next_due += thread->run->interval) {
+        bool is_queued = false;
+        for (size_t i = 0; !is_queued && (i < thread->connection_count); i++) {
+            load_connection_t* connection = thread->connections + thread->next_connection;
+            thread->next_connection = (thread->next_connection + 1) % thread->connection_count;
+            is_queued = enqueue_request(connection, *next_due);
+            if (is_queued && !flush_connection(thread, connection)) {
+                reconnect(thread, connection, true);
+            }
+        }
+        thread->dropped += (!is_queued && (*next_due >= thread->run->measure_from)) ? 1 : 0;
+    }
+}
+
+static int start_timer(load_thread_t* thread, double interval) {
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    long nanoseconds = (long)(interval * 1e9);
+    nanoseconds = nanoseconds ? nanoseconds : 1;
+    struct itimerspec period = {
+        .it_interval = {.tv_sec = nanoseconds / 1000000000L, .tv_nsec = nanoseconds % 1000000000L},
+        .it_value = {.tv_sec = nanoseconds / 1000000000L, .tv_nsec = nanoseconds % 1000000000L},
+    };
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    if ((timer < 0) || (timerfd_settime(timer, 0, &period, NULL) != 0) ||
+        (epoll_ctl(thread->epoll, EPOLL_CTL_ADD, timer, &event) != 0)) {
+        close(timer);
+        return -1;
+    }
+    return timer;
+}
+
+static void* run_thread(void* argument) {
+    load_thread_t* thread = argument;
+    const load_run_t* run = thread->run;
+    double now = divulge_bench_now();
+    for (size_t i = 0; i < thread->connection_count; i++) {
+        load_connection_t* connection = thread->connections + i;
+        if (!connect_connection(thread, connection)) {
+            thread->errors++;
+        } else if (run->interval == 0.0) {
+            enqueue_request(connection, now);
+            if (!flush_connection(thread, connection)) {
+                reconnect(thread, connection, true);
+            }
+        }
+    }
+    int timer = (run->interval > 0.0) ? start_timer(thread, run->interval) : -1;
+    double next_due = divulge_bench_now();
+    struct epoll_event events[LOAD_MAX_EVENTS];
+    while ((now = divulge_bench_now()) < run->end) {
+        int timeout = (int)((run->end - now) * 1e3) + 1;
+        int count = epoll_wait(thread->epoll, events, LOAD_MAX_EVENTS, timeout);
+        for (int i = 0; i < count; i++) {
+            load_connection_t* connection = events[i].data.ptr;
+            if (!connection) {
+                uint64_t expirations;
+                (void)!read(timer, &expirations, sizeof(expirations));
+                send_due_requests(thread, &next_due);
+                continue;
+            }
+            bool is_error = false;
+            if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) &&
+                !receive_responses(thread, connection, &is_error)) {
+                reconnect(thread, connection, is_error);
+            } else if ((events[i].events & EPOLLOUT) && !flush_connection(thread, connection)) {
+                reconnect(thread, connection, true);
+            }
+        }
+    }
+    for (size_t i = 0; i < thread->connection_count; i++) {
+        load_connection_t* connection = thread->connections + i;
+        for (size_t j = 0; j < connection->queued; j++) {
+            double intended = connection->intended[(connection->head + j) % LOAD_MAX_PIPELINE];
+            thread->incomplete += (intended >= run->measure_from) ? 1 : 0;
+        }
+        if (connection->fd >= 0) {
+            close(connection->fd);
+        }
+    }
+    if (timer >= 0) {
+        close(timer);
+    }
+    return NULL;
+}
+
+static bool items_handler(divulge_request_t* request, void* context) {
+    divulge_header_entry_t entries[] = {{"Content-Type", "application/json"}};
+    divulge_response_t response = {
+        .return_code = 200, .header = {entries, 1}, .payload = body, .payload_size = strlen(body)};
+    return divulge_respond(request, &response);
+}
+
+static divulge_epoll_t* start_server(const divulge_bench_load_options_t* options, uint16_t* port) {
+    divulge_configuration_t configuration = {.max_requests_per_connection = SIZE_MAX};
+    divulge_epoll_prepare_configuration(&configuration);
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_uri_t uri = {.uri = options->path, .method = DIVULGE_ROUTE_METHOD_GET, .handler = {items_handler}};
+    divulge_register_uri(divulge, &uri);
+    divulge_epoll_configuration_t epoll_configuration = {.address = options->host,
+                                                         .reactor_count = options->server_threads};
+    divulge_epoll_t* epoll = divulge_epoll_create(divulge, &epoll_configuration);
+    if (!epoll || !divulge_epoll_start(epoll)) {
+        divulge_epoll_destroy(epoll);
+        return NULL;
+    }
+    *port = divulge_epoll_get_port(epoll);
+    return epoll;
+}
+
+static bool prepare_run(load_run_t* run, const divulge_bench_load_options_t* options, uint16_t port) {
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+    struct addrinfo* addresses = NULL;
+    if ((getaddrinfo(options->host, service, &hints, &addresses) != 0) || !addresses) {
+        return false;
+    }
+    memcpy(&run->address, addresses->ai_addr, addresses->ai_addrlen);
+    run->address_size = addresses->ai_addrlen;
+    freeaddrinfo(addresses);
+    int size = snprintf(run->requests, LOAD_MAX_REQUEST_SIZE,
+                        "GET %s HTTP/1.1\r\n"
+                        "Host: %s:%u\r\n"
+                        "User-Agent: divulge-bench\r\n"
+                        "Accept: */*\r\n"
+                        "\r\n",
+                        options->path, options->host, port);
+    if ((size <= 0) || (size >= LOAD_MAX_REQUEST_SIZE)) {
+        return false;
+    }
+    run->request_size = (size_t)size;
+    for (size_t i = 1; i < LOAD_SEND_BATCH; i++) {
+        memcpy(run->requests + i * run->request_size, run->requests, run->request_size);
+    }
+    run->interval = (options->rate > 0.0) ? (double)options->threads / options->rate : 0.0;
+    return true;
+}
+
+static void add_report(const divulge_bench_load_options_t* options,
+                       const load_run_t* run,
+                       const load_thread_t* total,
+                       const load_histogram_t* histogram,
+                       bool is_in_process,
+                       uint16_t port,
+                       divulge_bench_json_t* json) {
+    double requests_per_second = (double)total->requests / options->duration_s;
+    double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    const char* quantile_names[] = {"p50", "p90", "p99", "p999"};
+    fprintf(stderr, "%s loop, %zu threads, %zu connections: %.0f requests/s, p50 %.1f us, p99 %.1f us, "
+            "p999 %.1f us, %llu errors\n", (run->interval > 0.0) ? "open" : "closed", options->threads,
+            options->connections, requests_per_second, get_quantile_us(histogram, 0.5),
+            get_quantile_us(histogram, 0.99), get_quantile_us(histogram, 0.999), (unsigned long long)total->errors);
+    divulge_bench_json_begin_object(json, "load");
+    divulge_bench_json_add_string(json, "server", is_in_process ? "in-process epoll" : "external");
+    divulge_bench_json_add_integer(json, "server_threads", is_in_process ? options->server_threads : 0);
+    divulge_bench_json_add_string(json, "host", options->host);
+    divulge_bench_json_add_integer(json, "port", port);
+    divulge_bench_json_add_string(json, "path", options->path);
+    divulge_bench_json_add_string(json, "mode", (run->interval > 0.0) ? "open" : "closed");
+    divulge_bench_json_add_number(json, "target_rate", options->rate);
+    divulge_bench_json_add_integer(json, "threads", options->threads);
+    divulge_bench_json_add_integer(json, "connections", options->connections);
+    divulge_bench_json_add_number(json, "duration_s", options->duration_s);
+    divulge_bench_json_add_number(json, "warmup_s", options->warmup_s);
+    divulge_bench_json_add_integer(json, "requests", total->requests);
+    divulge_bench_json_add_number(json, "requests_per_second", requests_per_second);
+    divulge_bench_json_add_integer(json, "non_2xx", total->non_2xx);
+    divulge_bench_json_add_integer(json, "errors", total->errors);
+    divulge_bench_json_add_integer(json, "dropped", total->dropped);
+    divulge_bench_json_add_integer(json, "incomplete", total->incomplete);
+    divulge_bench_json_add_integer(json, "reconnects", total->reconnects);
+    divulge_bench_json_begin_object(json, "latency_us");
+    divulge_bench_json_add_number(json, "mean", histogram->count ? histogram->sum / (double)histogram->count / 1e3 : 0);
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        divulge_bench_json_add_number(json, quantile_names[i], get_quantile_us(histogram, quantiles[i]));
+    }
+    divulge_bench_json_add_number(json, "max", (double)histogram->max / 1e3);
+    divulge_bench_json_end_object(json);
+    divulge_bench_json_end_object(json);
+}
+
+bool divulge_bench_run_load(const divulge_bench_load_options_t* options, divulge_bench_json_t* json) {
+    uint16_t port = options->port;
+    divulge_epoll_t* server = port ? NULL : start_server(options, &port);
+    load_run_t* run = calloc(1, sizeof(load_run_t));
+    load_thread_t* threads = calloc(options->threads, sizeof(load_thread_t));
+    load_connection_t* connections = calloc(options->connections, sizeof(load_connection_t));
+    char* receive_buffers = malloc(options->connections * LOAD_RECEIVE_BUFFER_SIZE);
+    load_histogram_t* histogram = calloc(1, sizeof(load_histogram_t));
+    bool is_successful = run && threads && connections && receive_buffers && histogram && port &&
+                         prepare_run(run, options, port);
+    if (!is_successful) {
+        fprintf(stderr, "cannot %s %s:%u\n", port ? "reach" : "start a server on", options->host, port);
+    }
+    size_t started = 0;
+    if (is_successful) {
+        run->start = divulge_bench_now();
+        run->measure_from = run->start + options->warmup_s;
+        run->end = run->measure_from + options->duration_s;
+        for (size_t i = 0; i < options->connections; i++) {
+            connections[i].received = receive_buffers + i * LOAD_RECEIVE_BUFFER_SIZE;
+            connections[i].fd = -1;
+        }
+        for (size_t i = 0; i < options->threads; i++) {
+            size_t first = i * options->connections / options->threads;
+            threads[i].run = run;
+            threads[i].connections = connections + first;
+            threads[i].connection_count = (i + 1) * options->connections / options->threads - first;
+            threads[i].epoll = epoll_create1(0);
+            if ((threads[i].epoll < 0) || (pthread_create(&threads[i].thread, NULL, run_thread, threads + i) != 0)) {
+                close(threads[i].epoll);
+                is_successful = false;
+                break;
+            }
+            started++;
+        }
+    }
+    load_thread_t total = {0};
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i].thread, NULL);
+        close(threads[i].epoll);
+        merge_histogram(histogram, &threads[i].histogram);
+        total.requests += threads[i].requests;
+        total.non_2xx += threads[i].non_2xx;
+        total.errors += threads[i].errors;
+        total.dropped += threads[i].dropped;
+        total.incomplete += threads[i].incomplete;
+        total.reconnects += threads[i].reconnects;
+    }
+    if (is_successful) {
+        add_report(options, run, &total, histogram, server != NULL, port, json);
+    }
+    divulge_epoll_destroy(server);
+    free(histogram);
+    free(receive_buffers);
+    free(connections);
+    free(threads);
+    free(run);
+    return is_successful && (total.requests > 0);
+}
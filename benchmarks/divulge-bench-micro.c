@@ -0,0 +1,317 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "divulge-bench.h"
+#include "divulge-parser.h"
+#include "divulge-router.h"
+#include "divulge.h"
+
+#define MICRO_MAX_ROUNDS (16)
+#define MICRO_ROUTE_SIZE (64)
+#define MICRO_RESPONSE_BUFFER_SIZE (1024)
+
+typedef struct micro_state {
+    size_t parameter;
+    divulge_router_t* router;
+    char (*paths)[MICRO_ROUTE_SIZE];
+    divulge_t* divulge;
+    const char* header_name;
+    size_t iterations;
+    size_t failures;
+} micro_state_t;
+
+typedef struct micro_benchmark {
+    const char* name;
+    void (*setup)(micro_state_t* state);
+    void (*run)(micro_state_t* state, size_t iterations);
+    void (*teardown)(micro_state_t* state);
+    size_t parameter;
+} micro_benchmark_t;
+
+static const char* minimal_request =
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost\r\n"
+    "\r\n";
+
+static const char* browser_request =
+    "GET /api/v1/dashboard/widgets?range=24h&refresh=true HTTP/1.1\r\n"
+    "Host: dashboard.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\n"
+    "Accept: application/json, text/plain, */*\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Accept-Language: en-US,en;q=0.9,pl;q=0.8\r\n"
+    "Referer: https://dashboard.example.com/overview\r\n"
+    "Cookie: session=3f9a8b7c6d5e4f3a2b1c0d9e8f7a6b5c; theme=dark; tz=Europe%2FWarsaw\r\n"
+    "Authorization: Basic ZzI6ZzM=\r\n"
+    "\r\n";
+
+static const char* body = "{\"items\":[1,2,3,4,5,6,7,8]}";
+
+static void discard_send(void* connection_context, const char* data, size_t data_size) {}
+
+static void discard_send_vector(void* connection_context, const divulge_slice_t* segments, size_t segment_count) {}
+
+static void discard_close(void* connection_context) {}
+
+static void run_parser(micro_state_t* state, const char* request, size_t iterations) {
+    size_t request_size = strlen(request);
+    size_t fragment_size = state->parameter ? state->parameter : request_size;
+    divulge_parser_t parser;
+    for (size_t i = 0; i < iterations; i++) {
+        divulge_parser_initialize(&parser, NULL);
+        divulge_parser_status_t status = DIVULGE_PARSER_STATUS_INCOMPLETE;
+        for (size_t available = 0; (status == DIVULGE_PARSER_STATUS_INCOMPLETE) && (available < request_size);) {
+            available += fragment_size;
+            available = (available > request_size) ? request_size : available;
+            status = divulge_parser_feed(&parser, request, available);
+        }
+        state->failures += (status == DIVULGE_PARSER_STATUS_COMPLETE) ? 0 : 1;
+    }
+}
+
+static void run_parse_minimal(micro_state_t* state, size_t iterations) {
+    run_parser(state, minimal_request, iterations);
+}
+
+static void run_parse_browser(micro_state_t* state, size_t iterations) {
+    run_parser(state, browser_request, iterations);
+}
+
+static void setup_router(micro_state_t* state, const char* suffix) {
+    state->router = divulge_router_create();
+    state->paths = calloc(state->parameter, MICRO_ROUTE_SIZE);
+    for (size_t i = 0; i < state->parameter; i++) {
+        char pattern[MICRO_ROUTE_SIZE + 8];
+        snprintf(state->paths[i], MICRO_ROUTE_SIZE, "/api/v1/service%zu/resource%zu", i / 100, i);
+        snprintf(pattern, sizeof(pattern), "%s%s", state->paths[i], suffix);
+        divulge_router_insert(state->router, DIVULGE_ROUTE_METHOD_GET, pattern, state->paths[i]);
+        if (*suffix) {
+            strncat(state->paths[i], "/42", MICRO_ROUTE_SIZE - strlen(state->paths[i]) - 1);
+        }
+    }
+}
+
+static void setup_static_routes(micro_state_t* state) {
+    setup_router(state, "");
+}
+
+static void setup_parameter_routes(micro_state_t* state) {
+    setup_router(state, "/:id");
+}
+
+/*
+ * Visits the routes in a scattered order, so lookups do not keep walking the same cached trie nodes.
+ */
+static void run_route(micro_state_t* state, size_t iterations) {
+    divulge_route_parameter_t parameters[DIVULGE_MAX_ROUTE_PARAMETERS];
+    size_t parameter_count = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        const char* path = state->paths[(i * 7919) % state->parameter];
+        state->failures += divulge_router_lookup(state->router, DIVULGE_ROUTE_METHOD_GET, path, strlen(path),
+                                                 parameters, &parameter_count)
+                               ? 0
+                               : 1;
+    }
+}
+
+static void teardown_router(micro_state_t* state) {
+    divulge_router_destroy(state->router);
+    free(state->paths);
+}
+
+static divulge_t* create_divulge(bool is_vectored) {
+    divulge_configuration_t configuration = {.send = discard_send, .close = discard_close};
+    if (is_vectored) {
+        configuration.send_vector = discard_send_vector;
+    }
+    return divulge_initialize(&configuration);
+}
+
+static void register_handler(micro_state_t* state, const char* path, divulge_uri_handler_t handler) {
+    divulge_uri_t uri = {
+        .uri = path, .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = handler, .context = state}};
+    divulge_register_uri(state->divulge, &uri);
+}
+
+/*
+ * The lookups run inside a single handler call, so the request around them is spread over all iterations.
+ */
+static bool find_header_handler(divulge_request_t* request, void* context) {
+    micro_state_t* state = context;
+    divulge_slice_t value;
+    for (size_t i = 0; i < state->iterations; i++) {
+        bool is_found = divulge_find_request_header(request, state->header_name, &value);
+        state->failures += (is_found != (state->parameter != 0)) ? 1 : 0;
+    }
+    return divulge_send_status(request, 204);
+}
+
+static void setup_header(micro_state_t* state) {
+    static const char* names[] = {"X-Missing", "host", "AUTHORIZATION"};
+    state->header_name = names[state->parameter];
+    state->divulge = create_divulge(false);
+    register_handler(state, "/api/v1/dashboard/widgets", find_header_handler);
+}
+
+static void run_header(micro_state_t* state, size_t iterations) {
+    char response_buffer[MICRO_RESPONSE_BUFFER_SIZE];
+    state->iterations = iterations;
+    divulge_process_request(state->divulge, NULL, browser_request, strlen(browser_request), response_buffer,
+                            sizeof(response_buffer));
+}
+
+static bool respond_handler(divulge_request_t* request, void* context) {
+    divulge_header_entry_t entries[] = {
+        {"Content-Type", "application/json"},
+        {"Cache-Control", "no-store"},
+        {"X-Request-Id", "4f3a2b1c0d9e8f7a"},
+        {"Vary", "Accept-Encoding"},
+    };
+    divulge_response_t response = {.return_code = 200, .payload = body, .payload_size = strlen(body)};
+    if (((micro_state_t*)context)->parameter) {
+        response.header = (divulge_header_t){.entries = entries, .count = sizeof(entries) / sizeof(entries[0])};
+    }
+    return divulge_respond(request, &response);
+}
+
+static bool respond_chunked_handler(divulge_request_t* request, void* context) {
+    bool is_successful = divulge_begin_response(request, 200, NULL, DIVULGE_CONTENT_LENGTH_UNKNOWN);
+    for (size_t i = 0; is_successful && (i < 4); i++) {
+        is_successful = divulge_write_response(request, body, strlen(body));
+    }
+    return is_successful && divulge_end_response(request);
+}
+
+static void setup_respond(micro_state_t* state) {
+    state->divulge = create_divulge(false);
+    register_handler(state, "/", respond_handler);
+}
+
+static void setup_respond_vector(micro_state_t* state) {
+    state->divulge = create_divulge(true);
+    register_handler(state, "/", respond_handler);
+}
+
+static void setup_respond_chunked(micro_state_t* state) {
+    state->divulge = create_divulge(false);
+    register_handler(state, "/", respond_chunked_handler);
+}
+
+/*
+ * Whole requests answered into a transport discarding the output: the minimal request keeps the parsing share
+ * small, so differences between these benchmarks are differences in building the response.
+ */
+static void run_respond(micro_state_t* state, size_t iterations) {
+    char response_buffer[MICRO_RESPONSE_BUFFER_SIZE];
+    size_t request_size = strlen(minimal_request);
+    for (size_t i = 0; i < iterations; i++) {
+        divulge_process_request(state->divulge, NULL, minimal_request, request_size, response_buffer,
+                                sizeof(response_buffer));
+    }
+}
+
+static const micro_benchmark_t benchmarks[] = {
+    {"parse/minimal", NULL, run_parse_minimal, NULL, 0},
+    {"parse/browser", NULL, run_parse_browser, NULL, 0},
+    {"parse/browser-64-byte-fragments", NULL, run_parse_browser, NULL, 64},
+    {"route/static-10", setup_static_routes, run_route, teardown_router, 10},
+    {"route/static-100", setup_static_routes, run_route, teardown_router, 100},
+    {"route/static-1000", setup_static_routes, run_route, teardown_router, 1000},
+    {"route/static-10000", setup_static_routes, run_route, teardown_router, 10000},
+    {"route/parameter-1000", setup_parameter_routes, run_route, teardown_router, 1000},
+    {"header/find-missing", setup_header, run_header, NULL, 0},
+    {"header/find-first", setup_header, run_header, NULL, 1},
+    {"header/find-last", setup_header, run_header, NULL, 2},
+    {"respond/payload", setup_respond, run_respond, NULL, 0},
+    {"respond/payload-4-headers", setup_respond, run_respond, NULL, 1},
+    {"respond/payload-vectored", setup_respond_vector, run_respond, NULL, 0},
+    {"respond/chunked", setup_respond_chunked, run_respond, NULL, 0},
+};
+
+static int compare_doubles(const void* a, const void* b) {
+    double difference = *(const double*)a - *(const double*)b;
+    return (difference > 0) - (difference < 0);
+}
+
+static double time_run(const micro_benchmark_t* benchmark, micro_state_t* state, size_t iterations) {
+    double start = divulge_bench_now();
+    benchmark->run(state, iterations);
+    return divulge_bench_now() - start;
+}
+
+/*
+ * Doubles the iteration count until a run is long enough to time, then sizes the rounds from that rate.
+ */
+static void run_benchmark(const micro_benchmark_t* benchmark,
+                          const divulge_bench_micro_options_t* options,
+                          divulge_bench_json_t* json) {
+    micro_state_t state = {.parameter = benchmark->parameter};
+    if (benchmark->setup) {
+        benchmark->setup(&state);
+    }
+    size_t rounds = (options->rounds > MICRO_MAX_ROUNDS) ? MICRO_MAX_ROUNDS : options->rounds;
+    rounds = rounds ? rounds : 1;
+    double round_time = options->min_time_s / (double)rounds;
+    size_t iterations = 1;
+    double elapsed = time_run(benchmark, &state, iterations);
+    while ((elapsed < round_time / 10.0) && (iterations < ((size_t)1 << 40))) {
+        iterations *= 2;
+        elapsed = time_run(benchmark, &state, iterations);
+    }
+    iterations = (size_t)((double)iterations * round_time / ((elapsed > 0.0) ? elapsed : 1e-9));
+    iterations = iterations ? iterations : 1;
+    state.failures = 0;
+    double nanoseconds[MICRO_MAX_ROUNDS];
+    for (size_t round = 0; round < rounds; round++) {
+        nanoseconds[round] = time_run(benchmark, &state, iterations) * 1e9 / (double)iterations;
+    }
+    qsort(nanoseconds, rounds, sizeof(double), compare_doubles);
+    double median = nanoseconds[rounds / 2];
+    fprintf(stderr, "%-32s %10.1f ns/op %14.0f ops/s%s\n", benchmark->name, median, 1e9 / median,
+            state.failures ? " (FAILURES!)" : "");
+    divulge_bench_json_begin_object(json, NULL);
+    divulge_bench_json_add_string(json, "name", benchmark->name);
+    divulge_bench_json_add_integer(json, "iterations", (uint64_t)(iterations * rounds));
+    divulge_bench_json_add_number(json, "ns_per_op", median);
+    divulge_bench_json_add_number(json, "ns_per_op_min", nanoseconds[0]);
+    divulge_bench_json_add_number(json, "ns_per_op_max", nanoseconds[rounds - 1]);
+    divulge_bench_json_add_number(json, "ops_per_second", 1e9 / median);
+    divulge_bench_json_add_integer(json, "failures", state.failures);
+    divulge_bench_json_end_object(json);
+    if (benchmark->teardown) {
+        benchmark->teardown(&state);
+    }
+}
+
+void divulge_bench_run_micro(const divulge_bench_micro_options_t* options, divulge_bench_json_t* json) {
+    divulge_bench_json_begin_array(json, "micro");
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (!options->filter || strstr(benchmarks[i].name, options->filter)) {
+            run_benchmark(benchmarks + i, options, json);
+        }
+    }
+    divulge_bench_json_end_array(json);
+}
@@ -0,0 +1,276 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-bench.h"
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "divulge-scan.h"
+
+#define DIVULGE_BENCH_SCHEMA_VERSION (1)
+
+double divulge_bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void write_key(divulge_bench_json_t* json, const char* key) {
+    if (json->depth > 0) {
+        fputs(json->has_members[json->depth - 1] ? ",\n" : "\n", json->file);
+        json->has_members[json->depth - 1] = true;
+    }
+    fprintf(json->file, "%*s", (int)(2 * json->depth), "");
+    if (key) {
+        fprintf(json->file, "\"%s\": ", key);
+    }
+}
+
+static void begin_container(divulge_bench_json_t* json, const char* key, char opening) {
+    write_key(json, key);
+    fputc(opening, json->file);
+    if (json->depth < DIVULGE_BENCH_JSON_MAX_DEPTH) {
+        json->has_members[json->depth++] = false;
+    }
+}
+
+static void end_container(divulge_bench_json_t* json, char closing) {
+    if (json->depth == 0) {
+        return;
+    }
+    json->depth--;
+    if (json->has_members[json->depth]) {
+        fprintf(json->file, "\n%*s", (int)(2 * json->depth), "");
+    }
+    fputc(closing, json->file);
+    if (json->depth == 0) {
+        fputc('\n', json->file);
+    }
+}
+
+void divulge_bench_json_begin_object(divulge_bench_json_t* json, const char* key) {
+    begin_container(json, key, '{');
+}
+
+void divulge_bench_json_end_object(divulge_bench_json_t* json) {
+    end_container(json, '}');
+}
+
+void divulge_bench_json_begin_array(divulge_bench_json_t* json, const char* key) {
+    begin_container(json, key, '[');
+}
+
+void divulge_bench_json_end_array(divulge_bench_json_t* json) {
+    end_container(json, ']');
+}
+
+void divulge_bench_json_add_number(divulge_bench_json_t* json, const char* key, double value) {
+    write_key(json, key);
+    fprintf(json->file, "%.6g", value);
+}
+
+void divulge_bench_json_add_integer(divulge_bench_json_t* json, const char* key, uint64_t value) {
+    write_key(json, key);
+    fprintf(json->file, "%llu", (unsigned long long)value);
+}
+
+void divulge_bench_json_add_string(divulge_bench_json_t* json, const char* key, const char* value) {
+    write_key(json, key);
+    fputc('"', json->file);
+    for (const char* c = value; *c; c++) {
+        if ((*c == '"') || (*c == '\\')) {
+            fprintf(json->file, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(json->file, "\\u%04x", (unsigned char)*c);
+        } else {
+            fputc(*c, json->file);
+        }
+    }
+    fputc('"', json->file);
+}
+
+void divulge_bench_json_add_boolean(divulge_bench_json_t* json, const char* key, bool value) {
+    write_key(json, key);
+    fputs(value ? "true" : "false", json->file);
+}
+
+static void add_environment(divulge_bench_json_t* json) {
+    char timestamp[32];
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    char hostname[256] = "";
+    gethostname(hostname, sizeof(hostname) - 1);
+    divulge_bench_json_add_string(json, "timestamp", timestamp);
+    divulge_bench_json_begin_object(json, "environment");
+    divulge_bench_json_add_string(json, "hostname", hostname);
+    divulge_bench_json_add_integer(json, "cpus", (uint64_t)sysconf(_SC_NPROCESSORS_ONLN));
+    divulge_scan_implementation_t scan = divulge_scan_get_implementation();
+    divulge_bench_json_add_string(json, "scan", divulge_scan_get_implementation_name(scan));
+#ifdef DIVULGE_COMPRESSION
+    divulge_bench_json_add_boolean(json, "compression", true);
+#else
+    divulge_bench_json_add_boolean(json, "compression", false);
+#endif
+#ifdef NDEBUG
+    divulge_bench_json_add_boolean(json, "assertions", false);
+#else
+    divulge_bench_json_add_boolean(json, "assertions", true);
+#endif
+    divulge_bench_json_end_object(json);
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [micro|load|all] [options]\n"
+            "  --output FILE          write the JSON report to FILE instead of stdout\n"
+            "micro:\n"
+            "  --filter TEXT          run only benchmarks whose name contains TEXT\n"
+            "  --min-time SECONDS     measured time per benchmark (default 0.5)\n"
+            "load:\n"
+            "  --host ADDRESS         server address (default 127.0.0.1)\n"
+            "  --port PORT            server port, 0 to start an in-process epoll server (default 0)\n"
+            "  --path PATH            request path (default /)\n"
+            "  --server-threads N     reactors of the in-process server (default 1)\n"
+            "  --threads N            client threads (default 1)\n"
+            "  --connections N        keep-alive connections (default 16)\n"
+            "  --duration SECONDS     measured time (default 5)\n"
+            "  --warmup SECONDS       time before measuring (default 1)\n"
+            "  --rate REQUESTS        open loop at REQUESTS per second, 0 for a closed loop (default 0)\n",
+            program);
+}
+
+int main(int argc, char* argv[]) {
+    enum {
+        OPTION_OUTPUT = 256,
+        OPTION_FILTER,
+        OPTION_MIN_TIME,
+        OPTION_HOST,
+        OPTION_PORT,
+        OPTION_PATH,
+        OPTION_SERVER_THREADS,
+        OPTION_THREADS,
+        OPTION_CONNECTIONS,
+        OPTION_DURATION,
+        OPTION_WARMUP,
+        OPTION_RATE,
+    };
+    static const struct option long_options[] = {
+        {"output", required_argument, NULL, OPTION_OUTPUT},
+        {"filter", required_argument, NULL, OPTION_FILTER},
+        {"min-time", required_argument, NULL, OPTION_MIN_TIME},
+        {"host", required_argument, NULL, OPTION_HOST},
+        {"port", required_argument, NULL, OPTION_PORT},
+        {"path", required_argument, NULL, OPTION_PATH},
+        {"server-threads", required_argument, NULL, OPTION_SERVER_THREADS},
+        {"threads", required_argument, NULL, OPTION_THREADS},
+        {"connections", required_argument, NULL, OPTION_CONNECTIONS},
+        {"duration", required_argument, NULL, OPTION_DURATION},
+        {"warmup", required_argument, NULL, OPTION_WARMUP},
+        {"rate", required_argument, NULL, OPTION_RATE},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    divulge_bench_micro_options_t micro = {.min_time_s = 0.5, .rounds = 5};
+    divulge_bench_load_options_t load = {.host = "127.0.0.1",
+                                         .path = "/",
+                                         .server_threads = 1,
+                                         .threads = 1,
+                                         .connections = 16,
+                                         .duration_s = 5.0,
+                                         .warmup_s = 1.0};
+    const char* output = NULL;
+    int option;
+    while ((option = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (option) {
+            case OPTION_OUTPUT:
+                output = optarg;
+                break;
+            case OPTION_FILTER:
+                micro.filter = optarg;
+                break;
+            case OPTION_MIN_TIME:
+                micro.min_time_s = atof(optarg);
+                break;
+            case OPTION_HOST:
+                load.host = optarg;
+                break;
+            case OPTION_PORT:
+                load.port = (uint16_t)atoi(optarg);
+                break;
+            case OPTION_PATH:
+                load.path = optarg;
+                break;
+            case OPTION_SERVER_THREADS:
+                load.server_threads = (size_t)atol(optarg);
+                break;
+            case OPTION_THREADS:
+                load.threads = (size_t)atol(optarg);
+                break;
+            case OPTION_CONNECTIONS:
+                load.connections = (size_t)atol(optarg);
+                break;
+            case OPTION_DURATION:
+                load.duration_s = atof(optarg);
+                break;
+            case OPTION_WARMUP:
+                load.warmup_s = atof(optarg);
+                break;
+            case OPTION_RATE:
+                load.rate = atof(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return (option == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    const char* mode = (optind < argc) ? argv[optind] : "all";
+    bool is_running_micro = (strcmp(mode, "micro") == 0) || (strcmp(mode, "all") == 0);
+    bool is_running_load = (strcmp(mode, "load") == 0) || (strcmp(mode, "all") == 0);
+    if ((!is_running_micro && !is_running_load) || (micro.min_time_s <= 0.0) || !load.threads ||
+        (load.connections < load.threads) || (load.duration_s <= 0.0) || (load.rate < 0.0)) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    divulge_bench_json_t json = {.file = output ? fopen(output, "w") : stdout};
+    if (!json.file) {
+        perror(output);
+        return EXIT_FAILURE;
+    }
+    bool is_successful = true;
+    divulge_bench_json_begin_object(&json, NULL);
+    divulge_bench_json_add_integer(&json, "schema_version", DIVULGE_BENCH_SCHEMA_VERSION);
+    add_environment(&json);
+    if (is_running_micro) {
+        divulge_bench_run_micro(&micro, &json);
+    }
+    if (is_running_load) {
+        is_successful = divulge_bench_run_load(&load, &json);
+    }
+    divulge_bench_json_end_object(&json);
+    if (output) {
+        fclose(json.file);
+    }
+    return is_successful ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,96 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_BENCH_H
+#define DIVULGE_BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+/**
+ * @defgroup divulge-bench Divulge benchmark suite
+ * @brief In-process microbenchmarks and a loopback load generator reporting JSON
+ * @{
+ */
+#define DIVULGE_BENCH_JSON_MAX_DEPTH (8)
+
+typedef struct divulge_bench_json {
+    FILE* file;
+    size_t depth;
+    bool has_members[DIVULGE_BENCH_JSON_MAX_DEPTH];
+} divulge_bench_json_t;
+
+typedef struct divulge_bench_micro_options {
+    const char* filter;  /**< run only benchmarks whose name contains it, NULL for all */
+    double min_time_s;   /**< measured time per benchmark */
+    size_t rounds;       /**< the time is split into rounds, the median round is reported */
+} divulge_bench_micro_options_t;
+
+typedef struct divulge_bench_load_options {
+    const char* host;
+    uint16_t port;          /**< 0 to start an in-process epoll server */
+    const char* path;
+    size_t server_threads;  /**< reactors of the in-process server */
+    size_t threads;         /**< client threads, each with its own epoll loop */
+    size_t connections;     /**< keep-alive connections shared out among the threads */
+    double duration_s;
+    double warmup_s;        /**< responses completed before the warmup ends are not counted */
+    double rate;            /**< requests per second for an open loop, 0 for a closed loop */
+} divulge_bench_load_options_t;
+
+double divulge_bench_now(void);
+
+/**
+ * @brief Start an object, `key` is NULL at the top level and in arrays
+ */
+void divulge_bench_json_begin_object(divulge_bench_json_t* json, const char* key);
+
+void divulge_bench_json_end_object(divulge_bench_json_t* json);
+
+void divulge_bench_json_begin_array(divulge_bench_json_t* json, const char* key);
+
+void divulge_bench_json_end_array(divulge_bench_json_t* json);
+
+void divulge_bench_json_add_number(divulge_bench_json_t* json, const char* key, double value);
+
+void divulge_bench_json_add_integer(divulge_bench_json_t* json, const char* key, uint64_t value);
+
+void divulge_bench_json_add_string(divulge_bench_json_t* json, const char* key, const char* value);
+
+void divulge_bench_json_add_boolean(divulge_bench_json_t* json, const char* key, bool value);
+
+/**
+ * @brief Run the microbenchmarks, adding a `micro` array
+ */
+void divulge_bench_run_micro(const divulge_bench_micro_options_t* options, divulge_bench_json_t* json);
+
+/**
+ * @brief Run the load generator, adding a `load` object
+ * @return false when the server could not be started or reached
+ */
+bool divulge_bench_run_load(const divulge_bench_load_options_t* options, divulge_bench_json_t* json);
+/**
+ * @}
+ */
+#endif  // DIVULGE_BENCH_H
@@ -27,6 +27,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <signal.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -36,61 +37,30 @@
 #define G2LABS_LOG_MODULE_LEVEL G2LABS_LOG_MODULE_LEVEL_INFO
 #define G2LABS_LOG_MODULE_NAME "divulge-x64"
 #include "divulge-basic-authentication.h"
+#include "divulge-epoll.h"
+#include "divulge-metrics.h"
+#include "divulge-static.h"
+#ifdef DIVULGE_TRACING
+#include "divulge-trace.h"
+#endif
 #include "divulge.h"
 #include "file-names.h"
 #include "g2labs-log.h"
 #include "static-string.h"
-#include "stream-server.h"
 
 #define DIVULGE_EXAMPLE_PORT (5000)
 #define DIVULGE_EXAMPLE_MAX_WAITING_CONNECTIONS (100)
-#define DIVULGE_EXAMPLE_THREAD_POOL_SIZE (20)
 #define DIVULGE_EXAMPLE_BUFFER_SIZE (1024)
-
-static void socket_send_response(void* connection_context, const char* data, size_t data_size) {
-    stream_server_connection_t* connection = (stream_server_connection_t*)connection_context;
-    stream_server_write(connection, data, data_size);
-}
-
-static void socket_close(void* connection_context) {
-    stream_server_connection_t* connection = (stream_server_connection_t*)connection_context;
-    stream_server_close(connection);
-}
-
-static bool root_handler(divulge_request_t* request, void* context) {
-    char* file_buffer = NULL;
-    divulge_header_entry_t header_entries[] = {{.key = "Content-Type", .value = "text/html"}};
-    divulge_response_t response = {
-        .return_code = 200,
-        .header = {.count = 1, .entries = header_entries},
-        .payload = "",
-        .payload_size = 0,
-    };
-    struct stat st;
-    const char* file_name = ROOT_FILE_NAME;
-    int result = stat(file_name, &st);
-    if (result != 0) {
-        response.return_code = 500;
-        response.payload = "Error while accessing file";
-        response.payload_size = strlen(response.payload);
-    } else {
-        size_t file_size = st.st_size;
-        file_buffer = calloc(file_size, sizeof(char));
-        FILE* f = fopen(file_name, "r");
-        size_t bytes_read = fread(file_buffer, file_size, 1, f);
-        fclose(f);
-        response.payload = file_buffer;
-        response.payload_size = bytes_read;
-    }
-    bool status = divulge_respond(request, &response);
-    if (file_buffer) {
-        free(file_buffer);
-    }
-    return status;
-}
+#define DIVULGE_EXAMPLE_REQUEST_BUFFER_SIZE (16384)
+#define DIVULGE_EXAMPLE_IDLE_TIMEOUT_MS (60000)
+#define DIVULGE_EXAMPLE_HEADER_TIMEOUT_MS (10000)
+#define DIVULGE_EXAMPLE_REQUEST_TIMEOUT_MS (60000)
+#define DIVULGE_EXAMPLE_MIN_BODY_RATE (240)
+#define DIVULGE_EXAMPLE_TRACE_SAMPLE_PERIOD (100)
+#define DIVULGE_EXAMPLE_TRACE_PATH "divulge-trace.json"
 
 static bool root_post_handler(divulge_request_t* request, void* context) {
-    I("Received POST /: '%s'", request->payload);
+    I("Received POST /: '%.*s'", (int)request->payload.size, request->payload.data);
     return divulge_redirect(request, "/");
 }
 
@@ -107,9 +77,17 @@ static bool restricted_access_handler(divulge_request_t* request, void* context)
     return divulge_respond(request, &response);
 }
 
+static bool health_handler(divulge_request_t* request, void* context) {
+    return divulge_respond_template(request, context);
+}
+
 static divulge_uri_t root_uri = {
     .uri = "/",
-    .handler = {.handler = root_handler},
+    .method = DIVULGE_ROUTE_METHOD_GET,
+};
+
+static divulge_uri_t public_uri = {
+    .uri = "/*",
     .method = DIVULGE_ROUTE_METHOD_GET,
 };
 
@@ -125,8 +103,28 @@ static divulge_uri_t restricted_uri = {
     .method = DIVULGE_ROUTE_METHOD_GET,
 };
 
+static divulge_uri_t health_uri = {
+    .uri = "/health",
+    .handler = {.handler = health_handler},
+    .method = DIVULGE_ROUTE_METHOD_GET,
+};
+
+static divulge_uri_t metrics_uri = {
+    .uri = "/metrics",
+    .handler = {.handler = divulge_metrics_handler},
+    .method = DIVULGE_ROUTE_METHOD_GET,
+};
+
+#ifdef DIVULGE_TRACING
+static divulge_uri_t trace_uri = {
+    .uri = "/trace",
+    .handler = {.handler = divulge_tracer_handler},
+    .method = DIVULGE_ROUTE_METHOD_GET,
+};
+#endif
+
 static bool logger_middleware_handler(divulge_request_t* request, void* context) {
-    I("[%s] '%s'", divulge_method_name_from_method(request->method), request->route);
+    I("[%s] '%.*s'", divulge_method_name_from_method(request->method), (int)request->route.size, request->route.data);
     return true;
 }
 
@@ -140,40 +138,71 @@ static bool authenticate_user(void* context, const char* username, const char* p
 }
 
 static divulge_t* initialize_router(void) {
+    divulge_metrics_t* metrics = divulge_metrics_create();
+#ifdef DIVULGE_TRACING
+    divulge_tracer_configuration_t tracer_configuration = {.sample_period = DIVULGE_EXAMPLE_TRACE_SAMPLE_PERIOD};
+    divulge_tracer_t* tracer = divulge_tracer_create(&tracer_configuration);
+    divulge_tracer_dump_on_signal(tracer, SIGUSR2, DIVULGE_EXAMPLE_TRACE_PATH);
+#endif
     divulge_configuration_t configuration = {
-        .send = socket_send_response,
-        .close = socket_close,
+        .connection_buffer_size = DIVULGE_EXAMPLE_REQUEST_BUFFER_SIZE,
+        .response_buffer_size = DIVULGE_EXAMPLE_BUFFER_SIZE,
+        .metrics = metrics,
+        .is_date_sent = true,
+        .idle_timeout_ms = DIVULGE_EXAMPLE_IDLE_TIMEOUT_MS,
+        .header_timeout_ms = DIVULGE_EXAMPLE_HEADER_TIMEOUT_MS,
+        .request_timeout_ms = DIVULGE_EXAMPLE_REQUEST_TIMEOUT_MS,
+        .min_body_rate = DIVULGE_EXAMPLE_MIN_BODY_RATE,
+#ifdef DIVULGE_TRACING
+        .tracer = tracer,
+#endif
     };
+    divulge_epoll_prepare_configuration(&configuration);
     divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_static_configuration_t static_configuration = {
+        .url_prefix = "/",
+        .directory = PUBLIC_DIRECTORY,
+        .index_file_name = "index.html",
+    };
+    divulge_handler_object_t* static_handler = divulge_static_create(&static_configuration);
+    root_uri.handler = *static_handler;
+    public_uri.handler = *static_handler;
     divulge_register_uri(divulge, &root_uri);
+    divulge_register_uri(divulge, &public_uri);
     divulge_add_middleware_to_uri(divulge, &root_uri, &logger_middleware);
     divulge_register_uri(divulge, &root_post_uri);
     divulge_add_middleware_to_uri(divulge, &root_post_uri, &logger_middleware);
     divulge_register_uri(divulge, &restricted_uri);
     divulge_add_middleware_to_uri(divulge, &restricted_uri,
                                   divulge_basic_authentication_create("G2Labs realm", authenticate_user, NULL));
+    divulge_response_t health_response = {.return_code = 200, .payload = "OK", .payload_size = 2};
+    health_uri.handler.context = divulge_response_template_create(&health_response);
+    divulge_register_uri(divulge, &health_uri);
+    metrics_uri.handler.context = metrics;
+    divulge_register_uri(divulge, &metrics_uri);
+#ifdef DIVULGE_TRACING
+    trace_uri.handler.context = tracer;
+    divulge_register_uri(divulge, &trace_uri);
+#endif
     return divulge;
 }
 
-static void connection_handler(stream_server_t* server, stream_server_connection_t* connection, void* context) {
-    divulge_t* router = (divulge_t*)context;
-    char request_buffer[DIVULGE_EXAMPLE_BUFFER_SIZE];
-    char response_buffer[DIVULGE_EXAMPLE_BUFFER_SIZE];
-    size_t request_bytes_read = stream_server_read(connection, request_buffer, sizeof(request_buffer) - 1);
-    request_buffer[request_bytes_read] = '\0';
-    divulge_process_request(router, connection, request_buffer, request_bytes_read, response_buffer,
-                            sizeof(response_buffer));
-}
-
 int main(void) {
     I("Divulge example running on Linux(x64)");
 
     divulge_t* router = initialize_router();
 
-    stream_server_t* server = stream_server_create(DIVULGE_EXAMPLE_PORT, DIVULGE_EXAMPLE_MAX_WAITING_CONNECTIONS,
-                                                   DIVULGE_EXAMPLE_THREAD_POOL_SIZE, connection_handler, router);
+    divulge_epoll_configuration_t epoll_configuration = {
+        .port = DIVULGE_EXAMPLE_PORT,
+        .backlog = DIVULGE_EXAMPLE_MAX_WAITING_CONNECTIONS,
+    };
+    divulge_epoll_t* epoll = divulge_epoll_create(router, &epoll_configuration);
+    if (!epoll || !divulge_epoll_start(epoll)) {
+        E("Could not serve on port %d", DIVULGE_EXAMPLE_PORT);
+        return 1;
+    }
     while (true) {
-        stream_server_loop(server);
+        pause();
     }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,205 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-admission.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "divulge-time.h"
+
+#define ADMISSION_SHARD_COUNT (16)
+#define ADMISSION_PROBE_LENGTH (8)
+
+/*
+ * A slot without an address is empty. Slots are only ever reused, never emptied, so probing can stop at the
+ * first empty one.
+ */
+typedef struct client_bucket {
+    char address[DIVULGE_ADMISSION_MAX_ADDRESS_SIZE];
+    uint8_t address_size;
+    uint32_t hash;
+    double tokens;
+    uint64_t updated_at_ms;
+} client_bucket_t;
+
+typedef struct admission_shard {
+    pthread_mutex_t lock;
+    client_bucket_t* buckets;
+} admission_shard_t;
+
+typedef struct divulge_admission_context {
+    divulge_admission_configuration_t configuration;
+    divulge_response_template_t* rejection_response;
+    size_t shard_capacity;
+    admission_shard_t shards[ADMISSION_SHARD_COUNT];
+} divulge_admission_context_t;
+
+static uint32_t hash_address(const char* address, size_t address_size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < address_size; i++) {
+        hash = (hash ^ (uint8_t)address[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Finds the bucket of the address, or gives it the first empty slot or else the one idle longest.
+ */
+static client_bucket_t* find_bucket(divulge_admission_context_t* ctx,
+                                    admission_shard_t* shard,
+                                    const char* address,
+                                    size_t address_size,
+                                    uint32_t hash) {
+    size_t mask = ctx->shard_capacity - 1;
+    size_t index = (hash / ADMISSION_SHARD_COUNT) & mask;
+    client_bucket_t* victim = NULL;
+    for (size_t i = 0; i < ADMISSION_PROBE_LENGTH; i++) {
+        client_bucket_t* bucket = shard->buckets + ((index + i) & mask);
+        if (bucket->address_size == 0) {
+            victim = bucket;
+            break;
+        }
+        if ((bucket->hash == hash) && (bucket->address_size == address_size) &&
+            (memcmp(bucket->address, address, address_size) == 0)) {
+            return bucket;
+        }
+        if (!victim || (bucket->updated_at_ms < victim->updated_at_ms)) {
+            victim = bucket;
+        }
+    }
+    memcpy(victim->address, address, address_size);
+    victim->address_size = (uint8_t)address_size;
+    victim->hash = hash;
+    victim->tokens = ctx->configuration.burst;
+    victim->updated_at_ms = 0;
+    return victim;
+}
+
+static bool take_token(divulge_admission_context_t* ctx, const char* address, size_t address_size, uint64_t now_ms) {
+    if (address_size > DIVULGE_ADMISSION_MAX_ADDRESS_SIZE) {
+        address_size = DIVULGE_ADMISSION_MAX_ADDRESS_SIZE;
+    }
+    uint32_t hash = hash_address(address, address_size);
+    admission_shard_t* shard = ctx->shards + (hash % ADMISSION_SHARD_COUNT);
+    pthread_mutex_lock(&shard->lock);
+    client_bucket_t* bucket = find_bucket(ctx, shard, address, address_size, hash);
+    if (now_ms > bucket->updated_at_ms) {
+        double refill = (double)(now_ms - bucket->updated_at_ms) * ctx->configuration.requests_per_second / 1000.0;
+        bucket->tokens = (bucket->tokens + refill < ctx->configuration.burst) ? bucket->tokens + refill
+                                                                               : ctx->configuration.burst;
+        bucket->updated_at_ms = now_ms;
+    }
+    bool is_taken = (bucket->tokens >= 1.0);
+    if (is_taken) {
+        bucket->tokens -= 1.0;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return is_taken;
+}
+
+bool divulge_admission_take_token(divulge_handler_object_t* admission,
+                                  const char* address,
+                                  size_t address_size,
+                                  uint64_t now_ms) {
+    if (!admission || !address || (address_size == 0)) {
+        return true;
+    }
+    return take_token(admission->context, address, address_size, now_ms);
+}
+
+static bool middleware(divulge_request_t* request, void* context) {
+    divulge_admission_context_t* ctx = context;
+    divulge_slice_t address;
+    if (!divulge_get_peer_address(request, &address) ||
+        take_token(ctx, address.data, address.size, divulge_get_time_ms())) {
+        return true;
+    }
+    divulge_respond_template(request, ctx->rejection_response);
+    return false;
+}
+
+static divulge_response_template_t* create_rejection_response(void) {
+    const char* payload = "Divulge Error: too many requests";
+    divulge_header_entry_t header_entries[] = {{.key = "Retry-After", .value = "1"}};
+    divulge_response_t response = {
+        .return_code = 429,
+        .header = {.count = 1, .entries = header_entries},
+        .payload = payload,
+        .payload_size = strlen(payload),
+    };
+    return divulge_response_template_create(&response);
+}
+
+static void destroy_context(divulge_admission_context_t* ctx) {
+    for (size_t i = 0; i < ADMISSION_SHARD_COUNT; i++) {
+        free(ctx->shards[i].buckets);
+    }
+    divulge_response_template_destroy(ctx->rejection_response);
+    free(ctx);
+}
+
+divulge_handler_object_t* divulge_admission_create(const divulge_admission_configuration_t* configuration) {
+    if (!configuration || !(configuration->requests_per_second > 0.0)) {
+        return NULL;
+    }
+    divulge_handler_object_t* object = calloc(1, sizeof(divulge_handler_object_t));
+    if (!object) {
+        return NULL;
+    }
+    divulge_admission_context_t* ctx = calloc(1, sizeof(divulge_admission_context_t));
+    if (!ctx) {
+        free(object);
+        return NULL;
+    }
+    ctx->configuration = *configuration;
+    if (!(ctx->configuration.burst > 0.0)) {
+        ctx->configuration.burst = ctx->configuration.requests_per_second;
+    }
+    if (ctx->configuration.burst < 1.0) {
+        ctx->configuration.burst = 1.0;
+    }
+    if (ctx->configuration.max_clients == 0) {
+        ctx->configuration.max_clients = DIVULGE_ADMISSION_DEFAULT_MAX_CLIENTS;
+    }
+    ctx->shard_capacity = ADMISSION_PROBE_LENGTH;
+    while ((ctx->shard_capacity * ADMISSION_SHARD_COUNT) < ctx->configuration.max_clients) {
+        ctx->shard_capacity *= 2;
+    }
+    ctx->rejection_response = create_rejection_response();
+    bool is_ready = (ctx->rejection_response != NULL);
+    for (size_t i = 0; is_ready && (i < ADMISSION_SHARD_COUNT); i++) {
+        ctx->shards[i].buckets = calloc(ctx->shard_capacity, sizeof(client_bucket_t));
+        is_ready = (ctx->shards[i].buckets != NULL);
+    }
+    if (!is_ready) {
+        destroy_context(ctx);
+        free(object);
+        return NULL;
+    }
+    for (size_t i = 0; i < ADMISSION_SHARD_COUNT; i++) {
+        pthread_mutex_init(&ctx->shards[i].lock, NULL);
+    }
+    object->context = ctx;
+    object->handler = middleware;
+    return object;
+}
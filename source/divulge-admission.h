@@ -0,0 +1,71 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_ADMISSION_H
+#define DIVULGE_ADMISSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-admission Divulge admission control
+ * @ingroup divulge
+ * @brief Middleware rate limiting every client with a token bucket
+ *
+ * Clients are told apart by the peer address the transport gives (see divulge_get_peer_address()); requests
+ * from an unknown address are let through. Every client gets a bucket of `burst` tokens refilled at
+ * `requests_per_second`, and a request finding it empty is answered with a pre-serialized 429. Buckets live in
+ * independently locked shards of open-addressed slots; a new client takes an empty slot near its hash or else
+ * the one idle longest, which has refilled if it was idle long enough. Attach the middleware to routes, or set
+ * it as `admission` in divulge_configuration_t to run it on every request before routing, next to
+ * `max_concurrent_requests`.
+ * @{
+ */
+#define DIVULGE_ADMISSION_DEFAULT_MAX_CLIENTS (65536)
+#define DIVULGE_ADMISSION_MAX_ADDRESS_SIZE (16)
+
+typedef struct divulge_admission_configuration {
+    double requests_per_second; /**< sustained rate allowed per client */
+    double burst;               /**< requests allowed at once, 0 for `requests_per_second` but at least 1 */
+    size_t max_clients;         /**< buckets kept, 0 for DIVULGE_ADMISSION_DEFAULT_MAX_CLIENTS */
+} divulge_admission_configuration_t;
+
+/**
+ * @return middleware, or NULL if `requests_per_second` is not positive or memory is short
+ */
+divulge_handler_object_t* divulge_admission_create(const divulge_admission_configuration_t* configuration);
+
+/**
+ * @brief Take a token from the bucket of a client
+ * @param now_ms time of a monotonic clock, in milliseconds
+ * @return false if the bucket is empty
+ */
+bool divulge_admission_take_token(divulge_handler_object_t* admission,
+                                  const char* address,
+                                  size_t address_size,
+                                  uint64_t now_ms);
+/**
+ * @}
+ */
+#endif  // DIVULGE_ADMISSION_H
@@ -0,0 +1,131 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-arena.h"
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ARENA_ALIGNMENT (alignof(max_align_t))
+#define ALIGN_UP(x) (((x) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+typedef struct divulge_arena_block {
+    struct divulge_arena_block* next;
+    size_t size;
+    size_t used;
+    alignas(max_align_t) char data[];
+} divulge_arena_block_t;
+
+typedef struct arena_pool {
+    divulge_arena_block_t* blocks;
+    size_t block_count;
+} arena_pool_t;
+
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+
+static void free_blocks(divulge_arena_block_t* block) {
+    while (block) {
+        divulge_arena_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+static void destroy_pool(void* pool) {
+    free_blocks(((arena_pool_t*)pool)->blocks);
+    free(pool);
+}
+
+static void create_pool_key(void) {
+    pthread_key_create(&pool_key, destroy_pool);
+}
+
+static arena_pool_t* get_pool(void) {
+    pthread_once(&pool_key_once, create_pool_key);
+    arena_pool_t* pool = pthread_getspecific(pool_key);
+    if (!pool) {
+        pool = calloc(1, sizeof(arena_pool_t));
+        if (pool && (pthread_setspecific(pool_key, pool) != 0)) {
+            free(pool);
+            pool = NULL;
+        }
+    }
+    return pool;
+}
+
+static divulge_arena_block_t* acquire_block(size_t size) {
+    arena_pool_t* pool = get_pool();
+    if (pool && pool->blocks && (pool->blocks->size >= size)) {
+        divulge_arena_block_t* block = pool->blocks;
+        pool->blocks = block->next;
+        pool->block_count--;
+        return block;
+    }
+    size_t block_size = (size > DIVULGE_ARENA_BLOCK_SIZE) ? size : DIVULGE_ARENA_BLOCK_SIZE;
+    divulge_arena_block_t* block = malloc(sizeof(divulge_arena_block_t) + block_size);
+    if (block) {
+        block->size = block_size;
+    }
+    return block;
+}
+
+void* divulge_arena_allocate(divulge_arena_t* arena, size_t size) {
+    if (!arena || (size == 0) || (size > (SIZE_MAX / 2))) {
+        return NULL;
+    }
+    size = ALIGN_UP(size);
+    divulge_arena_block_t* block = arena->newest;
+    if (!block || ((block->size - block->used) < size)) {
+        block = acquire_block(size);
+        if (!block) {
+            return NULL;
+        }
+        block->used = 0;
+        block->next = arena->newest;
+        arena->newest = block;
+        arena->oldest = arena->oldest ? arena->oldest : block;
+        arena->block_count++;
+    }
+    void* memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+void divulge_arena_reset(divulge_arena_t* arena) {
+    if (!arena || !arena->newest) {
+        return;
+    }
+    arena_pool_t* pool = get_pool();
+    if (pool && ((pool->block_count + arena->block_count) <= DIVULGE_ARENA_MAX_POOLED_BLOCKS)) {
+        arena->oldest->next = pool->blocks;
+        pool->blocks = arena->newest;
+        pool->block_count += arena->block_count;
+    } else {
+        free_blocks(arena->newest);
+    }
+    arena->newest = NULL;
+    arena->oldest = NULL;
+    arena->block_count = 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_ARENA_H
+#define DIVULGE_ARENA_H
+
+#include <stddef.h>
+/**
+ * @defgroup divulge-arena Divulge arena allocator
+ * @ingroup divulge
+ * @brief Bump allocator for memory released all at once
+ *
+ * Allocations are carved out of blocks. A reset hands the blocks to a per-thread pool in one step, and later
+ * arenas on the same thread take them from there, so a steady request load does not reach malloc at all. A
+ * zero-initialized arena is empty and ready to use.
+ * @{
+ */
+#define DIVULGE_ARENA_BLOCK_SIZE (8192)
+#define DIVULGE_ARENA_MAX_POOLED_BLOCKS (8)
+
+typedef struct divulge_arena_block divulge_arena_block_t;
+
+typedef struct divulge_arena {
+    divulge_arena_block_t* newest;
+    divulge_arena_block_t* oldest;
+    size_t block_count;
+} divulge_arena_t;
+
+/**
+ * @return memory aligned for any type, or NULL
+ */
+void* divulge_arena_allocate(divulge_arena_t* arena, size_t size);
+
+/**
+ * @brief Release every allocation, giving the blocks back to the pool of the calling thread
+ */
+void divulge_arena_reset(divulge_arena_t* arena);
+/**
+ * @}
+ */
+#endif  // DIVULGE_ARENA_H
@@ -22,63 +22,313 @@
  * SOFTWARE.
  */
 #include "divulge-basic-authentication.h"
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "divulge-time.h"
 #include "encodings-base64.h"
 
+#define BASIC_SCHEME "basic"
+#define BASIC_SCHEME_SIZE (sizeof(BASIC_SCHEME) - 1)
+#define MAX_DECODED_SIZE ((DIVULGE_BASIC_AUTHENTICATION_MAX_CREDENTIALS_SIZE / 4) * 3 + 4)
+#define CACHE_PROBE_COUNT (4)
+
+typedef struct credential_entry {
+    uint64_t tag[2];
+    uint64_t user_tag;
+    uint64_t expires_at_ms;
+    bool is_used;
+    bool is_accepted;
+} credential_entry_t;
+
 typedef struct divulge_basic_authentication_context {
-    const char* realm;
-    divulge_basic_authentication_authenticate_user_callback_t authentication_callback;
-    void* authentication_context;
+    divulge_basic_authentication_configuration_t configuration;
+    divulge_response_template_t* challenge_response;
+    pthread_mutex_t lock;
+    credential_entry_t* entries;
+    uint64_t generation; /**< bumped when users are forgotten, so results checked before are not cached */
+    uint64_t keys[3][2];
 } divulge_basic_authentication_context_t;
 
+static bool get_basic_credentials(divulge_slice_t value, divulge_slice_t* credentials) {
+    if (value.size <= BASIC_SCHEME_SIZE) {
+        return false;
+    }
+    for (size_t i = 0; i < BASIC_SCHEME_SIZE; i++) {
+        char c = value.data[i];
+        if ((char)(((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c) != BASIC_SCHEME[i]) {
+            return false;
+        }
+    }
+    size_t offset = BASIC_SCHEME_SIZE;
+    if (value.data[offset] != ' ') {
+        return false;
+    }
+    while ((offset < value.size) && (value.data[offset] == ' ')) {
+        offset++;
+    }
+    credentials->data = value.data + offset;
+    credentials->size = value.size - offset;
+    return credentials->size > 0;
+}
+
+#define ROTATE_LEFT(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND(v0, v1, v2, v3) \
+    do {                          \
+        v0 += v1;                 \
+        v1 = ROTATE_LEFT(v1, 13); \
+        v1 ^= v0;                 \
+        v0 = ROTATE_LEFT(v0, 32); \
+        v2 += v3;                 \
+        v3 = ROTATE_LEFT(v3, 16); \
+        v3 ^= v2;                 \
+        v0 += v3;                 \
+        v3 = ROTATE_LEFT(v3, 21); \
+        v3 ^= v0;                 \
+        v2 += v1;                 \
+        v1 = ROTATE_LEFT(v1, 17); \
+        v1 ^= v2;                 \
+        v2 = ROTATE_LEFT(v2, 32); \
+    } while (0)
+
+/*
+ * SipHash-2-4: a keyed hash, so that the stored tags reveal nothing about the credentials and cannot be matched
+ * by crafted collisions without the per-middleware random key.
+ */
+static uint64_t sip_hash(const uint64_t key[2], const char* data, size_t size) {
+    uint64_t v0 = key[0] ^ 0x736f6d6570736575ull;
+    uint64_t v1 = key[1] ^ 0x646f72616e646f6dull;
+    uint64_t v2 = key[0] ^ 0x6c7967656e657261ull;
+    uint64_t v3 = key[1] ^ 0x7465646279746573ull;
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t tail_offset = size - (size % 8);
+    for (size_t offset = 0; offset < tail_offset; offset += 8) {
+        uint64_t m = 0;
+        for (size_t i = 0; i < 8; i++) {
+            m |= (uint64_t)bytes[offset + i] << (8 * i);
+        }
+        v3 ^= m;
+        SIP_ROUND(v0, v1, v2, v3);
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    uint64_t last = (uint64_t)size << 56;
+    for (size_t i = 0; i < (size % 8); i++) {
+        last |= (uint64_t)bytes[tail_offset + i] << (8 * i);
+    }
+    v3 ^= last;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++) {
+        SIP_ROUND(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static void erase(void* data, size_t size) {
+    volatile unsigned char* bytes = data;
+    while (size--) {
+        *bytes++ = 0;
+    }
+}
+
+static bool authenticate(divulge_basic_authentication_context_t* ctx,
+                         divulge_slice_t credentials,
+                         uint64_t* user_tag) {
+    char encoded[DIVULGE_BASIC_AUTHENTICATION_MAX_CREDENTIALS_SIZE + 1];
+    char decoded[MAX_DECODED_SIZE] = {0};
+    if (credentials.size >= sizeof(encoded)) {
+        return false;
+    }
+    memcpy(encoded, credentials.data, credentials.size);
+    encoded[credentials.size] = '\0';
+    bool result = false;
+    if (encodings_base64_get_decode_buffer_size(encoded) < sizeof(decoded)) {
+        encodings_base64_decode(encoded, decoded);
+        char* separator = strchr(decoded, ':');
+        if (separator) {
+            *separator = '\0';
+            *user_tag = sip_hash(ctx->keys[2], decoded, (size_t)(separator - decoded));
+            result = ctx->configuration.authentication_callback(ctx->configuration.authentication_context, decoded,
+                                                                separator + 1);
+        }
+    }
+    erase(decoded, sizeof(decoded));
+    erase(encoded, sizeof(encoded));
+    return result;
+}
+
+static credential_entry_t* get_probed_entry(divulge_basic_authentication_context_t* ctx,
+                                            const uint64_t tag[2],
+                                            size_t probe) {
+    return ctx->entries + ((tag[0] + probe) % ctx->configuration.max_cached_credentials);
+}
+
+static bool find_cached_result(divulge_basic_authentication_context_t* ctx,
+                               const uint64_t tag[2],
+                               bool* result,
+                               uint64_t* generation) {
+    bool is_found = false;
+    uint64_t now = divulge_get_time_ms();
+    pthread_mutex_lock(&ctx->lock);
+    *generation = ctx->generation;
+    for (size_t probe = 0; probe < CACHE_PROBE_COUNT; probe++) {
+        credential_entry_t* entry = get_probed_entry(ctx, tag, probe);
+        if (entry->is_used && (entry->tag[0] == tag[0]) && (entry->tag[1] == tag[1]) &&
+            (now < entry->expires_at_ms)) {
+            *result = entry->is_accepted;
+            is_found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return is_found;
+}
+
+/*
+ * A result checked before users were forgotten is dropped, as it may accept a password changed meanwhile.
+ */
+static void cache_result(divulge_basic_authentication_context_t* ctx,
+                         const uint64_t tag[2],
+                         uint64_t user_tag,
+                         bool is_accepted,
+                         uint64_t generation) {
+    unsigned time_to_live_ms =
+        is_accepted ? ctx->configuration.time_to_live_ms : ctx->configuration.rejection_time_to_live_ms;
+    if (time_to_live_ms == 0) {
+        return;
+    }
+    uint64_t now = divulge_get_time_ms();
+    pthread_mutex_lock(&ctx->lock);
+    if (generation != ctx->generation) {
+        pthread_mutex_unlock(&ctx->lock);
+        return;
+    }
+    credential_entry_t* victim = get_probed_entry(ctx, tag, 0);
+    for (size_t probe = 0; probe < CACHE_PROBE_COUNT; probe++) {
+        credential_entry_t* entry = get_probed_entry(ctx, tag, probe);
+        bool is_same = entry->is_used && (entry->tag[0] == tag[0]) && (entry->tag[1] == tag[1]);
+        if (!entry->is_used || is_same || (entry->expires_at_ms <= now)) {
+            victim = entry;
+            break;
+        }
+        if (entry->expires_at_ms < victim->expires_at_ms) {
+            victim = entry;
+        }
+    }
+    *victim = (credential_entry_t){
+        .tag = {tag[0], tag[1]},
+        .user_tag = user_tag,
+        .expires_at_ms = now + time_to_live_ms,
+        .is_used = true,
+        .is_accepted = is_accepted,
+    };
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static bool is_authorized(divulge_basic_authentication_context_t* ctx, divulge_slice_t credentials) {
+    if (!ctx->entries) {
+        uint64_t user_tag = 0;
+        return authenticate(ctx, credentials, &user_tag);
+    }
+    uint64_t tag[2] = {
+        sip_hash(ctx->keys[0], credentials.data, credentials.size),
+        sip_hash(ctx->keys[1], credentials.data, credentials.size),
+    };
+    bool result = false;
+    uint64_t generation = 0;
+    if (!find_cached_result(ctx, tag, &result, &generation)) {
+        uint64_t user_tag = 0;
+        result = authenticate(ctx, credentials, &user_tag);
+        cache_result(ctx, tag, user_tag, result, generation);
+    }
+    return result;
+}
+
 static bool handler(divulge_request_t* request, void* context) {
     divulge_basic_authentication_context_t* ctx = (divulge_basic_authentication_context_t*)context;
-    const char* authorization_header = divulge_find_request_header_key(request, "Authorization");
+    divulge_slice_t authorization = {0};
+    divulge_slice_t credentials = {0};
     bool result = false;
-    if (!authorization_header) {
-        result = false;
-    } else {
-        const char* value = divulge_get_request_header_entry_value(authorization_header);
-        char* encoding = strstr(value, " ") + 1;
-        char* decoded = calloc(encodings_base64_get_decode_buffer_size(encoding) + 1, sizeof(char));
-        encodings_base64_decode(encoding, decoded);
-        char* username = strtok(decoded, ":");
-        char* password = strtok(NULL, ":");
-        if (!username || !password || !ctx->authentication_callback(ctx->authentication_context, username, password)) {
-            result = false;
-        } else {
-            result = true;
-        }
-        free(decoded);
+    if (divulge_find_request_header(request, "Authorization", &authorization) &&
+        get_basic_credentials(authorization, &credentials)) {
+        result = is_authorized(ctx, credentials);
     }
     if (!result) {
-        char realm_buffer[100];
-        sprintf(realm_buffer, "Basic realm=\"%s\"", ctx->realm);
-        divulge_header_entry_t header_entries[] = {
-            {.key = "WWW-Authenticate", .value = realm_buffer},
-        };
-        divulge_response_t response = {
-            .return_code = 401,
-            .header =
-                {
-                    .count = 1,
-                    .entries = header_entries,
-                },
-            .payload = "",
-            .payload_size = 0,
-        };
-        divulge_respond(request, &response);
+        divulge_respond_template(request, ctx->challenge_response);
     }
     return result;
 }
 
-divulge_handler_object_t* divulge_basic_authentication_create(
-    const char* realm,
-    divulge_basic_authentication_authenticate_user_callback_t authentication_callback,
-    void* authentication_context) {
-    if (!realm || !authentication_callback) {
+/*
+ * The realm is a quoted string, so quotes and backslashes in it are escaped.
+ */
+static char* create_challenge(const char* realm) {
+    const char* prefix = "Basic realm=\"";
+    size_t size = strlen(prefix) + 2 * strlen(realm) + 2;
+    char* challenge = malloc(size);
+    if (!challenge) {
+        return NULL;
+    }
+    char* end = challenge + strlen(prefix);
+    memcpy(challenge, prefix, strlen(prefix));
+    for (const char* c = realm; *c; c++) {
+        if ((*c == '"') || (*c == '\\')) {
+            *end++ = '\\';
+        }
+        *end++ = *c;
+    }
+    *end++ = '"';
+    *end = '\0';
+    return challenge;
+}
+
+static bool generate_keys(uint64_t keys[3][2]) {
+    FILE* random = fopen("/dev/urandom", "rb");
+    if (!random) {
+        return false;
+    }
+    bool result = fread(keys, sizeof(uint64_t), 6, random) == 6;
+    fclose(random);
+    return result;
+}
+
+static divulge_response_template_t* create_challenge_response(const char* realm) {
+    char* challenge = create_challenge(realm);
+    if (!challenge) {
+        return NULL;
+    }
+    divulge_header_entry_t header_entries[] = {
+        {.key = "WWW-Authenticate", .value = challenge},
+    };
+    divulge_response_t response = {
+        .return_code = 401,
+        .header =
+            {
+                .count = 1,
+                .entries = header_entries,
+            },
+        .payload = "",
+        .payload_size = 0,
+    };
+    divulge_response_template_t* challenge_response = divulge_response_template_create(&response);
+    free(challenge);
+    return challenge_response;
+}
+
+static void destroy_context(divulge_basic_authentication_context_t* ctx) {
+    free(ctx->entries);
+    divulge_response_template_destroy(ctx->challenge_response);
+    free(ctx);
+}
+
+divulge_handler_object_t* divulge_basic_authentication_create_with_configuration(
+    const divulge_basic_authentication_configuration_t* configuration) {
+    if (!configuration || !configuration->realm || !configuration->authentication_callback) {
         return NULL;
     }
     divulge_handler_object_t* object = calloc(1, sizeof(divulge_handler_object_t));
@@ -90,10 +340,68 @@ divulge_handler_object_t* divulge_basic_authentication_create(
         free(object);
         return NULL;
     }
-    ctx->authentication_callback = authentication_callback;
-    ctx->authentication_context = authentication_context;
-    ctx->realm = realm;
+    ctx->configuration = *configuration;
+    if (ctx->configuration.time_to_live_ms == 0) {
+        ctx->configuration.time_to_live_ms = DIVULGE_BASIC_AUTHENTICATION_DEFAULT_TIME_TO_LIVE_MS;
+    }
+    ctx->challenge_response = create_challenge_response(configuration->realm);
+    bool is_cache_ready = true;
+    if (configuration->max_cached_credentials > 0) {
+        ctx->entries = calloc(configuration->max_cached_credentials, sizeof(credential_entry_t));
+        is_cache_ready = ctx->entries && generate_keys(ctx->keys);
+    }
+    if (!ctx->challenge_response || !is_cache_ready) {
+        destroy_context(ctx);
+        free(object);
+        return NULL;
+    }
+    pthread_mutex_init(&ctx->lock, NULL);
     object->context = ctx;
     object->handler = handler;
     return object;
-}
\ No newline at end of file
+}
+
+divulge_handler_object_t* divulge_basic_authentication_create(
+    const char* realm,
+    divulge_basic_authentication_authenticate_user_callback_t authentication_callback,
+    void* authentication_context) {
+    divulge_basic_authentication_configuration_t configuration = {
+        .realm = realm,
+        .authentication_callback = authentication_callback,
+        .authentication_context = authentication_context,
+    };
+    return divulge_basic_authentication_create_with_configuration(&configuration);
+}
+
+void divulge_basic_authentication_forget_user(divulge_handler_object_t* object, const char* username) {
+    if (!object || !username) {
+        return;
+    }
+    divulge_basic_authentication_context_t* ctx = (divulge_basic_authentication_context_t*)object->context;
+    if (!ctx->entries) {
+        return;
+    }
+    uint64_t user_tag = sip_hash(ctx->keys[2], username, strlen(username));
+    pthread_mutex_lock(&ctx->lock);
+    ctx->generation++;
+    for (size_t i = 0; i < ctx->configuration.max_cached_credentials; i++) {
+        if (ctx->entries[i].is_used && (ctx->entries[i].user_tag == user_tag)) {
+            ctx->entries[i].is_used = false;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+void divulge_basic_authentication_forget_all(divulge_handler_object_t* object) {
+    if (!object) {
+        return;
+    }
+    divulge_basic_authentication_context_t* ctx = (divulge_basic_authentication_context_t*)object->context;
+    if (!ctx->entries) {
+        return;
+    }
+    pthread_mutex_lock(&ctx->lock);
+    ctx->generation++;
+    memset(ctx->entries, 0, ctx->configuration.max_cached_credentials * sizeof(credential_entry_t));
+    pthread_mutex_unlock(&ctx->lock);
+}
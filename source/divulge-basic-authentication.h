@@ -24,7 +24,20 @@
 #ifndef DIVULGE_BASIC_AUTHENTICATION_H
 #define DIVULGE_BASIC_AUTHENTICATION_H
 
+#include <stddef.h>
 #include "divulge.h"
+/**
+ * @defgroup divulge-basic-authentication Divulge basic authentication
+ * @ingroup divulge
+ * @brief Middleware checking `Authorization: Basic` credentials
+ *
+ * Verifying a password is usually slow on purpose, so verified `Authorization` values may be remembered for a
+ * while. The cache keeps only keyed SipHash tags of the header value and of the user name, never the credentials
+ * themselves, and may also remember rejected values to refuse repeated guesses without calling back.
+ * @{
+ */
+#define DIVULGE_BASIC_AUTHENTICATION_MAX_CREDENTIALS_SIZE (512)
+#define DIVULGE_BASIC_AUTHENTICATION_DEFAULT_TIME_TO_LIVE_MS (60000)
 
 typedef bool (*divulge_basic_authentication_authenticate_user_callback_t)(void* context,
                                                                           const char* username,
@@ -35,4 +48,25 @@ divulge_handler_object_t* divulge_basic_authentication_create(
     divulge_basic_authentication_authenticate_user_callback_t authentication_callback,
     void* authentication_context);
 
+typedef struct divulge_basic_authentication_configuration {
+    const char* realm; /**< must outlive the middleware */
+    divulge_basic_authentication_authenticate_user_callback_t authentication_callback;
+    void* authentication_context;
+    size_t max_cached_credentials;      /**< number of remembered `Authorization` values, 0 disables the cache */
+    unsigned time_to_live_ms;           /**< 0 for DIVULGE_BASIC_AUTHENTICATION_DEFAULT_TIME_TO_LIVE_MS */
+    unsigned rejection_time_to_live_ms; /**< how long rejected values are refused without calling back, 0 never */
+} divulge_basic_authentication_configuration_t;
+
+divulge_handler_object_t* divulge_basic_authentication_create_with_configuration(
+    const divulge_basic_authentication_configuration_t* configuration);
+
+/**
+ * @brief Forget the cached credentials of a user, e.g. after a password change
+ */
+void divulge_basic_authentication_forget_user(divulge_handler_object_t* object, const char* username);
+
+void divulge_basic_authentication_forget_all(divulge_handler_object_t* object);
+/**
+ * @}
+ */
 #endif  // DIVULGE_BASIC_AUTHENTICATION_H
@@ -0,0 +1,221 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-body.h"
+#include <stdint.h>
+#include <string.h>
+
+typedef enum body_state {
+    STATE_DATA,
+    STATE_CHUNK_SIZE,
+    STATE_CHUNK_EXTENSION,
+    STATE_CHUNK_SIZE_LF,
+    STATE_CHUNK_DATA,
+    STATE_CHUNK_DATA_CR,
+    STATE_CHUNK_DATA_LF,
+    STATE_TRAILER_START,
+    STATE_TRAILER,
+    STATE_TRAILER_LF,
+    STATE_LAST_LF,
+    STATE_DONE,
+    STATE_ERROR,
+} body_state_t;
+
+static int hex_digit_value(char c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static divulge_body_status_t fail(divulge_body_decoder_t* decoder, divulge_body_error_t error) {
+    decoder->state = STATE_ERROR;
+    decoder->error = error;
+    return DIVULGE_BODY_STATUS_ERROR;
+}
+
+void divulge_body_decoder_initialize(divulge_body_decoder_t* decoder,
+                                     bool is_chunked,
+                                     size_t content_length,
+                                     size_t max_size) {
+    if (!decoder) {
+        return;
+    }
+    memset(decoder, 0, sizeof(divulge_body_decoder_t));
+    decoder->is_chunked = is_chunked;
+    decoder->max_size = max_size;
+    decoder->remaining = is_chunked ? 0 : content_length;
+    decoder->state = is_chunked ? STATE_CHUNK_SIZE : STATE_DATA;
+    if (!is_chunked && (content_length > max_size)) {
+        fail(decoder, DIVULGE_BODY_ERROR_TOO_LARGE);
+    } else if (!is_chunked && (content_length == 0)) {
+        decoder->state = STATE_DONE;
+    }
+}
+
+/*
+ * Chunk-size lines and trailers are read a byte at a time; chunk data is moved in one piece.
+ */
+static divulge_body_status_t decode_chunked(divulge_body_decoder_t* decoder,
+                                            char* data,
+                                            size_t size,
+                                            size_t* consumed,
+                                            size_t* produced) {
+    size_t p = 0;
+    size_t output = 0;
+    while ((p < size) && (decoder->state != STATE_DONE)) {
+        char c = data[p];
+        if (decoder->state == STATE_CHUNK_DATA) {
+            size_t available = size - p;
+            size_t count = (available < decoder->remaining) ? available : decoder->remaining;
+            memmove(data + output, data + p, count);
+            output += count;
+            p += count;
+            decoder->remaining -= count;
+            decoder->decoded_size += count;
+            decoder->state = (decoder->remaining == 0) ? STATE_CHUNK_DATA_CR : STATE_CHUNK_DATA;
+            continue;
+        }
+        if ((decoder->state != STATE_CHUNK_DATA_CR) && (decoder->state != STATE_CHUNK_DATA_LF) &&
+            (++decoder->line_size > DIVULGE_BODY_MAX_CHUNK_LINE_SIZE)) {
+            return fail(decoder, DIVULGE_BODY_ERROR_BAD_CHUNK);
+        }
+        switch (decoder->state) {
+            case STATE_CHUNK_SIZE: {
+                int digit = hex_digit_value(c);
+                if (digit >= 0) {
+                    if (decoder->remaining > ((SIZE_MAX - (size_t)digit) >> 4)) {
+                        return fail(decoder, DIVULGE_BODY_ERROR_TOO_LARGE);
+                    }
+                    decoder->remaining = (decoder->remaining << 4) | (size_t)digit;
+                    decoder->has_digits = true;
+                } else if (!decoder->has_digits) {
+                    return fail(decoder, DIVULGE_BODY_ERROR_BAD_CHUNK);
+                } else if (c == '\r') {
+                    decoder->state = STATE_CHUNK_SIZE_LF;
+                } else if ((c == ';') || (c == ' ') || (c == '\t')) {
+                    decoder->state = STATE_CHUNK_EXTENSION;
+                } else {
+                    return fail(decoder, DIVULGE_BODY_ERROR_BAD_CHUNK);
+                }
+                break;
+            }
+            case STATE_CHUNK_EXTENSION:
+                if (c == '\r') {
+                    decoder->state = STATE_CHUNK_SIZE_LF;
+                } else if (c == '\n') {
+                    return fail(decoder, DIVULGE_BODY_ERROR_BAD_CHUNK);
+                }
+                break;
+            case STATE_CHUNK_SIZE_LF:
+                if (c != '\n') {
+                    return fail(decoder, DIVULGE_BODY_ERROR_BAD_CHUNK);
+                }
+                if (decoder->remaining > (decoder->max_size - decoder->decoded_size)) {
+                    return fail(decoder, DIVULGE_BODY_ERROR_TOO_LARGE);
+                }
+                decoder->line_size = 0;
+                decoder->has_digits = false;
+                decoder->state = (decoder->remaining == 0) ? STATE_TRAILER_START : STATE_CHUNK_DATA;
+                break;
+            case STATE_CHUNK_DATA_CR:
+                if (c != '\r') {
+                    return fail(decoder, DIVULGE_BODY_ERROR_BAD_CHUNK);
+                }
+                decoder->state = STATE_CHUNK_DATA_LF;
+                break;
+            case STATE_CHUNK_DATA_LF:
+                if (c != '\n') {
+                    return fail(decoder, DIVULGE_BODY_ERROR_BAD_CHUNK);
+                }
+                decoder->state = STATE_CHUNK_SIZE;
+                break;
+            case STATE_TRAILER_START:
+                decoder->state = (c == '\r') ? STATE_LAST_LF : STATE_TRAILER;
+                break;
+            case STATE_TRAILER:
+                if (c == '\r') {
+                    decoder->state = STATE_TRAILER_LF;
+                }
+                break;
+            case STATE_TRAILER_LF:
+            case STATE_LAST_LF:
+                if (c != '\n') {
+                    return fail(decoder, DIVULGE_BODY_ERROR_BAD_CHUNK);
+                }
+                decoder->line_size = 0;
+                decoder->state = (decoder->state == STATE_LAST_LF) ? STATE_DONE : STATE_TRAILER_START;
+                break;
+            default:
+                return fail(decoder, DIVULGE_BODY_ERROR_BAD_CHUNK);
+        }
+        p++;
+    }
+    *consumed = p;
+    *produced = output;
+    return (decoder->state == STATE_DONE) ? DIVULGE_BODY_STATUS_COMPLETE : DIVULGE_BODY_STATUS_INCOMPLETE;
+}
+
+divulge_body_status_t divulge_body_decode(divulge_body_decoder_t* decoder,
+                                          char* data,
+                                          size_t size,
+                                          size_t* consumed,
+                                          size_t* produced) {
+    if (!decoder || !consumed || !produced || (!data && (size > 0))) {
+        return DIVULGE_BODY_STATUS_ERROR;
+    }
+    *consumed = 0;
+    *produced = 0;
+    if (decoder->state == STATE_ERROR) {
+        return DIVULGE_BODY_STATUS_ERROR;
+    }
+    if (decoder->state == STATE_DONE) {
+        return DIVULGE_BODY_STATUS_COMPLETE;
+    }
+    if (decoder->is_chunked) {
+        return decode_chunked(decoder, data, size, consumed, produced);
+    }
+    size_t count = (size < decoder->remaining) ? size : decoder->remaining;
+    decoder->remaining -= count;
+    decoder->decoded_size += count;
+    *consumed = count;
+    *produced = count;
+    if (decoder->remaining == 0) {
+        decoder->state = STATE_DONE;
+        return DIVULGE_BODY_STATUS_COMPLETE;
+    }
+    return DIVULGE_BODY_STATUS_INCOMPLETE;
+}
+
+int divulge_body_get_error_status(const divulge_body_decoder_t* decoder) {
+    if (decoder && (decoder->error == DIVULGE_BODY_ERROR_TOO_LARGE)) {
+        return 413;
+    }
+    return 400;
+}
@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_BODY_H
+#define DIVULGE_BODY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+/**
+ * @defgroup divulge-body Divulge request body decoder
+ * @ingroup divulge
+ * @brief Resumable, in-place decoding of `Content-Length` and chunked request bodies
+ *
+ * The decoder is given the body bytes as they arrive and strips the chunked framing by moving the chunk data
+ * to the front of the same bytes, so no other buffer is needed and the body can be consumed in pieces of any
+ * size. It remembers where it stopped, including in the middle of a chunk-size line or of the trailers.
+ * @{
+ */
+#define DIVULGE_BODY_MAX_CHUNK_LINE_SIZE (4096)
+
+typedef enum divulge_body_status {
+    DIVULGE_BODY_STATUS_INCOMPLETE,
+    DIVULGE_BODY_STATUS_COMPLETE,
+    DIVULGE_BODY_STATUS_ERROR,
+} divulge_body_status_t;
+
+typedef enum divulge_body_error {
+    DIVULGE_BODY_ERROR_NONE,
+    DIVULGE_BODY_ERROR_BAD_CHUNK,
+    DIVULGE_BODY_ERROR_TOO_LARGE,
+} divulge_body_error_t;
+
+typedef struct divulge_body_decoder {
+    size_t remaining;    /**< bytes left in the body or in the current chunk */
+    size_t decoded_size; /**< body bytes produced so far */
+    size_t max_size;
+    size_t line_size;
+    bool is_chunked;
+    bool has_digits;
+    int state;
+    divulge_body_error_t error;
+} divulge_body_decoder_t;
+
+/**
+ * @param is_chunked whether the body uses the chunked transfer coding, otherwise it is `content_length` long
+ * @param max_size larger bodies fail with DIVULGE_BODY_ERROR_TOO_LARGE, as soon as their size is known
+ */
+void divulge_body_decoder_initialize(divulge_body_decoder_t* decoder,
+                                     bool is_chunked,
+                                     size_t content_length,
+                                     size_t max_size);
+
+/**
+ * @brief Decode the next received bytes of the body
+ * @param data received bytes; the decoded body bytes are written to its beginning
+ * @param size number of received bytes
+ * @param consumed number of received bytes that belonged to the body, the rest follows it
+ * @param produced number of decoded body bytes now at the beginning of `data`
+ */
+divulge_body_status_t divulge_body_decode(divulge_body_decoder_t* decoder,
+                                          char* data,
+                                          size_t size,
+                                          size_t* consumed,
+                                          size_t* produced);
+
+/**
+ * @brief HTTP status code best describing the decoder error
+ */
+int divulge_body_get_error_status(const divulge_body_decoder_t* decoder);
+/**
+ * @}
+ */
+#endif  // DIVULGE_BODY_H
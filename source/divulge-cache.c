@@ -0,0 +1,516 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-cache.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "divulge-time.h"
+#ifdef DIVULGE_COMPRESSION
+#include "divulge-compression.h"
+#endif
+
+#define CACHE_SHARD_COUNT (16)
+#define CACHE_BUCKET_COUNT (64)
+#define CACHE_MAX_KEY_SIZE (1024)
+#define CACHE_MAX_QUERY_PARAMETERS (32)
+#define CACHE_INITIAL_CAPTURE_SIZE (1024)
+#define CACHE_STATUS_OK "HTTP/1.1 200 "
+#ifdef DIVULGE_COMPRESSION
+#define CACHE_IS_KEYING_CODINGS (true)
+#else
+#define CACHE_IS_KEYING_CODINGS (false)
+#endif
+
+/*
+ * An entry is filling while the request that missed it runs the handler; requests for the same key wait for
+ * it. An entry without data tells that the response could not be cached: requests run the handler directly
+ * until it expires.
+ */
+typedef struct cache_entry {
+    struct cache_entry* next_in_bucket;
+    struct cache_entry* newer;
+    struct cache_entry* older;
+    char* key;
+    size_t key_size;
+    uint32_t hash;
+    size_t references;
+    bool is_filling;
+    char* data;
+    size_t size;
+    size_t header_size;
+    uint64_t expires_at_ms;
+} cache_entry_t;
+
+typedef struct cache_shard {
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    cache_entry_t* buckets[CACHE_BUCKET_COUNT];
+    cache_entry_t* newest;
+    cache_entry_t* oldest;
+    size_t size;
+} cache_shard_t;
+
+typedef struct divulge_cache_context {
+    divulge_cache_configuration_t configuration;
+    size_t max_shard_size;
+    cache_shard_t shards[CACHE_SHARD_COUNT];
+} divulge_cache_context_t;
+
+typedef struct cache_capture {
+    divulge_cache_context_t* ctx;
+    cache_shard_t* shard;
+    cache_entry_t* entry;
+    char* data;
+    size_t size;
+    size_t capacity;
+    bool is_too_large;
+} cache_capture_t;
+
+static uint32_t hash_key(const char* key, size_t key_size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < key_size; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int compare_slices(const void* a, const void* b) {
+    const divulge_slice_t* left = a;
+    const divulge_slice_t* right = b;
+    size_t size = (left->size < right->size) ? left->size : right->size;
+    int result = memcmp(left->data, right->data, size);
+    if (result != 0) {
+        return result;
+    }
+    return (left->size > right->size) - (left->size < right->size);
+}
+
+static bool append_to_key(char* key, size_t* key_size, const char* data, size_t size) {
+    if ((*key_size + size) > CACHE_MAX_KEY_SIZE) {
+        return false;
+    }
+    memcpy(key + *key_size, data, size);
+    *key_size += size;
+    return true;
+}
+
+/*
+ * The key is the path followed by the query parameters in sorted order, so that "?a=1&b=2" and "?b=2&a=1" share
+ * an entry, and by the content coding negotiated with the client, which a request target cannot contain.
+ */
+static bool build_key(divulge_request_t* request, char* key, size_t* key_size) {
+    divulge_slice_t parameters[CACHE_MAX_QUERY_PARAMETERS];
+    size_t parameter_count = 0;
+    const char* query = request->url_query.data;
+    size_t query_size = request->url_query.data ? request->url_query.size : 0;
+    size_t start = 0;
+    while (start < query_size) {
+        const char* ampersand = memchr(query + start, '&', query_size - start);
+        size_t end = ampersand ? (size_t)(ampersand - query) : query_size;
+        if (end > start) {
+            if (parameter_count == CACHE_MAX_QUERY_PARAMETERS) {
+                return false;
+            }
+            parameters[parameter_count++] = (divulge_slice_t){.data = query + start, .size = end - start};
+        }
+        start = end + 1;
+    }
+    qsort(parameters, parameter_count, sizeof(divulge_slice_t), compare_slices);
+    *key_size = 0;
+    if (!append_to_key(key, key_size, request->route.data, request->route.size)) {
+        return false;
+    }
+    for (size_t i = 0; i < parameter_count; i++) {
+        if (!append_to_key(key, key_size, (i == 0) ? "?" : "&", 1) ||
+            !append_to_key(key, key_size, parameters[i].data, parameters[i].size)) {
+            return false;
+        }
+    }
+#ifdef DIVULGE_COMPRESSION
+    divulge_content_coding_t coding = divulge_negotiate_content_coding(request);
+    if (coding != DIVULGE_CONTENT_CODING_IDENTITY) {
+        const char* name = divulge_content_coding_name(coding);
+        if (!append_to_key(key, key_size, " ", 1) || !append_to_key(key, key_size, name, strlen(name))) {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+static cache_entry_t** find_slot(cache_shard_t* shard, const char* key, size_t key_size, uint32_t hash) {
+    cache_entry_t** slot = shard->buckets + ((hash / CACHE_SHARD_COUNT) % CACHE_BUCKET_COUNT);
+    while (*slot) {
+        if (((*slot)->hash == hash) && ((*slot)->key_size == key_size) && (memcmp((*slot)->key, key, key_size) == 0)) {
+            break;
+        }
+        slot = &(*slot)->next_in_bucket;
+    }
+    return slot;
+}
+
+static void free_entry(cache_entry_t* entry) {
+    free(entry->data);
+    free(entry->key);
+    free(entry);
+}
+
+static void unlink_from_lru(cache_shard_t* shard, cache_entry_t* entry) {
+    if (entry->newer) {
+        entry->newer->older = entry->older;
+    } else if (shard->newest == entry) {
+        shard->newest = entry->older;
+    }
+    if (entry->older) {
+        entry->older->newer = entry->newer;
+    } else if (shard->oldest == entry) {
+        shard->oldest = entry->newer;
+    }
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+static void link_as_newest(cache_shard_t* shard, cache_entry_t* entry) {
+    entry->older = shard->newest;
+    entry->newer = NULL;
+    if (shard->newest) {
+        shard->newest->newer = entry;
+    }
+    shard->newest = entry;
+    if (!shard->oldest) {
+        shard->oldest = entry;
+    }
+}
+
+static void release_entry_locked(cache_entry_t* entry) {
+    if (--entry->references == 0) {
+        free_entry(entry);
+    }
+}
+
+static void release_entry(cache_shard_t* shard, cache_entry_t* entry) {
+    pthread_mutex_lock(&shard->lock);
+    release_entry_locked(entry);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+static void remove_entry(cache_shard_t* shard, cache_entry_t* entry) {
+    cache_entry_t** slot = find_slot(shard, entry->key, entry->key_size, entry->hash);
+    if (*slot == entry) {
+        *slot = entry->next_in_bucket;
+    }
+    if (!entry->is_filling) {
+        unlink_from_lru(shard, entry);
+        shard->size -= entry->size + entry->key_size;
+    }
+    release_entry_locked(entry);
+}
+
+static void evict_entries(cache_shard_t* shard, size_t max_size, const cache_entry_t* keep) {
+    while ((shard->size > max_size) && shard->oldest && (shard->oldest != keep)) {
+        remove_entry(shard, shard->oldest);
+    }
+}
+
+static cache_entry_t* insert_filling_entry(cache_shard_t* shard, const char* key, size_t key_size, uint32_t hash) {
+    cache_entry_t* entry = calloc(1, sizeof(cache_entry_t));
+    char* key_copy = malloc(key_size);
+    if (!entry || !key_copy) {
+        free(entry);
+        free(key_copy);
+        return NULL;
+    }
+    memcpy(key_copy, key, key_size);
+    entry->key = key_copy;
+    entry->key_size = key_size;
+    entry->hash = hash;
+    entry->references = 1;
+    entry->is_filling = true;
+    cache_entry_t** slot = find_slot(shard, key, key_size, hash);
+    entry->next_in_bucket = *slot;
+    *slot = entry;
+    return entry;
+}
+
+static void capture_write(void* context, const char* data, size_t size) {
+    cache_capture_t* capture = context;
+    if (capture->is_too_large) {
+        return;
+    }
+    if ((capture->size + size) > capture->ctx->configuration.max_entry_size) {
+        capture->is_too_large = true;
+        return;
+    }
+    if ((capture->size + size) > capture->capacity) {
+        size_t capacity = capture->capacity ? capture->capacity : CACHE_INITIAL_CAPTURE_SIZE;
+        while (capacity < (capture->size + size)) {
+            capacity *= 2;
+        }
+        char* captured = realloc(capture->data, capacity);
+        if (!captured) {
+            capture->is_too_large = true;
+            return;
+        }
+        capture->data = captured;
+        capture->capacity = capacity;
+    }
+    memcpy(capture->data + capture->size, data, size);
+    capture->size += size;
+}
+
+static size_t find_header_size(const char* data, size_t size) {
+    for (size_t i = 0; (i + 4) <= size; i++) {
+        if (memcmp(data + i, "\r\n\r\n", 4) == 0) {
+            return i + 2;
+        }
+    }
+    return 0;
+}
+
+static bool is_field_equal(const char* data, size_t size, const char* text) {
+    return (size == strlen(text)) && (strncasecmp(data, text, size) == 0);
+}
+
+static bool is_cache_control_private(const char* value, size_t size) {
+    size_t start = 0;
+    while (start < size) {
+        const char* comma = memchr(value + start, ',', size - start);
+        size_t end = comma ? (size_t)(comma - value) : size;
+        while ((start < end) && ((value[start] == ' ') || (value[start] == '\t'))) {
+            start++;
+        }
+        const char* equals = memchr(value + start, '=', end - start);
+        size_t directive_end = equals ? (size_t)(equals - value) : end;
+        while ((directive_end > start) && ((value[directive_end - 1] == ' ') || (value[directive_end - 1] == '\t'))) {
+            directive_end--;
+        }
+        if (is_field_equal(value + start, directive_end - start, "no-store") ||
+            is_field_equal(value + start, directive_end - start, "private")) {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+/*
+ * Responses meant for one client only, setting cookies or marked no-store or private, are not cached. Neither are
+ * those varying on request headers the key does not hold, as they would be replayed to clients that sent other
+ * values.
+ */
+static bool is_header_block_cacheable(const char* data, size_t header_size) {
+    const char* line = memchr(data, '\n', header_size);
+    const char* end = data + header_size;
+    while (line && ((line + 1) < end)) {
+        line++;
+        const char* line_end = memchr(line, '\r', (size_t)(end - line));
+        const char* colon = memchr(line, ':', (size_t)(end - line));
+        if (!line_end || !colon || (colon > line_end)) {
+            return false;
+        }
+        const char* value = colon + 1;
+        while ((value < line_end) && ((*value == ' ') || (*value == '\t'))) {
+            value++;
+        }
+        size_t name_size = (size_t)(colon - line);
+        size_t value_size = (size_t)(line_end - value);
+        if (is_field_equal(line, name_size, "Vary") &&
+            (!CACHE_IS_KEYING_CODINGS || !is_field_equal(value, value_size, "Accept-Encoding"))) {
+            return false;
+        }
+        if (is_field_equal(line, name_size, "Content-Encoding") && !CACHE_IS_KEYING_CODINGS) {
+            return false;
+        }
+        if (is_field_equal(line, name_size, "Set-Cookie") ||
+            (is_field_equal(line, name_size, "Cache-Control") && is_cache_control_private(value, value_size))) {
+            return false;
+        }
+        line = line_end + 1;
+    }
+    return true;
+}
+
+static bool is_capture_cacheable(const cache_capture_t* capture, size_t* header_size) {
+    size_t status_size = strlen(CACHE_STATUS_OK);
+    if (capture->is_too_large || (capture->size < status_size) ||
+        (memcmp(capture->data, CACHE_STATUS_OK, status_size) != 0)) {
+        return false;
+    }
+    *header_size = find_header_size(capture->data, capture->size);
+    return (*header_size > 0) && is_header_block_cacheable(capture->data, *header_size);
+}
+
+static void capture_finish(void* context, bool is_complete) {
+    cache_capture_t* capture = context;
+    cache_shard_t* shard = capture->shard;
+    cache_entry_t* entry = capture->entry;
+    size_t header_size = 0;
+    bool is_cacheable = is_complete && is_capture_cacheable(capture, &header_size);
+    pthread_mutex_lock(&shard->lock);
+    entry->is_filling = false;
+    entry->expires_at_ms = divulge_get_time_ms() + capture->ctx->configuration.time_to_live_ms;
+    if (is_cacheable) {
+        entry->data = capture->data;
+        entry->size = capture->size;
+        entry->header_size = header_size;
+        capture->data = NULL;
+    }
+    link_as_newest(shard, entry);
+    shard->size += entry->size + entry->key_size;
+    evict_entries(shard, capture->ctx->max_shard_size, entry);
+    pthread_cond_broadcast(&shard->filled);
+    pthread_mutex_unlock(&shard->lock);
+    free(capture->data);
+}
+
+static void start_capture(divulge_request_t* request,
+                          divulge_cache_context_t* ctx,
+                          cache_shard_t* shard,
+                          cache_entry_t* entry) {
+    cache_capture_t* capture = divulge_request_alloc(request, sizeof(cache_capture_t));
+    if (capture) {
+        *capture = (cache_capture_t){.ctx = ctx, .shard = shard, .entry = entry};
+        divulge_response_observer_t observer = {.write = capture_write, .finish = capture_finish, .context = capture};
+        if (divulge_observe_response(request, &observer)) {
+            return;
+        }
+    }
+    pthread_mutex_lock(&shard->lock);
+    remove_entry(shard, entry);
+    pthread_cond_broadcast(&shard->filled);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+static struct timespec get_wait_deadline(unsigned wait_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += wait_ms / 1000;
+    deadline.tv_nsec += (long)(wait_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return deadline;
+}
+
+static bool middleware(divulge_request_t* request, void* context) {
+    divulge_cache_context_t* ctx = (divulge_cache_context_t*)context;
+    char key[CACHE_MAX_KEY_SIZE];
+    size_t key_size = 0;
+    bool is_head = (request->method == DIVULGE_ROUTE_METHOD_HEAD);
+    if (((request->method != DIVULGE_ROUTE_METHOD_GET) && !is_head) || !build_key(request, key, &key_size)) {
+        return true;
+    }
+    divulge_slice_t authorization;
+    if (divulge_find_request_header(request, "Authorization", &authorization)) {
+        /* the response may hold what only these credentials may see */
+        return true;
+    }
+    uint32_t hash = hash_key(key, key_size);
+    cache_shard_t* shard = ctx->shards + (hash % CACHE_SHARD_COUNT);
+    pthread_mutex_lock(&shard->lock);
+    cache_entry_t* entry = *find_slot(shard, key, key_size, hash);
+    struct timespec deadline = get_wait_deadline(ctx->configuration.max_wait_ms);
+    while (entry && entry->is_filling) {
+        int result = pthread_cond_timedwait(&shard->filled, &shard->lock, &deadline);
+        entry = *find_slot(shard, key, key_size, hash);
+        if ((result == ETIMEDOUT) && entry && entry->is_filling) {
+            /* the filling response is slow: run the handler rather than hold this thread any longer */
+            pthread_mutex_unlock(&shard->lock);
+            return true;
+        }
+    }
+    if (entry && (divulge_get_time_ms() < entry->expires_at_ms)) {
+        if (!entry->data) {
+            pthread_mutex_unlock(&shard->lock);
+            return true;
+        }
+        entry->references++;
+        unlink_from_lru(shard, entry);
+        link_as_newest(shard, entry);
+        pthread_mutex_unlock(&shard->lock);
+        divulge_respond_serialized(request, entry->data, entry->size, entry->header_size);
+        release_entry(shard, entry);
+        return false;
+    }
+    if (is_head) {
+        /* HEAD is answered from a GET entry, but its response has no body to fill one with */
+        pthread_mutex_unlock(&shard->lock);
+        return true;
+    }
+    if (entry) {
+        remove_entry(shard, entry);
+    }
+    entry = insert_filling_entry(shard, key, key_size, hash);
+    pthread_mutex_unlock(&shard->lock);
+    if (entry) {
+        start_capture(request, ctx, shard, entry);
+    }
+    return true;
+}
+
+divulge_handler_object_t* divulge_cache_create(const divulge_cache_configuration_t* configuration) {
+    divulge_handler_object_t* object = calloc(1, sizeof(divulge_handler_object_t));
+    if (!object) {
+        return NULL;
+    }
+    divulge_cache_context_t* ctx = calloc(1, sizeof(divulge_cache_context_t));
+    if (!ctx) {
+        free(object);
+        return NULL;
+    }
+    if (configuration) {
+        ctx->configuration = *configuration;
+    }
+    if (ctx->configuration.time_to_live_ms == 0) {
+        ctx->configuration.time_to_live_ms = DIVULGE_CACHE_DEFAULT_TIME_TO_LIVE_MS;
+    }
+    if (ctx->configuration.max_size == 0) {
+        ctx->configuration.max_size = DIVULGE_CACHE_DEFAULT_MAX_SIZE;
+    }
+    if (ctx->configuration.max_entry_size == 0) {
+        ctx->configuration.max_entry_size = DIVULGE_CACHE_DEFAULT_MAX_ENTRY_SIZE;
+    }
+    if (ctx->configuration.max_wait_ms == 0) {
+        ctx->configuration.max_wait_ms = DIVULGE_CACHE_DEFAULT_MAX_WAIT_MS;
+    }
+    ctx->max_shard_size = ctx->configuration.max_size / CACHE_SHARD_COUNT;
+    if (ctx->configuration.max_entry_size > ctx->max_shard_size) {
+        ctx->configuration.max_entry_size = ctx->max_shard_size;
+    }
+    pthread_condattr_t condition_attributes;
+    pthread_condattr_init(&condition_attributes);
+    pthread_condattr_setclock(&condition_attributes, CLOCK_MONOTONIC);
+    for (size_t i = 0; i < CACHE_SHARD_COUNT; i++) {
+        pthread_mutex_init(&ctx->shards[i].lock, NULL);
+        pthread_cond_init(&ctx->shards[i].filled, &condition_attributes);
+    }
+    pthread_condattr_destroy(&condition_attributes);
+    object->context = ctx;
+    object->handler = middleware;
+    return object;
+}
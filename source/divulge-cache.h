@@ -0,0 +1,69 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_CACHE_H
+#define DIVULGE_CACHE_H
+
+#include <stddef.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-cache Divulge response cache
+ * @ingroup divulge
+ * @brief Middleware replaying serialized GET responses
+ *
+ * The cache is added to a route with divulge_add_middleware_to_uri(), after any authentication middleware, as a hit
+ * skips the middlewares that follow it; create one per route to give each its own time to live and size budget.
+ * Requests with an `Authorization` header bypass the cache, and responses with `Set-Cookie` or a `Cache-Control` of
+ * `no-store` or `private` are not cached. Successful (200) responses are captured as sent, keyed by path and query
+ * with the query parameters sorted, and replayed in a single send until they expire, without running the rest of
+ * the middlewares nor the handler. When built with compression, the key also holds the content coding negotiated
+ * from `Accept-Encoding`; responses with any other `Vary`, or with a `Content-Encoding` otherwise, are not cached.
+ * Entries are spread over independently locked LRU shards. When several requests miss the same key at once, only
+ * the first one runs the handler and the others wait for its response. The wait blocks the calling thread, such as
+ * a reactor with all its connections, so it lasts at most `max_wait_ms`; then the request runs the handler itself.
+ * HEAD requests are answered from the GET entries but do not fill them.
+ * Available on POSIX systems.
+ * @{
+ */
+#define DIVULGE_CACHE_DEFAULT_TIME_TO_LIVE_MS (1000)
+#define DIVULGE_CACHE_DEFAULT_MAX_SIZE (4 * 1024 * 1024)
+#define DIVULGE_CACHE_DEFAULT_MAX_ENTRY_SIZE (256 * 1024)
+#define DIVULGE_CACHE_DEFAULT_MAX_WAIT_MS (50)
+
+typedef struct divulge_cache_configuration {
+    unsigned time_to_live_ms; /**< 0 for DIVULGE_CACHE_DEFAULT_TIME_TO_LIVE_MS */
+    size_t max_size;          /**< bytes of all responses, 0 for DIVULGE_CACHE_DEFAULT_MAX_SIZE */
+    size_t max_entry_size;    /**< larger responses are not cached, 0 for DIVULGE_CACHE_DEFAULT_MAX_ENTRY_SIZE */
+    unsigned max_wait_ms;     /**< longest wait for a coalesced response, 0 for DIVULGE_CACHE_DEFAULT_MAX_WAIT_MS */
+} divulge_cache_configuration_t;
+
+/**
+ * @brief Create a caching middleware
+ * @param configuration configuration, NULL for the defaults
+ * @return middleware object or NULL
+ */
+divulge_handler_object_t* divulge_cache_create(const divulge_cache_configuration_t* configuration);
+/**
+ * @}
+ */
+#endif  // DIVULGE_CACHE_H
@@ -0,0 +1,277 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-compression.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define ZLIB_WINDOW_BITS (15)
+#define ZLIB_GZIP_WINDOW_BITS (ZLIB_WINDOW_BITS + 16)
+#define ZLIB_MEMORY_LEVEL (8)
+#define QUALITY_UNSET (-1)
+#define QUALITY_MAX (1000)
+
+typedef struct compressed_variant {
+    char* data;
+    size_t size;
+} compressed_variant_t;
+
+typedef struct divulge_compressed_payload {
+    const char* content_type;
+    compressed_variant_t variants[DIVULGE_CONTENT_CODING_COUNT];
+} divulge_compressed_payload_t;
+
+static const char* compressible_types[] = {
+    "application/json",
+    "application/javascript",
+    "application/xml",
+    "application/wasm",
+    "image/svg+xml",
+};
+
+static bool is_token_equal(const char* data, size_t size, const char* token) {
+    if (strlen(token) != size) {
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        char c = data[i];
+        if ((char)(((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c) != token[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool has_prefix(const char* text, size_t text_size, const char* prefix) {
+    size_t prefix_size = strlen(prefix);
+    return (text_size >= prefix_size) && is_token_equal(text, prefix_size, prefix);
+}
+
+bool divulge_is_compressible(const char* content_type, size_t size) {
+    if (!content_type || (size < DIVULGE_COMPRESSION_MIN_SIZE)) {
+        return false;
+    }
+    const char* parameters = strchr(content_type, ';');
+    size_t type_size = parameters ? (size_t)(parameters - content_type) : strlen(content_type);
+    while ((type_size > 0) && (content_type[type_size - 1] == ' ')) {
+        type_size--;
+    }
+    if (has_prefix(content_type, type_size, "text/")) {
+        return true;
+    }
+    bool has_structured_suffix = (type_size > 5) && (is_token_equal(content_type + type_size - 5, 5, "+json") ||
+                                                     is_token_equal(content_type + type_size - 4, 4, "+xml"));
+    if (has_structured_suffix) {
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(compressible_types) / sizeof(compressible_types[0]); i++) {
+        if (is_token_equal(content_type, type_size, compressible_types[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Parses "q=0.5" style weights into thousandths, as RFC 9110 allows at most three decimals.
+ */
+static int parse_quality(const char* data, size_t size) {
+    size_t i = 0;
+    while ((i < size) && (data[i] == ' ')) {
+        i++;
+    }
+    if (((size - i) < 2) || ((data[i] != 'q') && (data[i] != 'Q')) || (data[i + 1] != '=')) {
+        return QUALITY_UNSET;
+    }
+    i += 2;
+    if ((i >= size) || ((data[i] != '0') && (data[i] != '1'))) {
+        return 0;
+    }
+    int quality = (data[i] - '0') * QUALITY_MAX;
+    i++;
+    if ((i < size) && (data[i] == '.')) {
+        int scale = QUALITY_MAX / 10;
+        for (i++; (i < size) && (data[i] >= '0') && (data[i] <= '9') && (scale > 0); i++, scale /= 10) {
+            quality += (data[i] - '0') * scale;
+        }
+    }
+    return (quality > QUALITY_MAX) ? QUALITY_MAX : quality;
+}
+
+static void parse_coding(const char* data, size_t size, int qualities[DIVULGE_CONTENT_CODING_COUNT], int* any) {
+    size_t name_size = 0;
+    while ((name_size < size) && (data[name_size] != ';') && (data[name_size] != ' ') && (data[name_size] != '\t')) {
+        name_size++;
+    }
+    const char* parameters = memchr(data, ';', size);
+    int quality = parameters ? parse_quality(parameters + 1, size - (size_t)(parameters + 1 - data)) : QUALITY_UNSET;
+    quality = (quality == QUALITY_UNSET) ? QUALITY_MAX : quality;
+    if (is_token_equal(data, name_size, "gzip") || is_token_equal(data, name_size, "x-gzip")) {
+        qualities[DIVULGE_CONTENT_CODING_GZIP] = quality;
+    } else if (is_token_equal(data, name_size, "deflate")) {
+        qualities[DIVULGE_CONTENT_CODING_DEFLATE] = quality;
+    } else if (is_token_equal(data, name_size, "*")) {
+        *any = quality;
+    }
+}
+
+divulge_content_coding_t divulge_negotiate_content_coding(divulge_request_t* request) {
+    int qualities[DIVULGE_CONTENT_CODING_COUNT] = {QUALITY_UNSET, QUALITY_UNSET, QUALITY_UNSET};
+    int any = QUALITY_UNSET;
+    divulge_slice_t value;
+    size_t cursor = 0;
+    while (divulge_find_next_request_header(request, "Accept-Encoding", &cursor, &value)) {
+        size_t start = 0;
+        while (start < value.size) {
+            while ((start < value.size) && ((value.data[start] == ' ') || (value.data[start] == '\t'))) {
+                start++;
+            }
+            const char* comma = memchr(value.data + start, ',', value.size - start);
+            size_t end = comma ? (size_t)(comma - value.data) : value.size;
+            parse_coding(value.data + start, end - start, qualities, &any);
+            start = end + 1;
+        }
+    }
+    divulge_content_coding_t best = DIVULGE_CONTENT_CODING_IDENTITY;
+    int best_quality = 0;
+    for (int coding = DIVULGE_CONTENT_CODING_GZIP; coding < DIVULGE_CONTENT_CODING_COUNT; coding++) {
+        int quality = (qualities[coding] == QUALITY_UNSET) ? any : qualities[coding];
+        if (quality > best_quality) {
+            best = (divulge_content_coding_t)coding;
+            best_quality = quality;
+        }
+    }
+    return best;
+}
+
+const char* divulge_content_coding_name(divulge_content_coding_t coding) {
+    if (coding == DIVULGE_CONTENT_CODING_GZIP) {
+        return "gzip";
+    } else if (coding == DIVULGE_CONTENT_CODING_DEFLATE) {
+        return "deflate";
+    } else {
+        return "identity";
+    }
+}
+
+bool divulge_compress(divulge_content_coding_t coding,
+                      const char* data,
+                      size_t size,
+                      char** output,
+                      size_t* output_size) {
+    if (!data || !output || !output_size || (coding == DIVULGE_CONTENT_CODING_IDENTITY) ||
+        (coding >= DIVULGE_CONTENT_CODING_COUNT) || (size > UINT32_MAX)) {
+        return false;
+    }
+    z_stream stream = {0};
+    int window_bits = (coding == DIVULGE_CONTENT_CODING_GZIP) ? ZLIB_GZIP_WINDOW_BITS : ZLIB_WINDOW_BITS;
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, window_bits, ZLIB_MEMORY_LEVEL, Z_DEFAULT_STRATEGY) !=
+        Z_OK) {
+        return false;
+    }
+    size_t capacity = deflateBound(&stream, (uLong)size);
+    char* compressed = malloc(capacity);
+    bool result = false;
+    if (compressed) {
+        stream.next_in = (Bytef*)data;
+        stream.avail_in = (uInt)size;
+        stream.next_out = (Bytef*)compressed;
+        stream.avail_out = (uInt)capacity;
+        result = (deflate(&stream, Z_FINISH) == Z_STREAM_END) && (stream.total_out < size);
+    }
+    deflateEnd(&stream);
+    if (!result) {
+        free(compressed);
+        return false;
+    }
+    *output = compressed;
+    *output_size = stream.total_out;
+    return true;
+}
+
+divulge_compressed_payload_t* divulge_compressed_payload_create(const char* content_type,
+                                                                const char* data,
+                                                                size_t size) {
+    if (!content_type || !data) {
+        return NULL;
+    }
+    divulge_compressed_payload_t* payload = calloc(1, sizeof(divulge_compressed_payload_t));
+    if (!payload) {
+        return NULL;
+    }
+    payload->content_type = content_type;
+    compressed_variant_t* identity = payload->variants + DIVULGE_CONTENT_CODING_IDENTITY;
+    identity->data = malloc(size ? size : 1);
+    if (!identity->data) {
+        free(payload);
+        return NULL;
+    }
+    memcpy(identity->data, data, size);
+    identity->size = size;
+    if (divulge_is_compressible(content_type, size)) {
+        for (int coding = DIVULGE_CONTENT_CODING_GZIP; coding < DIVULGE_CONTENT_CODING_COUNT; coding++) {
+            compressed_variant_t* variant = payload->variants + coding;
+            divulge_compress((divulge_content_coding_t)coding, data, size, &variant->data, &variant->size);
+        }
+    }
+    return payload;
+}
+
+void divulge_compressed_payload_destroy(divulge_compressed_payload_t* payload) {
+    if (!payload) {
+        return;
+    }
+    for (int coding = 0; coding < DIVULGE_CONTENT_CODING_COUNT; coding++) {
+        free(payload->variants[coding].data);
+    }
+    free(payload);
+}
+
+bool divulge_respond_compressed(divulge_request_t* request,
+                                int return_code,
+                                const divulge_compressed_payload_t* payload) {
+    if (!request || !payload) {
+        return false;
+    }
+    divulge_content_coding_t coding = divulge_negotiate_content_coding(request);
+    if (!payload->variants[coding].data) {
+        coding = DIVULGE_CONTENT_CODING_IDENTITY;
+    }
+    divulge_header_entry_t header_entries[] = {
+        {.key = "Content-Type", .value = payload->content_type},
+        {.key = "Vary", .value = "Accept-Encoding"},
+        {.key = "Content-Encoding", .value = divulge_content_coding_name(coding)},
+    };
+    bool is_varying = (payload->variants[DIVULGE_CONTENT_CODING_GZIP].data != NULL) ||
+                      (payload->variants[DIVULGE_CONTENT_CODING_DEFLATE].data != NULL);
+    size_t header_count = (coding != DIVULGE_CONTENT_CODING_IDENTITY) ? 3 : (is_varying ? 2 : 1);
+    divulge_response_t response = {
+        .return_code = return_code,
+        .header = {.entries = header_entries, .count = header_count},
+        .payload = payload->variants[coding].data,
+        .payload_size = payload->variants[coding].size,
+    };
+    return divulge_respond(request, &response);
+}
@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_COMPRESSION_H
+#define DIVULGE_COMPRESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-compression Divulge response compression
+ * @ingroup divulge
+ * @brief Accept-Encoding negotiation and precompressed payloads
+ *
+ * Payloads are compressed once, when they are created or first needed, and the variant matching the
+ * client's `Accept-Encoding` is picked per request. Available when Divulge is built with zlib
+ * (`DIVULGE_COMPRESSION` is defined then).
+ * @{
+ */
+#define DIVULGE_COMPRESSION_MIN_SIZE (256)
+
+typedef enum divulge_content_coding {
+    DIVULGE_CONTENT_CODING_IDENTITY,
+    DIVULGE_CONTENT_CODING_GZIP,
+    DIVULGE_CONTENT_CODING_DEFLATE,
+    DIVULGE_CONTENT_CODING_COUNT,
+} divulge_content_coding_t;
+
+typedef struct divulge_compressed_payload divulge_compressed_payload_t;
+
+/**
+ * @brief Pick the content coding preferred by the client, honouring q-values
+ */
+divulge_content_coding_t divulge_negotiate_content_coding(divulge_request_t* request);
+
+const char* divulge_content_coding_name(divulge_content_coding_t coding);
+
+/**
+ * @brief Tell whether compressing a payload is worth it: large enough and not compressed already
+ */
+bool divulge_is_compressible(const char* content_type, size_t size);
+
+/**
+ * @brief Compress data with a content coding
+ * @param output allocated compressed data, to be freed by the caller
+ * @return false on failure or when the result would not be smaller than the input
+ */
+bool divulge_compress(divulge_content_coding_t coding,
+                      const char* data,
+                      size_t size,
+                      char** output,
+                      size_t* output_size);
+
+/**
+ * @brief Create a payload with all its compressed variants
+ * @param content_type content type, must outlive the payload
+ * @param data payload, copied
+ */
+divulge_compressed_payload_t* divulge_compressed_payload_create(const char* content_type,
+                                                                const char* data,
+                                                                size_t size);
+
+void divulge_compressed_payload_destroy(divulge_compressed_payload_t* payload);
+
+/**
+ * @brief Respond with the payload variant negotiated with the client, adding `Vary: Accept-Encoding`
+ */
+bool divulge_respond_compressed(divulge_request_t* request,
+                                int return_code,
+                                const divulge_compressed_payload_t* payload);
+/**
+ * @}
+ */
+#endif  // DIVULGE_COMPRESSION_H
@@ -0,0 +1,117 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-date.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define DATE_WORDS ((DIVULGE_DATE_SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t))
+#define DATE_BEING_WRITTEN (UINT64_MAX)
+
+/*
+ * Sequence lock: `second` is DATE_BEING_WRITTEN while the words are rewritten and then holds the formatted second
+ * plus one, so a reader that copied the words meanwhile sees the mismatch and formats the date itself.
+ */
+static struct {
+    atomic_uint_fast64_t second;
+    atomic_uint_fast64_t words[DATE_WORDS];
+} date_cache;
+
+static const char day_names[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+
+static const char month_names[12][4] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+static void put_digits(char* output, int value, size_t count) {
+    for (size_t i = count; i > 0; i--) {
+        output[i - 1] = (char)('0' + (value % 10));
+        value /= 10;
+    }
+}
+
+void divulge_format_date(time_t time, char* date) {
+    if (!date) {
+        return;
+    }
+    struct tm fields;
+    gmtime_r(&time, &fields);
+    memcpy(date, "Sun, 00 Jan 0000 00:00:00 GMT", DIVULGE_DATE_SIZE);
+    memcpy(date, day_names[fields.tm_wday], 3);
+    put_digits(date + 5, fields.tm_mday, 2);
+    memcpy(date + 8, month_names[fields.tm_mon], 3);
+    put_digits(date + 12, fields.tm_year + 1900, 4);
+    put_digits(date + 17, fields.tm_hour, 2);
+    put_digits(date + 20, fields.tm_min, 2);
+    put_digits(date + 23, fields.tm_sec, 2);
+}
+
+static bool read_cached_date(uint64_t second, char* date) {
+    uint64_t words[DATE_WORDS];
+    if (atomic_load_explicit(&date_cache.second, memory_order_acquire) != second) {
+        return false;
+    }
+    for (size_t i = 0; i < DATE_WORDS; i++) {
+        words[i] = atomic_load_explicit(date_cache.words + i, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&date_cache.second, memory_order_relaxed) != second) {
+        return false;
+    }
+    memcpy(date, words, DIVULGE_DATE_SIZE);
+    return true;
+}
+
+/*
+ * Only one thread writes at a time, and never an older second over a newer one.
+ */
+static void write_cached_date(uint64_t second, const char* date) {
+    uint64_t cached = atomic_load_explicit(&date_cache.second, memory_order_relaxed);
+    if ((cached >= second) || !atomic_compare_exchange_strong_explicit(&date_cache.second, &cached,
+                                                                       DATE_BEING_WRITTEN, memory_order_relaxed,
+                                                                       memory_order_relaxed)) {
+        return;
+    }
+    uint64_t words[DATE_WORDS] = {0};
+    memcpy(words, date, DIVULGE_DATE_SIZE);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < DATE_WORDS; i++) {
+        atomic_store_explicit(date_cache.words + i, words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&date_cache.second, second, memory_order_release);
+}
+
+void divulge_get_date(char* date) {
+    if (!date) {
+        return;
+    }
+    time_t now = time(NULL);
+    uint64_t second = (uint64_t)now + 1;
+    if (read_cached_date(second, date)) {
+        return;
+    }
+    divulge_format_date(now, date);
+    write_cached_date(second, date);
+}
@@ -0,0 +1,53 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_DATE_H
+#define DIVULGE_DATE_H
+
+#include <time.h>
+/**
+ * @defgroup divulge-date Divulge date
+ * @ingroup divulge
+ * @brief Date header values, formatted once per second for all threads
+ *
+ * The first thread to need the date of a new second formats it into a process-wide cache, which the other
+ * threads copy under a sequence lock without formatting or locking.
+ * @{
+ */
+#define DIVULGE_DATE_SIZE (29)
+
+/**
+ * @brief Format a time as the IMF-fixdate of the Date header, like `Sun, 06 Nov 1994 08:49:37 GMT`
+ * @param date at least DIVULGE_DATE_SIZE bytes, not NUL-terminated
+ */
+void divulge_format_date(time_t time, char* date);
+
+/**
+ * @brief Get the current Date header value
+ * @param date at least DIVULGE_DATE_SIZE bytes, not NUL-terminated
+ */
+void divulge_get_date(char* date);
+/**
+ * @}
+ */
+#endif  // DIVULGE_DATE_H
@@ -0,0 +1,624 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include "divulge-epoll.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "divulge-listener.h"
+#include "divulge-time.h"
+#include "divulge-timer.h"
+
+#define EPOLL_MAX_EVENTS (256)
+#define EPOLL_INITIAL_QUEUE_SIZE (4096)
+#define EPOLL_MAX_SEGMENTS (16)
+#define EPOLL_TIMER_TICK_MS (10)
+
+typedef struct epoll_reactor epoll_reactor_t;
+
+typedef struct epoll_connection {
+    struct epoll_connection* previous;
+    struct epoll_connection* next;
+    struct epoll_connection* next_resumed;
+    struct epoll_connection* next_expired;
+    struct epoll_connection* next_released;
+    epoll_reactor_t* reactor;
+    int socket;
+    divulge_connection_t* connection;
+    uint8_t peer_address[16]; /**< IPv4 or IPv6 address of the client */
+    size_t peer_address_size;
+    char* queue;
+    size_t queue_offset;
+    size_t queue_size;
+    size_t queue_capacity;
+    uint32_t events; /**< events the socket is watched for */
+    bool is_receive_paused;
+    bool is_closing;
+    bool has_failed;
+    bool is_resume_queued;
+    bool is_released; /**< done, freed once the current batch of events was handled */
+} epoll_connection_t;
+
+typedef struct epoll_reactor {
+    divulge_epoll_t* epoll;
+    pthread_t thread;
+    size_t index;
+    int listener;
+    int poll;
+    int wakeup;
+    atomic_bool is_stop_requested;
+    epoll_connection_t* connections;
+    pthread_mutex_t resume_mutex;
+    epoll_connection_t* resumed;
+    divulge_timer_wheel_t timers;
+    bool is_advancing_timers;
+    epoll_connection_t* expired;  /**< closed by their timers, to be released */
+    epoll_connection_t* released; /**< done, to be freed once the current batch of events was handled */
+} epoll_reactor_t;
+
+typedef struct divulge_epoll {
+    divulge_t* divulge;
+    divulge_epoll_configuration_t configuration;
+    uint16_t port;
+    bool is_running;
+    epoll_reactor_t* reactors;
+} divulge_epoll_t;
+
+/*
+ * The listener and the wakeup event are told apart from connections by these sentinel pointers.
+ */
+static char listener_tag;
+static char wakeup_tag;
+
+static bool append_to_queue(epoll_connection_t* connection, const char* data, size_t size) {
+    if ((connection->queue_size + size) > connection->queue_capacity) {
+        if (connection->queue_offset > 0) {
+            memmove(connection->queue, connection->queue + connection->queue_offset,
+                    connection->queue_size - connection->queue_offset);
+            connection->queue_size -= connection->queue_offset;
+            connection->queue_offset = 0;
+        }
+        size_t capacity = connection->queue_capacity ? connection->queue_capacity : EPOLL_INITIAL_QUEUE_SIZE;
+        while (capacity < (connection->queue_size + size)) {
+            capacity *= 2;
+        }
+        if (capacity > connection->queue_capacity) {
+            char* queue = realloc(connection->queue, capacity);
+            if (!queue) {
+                connection->has_failed = true;
+                return false;
+            }
+            connection->queue = queue;
+            connection->queue_capacity = capacity;
+        }
+    }
+    memcpy(connection->queue + connection->queue_size, data, size);
+    connection->queue_size += size;
+    return true;
+}
+
+static bool is_queue_empty(const epoll_connection_t* connection) {
+    return connection->queue_offset == connection->queue_size;
+}
+
+static bool is_would_block(void) {
+    return (errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR);
+}
+
+/*
+ * Sends what the socket takes without blocking and returns how much that was, or -1 on a broken connection.
+ */
+static ssize_t send_vector_now(epoll_connection_t* connection, struct iovec* vectors, size_t vector_count) {
+    struct msghdr message = {.msg_iov = vectors, .msg_iovlen = vector_count};
+    ssize_t sent = sendmsg(connection->socket, &message, MSG_NOSIGNAL);
+    if ((sent < 0) && !is_would_block()) {
+        connection->has_failed = true;
+        return -1;
+    }
+    return (sent < 0) ? 0 : sent;
+}
+
+static void send_segments(epoll_connection_t* connection, const divulge_slice_t* segments, size_t segment_count) {
+    if (connection->has_failed) {
+        return;
+    }
+    size_t skipped = 0;
+    if (is_queue_empty(connection)) {
+        struct iovec vectors[EPOLL_MAX_SEGMENTS];
+        size_t vector_count = (segment_count < EPOLL_MAX_SEGMENTS) ? segment_count : EPOLL_MAX_SEGMENTS;
+        for (size_t i = 0; i < vector_count; i++) {
+            vectors[i] = (struct iovec){.iov_base = (void*)segments[i].data, .iov_len = segments[i].size};
+        }
+        ssize_t sent = send_vector_now(connection, vectors, vector_count);
+        if (sent < 0) {
+            return;
+        }
+        skipped = (size_t)sent;
+    }
+    for (size_t i = 0; i < segment_count; i++) {
+        if (skipped >= segments[i].size) {
+            skipped -= segments[i].size;
+            continue;
+        }
+        if (!append_to_queue(connection, segments[i].data + skipped, segments[i].size - skipped)) {
+            return;
+        }
+        skipped = 0;
+    }
+}
+
+static void socket_send(void* connection_context, const char* data, size_t data_size) {
+    divulge_slice_t segment = {.data = data, .size = data_size};
+    send_segments(connection_context, &segment, 1);
+}
+
+static void socket_send_vector(void* connection_context, const divulge_slice_t* segments, size_t segment_count) {
+    send_segments(connection_context, segments, segment_count);
+}
+
+/*
+ * Whatever sendfile() cannot take right away is read into the queue, as the transport never blocks on a socket.
+ */
+static bool socket_send_file(void* connection_context, int file_descriptor, size_t offset, size_t size) {
+    epoll_connection_t* connection = connection_context;
+    off_t file_offset = (off_t)offset;
+    while (is_queue_empty(connection) && (size > 0) && !connection->has_failed) {
+        ssize_t sent = sendfile(connection->socket, file_descriptor, &file_offset, size);
+        if (sent > 0) {
+            size -= (size_t)sent;
+        } else if ((sent == 0) || !is_would_block()) {
+            return false;
+        } else {
+            break;
+        }
+    }
+    char buffer[EPOLL_INITIAL_QUEUE_SIZE];
+    while ((size > 0) && !connection->has_failed) {
+        size_t piece_size = (size < sizeof(buffer)) ? size : sizeof(buffer);
+        ssize_t bytes_read = pread(file_descriptor, buffer, piece_size, file_offset);
+        if ((bytes_read <= 0) || !append_to_queue(connection, buffer, (size_t)bytes_read)) {
+            return false;
+        }
+        file_offset += bytes_read;
+        size -= (size_t)bytes_read;
+    }
+    return !connection->has_failed;
+}
+
+/*
+ * A connection closed by its timer is not being handled: it is queued for the reactor to release.
+ */
+static void socket_close(void* connection_context) {
+    epoll_connection_t* connection = connection_context;
+    epoll_reactor_t* reactor = connection->reactor;
+    if (reactor->is_advancing_timers && !connection->is_closing) {
+        connection->next_expired = reactor->expired;
+        reactor->expired = connection;
+    }
+    connection->is_closing = true;
+}
+
+static bool wake_reactor(epoll_reactor_t* reactor) {
+    uint64_t value = 1;
+    return write(reactor->wakeup, &value, sizeof(value)) == sizeof(value);
+}
+
+/*
+ * Runs on the thread giving a deferred response: the connection is queued for its reactor, which resumes it.
+ */
+static void socket_resume(void* connection_context) {
+    epoll_connection_t* connection = connection_context;
+    epoll_reactor_t* reactor = connection->reactor;
+    pthread_mutex_lock(&reactor->resume_mutex);
+    if (!connection->is_resume_queued) {
+        connection->is_resume_queued = true;
+        connection->next_resumed = reactor->resumed;
+        reactor->resumed = connection;
+    }
+    pthread_mutex_unlock(&reactor->resume_mutex);
+    wake_reactor(reactor);
+}
+
+static divulge_slice_t socket_peer_address(void* connection_context) {
+    epoll_connection_t* connection = connection_context;
+    divulge_slice_t address = {.data = (const char*)connection->peer_address, .size = connection->peer_address_size};
+    return address;
+}
+
+void divulge_epoll_prepare_configuration(divulge_configuration_t* configuration) {
+    if (!configuration) {
+        return;
+    }
+    configuration->send = socket_send;
+    configuration->send_vector = socket_send_vector;
+    configuration->send_file = socket_send_file;
+    configuration->close = socket_close;
+    configuration->resume = socket_resume;
+    configuration->peer_address = socket_peer_address;
+}
+
+/*
+ * Once the divulge connection is gone no deferred response can queue the connection any more.
+ */
+static void remove_from_resumed(epoll_connection_t* connection) {
+    epoll_reactor_t* reactor = connection->reactor;
+    pthread_mutex_lock(&reactor->resume_mutex);
+    if (connection->is_resume_queued) {
+        epoll_connection_t** link = &reactor->resumed;
+        while (*link != connection) {
+            link = &(*link)->next_resumed;
+        }
+        *link = connection->next_resumed;
+        connection->is_resume_queued = false;
+    }
+    pthread_mutex_unlock(&reactor->resume_mutex);
+}
+
+static void destroy_connection(epoll_connection_t* connection) {
+    epoll_reactor_t* reactor = connection->reactor;
+    connection->is_closing = true;
+    divulge_connection_destroy(connection->connection);
+    remove_from_resumed(connection);
+    epoll_ctl(reactor->poll, EPOLL_CTL_DEL, connection->socket, NULL);
+    close(connection->socket);
+    if (connection->previous) {
+        connection->previous->next = connection->next;
+    } else {
+        reactor->connections = connection->next;
+    }
+    if (connection->next) {
+        connection->next->previous = connection->previous;
+    }
+    free(connection->queue);
+    free(connection);
+}
+
+static bool watch(epoll_reactor_t* reactor, int operation, int socket, uint32_t events, void* data) {
+    struct epoll_event event = {.events = events, .data.ptr = data};
+    return epoll_ctl(reactor->poll, operation, socket, &event) == 0;
+}
+
+static void set_peer_address(epoll_connection_t* connection, const struct sockaddr_storage* address) {
+    if (address->ss_family == AF_INET) {
+        const struct sockaddr_in* address_in = (const struct sockaddr_in*)address;
+        memcpy(connection->peer_address, &address_in->sin_addr, sizeof(address_in->sin_addr));
+        connection->peer_address_size = sizeof(address_in->sin_addr);
+    } else if (address->ss_family == AF_INET6) {
+        const struct sockaddr_in6* address_in6 = (const struct sockaddr_in6*)address;
+        memcpy(connection->peer_address, &address_in6->sin6_addr, sizeof(address_in6->sin6_addr));
+        connection->peer_address_size = sizeof(address_in6->sin6_addr);
+    }
+}
+
+static void accept_connections(epoll_reactor_t* reactor) {
+    for (;;) {
+        struct sockaddr_storage address;
+        socklen_t address_size = sizeof(address);
+        int socket =
+            accept4(reactor->listener, (struct sockaddr*)&address, &address_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0) {
+            return;
+        }
+        epoll_connection_t* connection = calloc(1, sizeof(epoll_connection_t));
+        if (connection) {
+            connection->reactor = reactor;
+            connection->socket = socket;
+            connection->events = EPOLLIN;
+            set_peer_address(connection, &address);
+            connection->connection = divulge_connection_create(reactor->epoll->divulge, connection);
+            divulge_connection_watch(connection->connection, &reactor->timers);
+        }
+        if (!connection || !connection->connection || !watch(reactor, EPOLL_CTL_ADD, socket, EPOLLIN, connection)) {
+            if (connection) {
+                divulge_connection_destroy(connection->connection);
+            }
+            free(connection);
+            close(socket);
+            continue;
+        }
+        connection->next = reactor->connections;
+        if (reactor->connections) {
+            reactor->connections->previous = connection;
+        }
+        reactor->connections = connection;
+    }
+}
+
+static void flush_queue(epoll_connection_t* connection) {
+    while (!is_queue_empty(connection) && !connection->has_failed) {
+        struct iovec vector = {
+            .iov_base = connection->queue + connection->queue_offset,
+            .iov_len = connection->queue_size - connection->queue_offset,
+        };
+        ssize_t sent = send_vector_now(connection, &vector, 1);
+        if (sent <= 0) {
+            break;
+        }
+        connection->queue_offset += (size_t)sent;
+    }
+    if (is_queue_empty(connection)) {
+        connection->queue_offset = 0;
+        connection->queue_size = 0;
+    }
+}
+
+static void receive(epoll_connection_t* connection) {
+    size_t size = 0;
+    char* buffer = divulge_connection_get_receive_buffer(connection->connection, &size);
+    if (size == 0) {
+        connection->is_receive_paused = true;
+        return;
+    }
+    ssize_t received = recv(connection->socket, buffer, size, 0);
+    if (received > 0) {
+        divulge_connection_receive(connection->connection, (size_t)received);
+    } else if (received == 0) {
+        connection->is_closing = true;
+    } else if (!is_would_block()) {
+        connection->has_failed = true;
+    }
+}
+
+/*
+ * A connection is either read or, while responses are queued, written: not reading it meanwhile keeps a client
+ * that does not read its responses from making the queue grow. Nor is it read while its buffer is full of requests
+ * waiting behind a deferred response, until the connection is resumed. A connection that is done is only freed once the
+ * batch of events is handled, as later events of the batch may still refer to it.
+ */
+static void update_connection(epoll_connection_t* connection) {
+    if (connection->is_released) {
+        return;
+    }
+    bool is_done = connection->has_failed || (connection->is_closing && is_queue_empty(connection));
+    if (is_done) {
+        connection->is_released = true;
+        divulge_connection_watch(connection->connection, NULL);
+        connection->next_released = connection->reactor->released;
+        connection->reactor->released = connection;
+        return;
+    }
+    uint32_t events = !is_queue_empty(connection) ? EPOLLOUT : (connection->is_receive_paused ? 0 : EPOLLIN);
+    if (events != connection->events) {
+        connection->events = events;
+        watch(connection->reactor, EPOLL_CTL_MOD, connection->socket, events, connection);
+    }
+}
+
+static void handle_connection(epoll_connection_t* connection, uint32_t events) {
+    if (connection->is_released) {
+        return;
+    }
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        connection->has_failed = true;
+    }
+    if ((events & EPOLLOUT) && !connection->has_failed) {
+        flush_queue(connection);
+    } else if ((events & EPOLLIN) && !connection->has_failed && !connection->is_closing) {
+        receive(connection);
+    }
+    update_connection(connection);
+}
+
+static void resume_connections(epoll_reactor_t* reactor) {
+    pthread_mutex_lock(&reactor->resume_mutex);
+    epoll_connection_t* connection = reactor->resumed;
+    reactor->resumed = NULL;
+    for (epoll_connection_t* queued = connection; queued; queued = queued->next_resumed) {
+        queued->is_resume_queued = false;
+    }
+    pthread_mutex_unlock(&reactor->resume_mutex);
+    while (connection) {
+        epoll_connection_t* next = connection->next_resumed;
+        if (!connection->has_failed && !connection->is_closing) {
+            connection->is_receive_paused = false;
+            divulge_connection_resume(connection->connection);
+        }
+        update_connection(connection);
+        connection = next;
+    }
+}
+
+/*
+ * Runs after the batch of events, up to the time the batch was collected: bytes that arrived while it was handled
+ * are collected by the next wait before the deadlines they may have crossed meanwhile are checked.
+ * Connections over their deadline are dropped without flushing their queues, as their clients may not be reading.
+ */
+static void advance_timers(epoll_reactor_t* reactor, uint64_t now_ms) {
+    reactor->is_advancing_timers = true;
+    divulge_timer_wheel_advance(&reactor->timers, now_ms);
+    reactor->is_advancing_timers = false;
+    while (reactor->expired) {
+        epoll_connection_t* connection = reactor->expired;
+        reactor->expired = connection->next_expired;
+        connection->has_failed = true;
+        update_connection(connection);
+    }
+}
+
+static void release_connections(epoll_reactor_t* reactor) {
+    while (reactor->released) {
+        epoll_connection_t* connection = reactor->released;
+        reactor->released = connection->next_released;
+        destroy_connection(connection);
+    }
+}
+
+static void* run_reactor(void* argument) {
+    epoll_reactor_t* reactor = argument;
+    if (reactor->epoll->configuration.is_pinning_reactors) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(reactor->index % CPU_SETSIZE, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    divulge_timer_wheel_initialize(&reactor->timers, EPOLL_TIMER_TICK_MS, divulge_get_time_ms());
+    bool is_running = true;
+    while (is_running) {
+        int timeout = divulge_timer_wheel_get_timeout(&reactor->timers);
+        if (timeout > 0) {
+            uint64_t lag_ms = divulge_get_time_ms() - reactor->timers.now_ms;
+            timeout = (lag_ms < (uint64_t)timeout) ? timeout - (int)lag_ms : 0;
+        }
+        int event_count = epoll_wait(reactor->poll, events, EPOLL_MAX_EVENTS, timeout);
+        uint64_t now_ms = divulge_get_time_ms();
+        for (int i = 0; i < event_count; i++) {
+            if (events[i].data.ptr == &listener_tag) {
+                accept_connections(reactor);
+            } else if (events[i].data.ptr == &wakeup_tag) {
+                uint64_t value = 0;
+                if (read(reactor->wakeup, &value, sizeof(value)) == sizeof(value)) {
+                    is_running = !atomic_load(&reactor->is_stop_requested);
+                    resume_connections(reactor);
+                }
+            } else {
+                handle_connection(events[i].data.ptr, events[i].events);
+            }
+        }
+        advance_timers(reactor, now_ms);
+        release_connections(reactor);
+    }
+    while (reactor->connections) {
+        destroy_connection(reactor->connections);
+    }
+    return NULL;
+}
+
+static bool set_up_reactor(divulge_epoll_t* epoll, epoll_reactor_t* reactor) {
+    reactor->listener =
+        divulge_listener_create(epoll->configuration.address, epoll->port, epoll->configuration.backlog);
+    reactor->poll = epoll_create1(EPOLL_CLOEXEC);
+    reactor->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((reactor->listener < 0) || (reactor->poll < 0) || (reactor->wakeup < 0)) {
+        return false;
+    }
+    if (epoll->port == 0) {
+        epoll->port = divulge_listener_get_port(reactor->listener);
+    }
+    return watch(reactor, EPOLL_CTL_ADD, reactor->listener, EPOLLIN, &listener_tag) &&
+           watch(reactor, EPOLL_CTL_ADD, reactor->wakeup, EPOLLIN, &wakeup_tag);
+}
+
+static void close_if_open(int descriptor) {
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+}
+
+divulge_epoll_t* divulge_epoll_create(divulge_t* divulge, const divulge_epoll_configuration_t* configuration) {
+    if (!divulge || !configuration) {
+        return NULL;
+    }
+    divulge_epoll_t* epoll = calloc(1, sizeof(divulge_epoll_t));
+    if (!epoll) {
+        return NULL;
+    }
+    epoll->divulge = divulge;
+    epoll->configuration = *configuration;
+    if (epoll->configuration.reactor_count == 0) {
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        epoll->configuration.reactor_count = (cpu_count > 0) ? (size_t)cpu_count : 1;
+    }
+    if (epoll->configuration.backlog <= 0) {
+        epoll->configuration.backlog = SOMAXCONN;
+    }
+    epoll->port = configuration->port;
+    epoll->reactors = calloc(epoll->configuration.reactor_count, sizeof(epoll_reactor_t));
+    if (!epoll->reactors) {
+        free(epoll);
+        return NULL;
+    }
+    for (size_t i = 0; i < epoll->configuration.reactor_count; i++) {
+        epoll->reactors[i] = (epoll_reactor_t){.epoll = epoll, .index = i, .listener = -1, .poll = -1, .wakeup = -1};
+        pthread_mutex_init(&epoll->reactors[i].resume_mutex, NULL);
+    }
+    for (size_t i = 0; i < epoll->configuration.reactor_count; i++) {
+        if (!set_up_reactor(epoll, epoll->reactors + i)) {
+            divulge_epoll_destroy(epoll);
+            return NULL;
+        }
+    }
+    return epoll;
+}
+
+uint16_t divulge_epoll_get_port(const divulge_epoll_t* epoll) {
+    return epoll ? epoll->port : 0;
+}
+
+static void stop_reactors(divulge_epoll_t* epoll, size_t reactor_count) {
+    for (size_t i = 0; i < reactor_count; i++) {
+        atomic_store(&epoll->reactors[i].is_stop_requested, true);
+        if (wake_reactor(epoll->reactors + i)) {
+            pthread_join(epoll->reactors[i].thread, NULL);
+        }
+        atomic_store(&epoll->reactors[i].is_stop_requested, false);
+    }
+}
+
+bool divulge_epoll_start(divulge_epoll_t* epoll) {
+    if (!epoll || epoll->is_running) {
+        return false;
+    }
+    for (size_t i = 0; i < epoll->configuration.reactor_count; i++) {
+        if (pthread_create(&epoll->reactors[i].thread, NULL, run_reactor, epoll->reactors + i) != 0) {
+            stop_reactors(epoll, i);
+            return false;
+        }
+    }
+    epoll->is_running = true;
+    return true;
+}
+
+void divulge_epoll_stop(divulge_epoll_t* epoll) {
+    if (!epoll || !epoll->is_running) {
+        return;
+    }
+    stop_reactors(epoll, epoll->configuration.reactor_count);
+    epoll->is_running = false;
+}
+
+void divulge_epoll_destroy(divulge_epoll_t* epoll) {
+    if (!epoll) {
+        return;
+    }
+    divulge_epoll_stop(epoll);
+    for (size_t i = 0; i < epoll->configuration.reactor_count; i++) {
+        close_if_open(epoll->reactors[i].listener);
+        close_if_open(epoll->reactors[i].poll);
+        close_if_open(epoll->reactors[i].wakeup);
+        pthread_mutex_destroy(&epoll->reactors[i].resume_mutex);
+    }
+    free(epoll->reactors);
+    free(epoll);
+}
@@ -0,0 +1,84 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_EPOLL_H
+#define DIVULGE_EPOLL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-epoll Divulge epoll transport
+ * @ingroup divulge
+ * @brief Non-blocking multi-reactor HTTP server
+ *
+ * Every reactor is a thread running its own epoll loop, pinned to a core, with its own `SO_REUSEPORT` listening
+ * socket, so the kernel spreads new connections over the reactors and no state is shared between them. A
+ * connection stays on the reactor that accepted it. Received bytes go straight to a divulge_connection_t.
+ * Responses are written without blocking; whatever the socket does not take is queued, and the connection is
+ * not read again until the queue is drained. Every reactor keeps a timer wheel enforcing the configured timeouts,
+ * see divulge_connection_watch(), and waits for events no longer than until its next timer is due. Available on
+ * Linux.
+ * @{
+ */
+typedef struct divulge_epoll divulge_epoll_t;
+
+typedef struct divulge_epoll_configuration {
+    const char* address;      /**< IPv4 address to listen on, NULL for all interfaces */
+    uint16_t port;            /**< 0 for a port chosen by the system, see divulge_epoll_get_port() */
+    size_t reactor_count;     /**< 0 for one per online CPU */
+    int backlog;              /**< 0 for SOMAXCONN */
+    bool is_pinning_reactors; /**< pin reactor `i` to CPU `i` */
+} divulge_epoll_configuration_t;
+
+/**
+ * @brief Fill in the transport callbacks of a router configuration
+ * @note Call before divulge_initialize(); the remaining fields are left unchanged.
+ */
+void divulge_epoll_prepare_configuration(divulge_configuration_t* configuration);
+
+/**
+ * @brief Create the listening sockets
+ * @param divulge router initialized with a configuration prepared by divulge_epoll_prepare_configuration()
+ * @return transport or NULL if the sockets could not be set up
+ */
+divulge_epoll_t* divulge_epoll_create(divulge_t* divulge, const divulge_epoll_configuration_t* configuration);
+
+uint16_t divulge_epoll_get_port(const divulge_epoll_t* epoll);
+
+/**
+ * @brief Start the reactor threads
+ */
+bool divulge_epoll_start(divulge_epoll_t* epoll);
+
+/**
+ * @brief Stop the reactors and close their connections
+ */
+void divulge_epoll_stop(divulge_epoll_t* epoll);
+
+void divulge_epoll_destroy(divulge_epoll_t* epoll);
+/**
+ * @}
+ */
+#endif  // DIVULGE_EPOLL_H
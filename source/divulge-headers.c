@@ -0,0 +1,107 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-headers.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define FNV_OFFSET_BASIS (2166136261u)
+#define FNV_PRIME (16777619u)
+
+static unsigned char to_lower(unsigned char c) {
+    return ((c >= 'A') && (c <= 'Z')) ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static uint32_t hash_name(const char* name, size_t name_size) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < name_size; i++) {
+        hash = (hash ^ to_lower((unsigned char)name[i])) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool is_name_equal(const char* a, const char* b, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (to_lower((unsigned char)a[i]) != to_lower((unsigned char)b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t find_hashed(const divulge_headers_t* headers, const char* name, size_t name_size, uint32_t hash) {
+    size_t index = headers->buckets[hash % DIVULGE_HEADERS_BUCKET_COUNT];
+    while (index != DIVULGE_HEADERS_NONE) {
+        const divulge_headers_field_t* field = headers->fields + index;
+        if ((field->hash == hash) && (field->name.size == name_size) &&
+            is_name_equal(headers->buffer + field->name.offset, name, name_size)) {
+            return index;
+        }
+        index = field->next_in_bucket;
+    }
+    return DIVULGE_HEADERS_NONE;
+}
+
+void divulge_headers_build(divulge_headers_t* headers, const divulge_parser_t* parser, const char* buffer) {
+    if (!headers || !parser || !buffer) {
+        return;
+    }
+    headers->buffer = buffer;
+    headers->count = 0;
+    memset(headers->buckets, DIVULGE_HEADERS_NONE, sizeof(headers->buckets));
+    for (size_t i = 0; i < parser->header_count; i++) {
+        divulge_headers_field_t* field = headers->fields + i;
+        field->name = parser->headers[i].key;
+        field->value = parser->headers[i].value;
+        field->hash = hash_name(buffer + field->name.offset, field->name.size);
+        field->next_in_bucket = DIVULGE_HEADERS_NONE;
+        field->next_with_name = DIVULGE_HEADERS_NONE;
+        size_t first = find_hashed(headers, buffer + field->name.offset, field->name.size, field->hash);
+        if (first == DIVULGE_HEADERS_NONE) {
+            uint8_t* bucket = headers->buckets + (field->hash % DIVULGE_HEADERS_BUCKET_COUNT);
+            field->next_in_bucket = *bucket;
+            *bucket = (uint8_t)i;
+        } else {
+            size_t last = first;
+            while (headers->fields[last].next_with_name != DIVULGE_HEADERS_NONE) {
+                last = headers->fields[last].next_with_name;
+            }
+            headers->fields[last].next_with_name = (uint8_t)i;
+        }
+        headers->count++;
+    }
+}
+
+size_t divulge_headers_find(const divulge_headers_t* headers, const char* name, size_t name_size) {
+    if (!headers || !name || !headers->buffer) {
+        return DIVULGE_HEADERS_NONE;
+    }
+    return find_hashed(headers, name, name_size, hash_name(name, name_size));
+}
+
+size_t divulge_headers_find_next(const divulge_headers_t* headers, size_t index) {
+    if (!headers || (index >= headers->count)) {
+        return DIVULGE_HEADERS_NONE;
+    }
+    return headers->fields[index].next_with_name;
+}
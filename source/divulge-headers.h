@@ -0,0 +1,80 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_HEADERS_H
+#define DIVULGE_HEADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "divulge-parser.h"
+/**
+ * @defgroup divulge-headers Divulge request header index
+ * @ingroup divulge
+ * @brief Case-insensitive hashed lookup of parsed request headers
+ *
+ * The index is built once per request from the parser spans. Names are hashed lowercased into a small open
+ * hash table, and repeated headers are chained in arrival order, so finding a header does not depend on the
+ * number of headers and never touches the request buffer beyond comparing the name.
+ * @{
+ */
+#define DIVULGE_HEADERS_BUCKET_COUNT (64)
+#define DIVULGE_HEADERS_NONE (0xff)
+
+typedef struct divulge_headers_field {
+    divulge_span_t name;
+    divulge_span_t value;
+    uint32_t hash;
+    uint8_t next_in_bucket;
+    uint8_t next_with_name;
+} divulge_headers_field_t;
+
+typedef struct divulge_headers {
+    const char* buffer;
+    divulge_headers_field_t fields[DIVULGE_PARSER_MAX_HEADERS];
+    size_t count;
+    uint8_t buckets[DIVULGE_HEADERS_BUCKET_COUNT];
+} divulge_headers_t;
+
+/**
+ * @brief Index the headers of a parsed request
+ * @param headers index to fill
+ * @param parser parser that finished the header block of `buffer`
+ * @param buffer request bytes the parser offsets refer to
+ */
+void divulge_headers_build(divulge_headers_t* headers, const divulge_parser_t* parser, const char* buffer);
+
+/**
+ * @brief Find the first header with the name, compared case-insensitively
+ * @return field index or DIVULGE_HEADERS_NONE
+ */
+size_t divulge_headers_find(const divulge_headers_t* headers, const char* name, size_t name_size);
+
+/**
+ * @brief Find the next header with the same name as the field
+ * @return field index or DIVULGE_HEADERS_NONE
+ */
+size_t divulge_headers_find_next(const divulge_headers_t* headers, size_t index);
+/**
+ * @}
+ */
+#endif  // DIVULGE_HEADERS_H
@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-listener.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int divulge_listener_create(const char* address, uint16_t port, int backlog) {
+    struct sockaddr_in socket_address = {.sin_family = AF_INET, .sin_port = htons(port)};
+    socket_address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (address && (inet_pton(AF_INET, address, &socket_address.sin_addr) != 1)) {
+        return -1;
+    }
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        return -1;
+    }
+    int enabled = 1;
+    bool is_ready = (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled)) == 0) &&
+                    (setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof(enabled)) == 0) &&
+                    (setsockopt(listener, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled)) == 0) &&
+                    (bind(listener, (struct sockaddr*)&socket_address, sizeof(socket_address)) == 0) &&
+                    (listen(listener, backlog) == 0);
+    if (!is_ready) {
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+uint16_t divulge_listener_get_port(int listener) {
+    struct sockaddr_in address;
+    socklen_t address_size = sizeof(address);
+    if (getsockname(listener, (struct sockaddr*)&address, &address_size) != 0) {
+        return 0;
+    }
+    return ntohs(address.sin_port);
+}
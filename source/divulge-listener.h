@@ -0,0 +1,43 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_LISTENER_H
+#define DIVULGE_LISTENER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Open a nonblocking `SO_REUSEPORT` TCP listener with `TCP_NODELAY`, which accepted sockets inherit
+ * @param address IPv4 address, NULL for all interfaces
+ * @param port port, 0 for one chosen by the system
+ * @param backlog listen() backlog
+ * @return socket or -1
+ */
+int divulge_listener_create(const char* address, uint16_t port, int backlog);
+
+/**
+ * @brief Port a listener is bound to, 0 on error
+ */
+uint16_t divulge_listener_get_port(int listener);
+
+#endif  // DIVULGE_LISTENER_H
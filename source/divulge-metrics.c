@@ -0,0 +1,581 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-metrics.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HISTOGRAM_SUB_BUCKET_BITS (3)
+#define HISTOGRAM_SUB_BUCKET_COUNT (1u << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_EXPONENT (36)
+#define HISTOGRAM_BUCKET_COUNT ((HISTOGRAM_MAX_EXPONENT - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT)
+#define RENDERED_BOUND_FIRST_EXPONENT (10)
+#define RENDERED_BOUND_LAST_EXPONENT (34)
+#define RENDERED_BOUND_STEP (2)
+#define MAX_STATUS (600)
+#define SHARD_INITIAL_CAPACITY (16)
+#define RENDER_INITIAL_CAPACITY (4096)
+
+typedef atomic_uint_fast64_t counter_t;
+
+typedef struct histogram {
+    counter_t counts[HISTOGRAM_BUCKET_COUNT];
+    counter_t sum_ns;
+} histogram_t;
+
+/*
+ * Counters are only written by the thread owning the shard, so a relaxed load and store replace a locked
+ * read-modify-write; readers merging the shards see each counter whole.
+ */
+typedef struct route_metrics {
+    char* route;
+    divulge_route_method_t method;
+    uint32_t hash;
+    counter_t received_size;
+    counter_t sent_size;
+    counter_t status_counts[MAX_STATUS];
+    histogram_t histograms[DIVULGE_METRICS_PHASE_COUNT];
+} route_metrics_t;
+
+/*
+ * Only the owning thread adds routes; the lock keeps readers away while it does.
+ */
+typedef struct metrics_shard {
+    pthread_mutex_t lock;
+    route_metrics_t** routes;
+    size_t route_count;
+    size_t capacity;
+    atomic_bool is_owned;
+    struct metrics_shard* next;
+} metrics_shard_t;
+
+typedef struct divulge_metrics {
+    pthread_key_t shard_key;
+    pthread_mutex_t lock;
+    metrics_shard_t* shards;
+} divulge_metrics_t;
+
+typedef struct merged_route {
+    const char* route;
+    divulge_route_method_t method;
+    uint64_t received_size;
+    uint64_t sent_size;
+    uint64_t status_counts[MAX_STATUS];
+    uint64_t counts[DIVULGE_METRICS_PHASE_COUNT][HISTOGRAM_BUCKET_COUNT];
+    uint64_t sums_ns[DIVULGE_METRICS_PHASE_COUNT];
+} merged_route_t;
+
+typedef struct text {
+    char* data;
+    size_t size;
+    size_t capacity;
+    bool has_failed;
+} text_t;
+
+static const char* phase_names[DIVULGE_METRICS_PHASE_COUNT] = {"parse", "middleware", "handler", "send", "total"};
+
+static inline void add_to_counter(counter_t* counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static inline uint64_t read_counter(counter_t* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static size_t get_bucket_index(uint64_t value) {
+    if (value < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return (size_t)value;
+    }
+    unsigned exponent = 63u - (unsigned)__builtin_clzll(value);
+    if (exponent >= HISTOGRAM_MAX_EXPONENT) {
+        return HISTOGRAM_BUCKET_COUNT - 1;
+    }
+    size_t sub_bucket = (size_t)(value >> (exponent - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKET_COUNT - 1);
+    return (exponent - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKET_COUNT + sub_bucket;
+}
+
+static uint64_t get_bucket_lower_bound(size_t index) {
+    if (index < HISTOGRAM_SUB_BUCKET_COUNT) {
+        return index;
+    }
+    unsigned exponent = (unsigned)(index / HISTOGRAM_SUB_BUCKET_COUNT) + HISTOGRAM_SUB_BUCKET_BITS - 1;
+    uint64_t sub_bucket = index % HISTOGRAM_SUB_BUCKET_COUNT;
+    return (HISTOGRAM_SUB_BUCKET_COUNT + sub_bucket) << (exponent - HISTOGRAM_SUB_BUCKET_BITS);
+}
+
+static uint32_t hash_route(const char* route, divulge_route_method_t method) {
+    uint32_t hash = 2166136261u;
+    for (const char* c = route ? route : ""; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return (hash ^ (uint32_t)method) * 16777619u;
+}
+
+static bool is_same_route(const char* a, const char* b) {
+    return (a == b) || (a && b && (strcmp(a, b) == 0));
+}
+
+static void release_shard(void* shard) {
+    atomic_store(&((metrics_shard_t*)shard)->is_owned, false);
+}
+
+divulge_metrics_t* divulge_metrics_create(void) {
+    divulge_metrics_t* metrics = calloc(1, sizeof(divulge_metrics_t));
+    if (!metrics) {
+        return NULL;
+    }
+    if (pthread_key_create(&metrics->shard_key, release_shard) != 0) {
+        free(metrics);
+        return NULL;
+    }
+    pthread_mutex_init(&metrics->lock, NULL);
+    return metrics;
+}
+
+void divulge_metrics_destroy(divulge_metrics_t* metrics) {
+    if (!metrics) {
+        return;
+    }
+    pthread_key_delete(metrics->shard_key);
+    metrics_shard_t* shard = metrics->shards;
+    while (shard) {
+        metrics_shard_t* next = shard->next;
+        for (size_t i = 0; i < shard->capacity; i++) {
+            if (shard->routes[i]) {
+                free(shard->routes[i]->route);
+                free(shard->routes[i]);
+            }
+        }
+        free(shard->routes);
+        pthread_mutex_destroy(&shard->lock);
+        free(shard);
+        shard = next;
+    }
+    pthread_mutex_destroy(&metrics->lock);
+    free(metrics);
+}
+
+/*
+ * Threads keep their shard until they exit; a later thread then takes it over, so that transports starting a
+ * thread per connection do not grow the shard list without bound.
+ */
+static metrics_shard_t* get_shard(divulge_metrics_t* metrics) {
+    metrics_shard_t* shard = pthread_getspecific(metrics->shard_key);
+    if (shard) {
+        return shard;
+    }
+    pthread_mutex_lock(&metrics->lock);
+    for (shard = metrics->shards; shard; shard = shard->next) {
+        bool is_owned = false;
+        if (atomic_compare_exchange_strong(&shard->is_owned, &is_owned, true)) {
+            break;
+        }
+    }
+    if (!shard) {
+        shard = calloc(1, sizeof(metrics_shard_t));
+        route_metrics_t** routes = calloc(SHARD_INITIAL_CAPACITY, sizeof(route_metrics_t*));
+        if (!shard || !routes) {
+            free(shard);
+            free(routes);
+            pthread_mutex_unlock(&metrics->lock);
+            return NULL;
+        }
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->routes = routes;
+        shard->capacity = SHARD_INITIAL_CAPACITY;
+        atomic_init(&shard->is_owned, true);
+        shard->next = metrics->shards;
+        metrics->shards = shard;
+    }
+    pthread_mutex_unlock(&metrics->lock);
+    if (pthread_setspecific(metrics->shard_key, shard) != 0) {
+        atomic_store(&shard->is_owned, false);
+        return NULL;
+    }
+    return shard;
+}
+
+static route_metrics_t** find_slot(route_metrics_t** routes,
+                                   size_t capacity,
+                                   const char* route,
+                                   divulge_route_method_t method,
+                                   uint32_t hash) {
+    size_t index = hash & (capacity - 1);
+    while (routes[index]) {
+        route_metrics_t* entry = routes[index];
+        if ((entry->hash == hash) && (entry->method == method) && is_same_route(entry->route, route)) {
+            break;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+    return routes + index;
+}
+
+static bool grow_shard(metrics_shard_t* shard) {
+    size_t capacity = shard->capacity * 2;
+    route_metrics_t** routes = calloc(capacity, sizeof(route_metrics_t*));
+    if (!routes) {
+        return false;
+    }
+    for (size_t i = 0; i < shard->capacity; i++) {
+        route_metrics_t* entry = shard->routes[i];
+        if (entry) {
+            *find_slot(routes, capacity, entry->route, entry->method, entry->hash) = entry;
+        }
+    }
+    free(shard->routes);
+    shard->routes = routes;
+    shard->capacity = capacity;
+    return true;
+}
+
+static route_metrics_t* add_route(metrics_shard_t* shard,
+                                  const char* route,
+                                  divulge_route_method_t method,
+                                  uint32_t hash) {
+    route_metrics_t* entry = calloc(1, sizeof(route_metrics_t));
+    if (!entry) {
+        return NULL;
+    }
+    entry->route = route ? strdup(route) : NULL;
+    if (route && !entry->route) {
+        free(entry);
+        return NULL;
+    }
+    entry->method = method;
+    entry->hash = hash;
+    pthread_mutex_lock(&shard->lock);
+    if (((shard->route_count + 1) * 2 > shard->capacity) && !grow_shard(shard)) {
+        pthread_mutex_unlock(&shard->lock);
+        free(entry->route);
+        free(entry);
+        return NULL;
+    }
+    *find_slot(shard->routes, shard->capacity, route, method, hash) = entry;
+    shard->route_count++;
+    pthread_mutex_unlock(&shard->lock);
+    return entry;
+}
+
+void divulge_metrics_record(divulge_metrics_t* metrics, const divulge_metrics_sample_t* sample) {
+    if (!metrics || !sample) {
+        return;
+    }
+    metrics_shard_t* shard = get_shard(metrics);
+    if (!shard) {
+        return;
+    }
+    uint32_t hash = hash_route(sample->route, sample->method);
+    route_metrics_t* entry = *find_slot(shard->routes, shard->capacity, sample->route, sample->method, hash);
+    if (!entry && !(entry = add_route(shard, sample->route, sample->method, hash))) {
+        return;
+    }
+    int status = ((sample->status > 0) && (sample->status < MAX_STATUS)) ? sample->status : 0;
+    add_to_counter(entry->status_counts + status, 1);
+    add_to_counter(&entry->received_size, sample->received_size);
+    add_to_counter(&entry->sent_size, sample->sent_size);
+    for (size_t i = 0; i < DIVULGE_METRICS_PHASE_COUNT; i++) {
+        histogram_t* histogram = entry->histograms + i;
+        add_to_counter(histogram->counts + get_bucket_index(sample->durations_ns[i]), 1);
+        add_to_counter(&histogram->sum_ns, sample->durations_ns[i]);
+    }
+}
+
+static void merge_route(merged_route_t* merged, route_metrics_t* entry) {
+    merged->received_size += read_counter(&entry->received_size);
+    merged->sent_size += read_counter(&entry->sent_size);
+    for (size_t i = 0; i < MAX_STATUS; i++) {
+        merged->status_counts[i] += read_counter(entry->status_counts + i);
+    }
+    for (size_t phase = 0; phase < DIVULGE_METRICS_PHASE_COUNT; phase++) {
+        histogram_t* histogram = entry->histograms + phase;
+        for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+            merged->counts[phase][i] += read_counter(histogram->counts + i);
+        }
+        merged->sums_ns[phase] += read_counter(&histogram->sum_ns);
+    }
+}
+
+/*
+ * Merges the shards into one entry per route and method. Route names point into the shards, which keep them
+ * until the metrics are destroyed.
+ */
+static merged_route_t* collect_routes(divulge_metrics_t* metrics, size_t* count) {
+    merged_route_t* merged = NULL;
+    size_t merged_count = 0;
+    size_t merged_capacity = 0;
+    pthread_mutex_lock(&metrics->lock);
+    for (metrics_shard_t* shard = metrics->shards; shard; shard = shard->next) {
+        pthread_mutex_lock(&shard->lock);
+        for (size_t i = 0; i < shard->capacity; i++) {
+            route_metrics_t* entry = shard->routes[i];
+            if (!entry) {
+                continue;
+            }
+            size_t index = 0;
+            while ((index < merged_count) &&
+                   ((merged[index].method != entry->method) || !is_same_route(merged[index].route, entry->route))) {
+                index++;
+            }
+            if (index == merged_count) {
+                if (merged_count == merged_capacity) {
+                    size_t capacity = merged_capacity ? merged_capacity * 2 : 8;
+                    merged_route_t* grown = realloc(merged, capacity * sizeof(merged_route_t));
+                    if (!grown) {
+                        continue;
+                    }
+                    merged = grown;
+                    merged_capacity = capacity;
+                }
+                memset(merged + index, 0, sizeof(merged_route_t));
+                merged[index].route = entry->route;
+                merged[index].method = entry->method;
+                merged_count++;
+            }
+            merge_route(merged + index, entry);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    pthread_mutex_unlock(&metrics->lock);
+    *count = merged_count;
+    return merged;
+}
+
+static merged_route_t* find_merged_route(merged_route_t* merged,
+                                         size_t count,
+                                         const char* route,
+                                         divulge_route_method_t method) {
+    for (size_t i = 0; i < count; i++) {
+        if ((merged[i].method == method) && is_same_route(merged[i].route, route)) {
+            return merged + i;
+        }
+    }
+    return NULL;
+}
+
+uint64_t divulge_metrics_get_request_count(divulge_metrics_t* metrics,
+                                           const char* route,
+                                           divulge_route_method_t method,
+                                           int status) {
+    if (!metrics || (status < 0) || (status >= MAX_STATUS)) {
+        return 0;
+    }
+    size_t count = 0;
+    merged_route_t* merged = collect_routes(metrics, &count);
+    merged_route_t* found = find_merged_route(merged, count, route, method);
+    uint64_t request_count = 0;
+    for (int i = 0; found && (i < MAX_STATUS); i++) {
+        if ((status == 0) || (i == status)) {
+            request_count += found->status_counts[i];
+        }
+    }
+    free(merged);
+    return request_count;
+}
+
+uint64_t divulge_metrics_get_duration_quantile(divulge_metrics_t* metrics,
+                                               const char* route,
+                                               divulge_route_method_t method,
+                                               divulge_metrics_phase_t phase,
+                                               double quantile) {
+    if (!metrics || (phase >= DIVULGE_METRICS_PHASE_COUNT)) {
+        return 0;
+    }
+    size_t count = 0;
+    merged_route_t* merged = collect_routes(metrics, &count);
+    merged_route_t* found = find_merged_route(merged, count, route, method);
+    uint64_t value = 0;
+    if (found) {
+        uint64_t total = 0;
+        for (size_t i = 0; i < HISTOGRAM_BUCKET_COUNT; i++) {
+            total += found->counts[phase][i];
+        }
+        double clamped = (quantile < 0.0) ? 0.0 : ((quantile > 1.0) ? 1.0 : quantile);
+        uint64_t rank = (uint64_t)(clamped * (double)total);
+        uint64_t seen = 0;
+        for (size_t i = 0; (total > 0) && (i < HISTOGRAM_BUCKET_COUNT); i++) {
+            seen += found->counts[phase][i];
+            if ((seen > rank) || (seen == total)) {
+                uint64_t lower = get_bucket_lower_bound(i);
+                uint64_t upper = (i + 1 < HISTOGRAM_BUCKET_COUNT) ? get_bucket_lower_bound(i + 1) : lower + 1;
+                value = lower + (upper - lower) / 2;
+                break;
+            }
+        }
+    }
+    free(merged);
+    return value;
+}
+
+static void append_text(text_t* text, const char* format, ...) {
+    if (text->has_failed) {
+        return;
+    }
+    for (;;) {
+        va_list arguments;
+        va_start(arguments, format);
+        int size = vsnprintf(text->data + text->size, text->capacity - text->size, format, arguments);
+        va_end(arguments);
+        if (size < 0) {
+            text->has_failed = true;
+            return;
+        }
+        if ((size_t)size < (text->capacity - text->size)) {
+            text->size += (size_t)size;
+            return;
+        }
+        size_t capacity = text->capacity * 2;
+        while (capacity - text->size <= (size_t)size) {
+            capacity *= 2;
+        }
+        char* data = realloc(text->data, capacity);
+        if (!data) {
+            text->has_failed = true;
+            return;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+}
+
+/*
+ * Label values escape backslashes, quotes and line feeds.
+ */
+static void append_labels(text_t* text, const merged_route_t* merged) {
+    append_text(text, "route=\"");
+    for (const char* c = merged->route ? merged->route : ""; *c; c++) {
+        if ((*c == '\\') || (*c == '"')) {
+            append_text(text, "\\%c", *c);
+        } else if (*c == '\n') {
+            append_text(text, "\\n");
+        } else {
+            append_text(text, "%c", *c);
+        }
+    }
+    append_text(text, "\",method=\"%s\"", divulge_method_name_from_method(merged->method));
+}
+
+static void render_histogram(text_t* text, const merged_route_t* merged, size_t phase) {
+    const uint64_t* counts = merged->counts[phase];
+    uint64_t cumulative = 0;
+    size_t index = 0;
+    for (unsigned exponent = RENDERED_BOUND_FIRST_EXPONENT; exponent <= RENDERED_BOUND_LAST_EXPONENT;
+         exponent += RENDERED_BOUND_STEP) {
+        size_t end = get_bucket_index((uint64_t)1 << exponent);
+        for (; index < end; index++) {
+            cumulative += counts[index];
+        }
+        append_text(text, "divulge_request_duration_seconds_bucket{");
+        append_labels(text, merged);
+        append_text(text, ",phase=\"%s\",le=\"%.9g\"} %llu\n", phase_names[phase],
+                    (double)((uint64_t)1 << exponent) / 1e9, (unsigned long long)cumulative);
+    }
+    for (; index < HISTOGRAM_BUCKET_COUNT; index++) {
+        cumulative += counts[index];
+    }
+    append_text(text, "divulge_request_duration_seconds_bucket{");
+    append_labels(text, merged);
+    append_text(text, ",phase=\"%s\",le=\"+Inf\"} %llu\n", phase_names[phase], (unsigned long long)cumulative);
+    append_text(text, "divulge_request_duration_seconds_sum{");
+    append_labels(text, merged);
+    append_text(text, ",phase=\"%s\"} %.9f\n", phase_names[phase], (double)merged->sums_ns[phase] / 1e9);
+    append_text(text, "divulge_request_duration_seconds_count{");
+    append_labels(text, merged);
+    append_text(text, ",phase=\"%s\"} %llu\n", phase_names[phase], (unsigned long long)cumulative);
+}
+
+char* divulge_metrics_render(divulge_metrics_t* metrics, size_t* size) {
+    if (!metrics) {
+        return NULL;
+    }
+    text_t text = {.data = malloc(RENDER_INITIAL_CAPACITY), .capacity = RENDER_INITIAL_CAPACITY};
+    if (!text.data) {
+        return NULL;
+    }
+    text.data[0] = '\0';
+    size_t count = 0;
+    merged_route_t* merged = collect_routes(metrics, &count);
+    append_text(&text, "# HELP divulge_requests_total Requests answered.\n# TYPE divulge_requests_total counter\n");
+    for (size_t i = 0; i < count; i++) {
+        for (int status = 0; status < MAX_STATUS; status++) {
+            if (merged[i].status_counts[status] > 0) {
+                append_text(&text, "divulge_requests_total{");
+                append_labels(&text, merged + i);
+                append_text(&text, ",status=\"%d\"} %llu\n", status,
+                            (unsigned long long)merged[i].status_counts[status]);
+            }
+        }
+    }
+    append_text(&text,
+                "# HELP divulge_request_bytes_total Request bytes received.\n"
+                "# TYPE divulge_request_bytes_total counter\n");
+    for (size_t i = 0; i < count; i++) {
+        append_text(&text, "divulge_request_bytes_total{");
+        append_labels(&text, merged + i);
+        append_text(&text, "} %llu\n", (unsigned long long)merged[i].received_size);
+    }
+    append_text(&text,
+                "# HELP divulge_response_bytes_total Response bytes sent.\n"
+                "# TYPE divulge_response_bytes_total counter\n");
+    for (size_t i = 0; i < count; i++) {
+        append_text(&text, "divulge_response_bytes_total{");
+        append_labels(&text, merged + i);
+        append_text(&text, "} %llu\n", (unsigned long long)merged[i].sent_size);
+    }
+    append_text(&text,
+                "# HELP divulge_request_duration_seconds Time spent answering requests, by phase.\n"
+                "# TYPE divulge_request_duration_seconds histogram\n");
+    for (size_t i = 0; i < count; i++) {
+        for (size_t phase = 0; phase < DIVULGE_METRICS_PHASE_COUNT; phase++) {
+            render_histogram(&text, merged + i, phase);
+        }
+    }
+    free(merged);
+    if (text.has_failed) {
+        free(text.data);
+        return NULL;
+    }
+    if (size) {
+        *size = text.size;
+    }
+    return text.data;
+}
+
+bool divulge_metrics_handler(divulge_request_t* request, void* context) {
+    size_t size = 0;
+    char* text = divulge_metrics_render(context, &size);
+    if (!text) {
+        divulge_response_t response = {.return_code = 500, .payload = "", .payload_size = 0};
+        return divulge_respond(request, &response);
+    }
+    divulge_header_entry_t header_entries[] = {{.key = "Content-Type", .value = "text/plain; version=0.0.4"}};
+    divulge_header_t header = {.entries = header_entries, .count = 1};
+    divulge_begin_response(request, 200, &header, size);
+    divulge_write_response(request, text, size);
+    free(text);
+    return divulge_end_response(request);
+}
@@ -0,0 +1,108 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_METRICS_H
+#define DIVULGE_METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-metrics Divulge metrics
+ * @ingroup divulge
+ * @brief Per-route request counters and latency histograms
+ *
+ * Set `metrics` in divulge_configuration_t to record every answered request: the number of requests per route,
+ * method and status, the request and response bytes, and log-linear latency histograms of the parse,
+ * middleware, handler and send phases and of the whole request. Each thread records into a shard of its own
+ * without locks or shared writes; the shards are only merged when the metrics are read, e.g. by
+ * divulge_metrics_handler() rendering them in the Prometheus text format.
+ * @{
+ */
+typedef enum divulge_metrics_phase {
+    DIVULGE_METRICS_PHASE_PARSE,      /**< parsing the request line and headers */
+    DIVULGE_METRICS_PHASE_MIDDLEWARE, /**< running the route's middlewares, without sending */
+    DIVULGE_METRICS_PHASE_HANDLER,    /**< running the handler, without sending */
+    DIVULGE_METRICS_PHASE_SEND,       /**< in the send callbacks */
+    DIVULGE_METRICS_PHASE_TOTAL,      /**< from parsing to the last byte handed to the transport */
+    DIVULGE_METRICS_PHASE_COUNT,
+} divulge_metrics_phase_t;
+
+typedef struct divulge_metrics_sample {
+    const char* route; /**< pattern of the matched route, NULL if none matched */
+    divulge_route_method_t method;
+    int status;
+    size_t received_size;
+    size_t sent_size;
+    uint64_t durations_ns[DIVULGE_METRICS_PHASE_COUNT];
+} divulge_metrics_sample_t;
+
+divulge_metrics_t* divulge_metrics_create(void);
+
+/**
+ * @note No request may be answered with the metrics anymore.
+ */
+void divulge_metrics_destroy(divulge_metrics_t* metrics);
+
+/**
+ * @brief Record an answered request in the calling thread's shard
+ */
+void divulge_metrics_record(divulge_metrics_t* metrics, const divulge_metrics_sample_t* sample);
+
+/**
+ * @brief Number of requests answered for the route with the status, over all threads
+ * @param route route pattern, NULL for requests no route matched
+ * @param status HTTP status, 0 for any
+ */
+uint64_t divulge_metrics_get_request_count(divulge_metrics_t* metrics,
+                                           const char* route,
+                                           divulge_route_method_t method,
+                                           int status);
+
+/**
+ * @brief Estimate a latency quantile of the route from its histogram
+ * @param quantile between 0 and 1
+ * @return nanoseconds, within 12.5% of the recorded value, or 0 without requests
+ */
+uint64_t divulge_metrics_get_duration_quantile(divulge_metrics_t* metrics,
+                                               const char* route,
+                                               divulge_route_method_t method,
+                                               divulge_metrics_phase_t phase,
+                                               double quantile);
+
+/**
+ * @brief Render all metrics in the Prometheus text exposition format
+ * @param size length of the text
+ * @return NUL-terminated text to be freed by the caller, or NULL
+ */
+char* divulge_metrics_render(divulge_metrics_t* metrics, size_t* size);
+
+/**
+ * @brief Route handler serving divulge_metrics_render(); the context is the metrics
+ */
+bool divulge_metrics_handler(divulge_request_t* request, void* context);
+/**
+ * @}
+ */
+#endif  // DIVULGE_METRICS_H
@@ -0,0 +1,399 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-parser.h"
+#include "divulge-scan.h"
+#include <stdint.h>
+#include <string.h>
+
+typedef enum parser_state {
+    STATE_METHOD,
+    STATE_TARGET,
+    STATE_VERSION,
+    STATE_REQUEST_LINE_LF,
+    STATE_HEADER_LINE_START,
+    STATE_HEADER_KEY,
+    STATE_HEADER_VALUE_START,
+    STATE_HEADER_VALUE,
+    STATE_HEADER_LF,
+    STATE_HEADERS_END_LF,
+    STATE_BODY,
+    STATE_DONE,
+    STATE_ERROR,
+} parser_state_t;
+
+static bool is_token_char(unsigned char c) {
+    return divulge_scan_is_in_class(c, DIVULGE_SCAN_CLASS_TOKEN_BIT);
+}
+
+static bool is_target_char(unsigned char c) {
+    return divulge_scan_is_in_class(c, DIVULGE_SCAN_CLASS_TARGET_BIT);
+}
+
+static bool is_value_char(unsigned char c) {
+    return divulge_scan_is_in_class(c, DIVULGE_SCAN_CLASS_VALUE_BIT);
+}
+
+static char to_lower(char c) {
+    return ((c >= 'A') && (c <= 'Z')) ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool is_key_equal(const char* buffer, divulge_span_t key, const char* name) {
+    size_t name_size = strlen(name);
+    if (key.size != name_size) {
+        return false;
+    }
+    for (size_t i = 0; i < name_size; i++) {
+        if (to_lower(buffer[key.offset + i]) != name[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static divulge_parser_status_t fail(divulge_parser_t* parser, divulge_parser_error_t error) {
+    parser->state = STATE_ERROR;
+    parser->error = error;
+    return DIVULGE_PARSER_STATUS_ERROR;
+}
+
+static divulge_parser_error_t parse_content_length(divulge_parser_t* parser, const char* buffer, divulge_span_t value) {
+    if (value.size == 0) {
+        return DIVULGE_PARSER_ERROR_BAD_REQUEST;
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < value.size; i++) {
+        char c = buffer[value.offset + i];
+        if ((c < '0') || (c > '9') || (length > (SIZE_MAX - 9) / 10)) {
+            return DIVULGE_PARSER_ERROR_BAD_REQUEST;
+        }
+        length = length * 10 + (size_t)(c - '0');
+    }
+    if (parser->has_content_length && (parser->body.size != length)) {
+        return DIVULGE_PARSER_ERROR_BAD_REQUEST;
+    }
+    parser->has_content_length = true;
+    parser->body.size = length;
+    return DIVULGE_PARSER_ERROR_NONE;
+}
+
+static divulge_parser_error_t parse_transfer_encoding(divulge_parser_t* parser,
+                                                      const char* buffer,
+                                                      divulge_span_t value) {
+    size_t start = value.offset;
+    size_t end = value.offset + value.size;
+    for (size_t i = start; i < end; i++) {
+        if (buffer[i] == ',') {
+            start = i + 1;
+        }
+    }
+    while ((start < end) && ((buffer[start] == ' ') || (buffer[start] == '\t'))) {
+        start++;
+    }
+    divulge_span_t last_coding = {.offset = start, .size = end - start};
+    parser->is_chunked = is_key_equal(buffer, last_coding, "chunked");
+    return parser->is_chunked ? DIVULGE_PARSER_ERROR_NONE : DIVULGE_PARSER_ERROR_UNSUPPORTED_TRANSFER_ENCODING;
+}
+
+static divulge_parser_error_t commit_header(divulge_parser_t* parser, const char* buffer) {
+    divulge_parser_header_t* header = parser->headers + parser->header_count++;
+    if (is_key_equal(buffer, header->key, "content-length")) {
+        return parse_content_length(parser, buffer, header->value);
+    } else if (is_key_equal(buffer, header->key, "transfer-encoding")) {
+        return parse_transfer_encoding(parser, buffer, header->value);
+    } else if (is_key_equal(buffer, header->key, "expect")) {
+        parser->expects_continue = is_key_equal(buffer, header->value, "100-continue");
+        return parser->expects_continue ? DIVULGE_PARSER_ERROR_NONE : DIVULGE_PARSER_ERROR_UNSUPPORTED_EXPECTATION;
+    }
+    return DIVULGE_PARSER_ERROR_NONE;
+}
+
+static bool parse_version(divulge_parser_t* parser, const char* buffer) {
+    const char* version = buffer + parser->version.offset;
+    if ((parser->version.size != 8) || (memcmp(version, "HTTP/1.", 7) != 0) || (version[7] < '0') ||
+        (version[7] > '9')) {
+        return false;
+    }
+    parser->version_minor = version[7] - '0';
+    return true;
+}
+
+static divulge_parser_error_t get_line_limit_error(parser_state_t state) {
+    if (state == STATE_TARGET) {
+        return DIVULGE_PARSER_ERROR_TARGET_TOO_LONG;
+    } else if (state <= STATE_REQUEST_LINE_LF) {
+        return DIVULGE_PARSER_ERROR_BAD_REQUEST;
+    } else {
+        return DIVULGE_PARSER_ERROR_HEADER_TOO_LARGE;
+    }
+}
+
+static size_t get_scan_end(const divulge_parser_t* parser, size_t buffer_size) {
+    size_t end = parser->line_start + parser->limits.max_line_size;
+    if (parser->state > STATE_REQUEST_LINE_LF) {
+        size_t header_end = parser->header_block.offset + parser->limits.max_header_size;
+        end = (header_end < end) ? header_end : end;
+    }
+    return (buffer_size < end) ? buffer_size : end;
+}
+
+/*
+ * Skips the run of characters the current state accepts without a state change, so only delimiters and
+ * invalid bytes reach the state machine.
+ */
+static size_t skip_run(divulge_parser_t* parser, const char* data, size_t size, size_t position) {
+    switch (parser->state) {
+        case STATE_METHOD:
+        case STATE_HEADER_KEY:
+            return divulge_scan(DIVULGE_SCAN_CLASS_TOKEN, data, size);
+        case STATE_TARGET:
+            return divulge_scan(parser->query_start ? DIVULGE_SCAN_CLASS_TARGET : DIVULGE_SCAN_CLASS_PATH, data, size);
+        case STATE_VERSION:
+            return divulge_scan(DIVULGE_SCAN_CLASS_TARGET, data, size);
+        case STATE_HEADER_VALUE: {
+            size_t run = divulge_scan(DIVULGE_SCAN_CLASS_VALUE, data, size);
+            for (size_t i = run; i > 0; i--) {
+                if ((data[i - 1] != ' ') && (data[i - 1] != '\t')) {
+                    parser->value_end = position + i;
+                    break;
+                }
+            }
+            return run;
+        }
+        default:
+            return 0;
+    }
+}
+
+void divulge_parser_initialize(divulge_parser_t* parser, const divulge_parser_limits_t* limits) {
+    if (!parser) {
+        return;
+    }
+    memset(parser, 0, sizeof(divulge_parser_t));
+    parser->state = STATE_METHOD;
+    parser->limits.max_line_size = DIVULGE_PARSER_DEFAULT_MAX_LINE_SIZE;
+    parser->limits.max_header_size = DIVULGE_PARSER_DEFAULT_MAX_HEADER_SIZE;
+    if (limits && (limits->max_line_size > 0)) {
+        parser->limits.max_line_size = limits->max_line_size;
+    }
+    if (limits && (limits->max_header_size > 0)) {
+        parser->limits.max_header_size = limits->max_header_size;
+    }
+}
+
+divulge_parser_status_t divulge_parser_feed(divulge_parser_t* parser, const char* buffer, size_t buffer_size) {
+    if (!parser || !buffer) {
+        return DIVULGE_PARSER_STATUS_ERROR;
+    }
+    size_t p = parser->position;
+    while ((p < buffer_size) && (parser->state < STATE_BODY)) {
+        if ((p - parser->line_start) >= parser->limits.max_line_size) {
+            return fail(parser, get_line_limit_error(parser->state));
+        }
+        if ((parser->state > STATE_REQUEST_LINE_LF) &&
+            ((p - parser->header_block.offset) >= parser->limits.max_header_size)) {
+            return fail(parser, DIVULGE_PARSER_ERROR_HEADER_TOO_LARGE);
+        }
+        size_t run = skip_run(parser, buffer + p, get_scan_end(parser, buffer_size) - p, p);
+        if (run > 0) {
+            p += run;
+            continue;
+        }
+        unsigned char c = (unsigned char)buffer[p];
+        switch (parser->state) {
+            case STATE_METHOD:
+                if ((c == ' ') && (p > parser->line_start)) {
+                    parser->method.offset = parser->line_start;
+                    parser->method.size = p - parser->line_start;
+                    parser->token_start = p + 1;
+                    parser->state = STATE_TARGET;
+                } else if (!is_token_char(c)) {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                }
+                break;
+            case STATE_TARGET:
+                if ((c == ' ') && (p > parser->token_start)) {
+                    parser->target.offset = parser->token_start;
+                    parser->target.size = p - parser->token_start;
+                    size_t path_end = parser->query_start ? parser->query_start - 1 : p;
+                    parser->path.offset = parser->token_start;
+                    parser->path.size = path_end - parser->token_start;
+                    parser->query.offset = parser->query_start ? parser->query_start : p;
+                    parser->query.size = p - parser->query.offset;
+                    parser->token_start = p + 1;
+                    parser->state = STATE_VERSION;
+                } else if ((c == '?') && !parser->query_start) {
+                    parser->query_start = p + 1;
+                } else if (!is_target_char(c)) {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                }
+                break;
+            case STATE_VERSION:
+                if (c == '\r') {
+                    parser->version.offset = parser->token_start;
+                    parser->version.size = p - parser->token_start;
+                    if (!parse_version(parser, buffer)) {
+                        return fail(parser, DIVULGE_PARSER_ERROR_UNSUPPORTED_VERSION);
+                    }
+                    parser->state = STATE_REQUEST_LINE_LF;
+                } else if (!is_target_char(c)) {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                }
+                break;
+            case STATE_REQUEST_LINE_LF:
+                if (c != '\n') {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                }
+                parser->line_start = p + 1;
+                parser->header_block.offset = p + 1;
+                parser->state = STATE_HEADER_LINE_START;
+                break;
+            case STATE_HEADER_LINE_START:
+                if (c == '\r') {
+                    parser->state = STATE_HEADERS_END_LF;
+                } else if (!is_token_char(c)) {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                } else if (parser->header_count >= DIVULGE_PARSER_MAX_HEADERS) {
+                    return fail(parser, DIVULGE_PARSER_ERROR_HEADER_TOO_LARGE);
+                } else {
+                    parser->token_start = p;
+                    parser->state = STATE_HEADER_KEY;
+                }
+                break;
+            case STATE_HEADER_KEY:
+                if (c == ':') {
+                    divulge_parser_header_t* header = parser->headers + parser->header_count;
+                    header->key.offset = parser->token_start;
+                    header->key.size = p - parser->token_start;
+                    parser->state = STATE_HEADER_VALUE_START;
+                } else if (!is_token_char(c)) {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                }
+                break;
+            case STATE_HEADER_VALUE_START:
+                if (c == '\r') {
+                    parser->token_start = p;
+                    parser->value_end = p;
+                    parser->state = STATE_HEADER_LF;
+                } else if ((c != ' ') && (c != '\t')) {
+                    if (!is_value_char(c)) {
+                        return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                    }
+                    parser->token_start = p;
+                    parser->value_end = p + 1;
+                    parser->state = STATE_HEADER_VALUE;
+                }
+                break;
+            case STATE_HEADER_VALUE:
+                if (c == '\r') {
+                    parser->state = STATE_HEADER_LF;
+                } else if (!is_value_char(c)) {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                } else if ((c != ' ') && (c != '\t')) {
+                    parser->value_end = p + 1;
+                }
+                break;
+            case STATE_HEADER_LF: {
+                if (c != '\n') {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                }
+                divulge_parser_header_t* header = parser->headers + parser->header_count;
+                header->value.offset = parser->token_start;
+                header->value.size = parser->value_end - parser->token_start;
+                divulge_parser_error_t error = commit_header(parser, buffer);
+                if (error != DIVULGE_PARSER_ERROR_NONE) {
+                    return fail(parser, error);
+                }
+                parser->line_start = p + 1;
+                parser->state = STATE_HEADER_LINE_START;
+                break;
+            }
+            case STATE_HEADERS_END_LF:
+                if (c != '\n') {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                }
+                parser->header_block.size = (p - 1) - parser->header_block.offset;
+                parser->body.offset = p + 1;
+                if (parser->is_chunked && parser->has_content_length) {
+                    return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+                }
+                parser->state = STATE_BODY;
+                break;
+            default:
+                return fail(parser, DIVULGE_PARSER_ERROR_BAD_REQUEST);
+        }
+        p++;
+    }
+    parser->position = p;
+    if ((parser->state == STATE_BODY) && !parser->is_chunked) {
+        if ((buffer_size - parser->body.offset) < parser->body.size) {
+            return DIVULGE_PARSER_STATUS_INCOMPLETE;
+        }
+        parser->position = parser->body.offset + parser->body.size;
+        parser->state = STATE_DONE;
+    }
+    if (parser->state == STATE_DONE) {
+        return DIVULGE_PARSER_STATUS_COMPLETE;
+    }
+    return (parser->state == STATE_ERROR) ? DIVULGE_PARSER_STATUS_ERROR : DIVULGE_PARSER_STATUS_INCOMPLETE;
+}
+
+size_t divulge_parser_get_request_size(const divulge_parser_t* parser) {
+    if (!parser || (parser->state != STATE_DONE)) {
+        return 0;
+    }
+    return parser->position;
+}
+
+bool divulge_parser_has_header_block(const divulge_parser_t* parser) {
+    return parser && ((parser->state == STATE_BODY) || (parser->state == STATE_DONE));
+}
+
+void divulge_parser_complete_body(divulge_parser_t* parser, size_t body_size) {
+    if (!parser || (parser->state != STATE_BODY)) {
+        return;
+    }
+    parser->body.size = body_size;
+    parser->position = parser->body.offset + body_size;
+    parser->state = STATE_DONE;
+}
+
+int divulge_parser_get_error_status(const divulge_parser_t* parser) {
+    if (!parser) {
+        return 400;
+    }
+    switch (parser->error) {
+        case DIVULGE_PARSER_ERROR_TARGET_TOO_LONG:
+            return 414;
+        case DIVULGE_PARSER_ERROR_HEADER_TOO_LARGE:
+            return 431;
+        case DIVULGE_PARSER_ERROR_UNSUPPORTED_VERSION:
+            return 505;
+        case DIVULGE_PARSER_ERROR_UNSUPPORTED_TRANSFER_ENCODING:
+            return 501;
+        case DIVULGE_PARSER_ERROR_UNSUPPORTED_EXPECTATION:
+            return 417;
+        default:
+            return 400;
+    }
+}
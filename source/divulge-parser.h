@@ -0,0 +1,141 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_PARSER_H
+#define DIVULGE_PARSER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+/**
+ * @defgroup divulge-parser Divulge request parser
+ * @ingroup divulge
+ * @brief Resumable HTTP/1.1 request parser
+ *
+ * The parser is fed the request buffer every time more bytes arrive. It remembers where it stopped, so each
+ * byte is inspected once, and it never writes to the buffer. All results are offsets into the buffer, which
+ * may therefore be moved or reallocated between calls.
+ *
+ * A `Content-Length` body is awaited in the buffer. A chunked body is left to the caller (see divulge-body.h):
+ * the parser stops after the header block and divulge_parser_complete_body() finishes the request.
+ * @{
+ */
+#define DIVULGE_PARSER_MAX_HEADERS (32)
+#define DIVULGE_PARSER_DEFAULT_MAX_LINE_SIZE (8192)
+#define DIVULGE_PARSER_DEFAULT_MAX_HEADER_SIZE (16384)
+
+typedef enum divulge_parser_status {
+    DIVULGE_PARSER_STATUS_INCOMPLETE,
+    DIVULGE_PARSER_STATUS_COMPLETE,
+    DIVULGE_PARSER_STATUS_ERROR,
+} divulge_parser_status_t;
+
+typedef enum divulge_parser_error {
+    DIVULGE_PARSER_ERROR_NONE,
+    DIVULGE_PARSER_ERROR_BAD_REQUEST,
+    DIVULGE_PARSER_ERROR_TARGET_TOO_LONG,
+    DIVULGE_PARSER_ERROR_HEADER_TOO_LARGE,
+    DIVULGE_PARSER_ERROR_UNSUPPORTED_VERSION,
+    DIVULGE_PARSER_ERROR_UNSUPPORTED_TRANSFER_ENCODING,
+    DIVULGE_PARSER_ERROR_UNSUPPORTED_EXPECTATION,
+} divulge_parser_error_t;
+
+typedef struct divulge_span {
+    size_t offset;
+    size_t size;
+} divulge_span_t;
+
+typedef struct divulge_parser_header {
+    divulge_span_t key;
+    divulge_span_t value;
+} divulge_parser_header_t;
+
+typedef struct divulge_parser_limits {
+    size_t max_line_size;
+    size_t max_header_size;
+} divulge_parser_limits_t;
+
+typedef struct divulge_parser {
+    divulge_span_t method;
+    divulge_span_t target;
+    divulge_span_t path;
+    divulge_span_t query;
+    divulge_span_t version;
+    int version_minor;
+    divulge_span_t header_block;
+    divulge_parser_header_t headers[DIVULGE_PARSER_MAX_HEADERS];
+    size_t header_count;
+    divulge_span_t body;
+    bool has_content_length;
+    bool is_chunked;
+    bool expects_continue; /**< `Expect: 100-continue`, the client waits for an interim response */
+    divulge_parser_error_t error;
+    divulge_parser_limits_t limits;
+    int state;
+    size_t position;
+    size_t line_start;
+    size_t token_start;
+    size_t query_start;
+    size_t value_end;
+} divulge_parser_t;
+
+/**
+ * @brief Prepare the parser for a new request
+ * @param parser parser to reset
+ * @param limits line and header block size limits, NULL for the defaults
+ */
+void divulge_parser_initialize(divulge_parser_t* parser, const divulge_parser_limits_t* limits);
+
+/**
+ * @brief Continue parsing
+ * @param parser parser
+ * @param buffer all bytes of the request received so far, starting with the request line
+ * @param buffer_size number of bytes in `buffer`
+ * @return DIVULGE_PARSER_STATUS_COMPLETE once the request line, headers and body are available; never for a
+ * chunked body
+ */
+divulge_parser_status_t divulge_parser_feed(divulge_parser_t* parser, const char* buffer, size_t buffer_size);
+
+/**
+ * @brief Number of buffer bytes taken by the complete request, including its body
+ */
+size_t divulge_parser_get_request_size(const divulge_parser_t* parser);
+
+/**
+ * @brief Whether the request line and the headers were parsed, though the body may still be missing
+ */
+bool divulge_parser_has_header_block(const divulge_parser_t* parser);
+
+/**
+ * @brief Finish a request whose body the caller decoded in place, so that it starts at `body.offset`
+ * @param body_size decoded body bytes, 0 when the body is consumed elsewhere
+ */
+void divulge_parser_complete_body(divulge_parser_t* parser, size_t body_size);
+
+/**
+ * @brief HTTP status code best describing the parser error
+ */
+int divulge_parser_get_error_status(const divulge_parser_t* parser);
+/**
+ * @}
+ */
+#endif  // DIVULGE_PARSER_H
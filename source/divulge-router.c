@@ -0,0 +1,335 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-router.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct router_node {
+    char* segment;
+    size_t segment_size;
+    struct router_node** children;
+    size_t child_count;
+    struct router_node* parameter_child;
+    struct router_node* wildcard_child;
+    void* values[DIVULGE_ROUTE_METHOD_COUNT];
+} router_node_t;
+
+typedef struct divulge_router {
+    router_node_t root;
+} divulge_router_t;
+
+typedef enum segment_type {
+    SEGMENT_TYPE_STATIC,
+    SEGMENT_TYPE_PARAMETER,
+    SEGMENT_TYPE_WILDCARD,
+} segment_type_t;
+
+static int compare_segments(const char* a, size_t a_size, const char* b, size_t b_size) {
+    if (a_size != b_size) {
+        return (a_size < b_size) ? -1 : 1;
+    }
+    return memcmp(a, b, a_size);
+}
+
+static router_node_t* create_node(const char* segment, size_t segment_size) {
+    router_node_t* node = calloc(1, sizeof(router_node_t));
+    if (!node) {
+        return NULL;
+    }
+    node->segment = malloc(segment_size + 1);
+    if (!node->segment) {
+        free(node);
+        return NULL;
+    }
+    memcpy(node->segment, segment, segment_size);
+    node->segment[segment_size] = '\0';
+    node->segment_size = segment_size;
+    return node;
+}
+
+static void destroy_node_children(router_node_t* node) {
+    for (size_t i = 0; i < node->child_count; i++) {
+        destroy_node_children(node->children[i]);
+        free(node->children[i]->segment);
+        free(node->children[i]);
+    }
+    free(node->children);
+    router_node_t* special_children[] = {node->parameter_child, node->wildcard_child};
+    for (size_t i = 0; i < 2; i++) {
+        if (special_children[i]) {
+            destroy_node_children(special_children[i]);
+            free(special_children[i]->segment);
+            free(special_children[i]);
+        }
+    }
+}
+
+static size_t find_child_position(router_node_t* node, const char* segment, size_t segment_size, bool* found) {
+    size_t low = 0;
+    size_t high = node->child_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        router_node_t* child = node->children[middle];
+        int result = compare_segments(child->segment, child->segment_size, segment, segment_size);
+        if (result == 0) {
+            *found = true;
+            return middle;
+        } else if (result < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *found = false;
+    return low;
+}
+
+static router_node_t* find_static_child(router_node_t* node, const char* segment, size_t segment_size) {
+    bool found = false;
+    size_t position = find_child_position(node, segment, segment_size, &found);
+    return found ? node->children[position] : NULL;
+}
+
+static router_node_t* insert_static_child(router_node_t* node, const char* segment, size_t segment_size) {
+    bool found = false;
+    size_t position = find_child_position(node, segment, segment_size, &found);
+    if (found) {
+        return node->children[position];
+    }
+    router_node_t** children = realloc(node->children, (node->child_count + 1) * sizeof(router_node_t*));
+    if (!children) {
+        return NULL;
+    }
+    node->children = children;
+    router_node_t* child = create_node(segment, segment_size);
+    if (!child) {
+        return NULL;
+    }
+    memmove(node->children + position + 1, node->children + position,
+            (node->child_count - position) * sizeof(router_node_t*));
+    node->children[position] = child;
+    node->child_count++;
+    return child;
+}
+
+static router_node_t* insert_special_child(router_node_t** slot, const char* segment, size_t segment_size) {
+    if (*slot) {
+        bool is_same_name = compare_segments((*slot)->segment, (*slot)->segment_size, segment, segment_size) == 0;
+        return is_same_name ? *slot : NULL;
+    }
+    *slot = create_node(segment, segment_size);
+    return *slot;
+}
+
+static segment_type_t get_segment_type(const char* segment, size_t segment_size) {
+    if ((segment_size > 0) && (segment[0] == ':')) {
+        return SEGMENT_TYPE_PARAMETER;
+    } else if ((segment_size > 0) && (segment[0] == '*')) {
+        return SEGMENT_TYPE_WILDCARD;
+    } else {
+        return SEGMENT_TYPE_STATIC;
+    }
+}
+
+static size_t get_segment_size(const char* segment, const char* end) {
+    const char* separator = memchr(segment, '/', (size_t)(end - segment));
+    return separator ? (size_t)(separator - segment) : (size_t)(end - segment);
+}
+
+static router_node_t* walk_pattern(divulge_router_t* router, const char* pattern, bool create) {
+    if (!pattern || (pattern[0] != '/')) {
+        return NULL;
+    }
+    router_node_t* node = &router->root;
+    const char* end = pattern + strlen(pattern);
+    const char* segment = pattern + 1;
+    if (segment == end) {
+        return node;
+    }
+    while (node && (segment <= end)) {
+        size_t segment_size = get_segment_size(segment, end);
+        bool is_last = (segment + segment_size) == end;
+        segment_type_t type = get_segment_type(segment, segment_size);
+        if (type == SEGMENT_TYPE_PARAMETER) {
+            if (segment_size < 2) {
+                return NULL;
+            }
+            node = create ? insert_special_child(&node->parameter_child, segment + 1, segment_size - 1)
+                          : node->parameter_child;
+        } else if (type == SEGMENT_TYPE_WILDCARD) {
+            if (!is_last) {
+                return NULL;
+            }
+            const char* name = (segment_size > 1) ? segment + 1 : segment;
+            size_t name_size = (segment_size > 1) ? segment_size - 1 : 1;
+            node = create ? insert_special_child(&node->wildcard_child, name, name_size) : node->wildcard_child;
+        } else {
+            node = create ? insert_static_child(node, segment, segment_size)
+                          : find_static_child(node, segment, segment_size);
+        }
+        segment += segment_size + 1;
+    }
+    return node;
+}
+
+divulge_router_t* divulge_router_create(void) {
+    return calloc(1, sizeof(divulge_router_t));
+}
+
+void divulge_router_destroy(divulge_router_t* router) {
+    if (!router) {
+        return;
+    }
+    destroy_node_children(&router->root);
+    free(router);
+}
+
+bool divulge_router_insert(divulge_router_t* router, divulge_route_method_t method, const char* pattern, void* value) {
+    if (!router || ((size_t)method >= DIVULGE_ROUTE_METHOD_COUNT) || !value) {
+        return false;
+    }
+    router_node_t* node = walk_pattern(router, pattern, true);
+    if (!node || node->values[method]) {
+        return false;
+    }
+    node->values[method] = value;
+    return true;
+}
+
+void* divulge_router_find(divulge_router_t* router, divulge_route_method_t method, const char* pattern) {
+    if (!router || ((size_t)method >= DIVULGE_ROUTE_METHOD_COUNT)) {
+        return NULL;
+    }
+    router_node_t* node = walk_pattern(router, pattern, false);
+    return node ? node->values[method] : NULL;
+}
+
+typedef struct lookup_state {
+    divulge_route_method_t method;
+    const char* end;
+    divulge_route_parameter_t* parameters;
+    size_t parameter_count;
+} lookup_state_t;
+
+static bool push_parameter(lookup_state_t* state,
+                           router_node_t* node,
+                           const char* value,
+                           size_t value_size) {
+    if (state->parameter_count >= DIVULGE_MAX_ROUTE_PARAMETERS) {
+        return false;
+    }
+    divulge_route_parameter_t* parameter = state->parameters + state->parameter_count++;
+    parameter->name.data = node->segment;
+    parameter->name.size = node->segment_size;
+    parameter->value.data = value;
+    parameter->value.size = value_size;
+    return true;
+}
+
+static void* lookup_node(lookup_state_t* state, router_node_t* node, const char* segment) {
+    if (segment > state->end) {
+        return node->values[state->method];
+    }
+    size_t segment_size = get_segment_size(segment, state->end);
+    const char* next = segment + segment_size + 1;
+    router_node_t* child = find_static_child(node, segment, segment_size);
+    if (child) {
+        void* value = lookup_node(state, child, next);
+        if (value) {
+            return value;
+        }
+    }
+    size_t parameter_count = state->parameter_count;
+    if (node->parameter_child && (segment_size > 0) &&
+        push_parameter(state, node->parameter_child, segment, segment_size)) {
+        void* value = lookup_node(state, node->parameter_child, next);
+        if (value) {
+            return value;
+        }
+        state->parameter_count = parameter_count;
+    }
+    if (node->wildcard_child && node->wildcard_child->values[state->method] &&
+        push_parameter(state, node->wildcard_child, segment, (size_t)(state->end - segment))) {
+        return node->wildcard_child->values[state->method];
+    }
+    return NULL;
+}
+
+void* divulge_router_lookup(divulge_router_t* router,
+                            divulge_route_method_t method,
+                            const char* path,
+                            size_t path_size,
+                            divulge_route_parameter_t* parameters,
+                            size_t* parameter_count) {
+    if (!router || ((size_t)method >= DIVULGE_ROUTE_METHOD_COUNT) || !path || (path_size == 0) || (path[0] != '/') ||
+        !parameters || !parameter_count) {
+        return NULL;
+    }
+    lookup_state_t state = {
+        .method = method,
+        .end = path + path_size,
+        .parameters = parameters,
+        .parameter_count = 0,
+    };
+    void* value = (path_size == 1) ? router->root.values[method] : lookup_node(&state, &router->root, path + 1);
+    *parameter_count = value ? state.parameter_count : 0;
+    return value;
+}
+
+uint32_t divulge_router_get_methods(divulge_router_t* router, const char* path, size_t path_size) {
+    uint32_t methods = 0;
+    divulge_route_parameter_t parameters[DIVULGE_MAX_ROUTE_PARAMETERS];
+    size_t parameter_count = 0;
+    for (size_t method = 0; method < DIVULGE_ROUTE_METHOD_COUNT; method++) {
+        if (divulge_router_lookup(router, (divulge_route_method_t)method, path, path_size, parameters,
+                                  &parameter_count)) {
+            methods |= 1u << method;
+        }
+    }
+    return methods;
+}
+
+static void for_each_node(router_node_t* node, void (*callback)(void* value, void* context), void* context) {
+    for (size_t i = 0; i < DIVULGE_ROUTE_METHOD_COUNT; i++) {
+        if (node->values[i]) {
+            callback(node->values[i], context);
+        }
+    }
+    for (size_t i = 0; i < node->child_count; i++) {
+        for_each_node(node->children[i], callback, context);
+    }
+    if (node->parameter_child) {
+        for_each_node(node->parameter_child, callback, context);
+    }
+    if (node->wildcard_child) {
+        for_each_node(node->wildcard_child, callback, context);
+    }
+}
+
+void divulge_router_for_each(divulge_router_t* router, void (*callback)(void* value, void* context), void* context) {
+    if (!router || !callback) {
+        return;
+    }
+    for_each_node(&router->root, callback, context);
+}
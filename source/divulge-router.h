@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_ROUTER_H
+#define DIVULGE_ROUTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-router Divulge router
+ * @ingroup divulge
+ * @brief Route trie keyed by path segment and method
+ *
+ * Every node of the trie stands for one path segment. A node has sorted static children, at most one
+ * `:parameter` child and at most one trailing `*` wildcard child, and a value slot per method. Static segments
+ * take precedence over parameters, which take precedence over the wildcard, as long as the node has a value for
+ * the method.
+ * @{
+ */
+typedef struct divulge_router divulge_router_t;
+
+divulge_router_t* divulge_router_create(void);
+
+void divulge_router_destroy(divulge_router_t* router);
+
+/**
+ * @brief Store a value under a route pattern
+ * @param router router to insert into
+ * @param method method the value is bound to
+ * @param pattern route pattern, e.g. `/users/:id`; a trailing `*` segment captures the rest of the path
+ * @param value value to store
+ * @return false when the pattern is malformed, conflicts with another pattern or is already taken
+ */
+bool divulge_router_insert(divulge_router_t* router, divulge_route_method_t method, const char* pattern, void* value);
+
+/**
+ * @brief Find the value stored under the exact pattern
+ */
+void* divulge_router_find(divulge_router_t* router, divulge_route_method_t method, const char* pattern);
+
+/**
+ * @brief Match a request path
+ * @param router router to search
+ * @param method request method
+ * @param path request path, does not need to be NUL-terminated
+ * @param path_size length of the path
+ * @param parameters captured parameters, pointing into `path`
+ * @param parameter_count number of captured parameters
+ * @return stored value, or NULL when nothing matched
+ */
+void* divulge_router_lookup(divulge_router_t* router,
+                            divulge_route_method_t method,
+                            const char* path,
+                            size_t path_size,
+                            divulge_route_parameter_t* parameters,
+                            size_t* parameter_count);
+
+/**
+ * @brief Tell which methods a request path is matched with
+ * @return bit `1 << method` set for every method the path has a value for
+ */
+uint32_t divulge_router_get_methods(divulge_router_t* router, const char* path, size_t path_size);
+
+/**
+ * @brief Call `callback` for every stored value
+ */
+void divulge_router_for_each(divulge_router_t* router, void (*callback)(void* value, void* context), void* context);
+/**
+ * @}
+ */
+#endif  // DIVULGE_ROUTER_H
@@ -0,0 +1,357 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-routes.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define READER_SHARDS (16)
+#define CACHE_LINE_SIZE (64)
+
+typedef struct reader_counter {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t count;
+} reader_counter_t;
+
+typedef struct snapshot_node {
+    divulge_routes_snapshot_t snapshot;
+    divulge_handler_object_t* middlewares;
+    unsigned long retired_epoch;
+    struct snapshot_node* next;
+} snapshot_node_t;
+
+typedef struct divulge_routes {
+    reader_counter_t readers[2][READER_SHARDS];
+    atomic_ulong epoch;
+    _Atomic(snapshot_node_t*) current;
+    atomic_size_t retired_count;
+    snapshot_node_t* retired;
+    atomic_ulong published_version;
+    pthread_mutex_t lock;
+    divulge_router_t* patterns;
+    divulge_route_entry_t* entries;
+    size_t entry_count;
+    divulge_handler_object_t not_found;
+    size_t update_depth;
+    bool is_dirty;
+    unsigned long version;
+} divulge_routes_t;
+
+static atomic_uint next_reader_shard;
+static _Thread_local unsigned reader_shard = UINT_MAX;
+
+static void free_snapshot(snapshot_node_t* node) {
+    divulge_router_destroy(node->snapshot.router);
+    free(node->snapshot.entries);
+    free(node->middlewares);
+    free(node);
+}
+
+static snapshot_node_t* compile_snapshot(divulge_routes_t* routes) {
+    snapshot_node_t* node = calloc(1, sizeof(snapshot_node_t));
+    if (!node) {
+        return NULL;
+    }
+    size_t middleware_count = 0;
+    for (size_t i = 0; i < routes->entry_count; i++) {
+        middleware_count += routes->entries[i].middleware_count;
+    }
+    node->snapshot.router = divulge_router_create();
+    node->snapshot.entries = calloc(routes->entry_count + 1, sizeof(divulge_route_entry_t));
+    node->middlewares = calloc(middleware_count + 1, sizeof(divulge_handler_object_t));
+    if (!node->snapshot.router || !node->snapshot.entries || !node->middlewares) {
+        free_snapshot(node);
+        return NULL;
+    }
+    divulge_handler_object_t* middlewares = node->middlewares;
+    for (size_t i = 0; i < routes->entry_count; i++) {
+        divulge_route_entry_t* source = routes->entries + i;
+        divulge_route_entry_t* entry = node->snapshot.entries + i;
+        entry->uri = source->uri;
+        entry->middlewares = middlewares;
+        entry->middleware_count = source->middleware_count;
+        if (source->middleware_count > 0) {
+            memcpy(middlewares, source->middlewares, source->middleware_count * sizeof(divulge_handler_object_t));
+        }
+        middlewares += source->middleware_count;
+        divulge_router_insert(node->snapshot.router, entry->uri.method, entry->uri.uri, entry);
+    }
+    node->snapshot.entry_count = routes->entry_count;
+    node->snapshot.not_found = routes->not_found;
+    node->snapshot.version = routes->version;
+    return node;
+}
+
+static bool is_reader_parity_drained(divulge_routes_t* routes, unsigned long parity) {
+    for (size_t i = 0; i < READER_SHARDS; i++) {
+        if (atomic_load(&routes->readers[parity][i].count) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool try_advance_epoch(divulge_routes_t* routes) {
+    unsigned long epoch = atomic_load(&routes->epoch);
+    if (!is_reader_parity_drained(routes, (epoch + 1) & 1)) {
+        return false;
+    }
+    atomic_store(&routes->epoch, epoch + 1);
+    return true;
+}
+
+static void reclaim_snapshots(divulge_routes_t* routes) {
+    for (size_t i = 0; (i < 2) && routes->retired; i++) {
+        if (!try_advance_epoch(routes)) {
+            break;
+        }
+    }
+    unsigned long epoch = atomic_load(&routes->epoch);
+    snapshot_node_t** link = &routes->retired;
+    while (*link) {
+        snapshot_node_t* node = *link;
+        if (epoch >= node->retired_epoch + 2) {
+            *link = node->next;
+            free_snapshot(node);
+            atomic_fetch_sub(&routes->retired_count, 1);
+        } else {
+            link = &node->next;
+        }
+    }
+}
+
+static bool publish_snapshot(divulge_routes_t* routes) {
+    if (routes->update_depth > 0) {
+        routes->is_dirty = true;
+        return true;
+    }
+    routes->version++;
+    snapshot_node_t* node = compile_snapshot(routes);
+    if (!node) {
+        return false;
+    }
+    snapshot_node_t* previous = atomic_exchange(&routes->current, node);
+    atomic_store(&routes->published_version, routes->version);
+    routes->is_dirty = false;
+    if (previous) {
+        previous->retired_epoch = atomic_load(&routes->epoch);
+        previous->next = routes->retired;
+        routes->retired = previous;
+        atomic_fetch_add(&routes->retired_count, 1);
+    }
+    reclaim_snapshots(routes);
+    return true;
+}
+
+static divulge_route_entry_t* find_entry(divulge_routes_t* routes, const divulge_uri_t* uri) {
+    for (size_t i = 0; i < routes->entry_count; i++) {
+        divulge_route_entry_t* entry = routes->entries + i;
+        if ((entry->uri.method == uri->method) && (strcmp(entry->uri.uri, uri->uri) == 0)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool rebuild_patterns(divulge_routes_t* routes) {
+    divulge_router_t* patterns = divulge_router_create();
+    if (!patterns) {
+        return false;
+    }
+    for (size_t i = 0; i < routes->entry_count; i++) {
+        divulge_router_insert(patterns, routes->entries[i].uri.method, routes->entries[i].uri.uri, routes);
+    }
+    divulge_router_destroy(routes->patterns);
+    routes->patterns = patterns;
+    return true;
+}
+
+divulge_routes_t* divulge_routes_create(void) {
+    divulge_routes_t* routes = aligned_alloc(CACHE_LINE_SIZE, sizeof(divulge_routes_t));
+    if (!routes) {
+        return NULL;
+    }
+    memset(routes, 0, sizeof(divulge_routes_t));
+    pthread_mutex_init(&routes->lock, NULL);
+    routes->patterns = divulge_router_create();
+    if (!routes->patterns || !publish_snapshot(routes)) {
+        divulge_router_destroy(routes->patterns);
+        pthread_mutex_destroy(&routes->lock);
+        free(routes);
+        return NULL;
+    }
+    return routes;
+}
+
+bool divulge_routes_register(divulge_routes_t* routes, const divulge_uri_t* uri) {
+    if (!routes || !uri || !uri->uri || !uri->handler.handler) {
+        return false;
+    }
+    pthread_mutex_lock(&routes->lock);
+    bool result = true;
+    divulge_route_entry_t* entry = find_entry(routes, uri);
+    if (entry) {
+        entry->uri.handler = uri->handler;
+        entry->uri.is_streaming_body = uri->is_streaming_body;
+    } else {
+        divulge_route_entry_t* entries =
+            realloc(routes->entries, (routes->entry_count + 1) * sizeof(divulge_route_entry_t));
+        result = entries && divulge_router_insert(routes->patterns, uri->method, uri->uri, routes);
+        if (entries) {
+            routes->entries = entries;
+        }
+        if (result) {
+            entry = routes->entries + routes->entry_count++;
+            memset(entry, 0, sizeof(*entry));
+            entry->uri = *uri;
+        }
+    }
+    result = result && publish_snapshot(routes);
+    pthread_mutex_unlock(&routes->lock);
+    return result;
+}
+
+bool divulge_routes_unregister(divulge_routes_t* routes, const divulge_uri_t* uri) {
+    if (!routes || !uri || !uri->uri) {
+        return false;
+    }
+    pthread_mutex_lock(&routes->lock);
+    divulge_route_entry_t* entry = find_entry(routes, uri);
+    bool result = (entry != NULL);
+    if (entry) {
+        free(entry->middlewares);
+        size_t index = (size_t)(entry - routes->entries);
+        memmove(entry, entry + 1, (routes->entry_count - index - 1) * sizeof(divulge_route_entry_t));
+        routes->entry_count--;
+        result = rebuild_patterns(routes) && publish_snapshot(routes);
+    }
+    pthread_mutex_unlock(&routes->lock);
+    return result;
+}
+
+bool divulge_routes_add_middleware(divulge_routes_t* routes,
+                                   const divulge_uri_t* uri,
+                                   const divulge_handler_object_t* middleware) {
+    if (!routes || !uri || !uri->uri || !middleware || !middleware->handler) {
+        return false;
+    }
+    pthread_mutex_lock(&routes->lock);
+    divulge_route_entry_t* entry = find_entry(routes, uri);
+    bool result = false;
+    if (entry) {
+        divulge_handler_object_t* middlewares =
+            realloc(entry->middlewares, (entry->middleware_count + 1) * sizeof(divulge_handler_object_t));
+        if (middlewares) {
+            entry->middlewares = middlewares;
+            entry->middlewares[entry->middleware_count++] = *middleware;
+            result = publish_snapshot(routes);
+        }
+    }
+    pthread_mutex_unlock(&routes->lock);
+    return result;
+}
+
+bool divulge_routes_remove_middleware(divulge_routes_t* routes,
+                                      const divulge_uri_t* uri,
+                                      const divulge_handler_object_t* middleware) {
+    if (!routes || !uri || !uri->uri || !middleware) {
+        return false;
+    }
+    pthread_mutex_lock(&routes->lock);
+    divulge_route_entry_t* entry = find_entry(routes, uri);
+    bool result = false;
+    for (size_t i = 0; entry && (i < entry->middleware_count); i++) {
+        divulge_handler_object_t* object = entry->middlewares + i;
+        if ((object->handler == middleware->handler) && (object->context == middleware->context)) {
+            memmove(object, object + 1, (entry->middleware_count - i - 1) * sizeof(divulge_handler_object_t));
+            entry->middleware_count--;
+            result = publish_snapshot(routes);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&routes->lock);
+    return result;
+}
+
+bool divulge_routes_set_not_found_handler(divulge_routes_t* routes, const divulge_handler_object_t* handler) {
+    if (!routes || !handler || !handler->handler) {
+        return false;
+    }
+    pthread_mutex_lock(&routes->lock);
+    routes->not_found = *handler;
+    bool result = publish_snapshot(routes);
+    pthread_mutex_unlock(&routes->lock);
+    return result;
+}
+
+void divulge_routes_begin_update(divulge_routes_t* routes) {
+    if (!routes) {
+        return;
+    }
+    pthread_mutex_lock(&routes->lock);
+    routes->update_depth++;
+    pthread_mutex_unlock(&routes->lock);
+}
+
+void divulge_routes_end_update(divulge_routes_t* routes) {
+    if (!routes) {
+        return;
+    }
+    pthread_mutex_lock(&routes->lock);
+    if (routes->update_depth > 0) {
+        routes->update_depth--;
+    }
+    if ((routes->update_depth == 0) && routes->is_dirty) {
+        publish_snapshot(routes);
+    }
+    pthread_mutex_unlock(&routes->lock);
+}
+
+unsigned long divulge_routes_get_version(divulge_routes_t* routes) {
+    if (!routes) {
+        return 0;
+    }
+    return atomic_load(&routes->published_version);
+}
+
+void divulge_routes_acquire(divulge_routes_t* routes, divulge_routes_reader_t* reader) {
+    if (reader_shard == UINT_MAX) {
+        reader_shard = atomic_fetch_add(&next_reader_shard, 1) % READER_SHARDS;
+    }
+    unsigned parity = (unsigned)(atomic_load(&routes->epoch) & 1);
+    atomic_fetch_add(&routes->readers[parity][reader_shard].count, 1);
+    reader->slot = parity * READER_SHARDS + reader_shard;
+    reader->snapshot = &atomic_load(&routes->current)->snapshot;
+}
+
+void divulge_routes_release(divulge_routes_t* routes, divulge_routes_reader_t* reader) {
+    atomic_fetch_sub(&routes->readers[reader->slot / READER_SHARDS][reader->slot % READER_SHARDS].count, 1);
+    reader->snapshot = NULL;
+    if ((atomic_load_explicit(&routes->retired_count, memory_order_relaxed) > 0) &&
+        (pthread_mutex_trylock(&routes->lock) == 0)) {
+        reclaim_snapshots(routes);
+        pthread_mutex_unlock(&routes->lock);
+    }
+}
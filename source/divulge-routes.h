@@ -0,0 +1,99 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_ROUTES_H
+#define DIVULGE_ROUTES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "divulge-router.h"
+#include "divulge.h"
+/**
+ * @defgroup divulge-routes Divulge route table
+ * @ingroup divulge
+ * @brief Versioned, read-copy-update route table
+ *
+ * Writers edit a private registry under a mutex and publish an immutable snapshot compiled from it. Readers
+ * pin the current snapshot without locking: they only bump a per-thread reader counter of the current epoch.
+ * A replaced snapshot is freed once both epoch counters have been seen drained after it was unpublished.
+ * @{
+ */
+typedef struct divulge_route_entry {
+    divulge_uri_t uri;
+    divulge_handler_object_t* middlewares;
+    size_t middleware_count;
+} divulge_route_entry_t;
+
+typedef struct divulge_routes_snapshot {
+    divulge_router_t* router;
+    divulge_route_entry_t* entries;
+    size_t entry_count;
+    divulge_handler_object_t not_found; /**< handler of requests no route matches, NULL for the built-in one */
+    unsigned long version;
+} divulge_routes_snapshot_t;
+
+typedef struct divulge_routes divulge_routes_t;
+
+typedef struct divulge_routes_reader {
+    const divulge_routes_snapshot_t* snapshot;
+    unsigned slot;
+} divulge_routes_reader_t;
+
+divulge_routes_t* divulge_routes_create(void);
+
+bool divulge_routes_register(divulge_routes_t* routes, const divulge_uri_t* uri);
+
+bool divulge_routes_unregister(divulge_routes_t* routes, const divulge_uri_t* uri);
+
+bool divulge_routes_add_middleware(divulge_routes_t* routes,
+                                   const divulge_uri_t* uri,
+                                   const divulge_handler_object_t* middleware);
+
+bool divulge_routes_remove_middleware(divulge_routes_t* routes,
+                                      const divulge_uri_t* uri,
+                                      const divulge_handler_object_t* middleware);
+
+/**
+ * @brief Publish the handler of requests no route matches, together with its context
+ */
+bool divulge_routes_set_not_found_handler(divulge_routes_t* routes, const divulge_handler_object_t* handler);
+
+/**
+ * @brief Defer publishing until the matching divulge_routes_end_update()
+ */
+void divulge_routes_begin_update(divulge_routes_t* routes);
+
+void divulge_routes_end_update(divulge_routes_t* routes);
+
+unsigned long divulge_routes_get_version(divulge_routes_t* routes);
+
+/**
+ * @brief Pin the current snapshot; never blocks
+ */
+void divulge_routes_acquire(divulge_routes_t* routes, divulge_routes_reader_t* reader);
+
+void divulge_routes_release(divulge_routes_t* routes, divulge_routes_reader_t* reader);
+/**
+ * @}
+ */
+#endif  // DIVULGE_ROUTES_H
@@ -0,0 +1,298 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-scan.h"
+#include <stdatomic.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define DIVULGE_SCAN_X86 (1)
+#include <immintrin.h>
+#endif
+
+typedef size_t (*scan_function_t)(const char* data, size_t size);
+
+typedef struct scan_kernels {
+    divulge_scan_implementation_t implementation;
+    scan_function_t functions[4];
+} scan_kernels_t;
+
+const uint8_t divulge_scan_character_classes[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    4, 15, 14, 15, 15, 15, 15, 15, 14, 14, 15, 15, 14, 15, 15, 14,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 14, 14, 14, 14, 6,
+    14, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 14, 14, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 15, 14, 15, 0,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+    14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+};
+
+static size_t scan_scalar(const char* data, size_t size, unsigned class_bit) {
+    for (size_t i = 0; i < size; i++) {
+        if (!divulge_scan_is_in_class((unsigned char)data[i], class_bit)) {
+            return i;
+        }
+    }
+    return size;
+}
+
+static size_t scan_scalar_token(const char* data, size_t size) {
+    return scan_scalar(data, size, DIVULGE_SCAN_CLASS_TOKEN_BIT);
+}
+
+static size_t scan_scalar_target(const char* data, size_t size) {
+    return scan_scalar(data, size, DIVULGE_SCAN_CLASS_TARGET_BIT);
+}
+
+static size_t scan_scalar_value(const char* data, size_t size) {
+    return scan_scalar(data, size, DIVULGE_SCAN_CLASS_VALUE_BIT);
+}
+
+static size_t scan_scalar_path(const char* data, size_t size) {
+    return scan_scalar(data, size, DIVULGE_SCAN_CLASS_PATH_BIT);
+}
+
+static const scan_kernels_t scalar_kernels = {
+    .implementation = DIVULGE_SCAN_IMPLEMENTATION_SCALAR,
+    .functions = {scan_scalar_token, scan_scalar_target, scan_scalar_value, scan_scalar_path},
+};
+
+#ifdef DIVULGE_SCAN_X86
+/*
+ * SSE4.2: PCMPESTRI finds the first byte falling into up to eight ranges of rejected characters. The token ranges
+ * also cover '|' and '~' to stay within eight ranges, so a hit is confirmed with the scalar table.
+ */
+static const char sse42_token_ranges[16] = "\x00 \"\"(),,//:@[]{\xff";
+static const char sse42_target_ranges[16] = "\x00 \x7f\x7f";
+static const char sse42_value_ranges[16] = "\x00\x08\x0a\x1f\x7f\x7f";
+static const char sse42_path_ranges[16] = "\x00 ??\x7f\x7f";
+
+__attribute__((target("sse4.2"))) static size_t scan_sse42(const char* data,
+                                                            size_t size,
+                                                            const char* ranges_literal,
+                                                            int ranges_size,
+                                                            unsigned class_bit) {
+    __m128i ranges = _mm_loadu_si128((const __m128i*)ranges_literal);
+    size_t i = 0;
+    while (i + 16 <= size) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(data + i));
+        int index = _mm_cmpestri(ranges, ranges_size, chunk, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+        if (index == 16) {
+            i += 16;
+        } else if (!divulge_scan_is_in_class((unsigned char)data[i + (size_t)index], class_bit)) {
+            return i + (size_t)index;
+        } else {
+            i += (size_t)index + 1;
+        }
+    }
+    return i + scan_scalar(data + i, size - i, class_bit);
+}
+
+__attribute__((target("sse4.2"))) static size_t scan_sse42_token(const char* data, size_t size) {
+    return scan_sse42(data, size, sse42_token_ranges, 16, DIVULGE_SCAN_CLASS_TOKEN_BIT);
+}
+
+__attribute__((target("sse4.2"))) static size_t scan_sse42_target(const char* data, size_t size) {
+    return scan_sse42(data, size, sse42_target_ranges, 4, DIVULGE_SCAN_CLASS_TARGET_BIT);
+}
+
+__attribute__((target("sse4.2"))) static size_t scan_sse42_value(const char* data, size_t size) {
+    return scan_sse42(data, size, sse42_value_ranges, 6, DIVULGE_SCAN_CLASS_VALUE_BIT);
+}
+
+__attribute__((target("sse4.2"))) static size_t scan_sse42_path(const char* data, size_t size) {
+    return scan_sse42(data, size, sse42_path_ranges, 6, DIVULGE_SCAN_CLASS_PATH_BIT);
+}
+
+static const scan_kernels_t sse42_kernels = {
+    .implementation = DIVULGE_SCAN_IMPLEMENTATION_SSE42,
+    .functions = {scan_sse42_token, scan_sse42_target, scan_sse42_value, scan_sse42_path},
+};
+
+/*
+ * AVX2: control characters are found with unsigned min comparisons. Tokens use a nibble lookup: the low nibble
+ * selects a bitmap of allowed high nibbles, so a byte is a token when both lookups share a bit.
+ */
+static const uint8_t avx2_token_low_nibbles[32] = {
+    0xe8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc, 0xf8, 0xf8, 0xf4, 0x54, 0xd0, 0x54, 0xf4, 0x70,
+    0xe8, 0xfc, 0xf8, 0xfc, 0xfc, 0xfc, 0xfc, 0xfc, 0xf8, 0xf8, 0xf4, 0x54, 0xd0, 0x54, 0xf4, 0x70,
+};
+static const uint8_t avx2_token_high_nibbles[32] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+__attribute__((target("avx2"))) static inline __m256i find_control_avx2(__m256i chunk, char last_control) {
+    __m256i is_control = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, _mm256_set1_epi8(last_control)), chunk);
+    return _mm256_or_si256(is_control, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(0x7f)));
+}
+
+__attribute__((target("avx2"))) static inline __m256i find_rejected_avx2(__m256i chunk,
+                                                                         divulge_scan_class_t scan_class) {
+    if (scan_class == DIVULGE_SCAN_CLASS_TOKEN) {
+        __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+        __m256i low = _mm256_and_si256(chunk, nibble_mask);
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble_mask);
+        __m256i allowed_high = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)avx2_token_low_nibbles), low);
+        __m256i high_bit = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)avx2_token_high_nibbles), high);
+        return _mm256_cmpeq_epi8(_mm256_and_si256(allowed_high, high_bit), _mm256_setzero_si256());
+    } else if (scan_class == DIVULGE_SCAN_CLASS_VALUE) {
+        __m256i is_tab = _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'));
+        return _mm256_andnot_si256(is_tab, find_control_avx2(chunk, 0x1f));
+    } else if (scan_class == DIVULGE_SCAN_CLASS_PATH) {
+        return _mm256_or_si256(find_control_avx2(chunk, ' '), _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('?')));
+    } else {
+        return find_control_avx2(chunk, ' ');
+    }
+}
+
+__attribute__((target("avx2"))) static inline size_t scan_avx2(const char* data,
+                                                               size_t size,
+                                                               divulge_scan_class_t scan_class,
+                                                               unsigned class_bit) {
+    size_t i = 0;
+    while (i + 32 <= size) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(data + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(find_rejected_avx2(chunk, scan_class));
+        if (mask) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+        i += 32;
+    }
+    return i + scan_scalar(data + i, size - i, class_bit);
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2_token(const char* data, size_t size) {
+    return scan_avx2(data, size, DIVULGE_SCAN_CLASS_TOKEN, DIVULGE_SCAN_CLASS_TOKEN_BIT);
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2_target(const char* data, size_t size) {
+    return scan_avx2(data, size, DIVULGE_SCAN_CLASS_TARGET, DIVULGE_SCAN_CLASS_TARGET_BIT);
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2_value(const char* data, size_t size) {
+    return scan_avx2(data, size, DIVULGE_SCAN_CLASS_VALUE, DIVULGE_SCAN_CLASS_VALUE_BIT);
+}
+
+__attribute__((target("avx2"))) static size_t scan_avx2_path(const char* data, size_t size) {
+    return scan_avx2(data, size, DIVULGE_SCAN_CLASS_PATH, DIVULGE_SCAN_CLASS_PATH_BIT);
+}
+
+static const scan_kernels_t avx2_kernels = {
+    .implementation = DIVULGE_SCAN_IMPLEMENTATION_AVX2,
+    .functions = {scan_avx2_token, scan_avx2_target, scan_avx2_value, scan_avx2_path},
+};
+#endif
+
+static _Atomic(const scan_kernels_t*) selected_kernels;
+
+static const scan_kernels_t* get_kernels(divulge_scan_implementation_t implementation) {
+    if (!divulge_scan_is_implementation_supported(implementation)) {
+        return NULL;
+    }
+#ifdef DIVULGE_SCAN_X86
+    if (implementation == DIVULGE_SCAN_IMPLEMENTATION_AVX2) {
+        return &avx2_kernels;
+    } else if (implementation == DIVULGE_SCAN_IMPLEMENTATION_SSE42) {
+        return &sse42_kernels;
+    }
+#endif
+    return &scalar_kernels;
+}
+
+static const scan_kernels_t* detect_kernels(void) {
+    divulge_scan_implementation_t preferred[] = {
+        DIVULGE_SCAN_IMPLEMENTATION_AVX2,
+        DIVULGE_SCAN_IMPLEMENTATION_SSE42,
+    };
+    for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+        const scan_kernels_t* kernels = get_kernels(preferred[i]);
+        if (kernels) {
+            return kernels;
+        }
+    }
+    return &scalar_kernels;
+}
+
+static const scan_kernels_t* load_kernels(void) {
+    const scan_kernels_t* kernels = atomic_load_explicit(&selected_kernels, memory_order_relaxed);
+    if (!kernels) {
+        kernels = detect_kernels();
+        atomic_store_explicit(&selected_kernels, kernels, memory_order_relaxed);
+    }
+    return kernels;
+}
+
+size_t divulge_scan(divulge_scan_class_t scan_class, const char* data, size_t size) {
+    if (!data || ((unsigned)scan_class > DIVULGE_SCAN_CLASS_PATH)) {
+        return 0;
+    }
+    return load_kernels()->functions[scan_class](data, size);
+}
+
+bool divulge_scan_is_implementation_supported(divulge_scan_implementation_t implementation) {
+    if (implementation == DIVULGE_SCAN_IMPLEMENTATION_SCALAR) {
+        return true;
+    }
+#ifdef DIVULGE_SCAN_X86
+    __builtin_cpu_init();
+    if (implementation == DIVULGE_SCAN_IMPLEMENTATION_AVX2) {
+        return __builtin_cpu_supports("avx2");
+    } else if (implementation == DIVULGE_SCAN_IMPLEMENTATION_SSE42) {
+        return __builtin_cpu_supports("sse4.2");
+    }
+#endif
+    return false;
+}
+
+bool divulge_scan_select_implementation(divulge_scan_implementation_t implementation) {
+    const scan_kernels_t* kernels = get_kernels(implementation);
+    if (!kernels) {
+        return false;
+    }
+    atomic_store_explicit(&selected_kernels, kernels, memory_order_relaxed);
+    return true;
+}
+
+divulge_scan_implementation_t divulge_scan_get_implementation(void) {
+    return load_kernels()->implementation;
+}
+
+const char* divulge_scan_get_implementation_name(divulge_scan_implementation_t implementation) {
+    if (implementation == DIVULGE_SCAN_IMPLEMENTATION_AVX2) {
+        return "avx2";
+    } else if (implementation == DIVULGE_SCAN_IMPLEMENTATION_SSE42) {
+        return "sse4.2";
+    } else {
+        return "scalar";
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_SCAN_H
+#define DIVULGE_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+/**
+ * @defgroup divulge-scan Divulge character scanning
+ * @ingroup divulge
+ * @brief Find the end of a run of request-line or header characters
+ *
+ * Every scan returns the index of the first byte that does not belong to the character class, or `size` when
+ * all of them do. Vector kernels (SSE4.2, AVX2) are selected at runtime from the CPU features and always give
+ * the same answer as the portable scalar code.
+ * @{
+ */
+#define DIVULGE_SCAN_CLASS_TOKEN_BIT (1)
+#define DIVULGE_SCAN_CLASS_TARGET_BIT (2)
+#define DIVULGE_SCAN_CLASS_VALUE_BIT (4)
+#define DIVULGE_SCAN_CLASS_PATH_BIT (8)
+
+typedef enum divulge_scan_class {
+    DIVULGE_SCAN_CLASS_TOKEN,  /**< RFC 9110 tchar: method and header names */
+    DIVULGE_SCAN_CLASS_TARGET, /**< visible characters: request target and version */
+    DIVULGE_SCAN_CLASS_VALUE,  /**< field-value characters: visible, obs-text, space and tab */
+    DIVULGE_SCAN_CLASS_PATH,   /**< target characters except `?` */
+} divulge_scan_class_t;
+
+typedef enum divulge_scan_implementation {
+    DIVULGE_SCAN_IMPLEMENTATION_SCALAR,
+    DIVULGE_SCAN_IMPLEMENTATION_SSE42,
+    DIVULGE_SCAN_IMPLEMENTATION_AVX2,
+} divulge_scan_implementation_t;
+
+extern const uint8_t divulge_scan_character_classes[256];
+
+static inline bool divulge_scan_is_in_class(unsigned char c, unsigned class_bit) {
+    return (divulge_scan_character_classes[c] & class_bit) != 0;
+}
+
+size_t divulge_scan(divulge_scan_class_t scan_class, const char* data, size_t size);
+
+/**
+ * @brief Force an implementation, e.g. for testing
+ * @return false when the CPU does not support it
+ */
+bool divulge_scan_select_implementation(divulge_scan_implementation_t implementation);
+
+bool divulge_scan_is_implementation_supported(divulge_scan_implementation_t implementation);
+
+divulge_scan_implementation_t divulge_scan_get_implementation(void);
+
+const char* divulge_scan_get_implementation_name(divulge_scan_implementation_t implementation);
+/**
+ * @}
+ */
+#endif  // DIVULGE_SCAN_H
@@ -0,0 +1,605 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-static.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "divulge-time.h"
+#ifdef DIVULGE_COMPRESSION
+#include "divulge-compression.h"
+#endif
+
+#define STATIC_BUCKET_COUNT (256)
+#define STATIC_MAX_PATH_SIZE (1024)
+#define STATIC_READ_BUFFER_SIZE (16384)
+#define STATIC_HEADER_COUNT (3)
+#define STATIC_MAX_RESPONSE_HEADER_COUNT (5)
+
+#ifdef __APPLE__
+#define STAT_MODIFICATION_TIME(st) ((st)->st_mtimespec)
+#else
+#define STAT_MODIFICATION_TIME(st) ((st)->st_mtim)
+#endif
+
+#ifdef DIVULGE_COMPRESSION
+typedef struct static_variant {
+    bool is_ready;
+    char* data;
+    size_t size;
+    char etag[80];
+} static_variant_t;
+#endif
+
+typedef struct static_file {
+    struct static_file* next;
+    char* key;
+    size_t key_size;
+    uint32_t hash;
+    size_t references;
+    char* body;
+    size_t size;
+    dev_t device;
+    ino_t inode;
+    struct timespec modification_time;
+    uint64_t checked_at_ms;
+    char etag[64];
+    char last_modified[32];
+    char content_length[24];
+    divulge_header_entry_t headers[STATIC_HEADER_COUNT];
+    bool is_compressible;
+#ifdef DIVULGE_COMPRESSION
+    static_variant_t variants[DIVULGE_CONTENT_CODING_COUNT];
+#endif
+} static_file_t;
+
+typedef struct static_representation {
+    const char* body;
+    size_t size;
+    const char* etag;
+    const char* content_encoding;
+} static_representation_t;
+
+typedef struct divulge_static_context {
+    divulge_static_configuration_t configuration;
+    size_t url_prefix_size;
+    pthread_mutex_t lock;
+    static_file_t* buckets[STATIC_BUCKET_COUNT];
+    size_t cached_size;
+} divulge_static_context_t;
+
+typedef struct content_type {
+    const char* extension;
+    const char* content_type;
+} content_type_t;
+
+static const content_type_t content_types[] = {
+    {"html", "text/html"},
+    {"htm", "text/html"},
+    {"css", "text/css"},
+    {"js", "text/javascript"},
+    {"mjs", "text/javascript"},
+    {"json", "application/json"},
+    {"txt", "text/plain"},
+    {"xml", "application/xml"},
+    {"svg", "image/svg+xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"webp", "image/webp"},
+    {"ico", "image/x-icon"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"wasm", "application/wasm"},
+    {"pdf", "application/pdf"},
+};
+
+static const char* get_content_type(const char* path) {
+    const char* dot = strrchr(path, '.');
+    const char* slash = strrchr(path, '/');
+    if (dot && (!slash || (dot > slash))) {
+        for (size_t i = 0; i < sizeof(content_types) / sizeof(content_types[0]); i++) {
+            if (strcasecmp(dot + 1, content_types[i].extension) == 0) {
+                return content_types[i].content_type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+static uint32_t hash_key(const char* key, size_t key_size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < key_size; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool is_path_safe(const char* path, size_t path_size) {
+    size_t segment_start = 0;
+    for (size_t i = 0; i <= path_size; i++) {
+        if ((i < path_size) && ((path[i] == '\0') || (path[i] == '\\'))) {
+            return false;
+        }
+        if ((i == path_size) || (path[i] == '/')) {
+            if (((i - segment_start) == 2) && (path[segment_start] == '.') && (path[segment_start + 1] == '.')) {
+                return false;
+            }
+            segment_start = i + 1;
+        }
+    }
+    return true;
+}
+
+static bool build_key(divulge_static_context_t* ctx, divulge_slice_t route, char* key, size_t* key_size) {
+    size_t prefix_size = ctx->url_prefix_size;
+    if ((route.size < prefix_size) || (memcmp(route.data, ctx->configuration.url_prefix, prefix_size) != 0)) {
+        return false;
+    }
+    bool is_prefix_complete = (prefix_size == 0) || (ctx->configuration.url_prefix[prefix_size - 1] == '/');
+    if (!is_prefix_complete && (route.size > prefix_size) && (route.data[prefix_size] != '/')) {
+        return false;
+    }
+    const char* path = route.data + prefix_size;
+    size_t path_size = route.size - prefix_size;
+    while ((path_size > 0) && (path[0] == '/')) {
+        path++;
+        path_size--;
+    }
+    if (!is_path_safe(path, path_size)) {
+        return false;
+    }
+    const char* index = "";
+    if ((path_size == 0) || (path[path_size - 1] == '/')) {
+        if (!ctx->configuration.index_file_name) {
+            return false;
+        }
+        index = ctx->configuration.index_file_name;
+    }
+    int size = snprintf(key, STATIC_MAX_PATH_SIZE, "%.*s%s", (int)path_size, path, index);
+    if ((size <= 0) || (size >= STATIC_MAX_PATH_SIZE)) {
+        return false;
+    }
+    *key_size = (size_t)size;
+    return true;
+}
+
+static bool build_file_path(divulge_static_context_t* ctx, const char* key, char* path) {
+    int size = snprintf(path, STATIC_MAX_PATH_SIZE, "%s/%s", ctx->configuration.directory, key);
+    return (size > 0) && (size < STATIC_MAX_PATH_SIZE);
+}
+
+static bool is_same_file(const static_file_t* file, const struct stat* st) {
+    struct timespec modification_time = STAT_MODIFICATION_TIME(st);
+    return (file->device == st->st_dev) && (file->inode == st->st_ino) && (file->size == (size_t)st->st_size) &&
+           (file->modification_time.tv_sec == modification_time.tv_sec) &&
+           (file->modification_time.tv_nsec == modification_time.tv_nsec);
+}
+
+static void free_file(static_file_t* file) {
+#ifdef DIVULGE_COMPRESSION
+    for (size_t i = 0; i < DIVULGE_CONTENT_CODING_COUNT; i++) {
+        free(file->variants[i].data);
+    }
+#endif
+    free(file->body);
+    free(file->key);
+    free(file);
+}
+
+static bool read_body(static_file_t* file, int fd) {
+    file->body = malloc(file->size ? file->size : 1);
+    if (!file->body) {
+        return false;
+    }
+    size_t offset = 0;
+    while (offset < file->size) {
+        ssize_t bytes_read = read(fd, file->body + offset, file->size - offset);
+        if (bytes_read <= 0) {
+            return false;
+        }
+        offset += (size_t)bytes_read;
+    }
+    return true;
+}
+
+static void describe_file(static_file_t* file, const struct stat* st) {
+    file->device = st->st_dev;
+    file->inode = st->st_ino;
+    file->size = (size_t)st->st_size;
+    file->modification_time = STAT_MODIFICATION_TIME(st);
+    unsigned long long modified_ns = (unsigned long long)file->modification_time.tv_sec * 1000000000ull +
+                                     (unsigned long long)file->modification_time.tv_nsec;
+    snprintf(file->etag, sizeof(file->etag), "\"%llx-%zx-%llx\"", (unsigned long long)file->inode, file->size,
+             modified_ns);
+    struct tm modified_tm;
+    gmtime_r(&st->st_mtime, &modified_tm);
+    strftime(file->last_modified, sizeof(file->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &modified_tm);
+    snprintf(file->content_length, sizeof(file->content_length), "%zu", file->size);
+    file->headers[0] = (divulge_header_entry_t){.key = "Content-Type", .value = get_content_type(file->key)};
+    file->headers[1] = (divulge_header_entry_t){.key = "ETag", .value = file->etag};
+    file->headers[2] = (divulge_header_entry_t){.key = "Last-Modified", .value = file->last_modified};
+}
+
+static static_file_t* load_file(divulge_static_context_t* ctx, const char* key, size_t key_size, uint32_t hash) {
+    char path[STATIC_MAX_PATH_SIZE];
+    if (!build_file_path(ctx, key, path)) {
+        return NULL;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    static_file_t* file = NULL;
+    if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode)) {
+        file = calloc(1, sizeof(static_file_t));
+    }
+    if (file) {
+        file->key = strdup(key);
+        file->key_size = key_size;
+        file->hash = hash;
+        file->checked_at_ms = divulge_get_time_ms();
+    }
+    if (file && file->key) {
+        describe_file(file, &st);
+    }
+    bool is_loaded = file && file->key;
+    if (is_loaded && (file->size <= ctx->configuration.max_cached_file_size)) {
+        is_loaded = read_body(file, fd);
+#ifdef DIVULGE_COMPRESSION
+        file->is_compressible = divulge_is_compressible(file->headers[0].value, file->size);
+#endif
+    }
+    close(fd);
+    if (!is_loaded && file) {
+        free_file(file);
+        return NULL;
+    }
+    return file;
+}
+
+static static_file_t** find_slot(divulge_static_context_t* ctx, const char* key, size_t key_size, uint32_t hash) {
+    static_file_t** slot = ctx->buckets + (hash % STATIC_BUCKET_COUNT);
+    while (*slot) {
+        if (((*slot)->hash == hash) && ((*slot)->key_size == key_size) && (memcmp((*slot)->key, key, key_size) == 0)) {
+            break;
+        }
+        slot = &(*slot)->next;
+    }
+    return slot;
+}
+
+static void release_file_locked(static_file_t* file) {
+    if (--file->references == 0) {
+        free_file(file);
+    }
+}
+
+static void release_file(divulge_static_context_t* ctx, static_file_t* file) {
+    pthread_mutex_lock(&ctx->lock);
+    release_file_locked(file);
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void unlink_file_locked(divulge_static_context_t* ctx, static_file_t** slot) {
+    static_file_t* file = *slot;
+    *slot = file->next;
+    if (file->body) {
+        ctx->cached_size -= file->size;
+    }
+    release_file_locked(file);
+}
+
+/*
+ * Publishes a freshly loaded file in place of the previous version, which stays alive until its last user
+ * releases it. The body is dropped when it does not fit in the cache budget; the file is then sent from disk.
+ */
+static static_file_t* insert_file(divulge_static_context_t* ctx, static_file_t* file) {
+    pthread_mutex_lock(&ctx->lock);
+    static_file_t** slot = find_slot(ctx, file->key, file->key_size, file->hash);
+    if (*slot) {
+        unlink_file_locked(ctx, slot);
+    }
+    if (file->body && ((ctx->cached_size + file->size) > ctx->configuration.max_cache_size)) {
+        free(file->body);
+        file->body = NULL;
+    } else if (file->body) {
+        ctx->cached_size += file->size;
+    }
+    file->next = *slot;
+    *slot = file;
+    file->references = 2;
+    pthread_mutex_unlock(&ctx->lock);
+    return file;
+}
+
+static void remove_file(divulge_static_context_t* ctx, static_file_t* file) {
+    pthread_mutex_lock(&ctx->lock);
+    static_file_t** slot = find_slot(ctx, file->key, file->key_size, file->hash);
+    if (*slot == file) {
+        unlink_file_locked(ctx, slot);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static bool is_file_unchanged(divulge_static_context_t* ctx, const static_file_t* file) {
+    char path[STATIC_MAX_PATH_SIZE];
+    struct stat st;
+    return build_file_path(ctx, file->key, path) && (stat(path, &st) == 0) && S_ISREG(st.st_mode) &&
+           is_same_file(file, &st);
+}
+
+static static_file_t* acquire_file(divulge_static_context_t* ctx, const char* key, size_t key_size) {
+    uint32_t hash = hash_key(key, key_size);
+    uint64_t now = divulge_get_time_ms();
+    pthread_mutex_lock(&ctx->lock);
+    static_file_t* file = *find_slot(ctx, key, key_size, hash);
+    bool is_due = false;
+    if (file) {
+        file->references++;
+        is_due = (now - file->checked_at_ms) >= ctx->configuration.revalidate_interval_ms;
+        file->checked_at_ms = is_due ? now : file->checked_at_ms;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    if (file && (!is_due || is_file_unchanged(ctx, file))) {
+        return file;
+    }
+    static_file_t* loaded = load_file(ctx, key, key_size, hash);
+    if (file) {
+        if (!loaded) {
+            remove_file(ctx, file);
+        }
+        release_file(ctx, file);
+    }
+    return loaded ? insert_file(ctx, loaded) : NULL;
+}
+
+#ifdef DIVULGE_COMPRESSION
+/*
+ * Compresses a cached body the first time a client asks for the coding. Concurrent first requests may both
+ * compress it; only one result is kept.
+ */
+static const static_variant_t* get_variant(divulge_static_context_t* ctx,
+                                           static_file_t* file,
+                                           divulge_content_coding_t coding) {
+    static_variant_t* variant = file->variants + coding;
+    pthread_mutex_lock(&ctx->lock);
+    bool is_ready = variant->is_ready;
+    pthread_mutex_unlock(&ctx->lock);
+    if (is_ready) {
+        return variant;
+    }
+    char* data = NULL;
+    size_t size = 0;
+    divulge_compress(coding, file->body, file->size, &data, &size);
+    pthread_mutex_lock(&ctx->lock);
+    if (!variant->is_ready) {
+        variant->data = data;
+        variant->size = size;
+        snprintf(variant->etag, sizeof(variant->etag), "%.*s-%s\"", (int)(strlen(file->etag) - 1), file->etag,
+                 divulge_content_coding_name(coding));
+        variant->is_ready = true;
+        data = NULL;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    free(data);
+    return variant;
+}
+#endif
+
+static static_representation_t get_representation(divulge_request_t* request,
+                                                  divulge_static_context_t* ctx,
+                                                  static_file_t* file) {
+    static_representation_t representation = {.body = file->body, .size = file->size, .etag = file->etag};
+#ifdef DIVULGE_COMPRESSION
+    divulge_content_coding_t coding = file->is_compressible ? divulge_negotiate_content_coding(request)
+                                                            : DIVULGE_CONTENT_CODING_IDENTITY;
+    const static_variant_t* variant =
+        (coding != DIVULGE_CONTENT_CODING_IDENTITY) ? get_variant(ctx, file, coding) : NULL;
+    if (variant && variant->data) {
+        representation.body = variant->data;
+        representation.size = variant->size;
+        representation.etag = variant->etag;
+        representation.content_encoding = divulge_content_coding_name(coding);
+    }
+#else
+    (void)request;
+    (void)ctx;
+#endif
+    return representation;
+}
+
+static size_t fill_headers(const static_file_t* file,
+                           const static_representation_t* representation,
+                           divulge_header_entry_t* entries) {
+    size_t count = 0;
+    entries[count++] = file->headers[0];
+    entries[count++] = (divulge_header_entry_t){.key = "ETag", .value = representation->etag};
+    entries[count++] = file->headers[2];
+    if (file->is_compressible) {
+        entries[count++] = (divulge_header_entry_t){.key = "Vary", .value = "Accept-Encoding"};
+    }
+    if (representation->content_encoding) {
+        entries[count++] =
+            (divulge_header_entry_t){.key = "Content-Encoding", .value = representation->content_encoding};
+    }
+    return count;
+}
+
+static bool has_matching_etag(divulge_slice_t value, const char* etag) {
+    size_t etag_size = strlen(etag);
+    size_t start = 0;
+    while (start < value.size) {
+        size_t end = start;
+        while ((end < value.size) && (value.data[end] != ',')) {
+            end++;
+        }
+        size_t next = end + 1;
+        while ((start < end) && ((value.data[start] == ' ') || (value.data[start] == '\t'))) {
+            start++;
+        }
+        while ((end > start) && ((value.data[end - 1] == ' ') || (value.data[end - 1] == '\t'))) {
+            end--;
+        }
+        if (((end - start) > 2) && (value.data[start] == 'W') && (value.data[start + 1] == '/')) {
+            start += 2;
+        }
+        bool is_any = ((end - start) == 1) && (value.data[start] == '*');
+        bool is_equal = ((end - start) == etag_size) && (memcmp(value.data + start, etag, etag_size) == 0);
+        if (is_any || is_equal) {
+            return true;
+        }
+        start = next;
+    }
+    return false;
+}
+
+static bool is_not_modified(divulge_request_t* request, const static_file_t* file, const char* etag) {
+    divulge_slice_t value;
+    size_t cursor = 0;
+    bool has_if_none_match = false;
+    while (divulge_find_next_request_header(request, "If-None-Match", &cursor, &value)) {
+        has_if_none_match = true;
+        if (has_matching_etag(value, etag)) {
+            return true;
+        }
+    }
+    if (!has_if_none_match && divulge_find_request_header(request, "If-Modified-Since", &value)) {
+        size_t last_modified_size = strlen(file->last_modified);
+        return (value.size == last_modified_size) && (memcmp(value.data, file->last_modified, value.size) == 0);
+    }
+    return false;
+}
+
+static bool respond_with_not_modified(divulge_request_t* request,
+                                      const static_file_t* file,
+                                      const static_representation_t* representation) {
+    divulge_header_entry_t header_entries[STATIC_MAX_RESPONSE_HEADER_COUNT + 1];
+    size_t count = fill_headers(file, representation, header_entries);
+    char content_length[24];
+    snprintf(content_length, sizeof(content_length), "%zu", representation->size);
+    header_entries[count++] = (divulge_header_entry_t){.key = "Content-Length", .value = content_length};
+    divulge_response_t response = {
+        .return_code = 304,
+        .header = {.entries = header_entries, .count = count},
+    };
+    return divulge_respond(request, &response);
+}
+
+static bool respond_with_not_found(divulge_request_t* request) {
+    const char* payload = "Not found";
+    divulge_response_t response = {.return_code = 404, .payload = payload, .payload_size = strlen(payload)};
+    return divulge_respond(request, &response);
+}
+
+static bool send_file_from_disk(divulge_request_t* request, divulge_static_context_t* ctx, static_file_t* file) {
+    char path[STATIC_MAX_PATH_SIZE];
+    int fd = build_file_path(ctx, file->key, path) ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    struct stat st;
+    if ((fd < 0) || (fstat(fd, &st) != 0)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return respond_with_not_found(request);
+    }
+    // A file replaced since it was described is sent without its stale validators
+    divulge_header_t header = {.entries = file->headers, .count = is_same_file(file, &st) ? STATIC_HEADER_COUNT : 1};
+    size_t size = (size_t)st.st_size;
+    divulge_begin_response(request, 200, &header, size);
+    if (!divulge_write_response_file(request, fd, 0, size)) {
+        char* buffer = divulge_request_alloc(request, STATIC_READ_BUFFER_SIZE);
+        ssize_t bytes_read = 0;
+        while (buffer && ((bytes_read = read(fd, buffer, STATIC_READ_BUFFER_SIZE)) > 0)) {
+            if (!divulge_write_response(request, buffer, (size_t)bytes_read)) {
+                break;
+            }
+        }
+    }
+    close(fd);
+    return divulge_end_response(request);
+}
+
+static bool handler(divulge_request_t* request, void* context) {
+    divulge_static_context_t* ctx = (divulge_static_context_t*)context;
+    char key[STATIC_MAX_PATH_SIZE];
+    size_t key_size = 0;
+    static_file_t* file = build_key(ctx, request->route, key, &key_size) ? acquire_file(ctx, key, key_size) : NULL;
+    if (!file) {
+        return respond_with_not_found(request);
+    }
+    bool result = false;
+    static_representation_t representation = get_representation(request, ctx, file);
+    if (is_not_modified(request, file, representation.etag)) {
+        result = respond_with_not_modified(request, file, &representation);
+    } else if (representation.body) {
+        divulge_header_entry_t header_entries[STATIC_MAX_RESPONSE_HEADER_COUNT];
+        size_t count = fill_headers(file, &representation, header_entries);
+        divulge_header_t header = {.entries = header_entries, .count = count};
+        divulge_begin_response(request, 200, &header, representation.size);
+        divulge_write_response(request, representation.body, representation.size);
+        result = divulge_end_response(request);
+    } else {
+        result = send_file_from_disk(request, ctx, file);
+    }
+    release_file(ctx, file);
+    return result;
+}
+
+divulge_handler_object_t* divulge_static_create(const divulge_static_configuration_t* configuration) {
+    if (!configuration || !configuration->url_prefix || !configuration->directory) {
+        return NULL;
+    }
+    divulge_handler_object_t* object = calloc(1, sizeof(divulge_handler_object_t));
+    if (!object) {
+        return NULL;
+    }
+    divulge_static_context_t* ctx = calloc(1, sizeof(divulge_static_context_t));
+    if (!ctx) {
+        free(object);
+        return NULL;
+    }
+    ctx->configuration = *configuration;
+    if (ctx->configuration.max_cached_file_size == 0) {
+        ctx->configuration.max_cached_file_size = DIVULGE_STATIC_DEFAULT_MAX_CACHED_FILE_SIZE;
+    }
+    if (ctx->configuration.max_cache_size == 0) {
+        ctx->configuration.max_cache_size = DIVULGE_STATIC_DEFAULT_MAX_CACHE_SIZE;
+    }
+    if (ctx->configuration.revalidate_interval_ms == 0) {
+        ctx->configuration.revalidate_interval_ms = DIVULGE_STATIC_DEFAULT_REVALIDATE_INTERVAL_MS;
+    }
+    ctx->url_prefix_size = strlen(configuration->url_prefix);
+    pthread_mutex_init(&ctx->lock, NULL);
+    object->context = ctx;
+    object->handler = handler;
+    return object;
+}
@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_STATIC_H
+#define DIVULGE_STATIC_H
+
+#include <stddef.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-static Divulge static files
+ * @ingroup divulge
+ * @brief Serve a directory with an in-memory file cache
+ *
+ * Small files are kept in memory together with their headers. A cached file is checked for changes of its
+ * inode, size or modification time at most once per `revalidate_interval_ms`, so repeated and conditional
+ * requests (answered with 304 from the strong ETag or Last-Modified) do not touch the disk. Larger files are
+ * sent with the `send_file` callback when it is configured. Available on POSIX systems.
+ * @{
+ */
+#define DIVULGE_STATIC_DEFAULT_MAX_CACHED_FILE_SIZE (64 * 1024)
+#define DIVULGE_STATIC_DEFAULT_MAX_CACHE_SIZE (16 * 1024 * 1024)
+#define DIVULGE_STATIC_DEFAULT_REVALIDATE_INTERVAL_MS (1000)
+
+typedef struct divulge_static_configuration {
+    const char* url_prefix;           /**< route prefix stripped from the request path, e.g. "/static" */
+    const char* directory;            /**< directory the remaining path is resolved in */
+    const char* index_file_name;      /**< served for paths ending with `/`, NULL to answer them with 404 */
+    size_t max_cached_file_size;      /**< 0 for DIVULGE_STATIC_DEFAULT_MAX_CACHED_FILE_SIZE */
+    size_t max_cache_size;            /**< 0 for DIVULGE_STATIC_DEFAULT_MAX_CACHE_SIZE */
+    unsigned revalidate_interval_ms;  /**< 0 for DIVULGE_STATIC_DEFAULT_REVALIDATE_INTERVAL_MS */
+} divulge_static_configuration_t;
+
+/**
+ * @brief Create a handler serving files, to be registered for a trailing wildcard route under `url_prefix`
+ * @param configuration configuration; the strings must outlive the handler
+ * @return handler object or NULL
+ */
+divulge_handler_object_t* divulge_static_create(const divulge_static_configuration_t* configuration);
+/**
+ * @}
+ */
+#endif  // DIVULGE_STATIC_H
@@ -0,0 +1,195 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-timer.h"
+#include <limits.h>
+#include <string.h>
+
+#define SLOT_MASK ((uint64_t)DIVULGE_TIMER_SLOT_COUNT - 1)
+#define WHEEL_SPAN ((uint64_t)1 << (DIVULGE_TIMER_SLOT_BITS * DIVULGE_TIMER_LEVEL_COUNT))
+
+void divulge_timer_wheel_initialize(divulge_timer_wheel_t* wheel, uint64_t tick_ms, uint64_t now_ms) {
+    if (!wheel) {
+        return;
+    }
+    memset(wheel, 0, sizeof(divulge_timer_wheel_t));
+    wheel->tick_ms = (tick_ms > 0) ? tick_ms : 1;
+    wheel->now_ms = now_ms;
+    wheel->tick = now_ms / wheel->tick_ms;
+}
+
+/*
+ * A timer goes to the lowest level whose slots it does not outrun: level `n` if it expires less than
+ * SLOT_COUNT^(n+1) ticks from now, in the slot its expiry falls in at that level's resolution.
+ */
+static void insert(divulge_timer_wheel_t* wheel, divulge_timer_t* timer) {
+    if (timer->expires_at < wheel->tick) {
+        timer->expires_at = wheel->tick;
+    }
+    uint64_t expires_at = timer->expires_at;
+    if ((expires_at - wheel->tick) >= WHEEL_SPAN) {
+        expires_at = wheel->tick + WHEEL_SPAN - 1;
+    }
+    uint64_t distance = expires_at - wheel->tick;
+    size_t level = 0;
+    while (distance >= ((uint64_t)1 << (DIVULGE_TIMER_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    size_t index = (size_t)((expires_at >> (DIVULGE_TIMER_SLOT_BITS * level)) & SLOT_MASK);
+    divulge_timer_t** slot = &wheel->slots[level][index];
+    timer->next = *slot;
+    if (timer->next) {
+        timer->next->link = &timer->next;
+    }
+    timer->link = slot;
+    timer->slot = (uint32_t)(level * DIVULGE_TIMER_SLOT_COUNT + index);
+    *slot = timer;
+    if (level == 0) {
+        wheel->occupied |= (uint64_t)1 << index;
+    }
+}
+
+static void unlink_timer(divulge_timer_wheel_t* wheel, divulge_timer_t* timer) {
+    *timer->link = timer->next;
+    if (timer->next) {
+        timer->next->link = timer->link;
+    }
+    timer->link = NULL;
+    timer->next = NULL;
+    wheel->count--;
+    if ((timer->slot < DIVULGE_TIMER_SLOT_COUNT) && !wheel->slots[0][timer->slot]) {
+        wheel->occupied &= ~((uint64_t)1 << timer->slot);
+    }
+}
+
+void divulge_timer_schedule(divulge_timer_wheel_t* wheel, divulge_timer_t* timer, uint64_t expires_at_ms) {
+    if (!wheel || !timer) {
+        return;
+    }
+    if (timer->link) {
+        unlink_timer(wheel, timer);
+    }
+    wheel->count++;
+    timer->expires_at = (expires_at_ms / wheel->tick_ms) + ((expires_at_ms % wheel->tick_ms) ? 1 : 0);
+    insert(wheel, timer);
+}
+
+void divulge_timer_cancel(divulge_timer_wheel_t* wheel, divulge_timer_t* timer) {
+    if (!wheel || !timer || !timer->link) {
+        return;
+    }
+    unlink_timer(wheel, timer);
+}
+
+/*
+ * The next tick with anything to do: one with timers in the first level, or the next turn of the first level,
+ * where the slots above are moved down.
+ */
+static uint64_t find_next_tick(const divulge_timer_wheel_t* wheel) {
+    if (wheel->count == 0) {
+        return UINT64_MAX;
+    }
+    size_t index = (size_t)(wheel->tick & SLOT_MASK);
+    if (index == 0) {
+        return wheel->tick;
+    }
+    uint64_t pending = wheel->occupied >> index;
+    if (pending) {
+        return wheel->tick + (uint64_t)__builtin_ctzll(pending);
+    }
+    return (wheel->tick | SLOT_MASK) + 1;
+}
+
+static void cascade(divulge_timer_wheel_t* wheel) {
+    for (size_t level = 1; level < DIVULGE_TIMER_LEVEL_COUNT; level++) {
+        uint64_t lower_mask = ((uint64_t)1 << (DIVULGE_TIMER_SLOT_BITS * level)) - 1;
+        if (wheel->tick & lower_mask) {
+            return;
+        }
+        size_t index = (size_t)((wheel->tick >> (DIVULGE_TIMER_SLOT_BITS * level)) & SLOT_MASK);
+        divulge_timer_t* timer = wheel->slots[level][index];
+        wheel->slots[level][index] = NULL;
+        while (timer) {
+            divulge_timer_t* next = timer->next;
+            insert(wheel, timer);
+            timer = next;
+        }
+    }
+}
+
+/*
+ * The slot is taken off the wheel before the callbacks run, so timers they schedule go to fresh slots.
+ */
+static size_t expire_slot(divulge_timer_wheel_t* wheel) {
+    size_t index = (size_t)(wheel->tick & SLOT_MASK);
+    divulge_timer_t* expired = wheel->slots[0][index];
+    wheel->slots[0][index] = NULL;
+    wheel->occupied &= ~((uint64_t)1 << index);
+    if (expired) {
+        expired->link = &expired;
+    }
+    wheel->tick++;
+    size_t count = 0;
+    while (expired) {
+        divulge_timer_t* timer = expired;
+        unlink_timer(wheel, timer);
+        count++;
+        if (timer->expire) {
+            timer->expire(timer->context);
+        }
+    }
+    return count;
+}
+
+size_t divulge_timer_wheel_advance(divulge_timer_wheel_t* wheel, uint64_t now_ms) {
+    if (!wheel) {
+        return 0;
+    }
+    wheel->now_ms = now_ms;
+    uint64_t target = now_ms / wheel->tick_ms;
+    size_t count = 0;
+    while (wheel->tick <= target) {
+        uint64_t tick = find_next_tick(wheel);
+        if (tick > target) {
+            wheel->tick = target + 1;
+            break;
+        }
+        wheel->tick = tick;
+        cascade(wheel);
+        count += expire_slot(wheel);
+    }
+    return count;
+}
+
+int divulge_timer_wheel_get_timeout(const divulge_timer_wheel_t* wheel) {
+    uint64_t tick = wheel ? find_next_tick(wheel) : UINT64_MAX;
+    if (tick == UINT64_MAX) {
+        return -1;
+    }
+    uint64_t advance_at_ms = tick * wheel->tick_ms;
+    if (advance_at_ms <= wheel->now_ms) {
+        return 0;
+    }
+    uint64_t timeout = advance_at_ms - wheel->now_ms;
+    return (timeout > INT_MAX) ? INT_MAX : (int)timeout;
+}
@@ -0,0 +1,105 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_TIMER_H
+#define DIVULGE_TIMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+/**
+ * @defgroup divulge-timer Divulge timer wheel
+ * @ingroup divulge
+ * @brief Hierarchical timer wheel for connection timeouts
+ *
+ * Time is counted in ticks of `tick_ms`. The wheel has DIVULGE_TIMER_LEVEL_COUNT levels of
+ * DIVULGE_TIMER_SLOT_COUNT slots, every level's slots spanning as many ticks as the whole level below, so a
+ * timer is put in a slot of the level its distance falls in, and is moved down a level each time the wheel
+ * turns past that level's slot. Scheduling and cancelling unlink and link a timer in constant time; timers are
+ * embedded in their owners and never allocated. Timers further away than the wheel spans are kept in its last
+ * slot until they come within reach.
+ *
+ * A wheel belongs to a single thread, which advances it, typically once per event loop iteration.
+ * @{
+ */
+#define DIVULGE_TIMER_SLOT_BITS (6)
+#define DIVULGE_TIMER_SLOT_COUNT (1u << DIVULGE_TIMER_SLOT_BITS)
+#define DIVULGE_TIMER_LEVEL_COUNT (4)
+
+typedef struct divulge_timer divulge_timer_t;
+
+typedef struct divulge_timer {
+    divulge_timer_t* next;
+    divulge_timer_t** link; /**< pointer to this timer in the slot, NULL when not scheduled */
+    uint64_t expires_at;    /**< tick */
+    uint32_t slot;
+    void (*expire)(void* context); /**< called once the timer expired, no longer scheduled */
+    void* context;
+} divulge_timer_t;
+
+typedef struct divulge_timer_wheel {
+    divulge_timer_t* slots[DIVULGE_TIMER_LEVEL_COUNT][DIVULGE_TIMER_SLOT_COUNT];
+    uint64_t occupied; /**< bit set for every slot of the first level holding timers */
+    uint64_t tick;     /**< next tick to expire */
+    uint64_t tick_ms;
+    uint64_t now_ms; /**< time the wheel was last advanced to */
+    size_t count;
+} divulge_timer_wheel_t;
+
+/**
+ * @param tick_ms resolution, timers expire up to one tick late
+ * @param now_ms current time, e.g. divulge_get_time_ms()
+ */
+void divulge_timer_wheel_initialize(divulge_timer_wheel_t* wheel, uint64_t tick_ms, uint64_t now_ms);
+
+/**
+ * @brief Schedule the timer, or reschedule it if already scheduled
+ * @param expires_at_ms time the timer expires at, not before; a past time expires it on the next advance
+ */
+void divulge_timer_schedule(divulge_timer_wheel_t* wheel, divulge_timer_t* timer, uint64_t expires_at_ms);
+
+/**
+ * @brief Remove the timer from the wheel, if scheduled
+ */
+void divulge_timer_cancel(divulge_timer_wheel_t* wheel, divulge_timer_t* timer);
+
+static inline bool divulge_timer_is_scheduled(const divulge_timer_t* timer) {
+    return timer && timer->link;
+}
+
+/**
+ * @brief Expire all timers due by `now_ms`, calling their `expire` callbacks
+ * @note Callbacks may schedule and cancel any timer; those scheduled for the past expire on the next tick.
+ * @return number of expired timers
+ */
+size_t divulge_timer_wheel_advance(divulge_timer_wheel_t* wheel, uint64_t now_ms);
+
+/**
+ * @brief Milliseconds from the last advance until the wheel should be advanced again, e.g. for epoll_wait()
+ * @return -1 when no timer is scheduled
+ */
+int divulge_timer_wheel_get_timeout(const divulge_timer_wheel_t* wheel);
+/**
+ * @}
+ */
+#endif  // DIVULGE_TIMER_H
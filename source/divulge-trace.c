@@ -0,0 +1,461 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-trace.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EVENT_WORDS (sizeof(divulge_trace_event_t) / sizeof(uint64_t))
+#define RENDER_INITIAL_CAPACITY (4096)
+
+_Static_assert(sizeof(divulge_trace_event_t) % sizeof(uint64_t) == 0, "trace events are copied in words");
+
+/*
+ * Sequence lock per slot: the owner zeroes `sequence` before rewriting the words and stores the event's position
+ * plus one afterwards, so a reader copying the slot meanwhile sees the mismatch and drops the copy.
+ */
+typedef struct trace_slot {
+    atomic_uint_fast64_t sequence;
+    atomic_uint_fast64_t words[EVENT_WORDS];
+} trace_slot_t;
+
+typedef struct trace_ring {
+    atomic_uint_fast64_t head;
+    uint32_t thread_number;
+    atomic_bool is_owned;
+    struct trace_ring* next;
+    trace_slot_t slots[];
+} trace_ring_t;
+
+typedef struct divulge_tracer {
+    atomic_uint_fast32_t sample_period;
+    atomic_uint_fast64_t next_request_id;
+    size_t capacity;
+    pthread_key_t ring_key;
+    pthread_mutex_t lock;
+    trace_ring_t* rings;
+    uint32_t ring_count;
+} divulge_tracer_t;
+
+typedef struct text {
+    char* data;
+    size_t size;
+    size_t capacity;
+    bool has_failed;
+} text_t;
+
+/*
+ * Process-wide, as signal dispositions are: the handler only writes to the pipe, the thread does the dumping.
+ */
+static struct {
+    pthread_mutex_t lock;
+    divulge_tracer_t* tracer;
+    char* path;
+    int signal_number;
+    struct sigaction previous_action;
+    int pipe[2];
+    pthread_t thread;
+} signal_dump = {.lock = PTHREAD_MUTEX_INITIALIZER, .pipe = {-1, -1}};
+
+static _Thread_local uint32_t sample_countdown;
+
+static const char* phase_names[] = {"request", "read", "parse", "middleware", "handler", "send"};
+
+static void release_ring(void* ring) {
+    atomic_store(&((trace_ring_t*)ring)->is_owned, false);
+}
+
+divulge_tracer_t* divulge_tracer_create(const divulge_tracer_configuration_t* configuration) {
+    if (!configuration) {
+        return NULL;
+    }
+    divulge_tracer_t* tracer = calloc(1, sizeof(divulge_tracer_t));
+    if (!tracer) {
+        return NULL;
+    }
+    if (pthread_key_create(&tracer->ring_key, release_ring) != 0) {
+        free(tracer);
+        return NULL;
+    }
+    size_t events = configuration->events_per_thread ? configuration->events_per_thread
+                                                      : DIVULGE_TRACE_DEFAULT_EVENTS_PER_THREAD;
+    for (tracer->capacity = 1; tracer->capacity < events; tracer->capacity *= 2) {
+    }
+    pthread_mutex_init(&tracer->lock, NULL);
+    atomic_init(&tracer->sample_period, configuration->sample_period);
+    atomic_init(&tracer->next_request_id, 1);
+    return tracer;
+}
+
+static void stop_signal_dump(void) {
+    if (!signal_dump.tracer) {
+        return;
+    }
+    sigaction(signal_dump.signal_number, &signal_dump.previous_action, NULL);
+    (void)!write(signal_dump.pipe[1], "q", 1);
+    pthread_join(signal_dump.thread, NULL);
+    close(signal_dump.pipe[0]);
+    close(signal_dump.pipe[1]);
+    free(signal_dump.path);
+    signal_dump.tracer = NULL;
+    signal_dump.path = NULL;
+    signal_dump.pipe[0] = -1;
+    signal_dump.pipe[1] = -1;
+}
+
+void divulge_tracer_destroy(divulge_tracer_t* tracer) {
+    if (!tracer) {
+        return;
+    }
+    pthread_mutex_lock(&signal_dump.lock);
+    if (signal_dump.tracer == tracer) {
+        stop_signal_dump();
+    }
+    pthread_mutex_unlock(&signal_dump.lock);
+    pthread_key_delete(tracer->ring_key);
+    trace_ring_t* ring = tracer->rings;
+    while (ring) {
+        trace_ring_t* next = ring->next;
+        free(ring);
+        ring = next;
+    }
+    pthread_mutex_destroy(&tracer->lock);
+    free(tracer);
+}
+
+void divulge_tracer_set_sample_period(divulge_tracer_t* tracer, uint32_t sample_period) {
+    if (!tracer) {
+        return;
+    }
+    atomic_store_explicit(&tracer->sample_period, sample_period, memory_order_relaxed);
+}
+
+/*
+ * With sampling off this is a single relaxed load. Otherwise every thread counts down on its own, so no
+ * shared counter is touched until a request is sampled.
+ */
+uint64_t divulge_tracer_begin_request(divulge_tracer_t* tracer) {
+    if (!tracer) {
+        return 0;
+    }
+    uint32_t period = (uint32_t)atomic_load_explicit(&tracer->sample_period, memory_order_relaxed);
+    if (period == 0) {
+        return 0;
+    }
+    if ((sample_countdown > 1) && (sample_countdown <= period)) {
+        sample_countdown--;
+        return 0;
+    }
+    sample_countdown = period;
+    return atomic_fetch_add_explicit(&tracer->next_request_id, 1, memory_order_relaxed);
+}
+
+/*
+ * Threads keep their ring until they exit; a later thread then takes it over.
+ */
+static trace_ring_t* get_ring(divulge_tracer_t* tracer) {
+    trace_ring_t* ring = pthread_getspecific(tracer->ring_key);
+    if (ring) {
+        return ring;
+    }
+    pthread_mutex_lock(&tracer->lock);
+    for (ring = tracer->rings; ring; ring = ring->next) {
+        bool is_owned = false;
+        if (atomic_compare_exchange_strong(&ring->is_owned, &is_owned, true)) {
+            break;
+        }
+    }
+    if (!ring) {
+        ring = calloc(1, sizeof(trace_ring_t) + tracer->capacity * sizeof(trace_slot_t));
+        if (!ring) {
+            pthread_mutex_unlock(&tracer->lock);
+            return NULL;
+        }
+        ring->thread_number = ++tracer->ring_count;
+        atomic_init(&ring->is_owned, true);
+        ring->next = tracer->rings;
+        tracer->rings = ring;
+    }
+    pthread_mutex_unlock(&tracer->lock);
+    if (pthread_setspecific(tracer->ring_key, ring) != 0) {
+        atomic_store(&ring->is_owned, false);
+        return NULL;
+    }
+    return ring;
+}
+
+void divulge_tracer_record(divulge_tracer_t* tracer, const divulge_trace_event_t* event) {
+    if (!tracer || !event) {
+        return;
+    }
+    trace_ring_t* ring = get_ring(tracer);
+    if (!ring) {
+        return;
+    }
+    uint64_t words[EVENT_WORDS];
+    memcpy(words, event, sizeof(words));
+    uint64_t position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    trace_slot_t* slot = ring->slots + (position & (tracer->capacity - 1));
+    atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < EVENT_WORDS; i++) {
+        atomic_store_explicit(slot->words + i, words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    atomic_store_explicit(&ring->head, position + 1, memory_order_release);
+}
+
+static bool read_slot(trace_slot_t* slot, uint64_t position, divulge_trace_event_t* event) {
+    uint64_t words[EVENT_WORDS];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != position + 1) {
+        return false;
+    }
+    for (size_t i = 0; i < EVENT_WORDS; i++) {
+        words[i] = atomic_load_explicit(slot->words + i, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != position + 1) {
+        return false;
+    }
+    memcpy(event, words, sizeof(words));
+    return true;
+}
+
+size_t divulge_tracer_collect(divulge_tracer_t* tracer,
+                              divulge_trace_event_t* events,
+                              uint32_t* thread_numbers,
+                              size_t max_count) {
+    if (!tracer) {
+        return 0;
+    }
+    size_t count = 0;
+    pthread_mutex_lock(&tracer->lock);
+    for (trace_ring_t* ring = tracer->rings; ring; ring = ring->next) {
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t position = (head > tracer->capacity) ? head - tracer->capacity : 0;
+        for (; position < head; position++) {
+            divulge_trace_event_t event;
+            if (!read_slot(ring->slots + (position & (tracer->capacity - 1)), position, &event)) {
+                continue;
+            }
+            if (events && (count < max_count)) {
+                events[count] = event;
+            }
+            if (thread_numbers && (count < max_count)) {
+                thread_numbers[count] = ring->thread_number;
+            }
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&tracer->lock);
+    return count;
+}
+
+static void append(text_t* text, const char* format, ...) {
+    if (text->has_failed) {
+        return;
+    }
+    for (;;) {
+        va_list arguments;
+        va_start(arguments, format);
+        int size = vsnprintf(text->data + text->size, text->capacity - text->size, format, arguments);
+        va_end(arguments);
+        if (size < 0) {
+            text->has_failed = true;
+            return;
+        }
+        if ((size_t)size < text->capacity - text->size) {
+            text->size += (size_t)size;
+            return;
+        }
+        size_t capacity = 2 * text->capacity + (size_t)size;
+        char* data = realloc(text->data, capacity);
+        if (!data) {
+            text->has_failed = true;
+            return;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+}
+
+static void append_escaped(text_t* text, const char* value, size_t max_size) {
+    for (size_t i = 0; (i < max_size) && value[i]; i++) {
+        unsigned char c = (unsigned char)value[i];
+        if ((c == '"') || (c == '\\')) {
+            append(text, "\\%c", c);
+        } else if (c < 0x20) {
+            append(text, "\\u%04x", c);
+        } else {
+            append(text, "%c", c);
+        }
+    }
+}
+
+static void append_event(text_t* text, const divulge_trace_event_t* event, uint32_t thread_number, long pid) {
+    const char* phase = (event->phase < sizeof(phase_names) / sizeof(phase_names[0])) ? phase_names[event->phase]
+                                                                                        : "unknown";
+    append(text, ",\n{\"name\":\"");
+    if (event->phase == DIVULGE_TRACE_PHASE_REQUEST) {
+        append_escaped(text, event->name, sizeof(event->name));
+    } else if (event->phase == DIVULGE_TRACE_PHASE_MIDDLEWARE) {
+        append(text, "middleware %u", event->index);
+    } else {
+        append(text, "%s", phase);
+    }
+    uint64_t duration = (event->end_ns > event->begin_ns) ? event->end_ns - event->begin_ns : 0;
+    append(text, "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%u,\"ts\":%llu.%03u,\"dur\":%llu.%03u", phase, pid,
+           thread_number, (unsigned long long)(event->begin_ns / 1000), (unsigned)(event->begin_ns % 1000),
+           (unsigned long long)(duration / 1000), (unsigned)(duration % 1000));
+    append(text, ",\"args\":{\"request\":%llu", (unsigned long long)event->request_id);
+    if (event->phase == DIVULGE_TRACE_PHASE_REQUEST) {
+        append(text, ",\"status\":%d", (int)event->status);
+    } else if ((event->phase == DIVULGE_TRACE_PHASE_PARSE) || (event->phase == DIVULGE_TRACE_PHASE_SEND)) {
+        append(text, ",\"call\":%u", event->index);
+    }
+    append(text, "}}");
+}
+
+char* divulge_tracer_render(divulge_tracer_t* tracer, size_t* size) {
+    if (!tracer || !size) {
+        return NULL;
+    }
+    size_t capacity = divulge_tracer_collect(tracer, NULL, NULL, 0) + 1;
+    divulge_trace_event_t* events = malloc(capacity * sizeof(divulge_trace_event_t));
+    uint32_t* thread_numbers = malloc(capacity * sizeof(uint32_t));
+    text_t text = {.data = malloc(RENDER_INITIAL_CAPACITY), .capacity = RENDER_INITIAL_CAPACITY};
+    if (!events || !thread_numbers || !text.data) {
+        free(events);
+        free(thread_numbers);
+        free(text.data);
+        return NULL;
+    }
+    size_t count = divulge_tracer_collect(tracer, events, thread_numbers, capacity);
+    count = (count < capacity) ? count : capacity;
+    long pid = (long)getpid();
+    pthread_mutex_lock(&tracer->lock);
+    uint32_t ring_count = tracer->ring_count;
+    pthread_mutex_unlock(&tracer->lock);
+    append(&text, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    append(&text, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"divulge\"}}", pid);
+    for (uint32_t i = 1; i <= ring_count; i++) {
+        append(&text, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,"
+               "\"args\":{\"name\":\"thread %u\"}}",
+               pid, i, i);
+    }
+    for (size_t i = 0; i < count; i++) {
+        append_event(&text, events + i, thread_numbers[i], pid);
+    }
+    append(&text, "\n]}\n");
+    free(events);
+    free(thread_numbers);
+    if (text.has_failed) {
+        free(text.data);
+        return NULL;
+    }
+    *size = text.size;
+    return text.data;
+}
+
+bool divulge_tracer_write(divulge_tracer_t* tracer, const char* path) {
+    if (!tracer || !path) {
+        return false;
+    }
+    size_t size = 0;
+    char* text = divulge_tracer_render(tracer, &size);
+    FILE* file = text ? fopen(path, "w") : NULL;
+    bool is_written = file && (fwrite(text, 1, size, file) == size);
+    if (file) {
+        is_written = (fclose(file) == 0) && is_written;
+    }
+    free(text);
+    return is_written;
+}
+
+static void handle_signal(int signal_number) {
+    (void)!write(signal_dump.pipe[1], "d", 1);
+}
+
+static void* run_signal_dump(void* argument) {
+    char command = 0;
+    while ((read(signal_dump.pipe[0], &command, 1) == 1) && (command == 'd')) {
+        divulge_tracer_write(signal_dump.tracer, signal_dump.path);
+    }
+    return NULL;
+}
+
+bool divulge_tracer_dump_on_signal(divulge_tracer_t* tracer, int signal_number, const char* path) {
+    if (!tracer || !path) {
+        return false;
+    }
+    pthread_mutex_lock(&signal_dump.lock);
+    stop_signal_dump();
+    signal_dump.path = strdup(path);
+    bool is_started = signal_dump.path && (pipe(signal_dump.pipe) == 0);
+    signal_dump.tracer = tracer;
+    signal_dump.signal_number = signal_number;
+    is_started = is_started && (pthread_create(&signal_dump.thread, NULL, run_signal_dump, NULL) == 0);
+    if (is_started) {
+        struct sigaction action = {.sa_handler = handle_signal, .sa_flags = SA_RESTART};
+        sigemptyset(&action.sa_mask);
+        if (sigaction(signal_number, &action, &signal_dump.previous_action) != 0) {
+            (void)!write(signal_dump.pipe[1], "q", 1);
+            pthread_join(signal_dump.thread, NULL);
+            is_started = false;
+        }
+    }
+    if (!is_started) {
+        if (signal_dump.pipe[0] >= 0) {
+            close(signal_dump.pipe[0]);
+            close(signal_dump.pipe[1]);
+        }
+        free(signal_dump.path);
+        signal_dump.tracer = NULL;
+        signal_dump.path = NULL;
+        signal_dump.pipe[0] = -1;
+        signal_dump.pipe[1] = -1;
+    }
+    pthread_mutex_unlock(&signal_dump.lock);
+    return is_started;
+}
+
+bool divulge_tracer_handler(divulge_request_t* request, void* context) {
+    size_t size = 0;
+    char* text = divulge_tracer_render(context, &size);
+    if (!text) {
+        divulge_response_t response = {.return_code = 500, .payload = "", .payload_size = 0};
+        return divulge_respond(request, &response);
+    }
+    divulge_header_entry_t header_entries[] = {{.key = "Content-Type", .value = "application/json"}};
+    divulge_header_t header = {.entries = header_entries, .count = 1};
+    divulge_begin_response(request, 200, &header, size);
+    divulge_write_response(request, text, size);
+    free(text);
+    return divulge_end_response(request);
+}
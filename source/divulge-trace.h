@@ -0,0 +1,129 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_TRACE_H
+#define DIVULGE_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-trace Divulge request tracer
+ * @ingroup divulge
+ * @brief Phase timelines of sampled requests, exported as Chrome trace JSON
+ *
+ * Available when Divulge is built with `DIVULGE_TRACING` defined; otherwise the tracing hooks compile to
+ * nothing. Set `tracer` in divulge_configuration_t and one request in `sample_period` is traced: reading,
+ * each parser feed, every middleware, the handler and every send call become timed events in a ring buffer of
+ * the thread serving the request. The rings are written without locks and overwrite their oldest events. They
+ * can be dumped on demand, on a signal or through divulge_tracer_handler() as Chrome/Perfetto trace JSON.
+ * @{
+ */
+#define DIVULGE_TRACE_NAME_SIZE (40)
+#define DIVULGE_TRACE_DEFAULT_EVENTS_PER_THREAD (4096)
+
+typedef enum divulge_trace_phase {
+    DIVULGE_TRACE_PHASE_REQUEST,    /**< from the first received byte to the last byte sent, or to a deferral */
+    DIVULGE_TRACE_PHASE_READ,       /**< from the first to the last received bytes of the request */
+    DIVULGE_TRACE_PHASE_PARSE,      /**< one parser feed */
+    DIVULGE_TRACE_PHASE_MIDDLEWARE, /**< one middleware, `index` tells which */
+    DIVULGE_TRACE_PHASE_HANDLER,    /**< the route handler or the 404 handler */
+    DIVULGE_TRACE_PHASE_SEND,       /**< one send callback */
+} divulge_trace_phase_t;
+
+typedef struct divulge_trace_event {
+    uint64_t request_id;
+    uint64_t begin_ns; /**< monotonic clock */
+    uint64_t end_ns;
+    uint32_t phase; /**< divulge_trace_phase_t */
+    uint32_t index; /**< middleware position, or the parser feed or send call number */
+    int32_t status; /**< response status, in DIVULGE_TRACE_PHASE_REQUEST events */
+    char name[DIVULGE_TRACE_NAME_SIZE]; /**< method and route, in DIVULGE_TRACE_PHASE_REQUEST events */
+} divulge_trace_event_t;
+
+typedef struct divulge_tracer_configuration {
+    uint32_t sample_period;   /**< trace one request in this many per thread, 0 to trace none */
+    size_t events_per_thread; /**< ring size, rounded up to a power of two; 0 for the default */
+} divulge_tracer_configuration_t;
+
+divulge_tracer_t* divulge_tracer_create(const divulge_tracer_configuration_t* configuration);
+
+/**
+ * @note No request may be answered with the tracer anymore.
+ */
+void divulge_tracer_destroy(divulge_tracer_t* tracer);
+
+/**
+ * @brief Change the sampling at runtime, 0 to stop it
+ */
+void divulge_tracer_set_sample_period(divulge_tracer_t* tracer, uint32_t sample_period);
+
+/**
+ * @brief Decide whether to trace a new request
+ * @return its id, or 0 when it is not sampled
+ */
+uint64_t divulge_tracer_begin_request(divulge_tracer_t* tracer);
+
+/**
+ * @brief Append an event to the calling thread's ring
+ */
+void divulge_tracer_record(divulge_tracer_t* tracer, const divulge_trace_event_t* event);
+
+/**
+ * @brief Copy the events currently held by all rings
+ * @param events where to copy, may be NULL to count only
+ * @param thread_numbers ring each event came from, may be NULL
+ * @param max_count capacity of `events` and `thread_numbers`
+ * @return number of events held, which may exceed `max_count`
+ */
+size_t divulge_tracer_collect(divulge_tracer_t* tracer,
+                              divulge_trace_event_t* events,
+                              uint32_t* thread_numbers,
+                              size_t max_count);
+
+/**
+ * @brief Render the held events in the Chrome trace event format
+ * @param size length of the returned text
+ * @return text to free(), or NULL on failure
+ */
+char* divulge_tracer_render(divulge_tracer_t* tracer, size_t* size);
+
+bool divulge_tracer_write(divulge_tracer_t* tracer, const char* path);
+
+/**
+ * @brief Write the trace to `path` whenever the process receives `signal_number`, e.g. SIGUSR2
+ *
+ * A single tracer at a time can be dumped on a signal; the dump is written by a helper thread, not in the
+ * signal handler. divulge_tracer_destroy() restores the previous action.
+ */
+bool divulge_tracer_dump_on_signal(divulge_tracer_t* tracer, int signal_number, const char* path);
+
+/**
+ * @brief Serve the trace JSON, with the tracer as the handler context
+ */
+bool divulge_tracer_handler(divulge_request_t* request, void* context);
+/**
+ * @}
+ */
+#endif  // DIVULGE_TRACE_H
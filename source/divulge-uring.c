@@ -0,0 +1,1013 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#define _GNU_SOURCE
+#include "divulge-uring.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "divulge-listener.h"
+#include "divulge-time.h"
+#include "divulge-timer.h"
+
+#define URING_QUEUE_DEPTH (256)
+#define URING_COMPLETION_QUEUE_DEPTH (4 * URING_QUEUE_DEPTH)
+#define URING_DEFAULT_MAX_CONNECTION_COUNT (1024)
+#define URING_BUFFER_COUNT (256) /* a power of two */
+#define URING_BUFFER_SIZE (4096)
+#define URING_BUFFER_GROUP (0)
+#define URING_INITIAL_OUTPUT_SIZE (4096)
+#define URING_MAX_PENDING_OUTPUT_SIZE (256 * 1024)
+#define URING_OPERATION_MASK ((uint64_t)7)
+#define URING_TIMER_TICK_MS (10)
+
+/*
+ * Completions carry the connection pointer, which is at least 8-byte aligned, with the operation in its low bits.
+ */
+typedef enum uring_operation {
+    URING_OPERATION_ACCEPT,
+    URING_OPERATION_WAKEUP,
+    URING_OPERATION_CANCEL,
+    URING_OPERATION_CANCEL_ALL,
+    URING_OPERATION_RECEIVE,
+    URING_OPERATION_SEND,
+    URING_OPERATION_SHUTDOWN,
+    URING_OPERATION_CLOSE,
+} uring_operation_t;
+
+typedef struct uring_queue {
+    int descriptor;
+    void* submission_ring;
+    size_t submission_ring_size;
+    void* completion_ring;
+    size_t completion_ring_size;
+    struct io_uring_sqe* entries;
+    size_t entries_size;
+    unsigned* submission_head;
+    unsigned* submission_tail;
+    unsigned submission_mask;
+    unsigned submission_entry_count;
+    unsigned* completion_head;
+    unsigned* completion_tail;
+    unsigned completion_mask;
+    struct io_uring_cqe* completions;
+    unsigned tail;
+    unsigned unsubmitted_count;
+} uring_queue_t;
+
+typedef struct uring_output {
+    char* data;
+    size_t offset;
+    size_t size;
+    size_t capacity;
+} uring_output_t;
+
+typedef struct uring_ring uring_ring_t;
+
+typedef struct uring_connection {
+    struct uring_connection* previous;
+    struct uring_connection* next;
+    struct uring_connection* next_resumed;
+    struct uring_connection* next_expired;
+    uring_ring_t* ring;
+    unsigned file;
+    divulge_connection_t* connection;
+    uring_output_t sending;
+    uring_output_t pending;
+    uring_output_t held; /**< received bytes the full connection buffer could not take yet */
+    size_t operation_count;
+    bool is_receiving;
+    bool is_receive_paused;
+    bool is_sending;
+    bool is_closing;
+    bool is_close_submitted;
+    bool is_closed;
+    bool has_failed;
+    bool is_resume_queued;
+} uring_connection_t;
+
+typedef struct uring_ring {
+    divulge_uring_t* uring;
+    pthread_t thread;
+    size_t index;
+    uring_queue_t queue;
+    int listener;
+    int wakeup;
+    uint64_t wakeup_value;
+    atomic_bool is_stop_requested;
+    pthread_mutex_t resume_mutex;
+    uring_connection_t* resumed;
+    struct io_uring_buf_ring* buffer_ring;
+    size_t buffer_ring_size;
+    char* buffers;
+    uint16_t buffer_tail;
+    uring_connection_t* connections;
+    size_t connection_count;
+    bool is_accepting;
+    bool is_cancelling;
+    bool is_stopping;
+    divulge_timer_wheel_t timers;
+    bool is_advancing_timers;
+    uring_connection_t* expired; /**< closed by their timers, to be advanced */
+} uring_ring_t;
+
+typedef struct divulge_uring {
+    divulge_t* divulge;
+    divulge_uring_configuration_t configuration;
+    uint16_t port;
+    bool is_running;
+    uring_ring_t* rings;
+} divulge_uring_t;
+
+static int uring_setup(unsigned entry_count, struct io_uring_params* parameters) {
+    return (int)syscall(__NR_io_uring_setup, entry_count, parameters);
+}
+
+/*
+ * A wait with a timeout fails with ETIME once it expired, unless entries were submitted.
+ */
+static int uring_enter(int descriptor, unsigned submit_count, unsigned wait_count, unsigned flags, int timeout_ms) {
+    if ((timeout_ms < 0) || (wait_count == 0)) {
+        return (int)syscall(__NR_io_uring_enter, descriptor, submit_count, wait_count, flags, NULL, 0);
+    }
+    struct __kernel_timespec timeout = {.tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L};
+    struct io_uring_getevents_arg argument = {.ts = (uint64_t)(uintptr_t)&timeout};
+    return (int)syscall(__NR_io_uring_enter, descriptor, submit_count, wait_count, flags | IORING_ENTER_EXT_ARG,
+                        &argument, sizeof(argument));
+}
+
+static int uring_register(int descriptor, unsigned opcode, void* argument, unsigned argument_count) {
+    return (int)syscall(__NR_io_uring_register, descriptor, opcode, argument, argument_count);
+}
+
+static void* map_queue_region(int descriptor, size_t size, off_t offset) {
+    void* region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, descriptor, offset);
+    return (region == MAP_FAILED) ? NULL : region;
+}
+
+static void unmap_queue(uring_queue_t* queue) {
+    if (queue->entries) {
+        munmap(queue->entries, queue->entries_size);
+    }
+    if (queue->completion_ring && (queue->completion_ring != queue->submission_ring)) {
+        munmap(queue->completion_ring, queue->completion_ring_size);
+    }
+    if (queue->submission_ring) {
+        munmap(queue->submission_ring, queue->submission_ring_size);
+    }
+    if (queue->descriptor >= 0) {
+        close(queue->descriptor);
+    }
+    *queue = (uring_queue_t){.descriptor = -1};
+}
+
+static bool map_queue(uring_queue_t* queue, unsigned entry_count, unsigned completion_entry_count) {
+    struct io_uring_params parameters = {.flags = IORING_SETUP_CQSIZE, .cq_entries = completion_entry_count};
+    *queue = (uring_queue_t){.descriptor = uring_setup(entry_count, &parameters)};
+    if (queue->descriptor < 0) {
+        queue->descriptor = -1;
+        return false;
+    }
+    queue->submission_ring_size = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+    queue->completion_ring_size = parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe);
+    if (parameters.features & IORING_FEAT_SINGLE_MMAP) {
+        if (queue->completion_ring_size > queue->submission_ring_size) {
+            queue->submission_ring_size = queue->completion_ring_size;
+        }
+        queue->completion_ring_size = queue->submission_ring_size;
+    }
+    queue->submission_ring = map_queue_region(queue->descriptor, queue->submission_ring_size, IORING_OFF_SQ_RING);
+    queue->completion_ring = (parameters.features & IORING_FEAT_SINGLE_MMAP)
+                                 ? queue->submission_ring
+                                 : map_queue_region(queue->descriptor, queue->completion_ring_size, IORING_OFF_CQ_RING);
+    queue->entries_size = parameters.sq_entries * sizeof(struct io_uring_sqe);
+    queue->entries = map_queue_region(queue->descriptor, queue->entries_size, IORING_OFF_SQES);
+    if (!queue->submission_ring || !queue->completion_ring || !queue->entries) {
+        unmap_queue(queue);
+        return false;
+    }
+    char* submission_ring = queue->submission_ring;
+    char* completion_ring = queue->completion_ring;
+    queue->submission_head = (unsigned*)(submission_ring + parameters.sq_off.head);
+    queue->submission_tail = (unsigned*)(submission_ring + parameters.sq_off.tail);
+    queue->submission_mask = *(unsigned*)(submission_ring + parameters.sq_off.ring_mask);
+    queue->submission_entry_count = parameters.sq_entries;
+    unsigned* array = (unsigned*)(submission_ring + parameters.sq_off.array);
+    for (unsigned i = 0; i < parameters.sq_entries; i++) {
+        array[i] = i;
+    }
+    queue->completion_head = (unsigned*)(completion_ring + parameters.cq_off.head);
+    queue->completion_tail = (unsigned*)(completion_ring + parameters.cq_off.tail);
+    queue->completion_mask = *(unsigned*)(completion_ring + parameters.cq_off.ring_mask);
+    queue->completions = (struct io_uring_cqe*)(completion_ring + parameters.cq_off.cqes);
+    queue->tail = *queue->submission_tail;
+    return true;
+}
+
+/*
+ * Publishes the prepared entries and, when `wait_count` is not 0, waits for that many completions, at most
+ * `timeout_ms` unless negative.
+ */
+static int submit(uring_queue_t* queue, unsigned wait_count, int timeout_ms) {
+    atomic_store_explicit((_Atomic unsigned*)queue->submission_tail, queue->tail, memory_order_release);
+    int result = uring_enter(queue->descriptor, queue->unsubmitted_count, wait_count,
+                             wait_count ? IORING_ENTER_GETEVENTS : 0, timeout_ms);
+    if (result > 0) {
+        queue->unsubmitted_count -= ((unsigned)result < queue->unsubmitted_count) ? (unsigned)result
+                                                                                   : queue->unsubmitted_count;
+    }
+    return result;
+}
+
+static unsigned get_free_entry_count(const uring_queue_t* queue) {
+    unsigned head = atomic_load_explicit((_Atomic unsigned*)queue->submission_head, memory_order_acquire);
+    return queue->submission_entry_count - (queue->tail - head);
+}
+
+/*
+ * Makes sure `count` entries can be prepared back to back, so a linked chain is never split between two
+ * submissions.
+ */
+static bool reserve_entries(uring_queue_t* queue, unsigned count) {
+    if (get_free_entry_count(queue) < count) {
+        submit(queue, 0, -1);
+    }
+    return get_free_entry_count(queue) >= count;
+}
+
+static struct io_uring_sqe* next_entry(uring_queue_t* queue, uint64_t user_data) {
+    struct io_uring_sqe* entry = queue->entries + (queue->tail & queue->submission_mask);
+    memset(entry, 0, sizeof(*entry));
+    entry->user_data = user_data;
+    queue->tail++;
+    queue->unsubmitted_count++;
+    return entry;
+}
+
+static uint64_t tag(void* connection, uring_operation_t operation) {
+    return (uint64_t)(uintptr_t)connection | (uint64_t)operation;
+}
+
+static bool are_operations_supported(const uring_queue_t* queue) {
+    static const uint8_t required[] = {
+        IORING_OP_ACCEPT, IORING_OP_RECV,  IORING_OP_SEND,         IORING_OP_SHUTDOWN,
+        IORING_OP_CLOSE,  IORING_OP_READ,  IORING_OP_ASYNC_CANCEL,
+        IORING_OP_SEND_ZC, /* not used, but arrived with multishot recv in Linux 6.0 */
+    };
+    size_t probe_size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, probe_size);
+    if (!probe) {
+        return false;
+    }
+    bool is_supported = uring_register(queue->descriptor, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0;
+    for (size_t i = 0; is_supported && (i < sizeof(required)); i++) {
+        is_supported = (required[i] <= probe->last_op) && (probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED);
+    }
+    free(probe);
+    return is_supported;
+}
+
+static bool register_files(uring_queue_t* queue, size_t file_count) {
+    struct io_uring_rsrc_register registration = {.nr = (unsigned)file_count, .flags = IORING_RSRC_REGISTER_SPARSE};
+    return uring_register(queue->descriptor, IORING_REGISTER_FILES2, &registration, sizeof(registration)) == 0;
+}
+
+static void provide_buffer(uring_ring_t* ring, uint16_t id) {
+    struct io_uring_buf* buffer = ring->buffer_ring->bufs + (ring->buffer_tail & (URING_BUFFER_COUNT - 1));
+    buffer->addr = (uint64_t)(uintptr_t)(ring->buffers + (size_t)id * URING_BUFFER_SIZE);
+    buffer->len = URING_BUFFER_SIZE;
+    buffer->bid = id;
+    ring->buffer_tail++;
+}
+
+static void publish_buffers(uring_ring_t* ring) {
+    atomic_store_explicit((_Atomic uint16_t*)&ring->buffer_ring->tail, ring->buffer_tail, memory_order_release);
+}
+
+static bool set_up_buffers(uring_ring_t* ring) {
+    ring->buffer_ring_size = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    void* buffer_ring = mmap(NULL, ring->buffer_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->buffer_ring = (buffer_ring == MAP_FAILED) ? NULL : buffer_ring;
+    ring->buffers = malloc((size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+    if (!ring->buffer_ring || !ring->buffers) {
+        return false;
+    }
+    struct io_uring_buf_reg registration = {
+        .ring_addr = (uint64_t)(uintptr_t)ring->buffer_ring,
+        .ring_entries = URING_BUFFER_COUNT,
+        .bgid = URING_BUFFER_GROUP,
+    };
+    if (uring_register(ring->queue.descriptor, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+        return false;
+    }
+    for (uint16_t id = 0; id < URING_BUFFER_COUNT; id++) {
+        provide_buffer(ring, id);
+    }
+    publish_buffers(ring);
+    return true;
+}
+
+bool divulge_uring_is_supported(void) {
+    uring_ring_t ring = {.queue = {.descriptor = -1}};
+    bool is_supported = map_queue(&ring.queue, 4, 8) && are_operations_supported(&ring.queue) &&
+                        register_files(&ring.queue, 1) && set_up_buffers(&ring);
+    unmap_queue(&ring.queue);
+    if (ring.buffer_ring) {
+        munmap(ring.buffer_ring, ring.buffer_ring_size);
+    }
+    free(ring.buffers);
+    return is_supported;
+}
+
+static bool append_output(uring_output_t* output, const char* data, size_t size) {
+    if ((output->size + size) > output->capacity) {
+        size_t capacity = output->capacity ? output->capacity : URING_INITIAL_OUTPUT_SIZE;
+        while (capacity < (output->size + size)) {
+            capacity *= 2;
+        }
+        char* output_data = realloc(output->data, capacity);
+        if (!output_data) {
+            return false;
+        }
+        output->data = output_data;
+        output->capacity = capacity;
+    }
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+    return true;
+}
+
+static bool is_output_empty(const uring_output_t* output) {
+    return output->offset == output->size;
+}
+
+static void clear_output(uring_output_t* output) {
+    output->offset = 0;
+    output->size = 0;
+}
+
+/*
+ * Output is only ever appended to the pending buffer: the sending one belongs to the kernel until its send
+ * completes.
+ */
+static void send_segments(uring_connection_t* connection, const divulge_slice_t* segments, size_t segment_count) {
+    for (size_t i = 0; (i < segment_count) && !connection->has_failed; i++) {
+        connection->has_failed = !append_output(&connection->pending, segments[i].data, segments[i].size);
+    }
+}
+
+static void socket_send(void* connection_context, const char* data, size_t data_size) {
+    divulge_slice_t segment = {.data = data, .size = data_size};
+    send_segments(connection_context, &segment, 1);
+}
+
+static void socket_send_vector(void* connection_context, const divulge_slice_t* segments, size_t segment_count) {
+    send_segments(connection_context, segments, segment_count);
+}
+
+static bool socket_send_file(void* connection_context, int file_descriptor, size_t offset, size_t size) {
+    uring_connection_t* connection = connection_context;
+    char buffer[URING_INITIAL_OUTPUT_SIZE];
+    while ((size > 0) && !connection->has_failed) {
+        size_t piece_size = (size < sizeof(buffer)) ? size : sizeof(buffer);
+        ssize_t bytes_read = pread(file_descriptor, buffer, piece_size, (off_t)offset);
+        if (bytes_read <= 0) {
+            return false;
+        }
+        connection->has_failed = !append_output(&connection->pending, buffer, (size_t)bytes_read);
+        offset += (size_t)bytes_read;
+        size -= (size_t)bytes_read;
+    }
+    return !connection->has_failed;
+}
+
+/*
+ * A connection closed by its timer is not being handled: it is queued for the ring to advance.
+ */
+static void socket_close(void* connection_context) {
+    uring_connection_t* connection = connection_context;
+    uring_ring_t* ring = connection->ring;
+    if (ring->is_advancing_timers && !connection->is_closing) {
+        connection->next_expired = ring->expired;
+        ring->expired = connection;
+    }
+    connection->is_closing = true;
+}
+
+static bool wake_ring(uring_ring_t* ring) {
+    uint64_t value = 1;
+    return write(ring->wakeup, &value, sizeof(value)) == sizeof(value);
+}
+
+/*
+ * Runs on the thread giving a deferred response: the connection is queued for its ring, which resumes it.
+ */
+static void socket_resume(void* connection_context) {
+    uring_connection_t* connection = connection_context;
+    uring_ring_t* ring = connection->ring;
+    pthread_mutex_lock(&ring->resume_mutex);
+    if (!connection->is_resume_queued) {
+        connection->is_resume_queued = true;
+        connection->next_resumed = ring->resumed;
+        ring->resumed = connection;
+    }
+    pthread_mutex_unlock(&ring->resume_mutex);
+    wake_ring(ring);
+}
+
+void divulge_uring_prepare_configuration(divulge_configuration_t* configuration) {
+    if (!configuration) {
+        return;
+    }
+    configuration->send = socket_send;
+    configuration->send_vector = socket_send_vector;
+    configuration->send_file = socket_send_file;
+    configuration->close = socket_close;
+    configuration->resume = socket_resume;
+}
+
+static void arm_accept(uring_ring_t* ring) {
+    if (!reserve_entries(&ring->queue, 1)) {
+        return;
+    }
+    struct io_uring_sqe* entry = next_entry(&ring->queue, tag(NULL, URING_OPERATION_ACCEPT));
+    entry->opcode = IORING_OP_ACCEPT;
+    entry->fd = ring->listener;
+    entry->ioprio = IORING_ACCEPT_MULTISHOT;
+    entry->file_index = IORING_FILE_INDEX_ALLOC;
+    ring->is_accepting = true;
+}
+
+static void arm_wakeup(uring_ring_t* ring) {
+    if (!reserve_entries(&ring->queue, 1)) {
+        return;
+    }
+    struct io_uring_sqe* entry = next_entry(&ring->queue, tag(NULL, URING_OPERATION_WAKEUP));
+    entry->opcode = IORING_OP_READ;
+    entry->fd = ring->wakeup;
+    entry->addr = (uint64_t)(uintptr_t)&ring->wakeup_value;
+    entry->len = sizeof(ring->wakeup_value);
+}
+
+static void arm_receive(uring_connection_t* connection) {
+    if (!reserve_entries(&connection->ring->queue, 1)) {
+        connection->has_failed = true;
+        return;
+    }
+    struct io_uring_sqe* entry = next_entry(&connection->ring->queue, tag(connection, URING_OPERATION_RECEIVE));
+    entry->opcode = IORING_OP_RECV;
+    entry->fd = (int)connection->file;
+    entry->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    entry->ioprio = IORING_RECV_MULTISHOT;
+    entry->buf_group = URING_BUFFER_GROUP;
+    connection->is_receiving = true;
+    connection->operation_count++;
+}
+
+/*
+ * A client that does not read its responses stops being read until they are sent, and one whose buffer is full of
+ * requests waiting behind a deferred response until the bytes held meanwhile fit in it again.
+ */
+static void pause_receive(uring_connection_t* connection) {
+    if (!reserve_entries(&connection->ring->queue, 1)) {
+        return;
+    }
+    struct io_uring_sqe* entry = next_entry(&connection->ring->queue, tag(NULL, URING_OPERATION_CANCEL));
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->addr = tag(connection, URING_OPERATION_RECEIVE);
+    connection->is_receive_paused = true;
+}
+
+static void cancel_all(uring_ring_t* ring) {
+    if (!reserve_entries(&ring->queue, 1)) {
+        return;
+    }
+    struct io_uring_sqe* entry = next_entry(&ring->queue, tag(NULL, URING_OPERATION_CANCEL_ALL));
+    entry->opcode = IORING_OP_ASYNC_CANCEL;
+    entry->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    ring->is_cancelling = true;
+}
+
+static void close_file(uring_ring_t* ring, unsigned file, uint64_t user_data, uint8_t flags) {
+    struct io_uring_sqe* entry = next_entry(&ring->queue, user_data);
+    entry->opcode = IORING_OP_CLOSE;
+    entry->file_index = file + 1;
+    entry->flags = flags;
+}
+
+/*
+ * Once the divulge connection is gone no deferred response can queue the connection any more.
+ */
+static void remove_from_resumed(uring_connection_t* connection) {
+    uring_ring_t* ring = connection->ring;
+    pthread_mutex_lock(&ring->resume_mutex);
+    if (connection->is_resume_queued) {
+        uring_connection_t** link = &ring->resumed;
+        while (*link != connection) {
+            link = &(*link)->next_resumed;
+        }
+        *link = connection->next_resumed;
+        connection->is_resume_queued = false;
+    }
+    pthread_mutex_unlock(&ring->resume_mutex);
+}
+
+static void destroy_connection(uring_connection_t* connection) {
+    uring_ring_t* ring = connection->ring;
+    connection->is_closing = true;
+    divulge_connection_destroy(connection->connection);
+    remove_from_resumed(connection);
+    if (connection->previous) {
+        connection->previous->next = connection->next;
+    } else {
+        ring->connections = connection->next;
+    }
+    if (connection->next) {
+        connection->next->previous = connection->previous;
+    }
+    free(connection->sending.data);
+    free(connection->pending.data);
+    free(connection->held.data);
+    free(connection);
+}
+
+/*
+ * Submits whatever the connection is ready for: the next send and, once closing, shutdown and close linked
+ * after it. A short or failed send breaks the link, and the chain is submitted again from here.
+ */
+static void advance(uring_connection_t* connection) {
+    if (connection->is_closed) {
+        if (connection->operation_count == 0) {
+            destroy_connection(connection);
+        }
+        return;
+    }
+    if (connection->is_sending || connection->is_close_submitted || connection->ring->is_cancelling) {
+        return;
+    }
+    if (connection->has_failed) {
+        clear_output(&connection->sending);
+        clear_output(&connection->pending);
+        connection->is_closing = true;
+    }
+    if (is_output_empty(&connection->sending) && !is_output_empty(&connection->pending)) {
+        uring_output_t sending = connection->sending;
+        connection->sending = connection->pending;
+        connection->pending = sending;
+        clear_output(&connection->pending);
+    }
+    bool is_sending = !is_output_empty(&connection->sending);
+    if (!is_sending && connection->is_receive_paused && is_output_empty(&connection->held)) {
+        connection->is_receive_paused = false;
+        if (!connection->is_receiving && !connection->is_closing) {
+            arm_receive(connection);
+        }
+    }
+    unsigned entry_count = (is_sending ? 1 : 0) + (connection->is_closing ? 2 : 0);
+    if ((entry_count == 0) || !reserve_entries(&connection->ring->queue, entry_count)) {
+        return;
+    }
+    if (is_sending) {
+        struct io_uring_sqe* entry = next_entry(&connection->ring->queue, tag(connection, URING_OPERATION_SEND));
+        entry->opcode = IORING_OP_SEND;
+        entry->fd = (int)connection->file;
+        entry->flags = IOSQE_FIXED_FILE | (connection->is_closing ? IOSQE_IO_LINK : 0);
+        entry->addr = (uint64_t)(uintptr_t)(connection->sending.data + connection->sending.offset);
+        entry->len = (unsigned)(connection->sending.size - connection->sending.offset);
+        entry->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        connection->is_sending = true;
+        connection->operation_count++;
+    }
+    if (connection->is_closing) {
+        struct io_uring_sqe* entry = next_entry(&connection->ring->queue, tag(connection, URING_OPERATION_SHUTDOWN));
+        entry->opcode = IORING_OP_SHUTDOWN;
+        entry->fd = (int)connection->file;
+        entry->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        entry->len = SHUT_RDWR;
+        close_file(connection->ring, connection->file, tag(connection, URING_OPERATION_CLOSE), 0);
+        connection->is_close_submitted = true;
+        connection->operation_count += 2;
+    }
+}
+
+static void accept_connection(uring_ring_t* ring, const struct io_uring_cqe* completion) {
+    if (!(completion->flags & IORING_CQE_F_MORE)) {
+        ring->is_accepting = false;
+    }
+    if (completion->res < 0) {
+        return;
+    }
+    unsigned file = (unsigned)completion->res;
+    uring_connection_t* connection = calloc(1, sizeof(uring_connection_t));
+    if (connection) {
+        connection->ring = ring;
+        connection->file = file;
+        connection->connection = divulge_connection_create(ring->uring->divulge, connection);
+        divulge_connection_watch(connection->connection, &ring->timers);
+    }
+    if (!connection || !connection->connection) {
+        free(connection);
+        if (reserve_entries(&ring->queue, 1)) {
+            close_file(ring, file, tag(NULL, URING_OPERATION_CLOSE), 0);
+        }
+        return;
+    }
+    connection->next = ring->connections;
+    if (ring->connections) {
+        ring->connections->previous = connection;
+    }
+    ring->connections = connection;
+    ring->connection_count++;
+    arm_receive(connection);
+}
+
+static size_t feed(uring_connection_t* connection, const char* data, size_t size) {
+    size_t fed_size = 0;
+    while ((fed_size < size) && !connection->is_closing) {
+        size_t free_size = 0;
+        char* buffer = divulge_connection_get_receive_buffer(connection->connection, &free_size);
+        if (free_size == 0) {
+            break;
+        }
+        size_t piece_size = ((size - fed_size) < free_size) ? (size - fed_size) : free_size;
+        memcpy(buffer, data + fed_size, piece_size);
+        fed_size += piece_size;
+        divulge_connection_receive(connection->connection, piece_size);
+    }
+    return fed_size;
+}
+
+/*
+ * Bytes the connection buffer has no room for, as requests wait behind a deferred response, are held until the
+ * connection is resumed; receiving is paused meanwhile.
+ */
+static void deliver(uring_connection_t* connection, const char* data, size_t size) {
+    if (is_output_empty(&connection->held)) {
+        size_t fed_size = feed(connection, data, size);
+        data += fed_size;
+        size -= fed_size;
+    }
+    if ((size > 0) && !connection->is_closing) {
+        connection->has_failed = !append_output(&connection->held, data, size);
+    }
+}
+
+static void deliver_held(uring_connection_t* connection) {
+    uring_output_t* held = &connection->held;
+    held->offset += feed(connection, held->data + held->offset, held->size - held->offset);
+    if (is_output_empty(held)) {
+        clear_output(held);
+    }
+}
+
+static void receive(uring_connection_t* connection, const struct io_uring_cqe* completion) {
+    if (!(completion->flags & IORING_CQE_F_MORE)) {
+        connection->is_receiving = false;
+        connection->operation_count--;
+    }
+    if (completion->flags & IORING_CQE_F_BUFFER) {
+        uint16_t id = (uint16_t)(completion->flags >> IORING_CQE_BUFFER_SHIFT);
+        if ((completion->res > 0) && !connection->is_closing && !connection->has_failed) {
+            deliver(connection, connection->ring->buffers + (size_t)id * URING_BUFFER_SIZE, (size_t)completion->res);
+        }
+        provide_buffer(connection->ring, id);
+    }
+    bool is_paused = (completion->res == -ECANCELED) && connection->is_receive_paused;
+    if ((completion->res == 0) || ((completion->res < 0) && (completion->res != -ENOBUFS) && !is_paused)) {
+        connection->is_closing = true;
+    }
+    bool is_flooding = connection->is_sending && (connection->pending.size > URING_MAX_PENDING_OUTPUT_SIZE);
+    bool is_buffer_full = !is_output_empty(&connection->held);
+    if ((is_flooding || is_buffer_full) && connection->is_receiving && !connection->is_receive_paused) {
+        pause_receive(connection);
+    }
+    if (!connection->is_receiving && !connection->is_receive_paused && !connection->is_closing &&
+        !connection->has_failed) {
+        arm_receive(connection);
+    }
+}
+
+static void finish_send(uring_connection_t* connection, int result) {
+    connection->is_sending = false;
+    connection->operation_count--;
+    if (result < 0) {
+        connection->has_failed = true;
+        return;
+    }
+    connection->sending.offset += (size_t)result;
+    if (is_output_empty(&connection->sending)) {
+        clear_output(&connection->sending);
+    }
+}
+
+static void finish_close(uring_connection_t* connection, int result) {
+    connection->operation_count--;
+    if (result == -ECANCELED) {
+        connection->is_close_submitted = false;
+        return;
+    }
+    connection->is_closed = true;
+    connection->ring->connection_count--;
+}
+
+/*
+ * Outstanding operations are cancelled first, so that nothing submitted afterwards to close the connections
+ * gets cancelled as well.
+ */
+static void finish_cancel_all(uring_ring_t* ring) {
+    ring->is_cancelling = false;
+    uring_connection_t* connection = ring->connections;
+    while (connection) {
+        uring_connection_t* next = connection->next;
+        connection->has_failed = true;
+        advance(connection);
+        connection = next;
+    }
+}
+
+static void resume_connections(uring_ring_t* ring) {
+    pthread_mutex_lock(&ring->resume_mutex);
+    uring_connection_t* connection = ring->resumed;
+    ring->resumed = NULL;
+    for (uring_connection_t* queued = connection; queued; queued = queued->next_resumed) {
+        queued->is_resume_queued = false;
+    }
+    pthread_mutex_unlock(&ring->resume_mutex);
+    while (connection) {
+        uring_connection_t* next = connection->next_resumed;
+        if (!connection->has_failed && !connection->is_closing) {
+            divulge_connection_resume(connection->connection);
+            deliver_held(connection);
+        }
+        advance(connection);
+        connection = next;
+    }
+}
+
+static void handle_completion(uring_ring_t* ring, const struct io_uring_cqe* completion) {
+    uring_operation_t operation = (uring_operation_t)(completion->user_data & URING_OPERATION_MASK);
+    uring_connection_t* connection = (uring_connection_t*)(uintptr_t)(completion->user_data & ~URING_OPERATION_MASK);
+    switch (operation) {
+        case URING_OPERATION_ACCEPT:
+            accept_connection(ring, completion);
+            return;
+        case URING_OPERATION_WAKEUP:
+            if (atomic_load(&ring->is_stop_requested)) {
+                ring->is_stopping = true;
+                cancel_all(ring);
+            } else {
+                arm_wakeup(ring);
+            }
+            resume_connections(ring);
+            return;
+        case URING_OPERATION_CANCEL:
+            return;
+        case URING_OPERATION_CANCEL_ALL:
+            finish_cancel_all(ring);
+            return;
+        case URING_OPERATION_RECEIVE:
+            receive(connection, completion);
+            break;
+        case URING_OPERATION_SEND:
+            finish_send(connection, completion->res);
+            break;
+        case URING_OPERATION_SHUTDOWN:
+            connection->operation_count--;
+            break;
+        case URING_OPERATION_CLOSE:
+            if (!connection) {
+                return;
+            }
+            finish_close(connection, completion->res);
+            break;
+    }
+    advance(connection);
+}
+
+static void handle_completions(uring_ring_t* ring) {
+    uring_queue_t* queue = &ring->queue;
+    unsigned head = *queue->completion_head;
+    unsigned tail = atomic_load_explicit((_Atomic unsigned*)queue->completion_tail, memory_order_acquire);
+    while (head != tail) {
+        struct io_uring_cqe completion = queue->completions[head & queue->completion_mask];
+        head++;
+        atomic_store_explicit((_Atomic unsigned*)queue->completion_head, head, memory_order_release);
+        handle_completion(ring, &completion);
+    }
+}
+
+/*
+ * Runs after the completions, up to the time they were collected: bytes that arrived while they were handled are
+ * collected by the next wait before the deadlines they may have crossed meanwhile are checked.
+ * Connections over their deadline send what they were given, such as a 408, with their shutdown linked after it.
+ */
+static void advance_timers(uring_ring_t* ring, uint64_t now_ms) {
+    ring->is_advancing_timers = true;
+    divulge_timer_wheel_advance(&ring->timers, now_ms);
+    ring->is_advancing_timers = false;
+    while (ring->expired) {
+        uring_connection_t* connection = ring->expired;
+        ring->expired = connection->next_expired;
+        advance(connection);
+    }
+}
+
+static void* run_ring(void* argument) {
+    uring_ring_t* ring = argument;
+    if (ring->uring->configuration.is_pinning_rings) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(ring->index % CPU_SETSIZE, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    ring->is_stopping = false;
+    divulge_timer_wheel_initialize(&ring->timers, URING_TIMER_TICK_MS, divulge_get_time_ms());
+    arm_wakeup(ring);
+    arm_accept(ring);
+    while (!ring->is_stopping || ring->connections || ring->is_accepting || ring->is_cancelling) {
+        publish_buffers(ring);
+        int timeout = divulge_timer_wheel_get_timeout(&ring->timers);
+        if (timeout > 0) {
+            uint64_t lag_ms = divulge_get_time_ms() - ring->timers.now_ms;
+            timeout = (lag_ms < (uint64_t)timeout) ? timeout - (int)lag_ms : 0;
+        }
+        if ((submit(&ring->queue, 1, timeout) < 0) && (errno != EINTR) && (errno != EBUSY) && (errno != EAGAIN) &&
+            (errno != ETIME)) {
+            break;
+        }
+        uint64_t now_ms = divulge_get_time_ms();
+        handle_completions(ring);
+        advance_timers(ring, now_ms);
+        bool has_room = ring->connection_count < ring->uring->configuration.max_connection_count;
+        if (!ring->is_accepting && !ring->is_stopping && has_room) {
+            arm_accept(ring);
+        }
+    }
+    while (ring->connections) {
+        destroy_connection(ring->connections);
+    }
+    return NULL;
+}
+
+static void close_if_open(int descriptor) {
+    if (descriptor >= 0) {
+        close(descriptor);
+    }
+}
+
+static void tear_down_ring(uring_ring_t* ring) {
+    unmap_queue(&ring->queue);
+    if (ring->buffer_ring) {
+        munmap(ring->buffer_ring, ring->buffer_ring_size);
+    }
+    free(ring->buffers);
+    close_if_open(ring->listener);
+    close_if_open(ring->wakeup);
+    pthread_mutex_destroy(&ring->resume_mutex);
+}
+
+static bool set_up_ring(divulge_uring_t* uring, uring_ring_t* ring) {
+    ring->listener =
+        divulge_listener_create(uring->configuration.address, uring->port, uring->configuration.backlog);
+    ring->wakeup = eventfd(0, EFD_CLOEXEC);
+    if ((ring->listener < 0) || (ring->wakeup < 0)) {
+        return false;
+    }
+    if (uring->port == 0) {
+        uring->port = divulge_listener_get_port(ring->listener);
+    }
+    return map_queue(&ring->queue, URING_QUEUE_DEPTH, URING_COMPLETION_QUEUE_DEPTH) &&
+           are_operations_supported(&ring->queue) &&
+           register_files(&ring->queue, uring->configuration.max_connection_count) && set_up_buffers(ring);
+}
+
+/*
+ * The registered file table may not be larger than the file descriptor limit.
+ */
+static size_t limit_connection_count(size_t connection_count) {
+    struct rlimit limit;
+    if ((getrlimit(RLIMIT_NOFILE, &limit) == 0) && (limit.rlim_cur != RLIM_INFINITY) &&
+        (connection_count > limit.rlim_cur)) {
+        return (size_t)limit.rlim_cur;
+    }
+    return connection_count;
+}
+
+divulge_uring_t* divulge_uring_create(divulge_t* divulge, const divulge_uring_configuration_t* configuration) {
+    if (!divulge || !configuration) {
+        return NULL;
+    }
+    divulge_uring_t* uring = calloc(1, sizeof(divulge_uring_t));
+    if (!uring) {
+        return NULL;
+    }
+    uring->divulge = divulge;
+    uring->configuration = *configuration;
+    if (uring->configuration.ring_count == 0) {
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        uring->configuration.ring_count = (cpu_count > 0) ? (size_t)cpu_count : 1;
+    }
+    if (uring->configuration.backlog <= 0) {
+        uring->configuration.backlog = SOMAXCONN;
+    }
+    if (uring->configuration.max_connection_count == 0) {
+        uring->configuration.max_connection_count = URING_DEFAULT_MAX_CONNECTION_COUNT;
+    }
+    uring->configuration.max_connection_count = limit_connection_count(uring->configuration.max_connection_count);
+    uring->port = configuration->port;
+    uring->rings = calloc(uring->configuration.ring_count, sizeof(uring_ring_t));
+    if (!uring->rings) {
+        free(uring);
+        return NULL;
+    }
+    for (size_t i = 0; i < uring->configuration.ring_count; i++) {
+        uring->rings[i] = (uring_ring_t){
+            .uring = uring, .index = i, .queue = {.descriptor = -1}, .listener = -1, .wakeup = -1};
+        pthread_mutex_init(&uring->rings[i].resume_mutex, NULL);
+    }
+    for (size_t i = 0; i < uring->configuration.ring_count; i++) {
+        if (!set_up_ring(uring, uring->rings + i)) {
+            divulge_uring_destroy(uring);
+            return NULL;
+        }
+    }
+    return uring;
+}
+
+uint16_t divulge_uring_get_port(const divulge_uring_t* uring) {
+    return uring ? uring->port : 0;
+}
+
+static void stop_rings(divulge_uring_t* uring, size_t ring_count) {
+    for (size_t i = 0; i < ring_count; i++) {
+        atomic_store(&uring->rings[i].is_stop_requested, true);
+        if (wake_ring(uring->rings + i)) {
+            pthread_join(uring->rings[i].thread, NULL);
+        }
+        atomic_store(&uring->rings[i].is_stop_requested, false);
+    }
+}
+
+bool divulge_uring_start(divulge_uring_t* uring) {
+    if (!uring || uring->is_running) {
+        return false;
+    }
+    for (size_t i = 0; i < uring->configuration.ring_count; i++) {
+        if (pthread_create(&uring->rings[i].thread, NULL, run_ring, uring->rings + i) != 0) {
+            stop_rings(uring, i);
+            return false;
+        }
+    }
+    uring->is_running = true;
+    return true;
+}
+
+void divulge_uring_stop(divulge_uring_t* uring) {
+    if (!uring || !uring->is_running) {
+        return;
+    }
+    stop_rings(uring, uring->configuration.ring_count);
+    uring->is_running = false;
+}
+
+void divulge_uring_destroy(divulge_uring_t* uring) {
+    if (!uring) {
+        return;
+    }
+    divulge_uring_stop(uring);
+    for (size_t i = 0; i < uring->configuration.ring_count; i++) {
+        tear_down_ring(uring->rings + i);
+    }
+    free(uring->rings);
+    free(uring);
+}
@@ -0,0 +1,93 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_URING_H
+#define DIVULGE_URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-uring Divulge io_uring transport
+ * @ingroup divulge
+ * @brief Completion-based HTTP server with one io_uring per thread
+ *
+ * Every ring thread owns an io_uring and a `SO_REUSEPORT` listener. Connections are accepted by a single
+ * multishot accept straight into the ring's registered file table, and read by one multishot recv each from a
+ * ring of provided buffers, so steady-state serving needs no per-request system call besides the one
+ * io_uring_enter() per loop iteration. Responses are copied into a per-connection output buffer and sent once
+ * the received bytes were handled; a closing connection links shutdown and close after its last send.
+ * Every ring keeps a timer wheel enforcing the configured timeouts, see divulge_connection_watch(), and waits
+ * for completions no longer than until its next timer is due.
+ *
+ * Needs Linux 6.0 or later. Check divulge_uring_is_supported() before preparing the configuration and fall back
+ * to the epoll transport (divulge-epoll.h) when it returns false.
+ * @{
+ */
+typedef struct divulge_uring divulge_uring_t;
+
+typedef struct divulge_uring_configuration {
+    const char* address;         /**< IPv4 address to listen on, NULL for all interfaces */
+    uint16_t port;               /**< 0 for a port chosen by the system, see divulge_uring_get_port() */
+    size_t ring_count;           /**< 0 for one per online CPU */
+    int backlog;                 /**< 0 for SOMAXCONN */
+    size_t max_connection_count; /**< open connections per ring, 0 for 1024; limited by RLIMIT_NOFILE */
+    bool is_pinning_rings;       /**< pin ring `i` to CPU `i` */
+} divulge_uring_configuration_t;
+
+/**
+ * @brief Tell whether the running kernel provides every io_uring feature the transport uses
+ */
+bool divulge_uring_is_supported(void);
+
+/**
+ * @brief Fill in the transport callbacks of a router configuration
+ * @note Call before divulge_initialize(); the remaining fields are left unchanged.
+ */
+void divulge_uring_prepare_configuration(divulge_configuration_t* configuration);
+
+/**
+ * @brief Create the rings and listening sockets
+ * @param divulge router initialized with a configuration prepared by divulge_uring_prepare_configuration()
+ * @return transport or NULL if io_uring is not supported or the sockets could not be set up
+ */
+divulge_uring_t* divulge_uring_create(divulge_t* divulge, const divulge_uring_configuration_t* configuration);
+
+uint16_t divulge_uring_get_port(const divulge_uring_t* uring);
+
+/**
+ * @brief Start the ring threads
+ */
+bool divulge_uring_start(divulge_uring_t* uring);
+
+/**
+ * @brief Cancel outstanding operations, close the connections and stop the ring threads
+ */
+void divulge_uring_stop(divulge_uring_t* uring);
+
+void divulge_uring_destroy(divulge_uring_t* uring);
+/**
+ * @}
+ */
+#endif  // DIVULGE_URING_H
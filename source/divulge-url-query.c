@@ -0,0 +1,329 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-url-query.h"
+#include <string.h>
+
+#define FNV_OFFSET_BASIS (2166136261u)
+#define FNV_PRIME (16777619u)
+#define MAX_DECODED_NUMBER_SIZE (64)
+
+static int hex_digit_value(char c) {
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F')) {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Decode the byte at `*position` and move past it.
+ */
+static unsigned char next_decoded(const char* data, size_t size, size_t* position) {
+    size_t i = *position;
+    if (data[i] == '+') {
+        *position = i + 1;
+        return ' ';
+    }
+    if ((data[i] == '%') && ((size - i) > 2)) {
+        int high = hex_digit_value(data[i + 1]);
+        int low = hex_digit_value(data[i + 2]);
+        if ((high >= 0) && (low >= 0)) {
+            *position = i + 3;
+            return (unsigned char)((high << 4) | low);
+        }
+    }
+    *position = i + 1;
+    return (unsigned char)data[i];
+}
+
+static bool is_key_equal(const divulge_url_query_parameter_t* parameter, const char* key, size_t key_size) {
+    if (!parameter->is_key_encoded) {
+        return (parameter->key.size == key_size) && (memcmp(parameter->key.data, key, key_size) == 0);
+    }
+    size_t position = 0;
+    size_t i = 0;
+    while ((position < parameter->key.size) && (i < key_size)) {
+        if (next_decoded(parameter->key.data, parameter->key.size, &position) != (unsigned char)key[i++]) {
+            return false;
+        }
+    }
+    return (position == parameter->key.size) && (i == key_size);
+}
+
+static bool are_keys_equal(const divulge_url_query_parameter_t* a, const divulge_url_query_parameter_t* b) {
+    if (!b->is_key_encoded) {
+        return is_key_equal(a, b->key.data, b->key.size);
+    }
+    if (!a->is_key_encoded) {
+        return is_key_equal(b, a->key.data, a->key.size);
+    }
+    size_t a_position = 0;
+    size_t b_position = 0;
+    while ((a_position < a->key.size) && (b_position < b->key.size)) {
+        if (next_decoded(a->key.data, a->key.size, &a_position) !=
+            next_decoded(b->key.data, b->key.size, &b_position)) {
+            return false;
+        }
+    }
+    return (a_position == a->key.size) && (b_position == b->key.size);
+}
+
+static uint32_t hash_key(const char* key, size_t key_size) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < key_size; i++) {
+        hash = (hash ^ (unsigned char)key[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/*
+ * Scan a key up to `=` or `&`, hashing it as decoded.
+ */
+static size_t scan_key(const char* data, size_t size, divulge_url_query_parameter_t* parameter) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    bool is_encoded = false;
+    size_t i = 0;
+    while ((i < size) && (data[i] != '=') && (data[i] != '&')) {
+        if ((data[i] == '%') || (data[i] == '+')) {
+            is_encoded = true;
+            size_t position = i;
+            hash = (hash ^ next_decoded(data, size, &position)) * FNV_PRIME;
+            i = position;
+        } else {
+            hash = (hash ^ (unsigned char)data[i]) * FNV_PRIME;
+            i++;
+        }
+    }
+    parameter->key = (divulge_slice_t){.data = data, .size = i};
+    parameter->hash = hash;
+    parameter->is_key_encoded = is_encoded;
+    return i;
+}
+
+static size_t scan_value(const char* data, size_t size, divulge_url_query_parameter_t* parameter) {
+    const char* end = memchr(data, '&', size);
+    size_t i = end ? (size_t)(end - data) : size;
+    parameter->value = (divulge_slice_t){.data = data, .size = i};
+    parameter->is_value_encoded = (memchr(data, '%', i) != NULL) || (memchr(data, '+', i) != NULL);
+    return i;
+}
+
+static size_t find_hashed(const divulge_url_query_t* query,
+                          const divulge_url_query_parameter_t* probe,
+                          const char* key,
+                          size_t key_size,
+                          uint32_t hash) {
+    size_t index = query->buckets[hash % DIVULGE_URL_QUERY_BUCKET_COUNT];
+    while (index != DIVULGE_URL_QUERY_NONE) {
+        const divulge_url_query_parameter_t* parameter = query->parameters + index;
+        if ((parameter->hash == hash) &&
+            (probe ? are_keys_equal(parameter, probe) : is_key_equal(parameter, key, key_size))) {
+            return index;
+        }
+        index = parameter->next_in_bucket;
+    }
+    return DIVULGE_URL_QUERY_NONE;
+}
+
+static void add_parameter(divulge_url_query_t* query) {
+    size_t index = query->count;
+    divulge_url_query_parameter_t* parameter = query->parameters + index;
+    parameter->next_in_bucket = DIVULGE_URL_QUERY_NONE;
+    parameter->next_with_key = DIVULGE_URL_QUERY_NONE;
+    size_t first = find_hashed(query, parameter, NULL, 0, parameter->hash);
+    if (first == DIVULGE_URL_QUERY_NONE) {
+        uint8_t* bucket = query->buckets + (parameter->hash % DIVULGE_URL_QUERY_BUCKET_COUNT);
+        parameter->next_in_bucket = *bucket;
+        *bucket = (uint8_t)index;
+    } else {
+        size_t last = first;
+        while (query->parameters[last].next_with_key != DIVULGE_URL_QUERY_NONE) {
+            last = query->parameters[last].next_with_key;
+        }
+        query->parameters[last].next_with_key = (uint8_t)index;
+    }
+    query->count++;
+}
+
+bool divulge_url_query_parse(divulge_url_query_t* query, const char* data, size_t size) {
+    if (!query) {
+        return false;
+    }
+    query->count = 0;
+    query->is_truncated = false;
+    memset(query->buckets, DIVULGE_URL_QUERY_NONE, sizeof(query->buckets));
+    size_t i = 0;
+    while (data && (i < size)) {
+        if (data[i] == '&') {
+            i++;
+            continue;
+        }
+        if (query->count == DIVULGE_URL_QUERY_MAX_PARAMETERS) {
+            query->is_truncated = true;
+            break;
+        }
+        divulge_url_query_parameter_t* parameter = query->parameters + query->count;
+        i += scan_key(data + i, size - i, parameter);
+        parameter->has_value = (i < size) && (data[i] == '=');
+        if (parameter->has_value) {
+            i++;
+            i += scan_value(data + i, size - i, parameter);
+        } else {
+            parameter->value = (divulge_slice_t){.data = data + i, .size = 0};
+            parameter->is_value_encoded = false;
+        }
+        add_parameter(query);
+    }
+    return !query->is_truncated;
+}
+
+size_t divulge_url_query_find(const divulge_url_query_t* query, const char* key, size_t key_size) {
+    if (!query || !key) {
+        return DIVULGE_URL_QUERY_NONE;
+    }
+    return find_hashed(query, NULL, key, key_size, hash_key(key, key_size));
+}
+
+size_t divulge_url_query_find_next(const divulge_url_query_t* query, size_t index) {
+    if (!query || (index >= query->count)) {
+        return DIVULGE_URL_QUERY_NONE;
+    }
+    return query->parameters[index].next_with_key;
+}
+
+size_t divulge_url_query_decode(const char* data, size_t size, char* buffer) {
+    if (!data || !buffer) {
+        return 0;
+    }
+    size_t decoded_size = 0;
+    size_t position = 0;
+    while (position < size) {
+        buffer[decoded_size++] = (char)next_decoded(data, size, &position);
+    }
+    return decoded_size;
+}
+
+bool divulge_url_query_get_value(const divulge_url_query_t* query,
+                                 size_t index,
+                                 char* buffer,
+                                 size_t buffer_size,
+                                 divulge_slice_t* value) {
+    if (!query || (index >= query->count) || !value) {
+        return false;
+    }
+    const divulge_url_query_parameter_t* parameter = query->parameters + index;
+    if (!parameter->is_value_encoded) {
+        *value = parameter->value;
+        return true;
+    }
+    if (!buffer || (buffer_size < parameter->value.size)) {
+        return false;
+    }
+    value->size = divulge_url_query_decode(parameter->value.data, parameter->value.size, buffer);
+    value->data = buffer;
+    return true;
+}
+
+static bool get_first_value(const divulge_url_query_t* query,
+                            const char* key,
+                            char* buffer,
+                            size_t buffer_size,
+                            const divulge_url_query_parameter_t** parameter,
+                            divulge_slice_t* value) {
+    if (!key) {
+        return false;
+    }
+    size_t index = divulge_url_query_find(query, key, strlen(key));
+    if (index == DIVULGE_URL_QUERY_NONE) {
+        return false;
+    }
+    *parameter = query->parameters + index;
+    return divulge_url_query_get_value(query, index, buffer, buffer_size, value);
+}
+
+bool divulge_url_query_get_integer(const divulge_url_query_t* query, const char* key, int64_t* value) {
+    char buffer[MAX_DECODED_NUMBER_SIZE];
+    const divulge_url_query_parameter_t* parameter = NULL;
+    divulge_slice_t text;
+    if (!value || !get_first_value(query, key, buffer, sizeof(buffer), &parameter, &text) || (text.size == 0)) {
+        return false;
+    }
+    bool is_negative = (text.data[0] == '-');
+    size_t i = is_negative ? 1 : 0;
+    if (i == text.size) {
+        return false;
+    }
+    uint64_t limit = is_negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t magnitude = 0;
+    for (; i < text.size; i++) {
+        if ((text.data[i] < '0') || (text.data[i] > '9')) {
+            return false;
+        }
+        uint64_t digit = (uint64_t)(text.data[i] - '0');
+        if (magnitude > (limit - digit) / 10) {
+            return false;
+        }
+        magnitude = magnitude * 10 + digit;
+    }
+    *value = (is_negative && (magnitude > 0)) ? -(int64_t)(magnitude - 1) - 1 : (int64_t)magnitude;
+    return true;
+}
+
+static bool is_text_equal(divulge_slice_t text, const char* expected) {
+    size_t i = 0;
+    for (; (i < text.size) && expected[i]; i++) {
+        char c = text.data[i];
+        if ((((c >= 'A') && (c <= 'Z')) ? (char)(c - 'A' + 'a') : c) != expected[i]) {
+            return false;
+        }
+    }
+    return (i == text.size) && !expected[i];
+}
+
+bool divulge_url_query_get_boolean(const divulge_url_query_t* query, const char* key, bool* value) {
+    static const char* true_texts[] = {"1", "true", "yes", "on"};
+    static const char* false_texts[] = {"0", "false", "no", "off"};
+    char buffer[MAX_DECODED_NUMBER_SIZE];
+    const divulge_url_query_parameter_t* parameter = NULL;
+    divulge_slice_t text;
+    if (!value || !get_first_value(query, key, buffer, sizeof(buffer), &parameter, &text)) {
+        return false;
+    }
+    if (!parameter->has_value) {
+        *value = true;
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(true_texts) / sizeof(true_texts[0]); i++) {
+        if (is_text_equal(text, true_texts[i]) || is_text_equal(text, false_texts[i])) {
+            *value = is_text_equal(text, true_texts[i]);
+            return true;
+        }
+    }
+    return false;
+}
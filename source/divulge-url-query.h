@@ -26,11 +26,93 @@
 
 #include <stdbool.h>
 #include <stddef.h>
-#include "static-string.h"
+#include <stdint.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-url-query Divulge URL query
+ * @ingroup divulge
+ * @brief Zero-copy index of the `key=value` pairs of a URL query
+ *
+ * A single pass splits the query on `&` into slices of the query itself and hashes every key as it would read
+ * once decoded; repeated keys are chained in order of appearance. Nothing is decoded or copied up front:
+ * `%XX` escapes and `+` are only resolved when a value is read, and values without any are returned as they
+ * are. A `%` not followed by two hex digits is taken literally.
+ * @{
+ */
+#define DIVULGE_URL_QUERY_MAX_PARAMETERS (128)
+#define DIVULGE_URL_QUERY_BUCKET_COUNT (64)
+#define DIVULGE_URL_QUERY_NONE (0xff)
+
+typedef struct divulge_url_query_parameter {
+    divulge_slice_t key;   /**< as received, possibly encoded */
+    divulge_slice_t value; /**< as received, possibly encoded; empty when there is no `=` */
+    uint32_t hash;
+    uint8_t next_in_bucket;
+    uint8_t next_with_key;
+    bool is_key_encoded;
+    bool is_value_encoded;
+    bool has_value; /**< the key was followed by `=` */
+} divulge_url_query_parameter_t;
 
 typedef struct divulge_url_query {
+    divulge_url_query_parameter_t parameters[DIVULGE_URL_QUERY_MAX_PARAMETERS];
+    size_t count;
+    bool is_truncated; /**< the query had more parameters, which were left out */
+    uint8_t buckets[DIVULGE_URL_QUERY_BUCKET_COUNT];
 } divulge_url_query_t;
 
-divulge_url_query_t divulge_url_query_create_from_raw_query(const char* raw_query);
+/**
+ * @brief Index a raw query, without the leading `?`
+ * @note The query must outlive the index, whose slices point into it.
+ * @return false when the query had more than DIVULGE_URL_QUERY_MAX_PARAMETERS parameters
+ */
+bool divulge_url_query_parse(divulge_url_query_t* query, const char* data, size_t size);
 
-#endif  // DIVULGE_URL_QUERY_H
\ No newline at end of file
+/**
+ * @brief Find the first parameter with the key, compared with the decoded keys
+ * @return parameter index or DIVULGE_URL_QUERY_NONE
+ */
+size_t divulge_url_query_find(const divulge_url_query_t* query, const char* key, size_t key_size);
+
+/**
+ * @brief Find the next parameter with the same key as the parameter
+ * @return parameter index or DIVULGE_URL_QUERY_NONE
+ */
+size_t divulge_url_query_find_next(const divulge_url_query_t* query, size_t index);
+
+/**
+ * @brief Get the decoded value of a parameter
+ * @param buffer where an encoded value is decoded, at least `parameters[index].value.size` bytes; values
+ * without escapes point into the query instead
+ * @return false when the value is encoded and the buffer is too small
+ */
+bool divulge_url_query_get_value(const divulge_url_query_t* query,
+                                 size_t index,
+                                 char* buffer,
+                                 size_t buffer_size,
+                                 divulge_slice_t* value);
+
+/**
+ * @brief Read the first value of the key as a decimal integer
+ * @return false when the key is missing, the value is not an integer or does not fit in int64_t
+ */
+bool divulge_url_query_get_integer(const divulge_url_query_t* query, const char* key, int64_t* value);
+
+/**
+ * @brief Read the first value of the key as a boolean
+ *
+ * `1`, `true`, `yes`, `on` and a key without `=` are true; `0`, `false`, `no` and `off` are false, in any case.
+ * @return false when the key is missing or the value is none of these
+ */
+bool divulge_url_query_get_boolean(const divulge_url_query_t* query, const char* key, bool* value);
+
+/**
+ * @brief Decode `%XX` escapes and `+`
+ * @param buffer at least `size` bytes, may be `data` itself
+ * @return decoded size
+ */
+size_t divulge_url_query_decode(const char* data, size_t size, char* buffer);
+/**
+ * @}
+ */
+#endif  // DIVULGE_URL_QUERY_H
@@ -0,0 +1,218 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "divulge-writer.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "divulge-time.h"
+#ifdef DIVULGE_TRACING
+#include "divulge-trace.h"
+#endif
+
+#define DIVULGE_WRITER_MAX_PRINT_SIZE (256)
+
+void divulge_writer_initialize(divulge_writer_t* writer,
+                               const divulge_configuration_t* configuration,
+                               void* connection_context,
+                               char* buffer,
+                               size_t buffer_size) {
+    if (!writer || !configuration) {
+        return;
+    }
+    writer->send = configuration->send;
+    writer->send_vector = configuration->send_vector;
+    writer->connection_context = connection_context;
+    writer->buffer = buffer;
+    writer->buffer_size = buffer_size;
+    writer->buffer_used = 0;
+    writer->segment_count = 0;
+    writer->observer = (divulge_response_observer_t){0};
+    writer->is_observer_paused = false;
+    writer->is_measuring = (configuration->metrics != NULL);
+    writer->sent_size = 0;
+    writer->send_time_ns = 0;
+    writer->sent_at_ns = 0;
+#ifdef DIVULGE_TRACING
+    writer->tracer = configuration->tracer;
+    writer->trace_id = 0;
+    writer->trace_send_count = 0;
+#endif
+}
+
+void divulge_writer_set_observer(divulge_writer_t* writer, const divulge_response_observer_t* observer) {
+    if (!writer || !observer) {
+        return;
+    }
+    writer->observer = *observer;
+}
+
+void divulge_writer_pause_observer(divulge_writer_t* writer, bool is_paused) {
+    if (!writer) {
+        return;
+    }
+    writer->is_observer_paused = is_paused;
+}
+
+static inline bool is_timing_sends(const divulge_writer_t* writer) {
+#ifdef DIVULGE_TRACING
+    return writer->is_measuring || (writer->trace_id != 0);
+#else
+    return writer->is_measuring;
+#endif
+}
+
+static void trace_send(divulge_writer_t* writer, uint64_t started_at) {
+#ifdef DIVULGE_TRACING
+    if (writer->trace_id) {
+        divulge_trace_event_t event = {
+            .request_id = writer->trace_id,
+            .begin_ns = started_at,
+            .end_ns = writer->sent_at_ns,
+            .phase = DIVULGE_TRACE_PHASE_SEND,
+            .index = writer->trace_send_count++,
+        };
+        divulge_tracer_record(writer->tracer, &event);
+    }
+#endif
+}
+
+static void send_data(divulge_writer_t* writer, const char* data, size_t size) {
+    if (!is_timing_sends(writer)) {
+        writer->send(writer->connection_context, data, size);
+        return;
+    }
+    uint64_t started_at = divulge_get_time_ns();
+    writer->send(writer->connection_context, data, size);
+    writer->sent_at_ns = divulge_get_time_ns();
+    writer->send_time_ns += writer->sent_at_ns - started_at;
+    writer->sent_size += size;
+    trace_send(writer, started_at);
+}
+
+static void send_segments(divulge_writer_t* writer) {
+    if (!is_timing_sends(writer)) {
+        writer->send_vector(writer->connection_context, writer->segments, writer->segment_count);
+        return;
+    }
+    uint64_t started_at = divulge_get_time_ns();
+    writer->send_vector(writer->connection_context, writer->segments, writer->segment_count);
+    writer->sent_at_ns = divulge_get_time_ns();
+    writer->send_time_ns += writer->sent_at_ns - started_at;
+    for (size_t i = 0; i < writer->segment_count; i++) {
+        writer->sent_size += writer->segments[i].size;
+    }
+    trace_send(writer, started_at);
+}
+
+static void observe(divulge_writer_t* writer, const char* data, size_t size) {
+    if (writer->observer.write && !writer->is_observer_paused && (size > 0)) {
+        writer->observer.write(writer->observer.context, data, size);
+    }
+}
+
+static void add_segment(divulge_writer_t* writer, const char* data, size_t size) {
+    if (writer->segment_count > 0) {
+        divulge_slice_t* last = writer->segments + writer->segment_count - 1;
+        if ((last->data + last->size) == data) {
+            last->size += size;
+            return;
+        }
+    }
+    if (writer->segment_count == DIVULGE_WRITER_MAX_SEGMENTS) {
+        divulge_writer_flush(writer);
+    }
+    writer->segments[writer->segment_count].data = data;
+    writer->segments[writer->segment_count].size = size;
+    writer->segment_count++;
+}
+
+static void append_copy(divulge_writer_t* writer, const char* data, size_t size) {
+    while (size > 0) {
+        bool is_full = (writer->buffer_used == writer->buffer_size) ||
+                       (writer->send_vector && (writer->segment_count == DIVULGE_WRITER_MAX_SEGMENTS));
+        if (is_full) {
+            divulge_writer_flush(writer);
+        }
+        size_t free_size = writer->buffer_size - writer->buffer_used;
+        size_t piece_size = (size < free_size) ? size : free_size;
+        char* destination = writer->buffer + writer->buffer_used;
+        memcpy(destination, data, piece_size);
+        writer->buffer_used += piece_size;
+        if (writer->send_vector) {
+            add_segment(writer, destination, piece_size);
+        }
+        data += piece_size;
+        size -= piece_size;
+    }
+}
+
+void divulge_writer_copy(divulge_writer_t* writer, const char* data, size_t size) {
+    if (!writer || !data) {
+        return;
+    }
+    observe(writer, data, size);
+    append_copy(writer, data, size);
+}
+
+void divulge_writer_print(divulge_writer_t* writer, const char* format, ...) {
+    if (!writer || !format) {
+        return;
+    }
+    char text[DIVULGE_WRITER_MAX_PRINT_SIZE];
+    va_list arguments;
+    va_start(arguments, format);
+    int size = vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    if (size > 0) {
+        divulge_writer_copy(writer, text, ((size_t)size < sizeof(text)) ? (size_t)size : sizeof(text) - 1);
+    }
+}
+
+void divulge_writer_reference(divulge_writer_t* writer, const char* data, size_t size) {
+    if (!writer || !data || (size == 0)) {
+        return;
+    }
+    observe(writer, data, size);
+    if (writer->send_vector) {
+        add_segment(writer, data, size);
+    } else if (size <= (writer->buffer_size - writer->buffer_used)) {
+        append_copy(writer, data, size);
+    } else {
+        divulge_writer_flush(writer);
+        send_data(writer, data, size);
+    }
+}
+
+void divulge_writer_flush(divulge_writer_t* writer) {
+    if (!writer) {
+        return;
+    }
+    if (writer->send_vector && (writer->segment_count > 0)) {
+        send_segments(writer);
+    } else if (!writer->send_vector && (writer->buffer_used > 0)) {
+        send_data(writer, writer->buffer, writer->buffer_used);
+    }
+    writer->buffer_used = 0;
+    writer->segment_count = 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVULGE_WRITER_H
+#define DIVULGE_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "divulge.h"
+/**
+ * @defgroup divulge-writer Divulge response writer
+ * @ingroup divulge
+ * @brief Gathers a response into as few socket writes as possible
+ *
+ * Small pieces (status line, headers, chunk framing) are copied into the response buffer, while bodies are
+ * referenced where they are. With a vectored send callback a flush is a single call covering both; with the
+ * plain callback the pieces are coalesced in the response buffer and large bodies are sent without copying.
+ * @{
+ */
+#define DIVULGE_WRITER_MAX_SEGMENTS (16)
+
+typedef struct divulge_writer {
+    divulge_socket_send_callback_t send;
+    divulge_socket_send_vector_callback_t send_vector;
+    void* connection_context;
+    char* buffer;
+    size_t buffer_size;
+    size_t buffer_used;
+    divulge_slice_t segments[DIVULGE_WRITER_MAX_SEGMENTS];
+    size_t segment_count;
+    divulge_response_observer_t observer;
+    bool is_observer_paused;
+    bool is_measuring;     /**< set when `metrics` are configured */
+    size_t sent_size;      /**< bytes handed to the send callbacks, while measuring */
+    uint64_t send_time_ns; /**< time spent in the send callbacks, while measuring */
+    uint64_t sent_at_ns;   /**< when the last send callback returned, while measuring */
+#ifdef DIVULGE_TRACING
+    divulge_tracer_t* tracer;
+    uint64_t trace_id;           /**< request whose sends are traced, 0 for none */
+    uint32_t trace_send_count;
+#endif
+} divulge_writer_t;
+
+void divulge_writer_initialize(divulge_writer_t* writer,
+                               const divulge_configuration_t* configuration,
+                               void* connection_context,
+                               char* buffer,
+                               size_t buffer_size);
+
+/**
+ * @brief Append bytes that may change or go away after the call
+ */
+void divulge_writer_copy(divulge_writer_t* writer, const char* data, size_t size);
+
+/**
+ * @brief Append formatted text
+ */
+void divulge_writer_print(divulge_writer_t* writer, const char* format, ...);
+
+/**
+ * @brief Append bytes that stay unchanged until the next divulge_writer_flush()
+ */
+void divulge_writer_reference(divulge_writer_t* writer, const char* data, size_t size);
+
+/**
+ * @brief Pass a copy of everything appended from now on to the observer
+ */
+void divulge_writer_set_observer(divulge_writer_t* writer, const divulge_response_observer_t* observer);
+
+/**
+ * @brief Stop or resume passing appended bytes to the observer, e.g. around a per-connection header
+ */
+void divulge_writer_pause_observer(divulge_writer_t* writer, bool is_paused);
+
+/**
+ * @brief Send everything appended so far
+ */
+void divulge_writer_flush(divulge_writer_t* writer);
+/**
+ * @}
+ */
+#endif  // DIVULGE_WRITER_H
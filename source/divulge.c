@@ -22,81 +22,333 @@
  * SOFTWARE.
  */
 #include "divulge.h"
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "dynamic-list.h"
+#include "divulge-arena.h"
+#include "divulge-body.h"
+#include "divulge-date.h"
+#include "divulge-headers.h"
+#include "divulge-metrics.h"
+#include "divulge-routes.h"
+#include "divulge-time.h"
+#include "divulge-timer.h"
+#include "divulge-url-query.h"
+#include "divulge-writer.h"
+#ifdef DIVULGE_TRACING
+#include "divulge-trace.h"
+#endif
 
 #define G2LABS_LOG_MODULE_LEVEL G2LABS_LOG_MODULE_LEVEL_INFO
 #define G2LABS_LOG_MODULE_NAME "divulge"
 #include "g2labs-log.h"
 
 #define DIVULGE_SERVER_NAME "Divulge"
-typedef struct route_entry {
-    divulge_uri_t uri;
-    dynamic_list_t* middlewares;
-} route_entry_t;
+#define DIVULGE_DEFAULT_MAX_REQUESTS_PER_CONNECTION (100)
+#define DIVULGE_DEFAULT_CONNECTION_BUFFER_SIZE (16384)
+#define DIVULGE_DEFAULT_RESPONSE_BUFFER_SIZE (1024)
+#define DIVULGE_DEFAULT_MAX_REQUEST_BODY_SIZE (64 * 1024 * 1024)
+#define DIVULGE_REASON_PHRASE_COUNT (512)
+#define DIVULGE_BODY_RATE_GRACE_MS (5000)
 typedef struct divulge {
     divulge_configuration_t configuration;
-    dynamic_list_t* routes;
-    divulge_uri_handler_t default_404_handler;
-    void* default_404_handler_context;
+    divulge_routes_t* routes;
+    divulge_response_template_t* not_found_response; /**< kept, as requests may still send it once replaced */
+    divulge_response_template_t* overloaded_response;
+    atomic_size_t concurrent_request_count;
+    atomic_uint_fast64_t timeout_counts[DIVULGE_TIMEOUT_COUNT];
 } divulge_t;
 
 typedef struct divulge_request_context {
     divulge_t* divulge;
     void* connection_context;
-    char* response_buffer;
-    size_t response_buffer_size;
+    divulge_connection_t* connection;
+    int version_minor;
+    const char* request_buffer;
+    divulge_headers_t headers;
+    divulge_url_query_t* url_query;
+    divulge_writer_t writer;
+    divulge_arena_t arena;
+    bool is_keep_alive;
+    bool is_head;                  /**< the response is sent without its body */
+    bool is_admitted;              /**< counted in the concurrent requests until answered */
+    bool is_body_pending;          /**< dispatched before the body was received, see divulge_read_body() */
+    bool is_keep_alive_after_body; /**< whether the connection may stay open once a pending body is read */
+    divulge_body_reader_t body_reader;
     bool was_status_sent;
     bool was_header_sent;
+    bool was_payload_sent;
+    bool is_streaming;
+    bool is_chunked;
+    bool was_file_sent;
+    size_t content_length;
+    size_t written_size;
+    divulge_deferred_t* deferred;
+    int return_code;
+    const char* route_pattern;
+    uint64_t started_at_ns;
+    uint64_t dispatched_at_ns;
+    uint64_t handled_at_ns;
+    uint64_t durations_ns[DIVULGE_METRICS_PHASE_COUNT];
 } divulge_request_context_t;
 
+typedef enum divulge_deferred_state {
+    DIVULGE_DEFERRED_STATE_PENDING,
+    DIVULGE_DEFERRED_STATE_COMPLETED,
+    DIVULGE_DEFERRED_STATE_CANCELLED,
+} divulge_deferred_state_t;
+
+/*
+ * Shared by the connection and the thread responding; the last of them to let go frees it.
+ */
+typedef struct divulge_deferred {
+    pthread_mutex_t mutex;
+    size_t reference_count;
+    divulge_deferred_state_t state;
+    divulge_t* divulge;
+    divulge_connection_t* connection;
+    void* connection_context;
+    int version_minor;
+    bool is_keep_alive;
+    bool is_head;
+    bool is_admitted;
+    bool was_payload_sent;
+    bool has_failed;
+    divulge_deferred_cancel_callback_t cancel;
+    void* cancel_context;
+    divulge_arena_t arena; /**< memory of the request, in use by its body reader and responder until released */
+    char* output;
+    size_t output_size;
+    size_t output_capacity;
+    divulge_metrics_sample_t sample;
+    uint64_t started_at_ns;
+    bool was_sent;
+    char response_buffer[];
+} divulge_deferred_t;
+
+typedef struct divulge_connection {
+    divulge_t* divulge;
+    void* connection_context;
+    divulge_parser_t parser;
+    char* buffer;
+    size_t buffer_size;
+    size_t request_offset;
+    size_t received_size;
+    size_t request_count;
+    char* response_buffer;
+    divulge_deferred_t* deferred;
+    divulge_body_decoder_t body_decoder;
+    divulge_body_reader_t body_reader;
+    size_t body_size;          /**< decoded bytes of a chunked body, right after the header block until streamed */
+    bool is_body_prepared;     /**< the header block was checked and the body decoder set up */
+    bool is_body_pending;      /**< the request is answered before its body was received */
+    bool is_body_streamed;     /**< received bytes go to the body reader */
+    bool is_continue_expected; /**< the client waits for `100 Continue` before sending the body */
+    uint64_t parse_time_ns;
+    divulge_timer_wheel_t* timer_wheel;
+    divulge_timer_t timer;
+    uint64_t deadline_ms;        /**< the timer is scheduled for */
+    uint64_t waiting_since_ms;   /**< the current request began to arrive, or the connection became idle */
+    uint64_t body_started_at_ms; /**< the header block of the current request was received */
+    size_t body_received_size;   /**< bytes received since */
+#ifdef DIVULGE_TRACING
+    uint64_t trace_id;
+    uint64_t trace_received_at_ns;
+    uint64_t trace_last_received_at_ns;
+    uint32_t trace_feed_count;
+#endif
+    bool is_closed;
+} divulge_connection_t;
+
+/*
+ * What the caller knows of the request before it is answered.
+ */
+typedef struct request_timing {
+    uint64_t started_at_ns; /**< parsing began, not counting waits for more bytes; 0 for now */
+#ifdef DIVULGE_TRACING
+    uint64_t trace_id;            /**< 0 unless the request is sampled */
+    uint64_t received_at_ns;      /**< first bytes of the request were received */
+    uint64_t last_received_at_ns; /**< last bytes of the request were received */
+#endif
+} request_timing_t;
+
+static const char* method_names[DIVULGE_ROUTE_METHOD_COUNT] = {
+    [DIVULGE_ROUTE_METHOD_GET] = "GET",
+    [DIVULGE_ROUTE_METHOD_POST] = "POST",
+    [DIVULGE_ROUTE_METHOD_PUT] = "PUT",
+    [DIVULGE_ROUTE_METHOD_DELETE] = "DELETE",
+    [DIVULGE_ROUTE_METHOD_PATCH] = "PATCH",
+    [DIVULGE_ROUTE_METHOD_HEAD] = "HEAD",
+    [DIVULGE_ROUTE_METHOD_OPTIONS] = "OPTIONS",
+    [DIVULGE_ROUTE_METHOD_ANY] = "ANY",
+};
+
 const char* divulge_method_name_from_method(divulge_route_method_t method) {
-    if (method == DIVULGE_ROUTE_METHOD_GET) {
-        return "GET";
-    } else if (method == DIVULGE_ROUTE_METHOD_POST) {
-        return "POST";
-    } else {
+    if ((size_t)method >= DIVULGE_ROUTE_METHOD_COUNT) {
         return "ANY";
     }
+    return method_names[method];
 }
 
-static divulge_route_method_t convert_request_method_to_method_type(const char* method_name) {
-    if (strcmp(method_name, "GET") == 0) {
-        return DIVULGE_ROUTE_METHOD_GET;
-    } else if (strcmp(method_name, "POST") == 0) {
-        return DIVULGE_ROUTE_METHOD_POST;
-    } else {
-        return DIVULGE_ROUTE_METHOD_ANY;
+static bool is_slice_equal_ignoring_case(divulge_slice_t slice, const char* text) {
+    size_t text_size = strlen(text);
+    if (slice.size != text_size) {
+        return false;
+    }
+    for (size_t i = 0; i < text_size; i++) {
+        char c = slice.data[i];
+        if ((char)(((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c) != text[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * The size and first byte leave at most one candidate, which a fixed-size compare confirms.
+ */
+static divulge_route_method_t convert_request_method_to_method_type(divulge_slice_t method_name) {
+    const char* name = method_name.data;
+    divulge_route_method_t method = DIVULGE_ROUTE_METHOD_ANY;
+    switch (method_name.size) {
+        case 3:
+            method = (name[0] == 'G') ? DIVULGE_ROUTE_METHOD_GET : DIVULGE_ROUTE_METHOD_PUT;
+            break;
+        case 4:
+            method = (name[0] == 'P') ? DIVULGE_ROUTE_METHOD_POST : DIVULGE_ROUTE_METHOD_HEAD;
+            break;
+        case 5:
+            method = DIVULGE_ROUTE_METHOD_PATCH;
+            break;
+        case 6:
+            method = DIVULGE_ROUTE_METHOD_DELETE;
+            break;
+        case 7:
+            method = DIVULGE_ROUTE_METHOD_OPTIONS;
+            break;
+        default:
+            return DIVULGE_ROUTE_METHOD_ANY;
     }
+    return (memcmp(name, method_names[method], method_name.size) == 0) ? method : DIVULGE_ROUTE_METHOD_ANY;
 }
 
+static const char* reason_phrases[DIVULGE_REASON_PHRASE_COUNT] = {
+    [100] = "Continue",
+    [101] = "Switching Protocols",
+    [102] = "Processing",
+    [103] = "Early Hints",
+    [200] = "OK",
+    [201] = "Created",
+    [202] = "Accepted",
+    [203] = "Non-Authoritative Information",
+    [204] = "No Content",
+    [205] = "Reset Content",
+    [206] = "Partial Content",
+    [207] = "Multi-Status",
+    [208] = "Already Reported",
+    [226] = "IM Used",
+    [300] = "Multiple Choices",
+    [301] = "Moved Permanently",
+    [302] = "Found",
+    [303] = "See Other",
+    [304] = "Not Modified",
+    [305] = "Use Proxy",
+    [307] = "Temporary Redirect",
+    [308] = "Permanent Redirect",
+    [400] = "Bad Request",
+    [401] = "Unauthorized",
+    [402] = "Payment Required",
+    [403] = "Forbidden",
+    [404] = "Not Found",
+    [405] = "Method Not Allowed",
+    [406] = "Not Acceptable",
+    [407] = "Proxy Authentication Required",
+    [408] = "Request Timeout",
+    [409] = "Conflict",
+    [410] = "Gone",
+    [411] = "Length Required",
+    [412] = "Precondition Failed",
+    [413] = "Content Too Large",
+    [414] = "URI Too Long",
+    [415] = "Unsupported Media Type",
+    [416] = "Range Not Satisfiable",
+    [417] = "Expectation Failed",
+    [421] = "Misdirected Request",
+    [422] = "Unprocessable Content",
+    [423] = "Locked",
+    [424] = "Failed Dependency",
+    [425] = "Too Early",
+    [426] = "Upgrade Required",
+    [428] = "Precondition Required",
+    [429] = "Too Many Requests",
+    [431] = "Request Header Fields Too Large",
+    [451] = "Unavailable For Legal Reasons",
+    [500] = "Internal Server Error",
+    [501] = "Not Implemented",
+    [502] = "Bad Gateway",
+    [503] = "Service Unavailable",
+    [504] = "Gateway Timeout",
+    [505] = "HTTP Version Not Supported",
+    [506] = "Variant Also Negotiates",
+    [507] = "Insufficient Storage",
+    [508] = "Loop Detected",
+    [510] = "Not Extended",
+    [511] = "Network Authentication Required",
+};
+
 static const char* convert_return_code_to_text(int return_code) {
-    if (return_code == 200) {
-        return "OK";
-    } else if (return_code == 301) {
-        return "Moved Permanently";
-    } else if (return_code == 404) {
-        return "Not found";
-    } else if (return_code == 500) {
-        return "Internal server error";
-    } else {
+    if ((return_code < 0) || (return_code >= DIVULGE_REASON_PHRASE_COUNT) || !reason_phrases[return_code]) {
         return "Other";
     }
+    return reason_phrases[return_code];
+}
+
+/*
+ * Informational, 204 and 304 responses have no body (RFC 9110, 8.6): neither a Content-Length nor a payload given
+ * for them is sent, as the client would read the payload as the start of the next response.
+ */
+static bool is_body_forbidden(int return_code) {
+    return ((return_code >= 100) && (return_code < 200)) || (return_code == 204) || (return_code == 304);
 }
 
 static bool respond_with_404(divulge_request_t* request, void* context) {
-    char buffer[1024];
-    snprintf(buffer, sizeof(buffer) - 1, "Divulge Error: [%s] '%s' failed!",
-             divulge_method_name_from_method(request->method), request->route);
+    divulge_respond_template(request, context);
+    return true;
+}
+
+static divulge_response_template_t* create_error_response(int return_code, const char* payload) {
+    divulge_response_t response = {
+        .return_code = return_code,
+        .payload = payload,
+        .payload_size = strlen(payload),
+    };
+    return divulge_response_template_create(&response);
+}
+
+/*
+ * Answers OPTIONS, or any method the path has no route for, with the methods it has.
+ */
+static void respond_with_allowed_methods(divulge_request_t* request, uint32_t methods) {
+    char allow[64] = "";
+    size_t size = 0;
+    for (size_t method = 0; method < DIVULGE_ROUTE_METHOD_ANY; method++) {
+        if (methods & (1u << method)) {
+            size += (size_t)snprintf(allow + size, sizeof(allow) - size, "%s%s", (size > 0) ? ", " : "",
+                                     method_names[method]);
+        }
+    }
+    bool is_options = (request->method == DIVULGE_ROUTE_METHOD_OPTIONS);
+    const char* payload = is_options ? "" : "Divulge Error: method not allowed";
+    divulge_header_entry_t header_entries[] = {{.key = "Allow", .value = allow}};
     divulge_response_t response = {
-        .payload = buffer,
-        .payload_size = strlen(buffer),
-        .return_code = 404,
+        .return_code = is_options ? 200 : 405,
+        .header = {.count = 1, .entries = header_entries},
+        .payload = payload,
+        .payload_size = strlen(payload),
     };
     divulge_respond(request, &response);
-    return true;
 }
 
 divulge_t* divulge_initialize(divulge_configuration_t* configuration) {
@@ -108,8 +360,27 @@ divulge_t* divulge_initialize(divulge_configuration_t* configuration) {
         return NULL;
     }
     memcpy(&divulge->configuration, configuration, sizeof(divulge_configuration_t));
-    divulge->routes = dynamic_list_create();
-    divulge->default_404_handler = respond_with_404;
+    if (divulge->configuration.max_requests_per_connection == 0) {
+        divulge->configuration.max_requests_per_connection = DIVULGE_DEFAULT_MAX_REQUESTS_PER_CONNECTION;
+    }
+    if (divulge->configuration.connection_buffer_size == 0) {
+        divulge->configuration.connection_buffer_size = DIVULGE_DEFAULT_CONNECTION_BUFFER_SIZE;
+    }
+    if (divulge->configuration.response_buffer_size == 0) {
+        divulge->configuration.response_buffer_size = DIVULGE_DEFAULT_RESPONSE_BUFFER_SIZE;
+    }
+    if (divulge->configuration.max_request_body_size == 0) {
+        divulge->configuration.max_request_body_size = DIVULGE_DEFAULT_MAX_REQUEST_BODY_SIZE;
+    }
+    divulge->not_found_response = create_error_response(404, "Divulge Error: not found");
+    divulge->overloaded_response = create_error_response(503, "Divulge Error: overloaded");
+    divulge->routes = (divulge->not_found_response && divulge->overloaded_response) ? divulge_routes_create() : NULL;
+    if (!divulge->routes) {
+        divulge_response_template_destroy(divulge->not_found_response);
+        divulge_response_template_destroy(divulge->overloaded_response);
+        free(divulge);
+        return NULL;
+    }
     return divulge;
 }
 
@@ -117,185 +388,1739 @@ void divulge_register_uri(divulge_t* divulge, divulge_uri_t* uri) {
     if (!divulge || !uri || !uri->handler.handler || !uri->uri) {
         return;
     }
-    route_entry_t* entry = calloc(1, sizeof(route_entry_t));
-    entry->middlewares = dynamic_list_create();
-    memcpy(&entry->uri, uri, sizeof(*uri));
-    dynamic_list_append(divulge->routes, entry);
+    divulge_routes_register(divulge->routes, uri);
+}
+
+bool divulge_unregister_uri(divulge_t* divulge, divulge_uri_t* uri) {
+    if (!divulge || !uri || !uri->uri) {
+        return false;
+    }
+    return divulge_routes_unregister(divulge->routes, uri);
 }
 
 void divulge_add_middleware_to_uri(divulge_t* divulge, divulge_uri_t* uri, divulge_handler_object_t* middleware) {
     if (!divulge || !uri || !middleware) {
         return;
     }
-    for (dynamic_list_iterator_t* it = dynamic_list_begin(divulge->routes); it; it = dynamic_list_next(it)) {
-        route_entry_t* entry = dynamic_list_get(it);
-        if ((entry->uri.method == uri->method) && (strcmp(entry->uri.uri, uri->uri) == 0)) {
-            divulge_handler_object_t* object = calloc(1, sizeof(divulge_handler_object_t));
-            memcpy(object, middleware, sizeof(*object));
-            dynamic_list_append(entry->middlewares, object);
-        }
+    divulge_routes_add_middleware(divulge->routes, uri, middleware);
+}
+
+bool divulge_remove_middleware_from_uri(divulge_t* divulge, divulge_uri_t* uri, divulge_handler_object_t* middleware) {
+    if (!divulge || !uri || !middleware) {
+        return false;
     }
+    return divulge_routes_remove_middleware(divulge->routes, uri, middleware);
 }
 
-void divulge_set_default_404_handler(divulge_t* divulge, divulge_uri_handler_t handler, void* context) {
-    if (!divulge || !handler) {
+void divulge_begin_routes_update(divulge_t* divulge) {
+    if (!divulge) {
         return;
     }
-    divulge->default_404_handler_context = context;
-    divulge->default_404_handler = handler;
+    divulge_routes_begin_update(divulge->routes);
 }
 
-static bool are_urls_equal(const char* request_url, const char* route_url) {
-    return ((strcmp(request_url, route_url) == 0) && (strlen(request_url) == strlen(route_url)));
+void divulge_end_routes_update(divulge_t* divulge) {
+    if (!divulge) {
+        return;
+    }
+    divulge_routes_end_update(divulge->routes);
 }
 
-static char* extract_query_from_request_url(char* request_url) {
-    char* query_separator = strchr(request_url, '?');
-    if (query_separator) {
-        *query_separator = '\0';
-        query_separator++;
+unsigned long divulge_get_routes_version(divulge_t* divulge) {
+    if (!divulge) {
+        return 0;
     }
-    return query_separator;
+    return divulge_routes_get_version(divulge->routes);
 }
 
-void divulge_process_request(divulge_t* divulge,
-                             void* connection_context,
-                             char* request_buffer,
-                             size_t request_buffer_size,
-                             char* response_buffer,
-                             size_t response_buffer_size) {
-    if (!divulge || !request_buffer || (request_buffer_size == 0) || !response_buffer || (response_buffer_size == 0)) {
+void divulge_set_default_404_handler(divulge_t* divulge, divulge_uri_handler_t handler, void* context) {
+    if (!divulge || !handler) {
         return;
     }
-    divulge_request_t request = {
-        .header = NULL,
-        .payload = NULL,
+    divulge_handler_object_t not_found = {.handler = handler, .context = context};
+    divulge_routes_set_not_found_handler(divulge->routes, &not_found);
+}
+
+static divulge_slice_t get_request_slice(const char* request_buffer, divulge_span_t span) {
+    divulge_slice_t slice = {.data = request_buffer + span.offset, .size = span.size};
+    return slice;
+}
+
+static void respond_with_parser_error(divulge_request_t* request, const divulge_parser_t* parser) {
+    bool is_incomplete = (parser->error == DIVULGE_PARSER_ERROR_NONE);
+    int return_code = is_incomplete ? 400 : divulge_parser_get_error_status(parser);
+    const char* payload = is_incomplete ? "Divulge Error: incomplete request" : "Divulge Error: malformed request";
+    divulge_response_t response = {
+        .return_code = return_code,
+        .payload = payload,
+        .payload_size = strlen(payload),
     };
-    divulge_request_context_t request_context = {
-        .divulge = divulge,
-        .connection_context = connection_context,
-        .response_buffer = response_buffer,
-        .response_buffer_size = response_buffer_size,
-        .was_status_sent = false,
-        .was_header_sent = false,
+    divulge_respond(request, &response);
+}
+
+#ifdef DIVULGE_TRACING
+static void record_trace_event(divulge_tracer_t* tracer,
+                               uint64_t trace_id,
+                               divulge_trace_phase_t phase,
+                               uint32_t index,
+                               uint64_t begin_ns,
+                               uint64_t end_ns) {
+    divulge_trace_event_t event = {
+        .request_id = trace_id, .begin_ns = begin_ns, .end_ns = end_ns, .phase = phase, .index = index};
+    divulge_tracer_record(tracer, &event);
+}
+#endif
+
+/*
+ * Start of a traced phase, 0 when the request is not traced.
+ */
+static inline uint64_t get_trace_time(divulge_request_context_t* context) {
+#ifdef DIVULGE_TRACING
+    return context->writer.trace_id ? divulge_get_time_ns() : 0;
+#else
+    return 0;
+#endif
+}
+
+static inline void trace_middleware(divulge_request_context_t* context, size_t index, uint64_t started_at) {
+#ifdef DIVULGE_TRACING
+    if (context->writer.trace_id) {
+        record_trace_event(context->writer.tracer, context->writer.trace_id, DIVULGE_TRACE_PHASE_MIDDLEWARE,
+                           (uint32_t)index, started_at, divulge_get_time_ns());
+    }
+#endif
+}
+
+static inline void trace_handler(divulge_request_context_t* context, uint64_t started_at) {
+#ifdef DIVULGE_TRACING
+    if (context->writer.trace_id) {
+        record_trace_event(context->writer.tracer, context->writer.trace_id, DIVULGE_TRACE_PHASE_HANDLER, 0,
+                           started_at, divulge_get_time_ns());
+    }
+#endif
+}
+
+/*
+ * Time since `*started_at` without the time spent sending meanwhile, which is accounted separately.
+ */
+static uint64_t measure_phase(divulge_request_context_t* context, uint64_t* started_at, uint64_t* send_time_ns) {
+    uint64_t now = divulge_get_time_ns();
+    uint64_t duration = (now - *started_at) - (context->writer.send_time_ns - *send_time_ns);
+    *started_at = now;
+    *send_time_ns = context->writer.send_time_ns;
+    return duration;
+}
+
+/*
+ * Refuses a body over the limit, or one too large for the buffer unless the route reads it in pieces.
+ */
+static bool accept_body(divulge_t* divulge, divulge_request_t* request, const divulge_uri_t* uri) {
+    divulge_request_context_t* context = request->context;
+    if ((request->payload.size <= divulge->configuration.max_request_body_size) &&
+        (!context->is_body_pending || uri->is_streaming_body)) {
+        return true;
+    }
+    const char* payload = "Divulge Error: request body too large";
+    divulge_response_t response = {
+        .return_code = 413,
+        .payload = payload,
+        .payload_size = strlen(payload),
     };
-    request.header = strstr(request_buffer, "\r\n") + 2;
-    request.payload = strstr(request_buffer, "\r\n\r\n") + 4;
-    char* method_name = strtok(request_buffer, " ");
-    request.route = strtok(NULL, " ");
-    request.url_query = extract_query_from_request_url((char*)request.route);
-    request.method = convert_request_method_to_method_type(method_name);
-    request.context = &request_context;
-    D("Received request: [%s] %s", method_name, request.route);
-    divulge_route_method_t method = convert_request_method_to_method_type(method_name);
+    context->is_keep_alive = false;
+    divulge_respond(request, &response);
+    return false;
+}
+
+/*
+ * Runs the admission middleware, then takes one of the concurrent request slots, which is given back once the
+ * request is answered. Shed requests close the connection.
+ */
+static bool admit_request(divulge_t* divulge, divulge_request_t* request) {
+    divulge_request_context_t* context = request->context;
+    const divulge_handler_object_t* admission = divulge->configuration.admission;
+    if (admission && !admission->handler(request, admission->context)) {
+        return false;
+    }
+    size_t max_concurrent_requests = divulge->configuration.max_concurrent_requests;
+    if (max_concurrent_requests == 0) {
+        return true;
+    }
+    if (atomic_fetch_add_explicit(&divulge->concurrent_request_count, 1, memory_order_relaxed) >=
+        max_concurrent_requests) {
+        atomic_fetch_sub_explicit(&divulge->concurrent_request_count, 1, memory_order_relaxed);
+        context->is_keep_alive = false;
+        divulge_respond_template(request, divulge->overloaded_response);
+        return false;
+    }
+    context->is_admitted = true;
+    return true;
+}
+
+static void finish_admitted_request(divulge_t* divulge) {
+    atomic_fetch_sub_explicit(&divulge->concurrent_request_count, 1, memory_order_relaxed);
+}
+
+/*
+ * Phases share their boundary timestamps, keeping the clock reads per request to a handful.
+ */
+static void dispatch_request(divulge_t* divulge, divulge_request_t* request) {
+    divulge_request_context_t* context = request->context;
+    bool is_measuring = context->writer.is_measuring;
+    uint64_t started_at = context->dispatched_at_ns;
+    uint64_t send_time_ns = context->writer.send_time_ns;
     bool was_route_handled = false;
-    for (dynamic_list_iterator_t* it = dynamic_list_begin(divulge->routes); it; it = dynamic_list_next(it)) {
-        route_entry_t* entry = dynamic_list_get(it);
-        if ((entry->uri.method == request.method) && are_urls_equal(request.route, entry->uri.uri)) {
-            bool can_execute_handler = true;
-            for (dynamic_list_iterator_t* jt = dynamic_list_begin(entry->middlewares); jt; jt = dynamic_list_next(jt)) {
-                divulge_handler_object_t* object = dynamic_list_get(jt);
-                can_execute_handler = object->handler(&request, object->context);
-                if (!can_execute_handler) {
-                    break;
-                }
-            }
-            if (can_execute_handler) {
-                entry->uri.handler.handler(&request, entry->uri.handler.context);
-                was_route_handled = true;
+    if (!admit_request(divulge, request)) {
+        if (is_measuring) {
+            context->durations_ns[DIVULGE_METRICS_PHASE_HANDLER] = measure_phase(context, &started_at, &send_time_ns);
+            context->handled_at_ns = started_at;
+        }
+        return;
+    }
+    divulge_routes_reader_t reader;
+    divulge_routes_acquire(divulge->routes, &reader);
+    divulge_router_t* router = reader.snapshot->router;
+    divulge_route_entry_t* entry = divulge_router_lookup(router, request->method, request->route.data,
+                                                         request->route.size, request->parameters,
+                                                         &request->parameter_count);
+    if (!entry && (request->method == DIVULGE_ROUTE_METHOD_HEAD)) {
+        entry = divulge_router_lookup(router, DIVULGE_ROUTE_METHOD_GET, request->route.data, request->route.size,
+                                      request->parameters, &request->parameter_count);
+    }
+    if (!entry && (request->method != DIVULGE_ROUTE_METHOD_ANY)) {
+        entry = divulge_router_lookup(router, DIVULGE_ROUTE_METHOD_ANY, request->route.data, request->route.size,
+                                      request->parameters, &request->parameter_count);
+    }
+    uint32_t allowed_methods = 0;
+    if (!entry) {
+        allowed_methods = divulge_router_get_methods(router, request->route.data, request->route.size);
+        if (allowed_methods & (1u << DIVULGE_ROUTE_METHOD_GET)) {
+            allowed_methods |= 1u << DIVULGE_ROUTE_METHOD_HEAD;
+        }
+        if (allowed_methods) {
+            allowed_methods |= 1u << DIVULGE_ROUTE_METHOD_OPTIONS;
+        }
+    }
+    if (entry) {
+        context->route_pattern = entry->uri.uri;
+        bool can_execute_handler = accept_body(divulge, request, &entry->uri);
+        for (size_t i = 0; can_execute_handler && (i < entry->middleware_count); i++) {
+            divulge_handler_object_t* object = entry->middlewares + i;
+            uint64_t middleware_started_at = get_trace_time(context);
+            can_execute_handler = object->handler(request, object->context);
+            trace_middleware(context, i, middleware_started_at);
+            if (!can_execute_handler) {
+                break;
             }
         }
+        if (is_measuring && (entry->middleware_count > 0)) {
+            context->durations_ns[DIVULGE_METRICS_PHASE_MIDDLEWARE] =
+                measure_phase(context, &started_at, &send_time_ns);
+        }
+        if (can_execute_handler) {
+            uint64_t handler_started_at = get_trace_time(context);
+            entry->uri.handler.handler(request, entry->uri.handler.context);
+            trace_handler(context, handler_started_at);
+            was_route_handled = true;
+        }
     }
-    if (!request.context->was_status_sent && !was_route_handled) {
-        divulge->default_404_handler(&request, divulge->default_404_handler_context);
+    divulge_handler_object_t not_found = reader.snapshot->not_found;
+    divulge_routes_release(divulge->routes, &reader);
+    if (!context->was_status_sent && !was_route_handled) {
+        uint64_t handler_started_at = get_trace_time(context);
+        if (allowed_methods) {
+            respond_with_allowed_methods(request, allowed_methods);
+        } else if (not_found.handler) {
+            not_found.handler(request, not_found.context);
+        } else {
+            respond_with_404(request, divulge->not_found_response);
+        }
+        trace_handler(context, handler_started_at);
+    }
+    if (is_measuring) {
+        context->durations_ns[DIVULGE_METRICS_PHASE_HANDLER] = measure_phase(context, &started_at, &send_time_ns);
+        context->handled_at_ns = started_at;
     }
-    if (divulge->configuration.close) {
-        divulge->configuration.close(connection_context);
+}
+
+void divulge_prepare_parser(divulge_t* divulge, divulge_parser_t* parser) {
+    if (!divulge || !parser) {
+        return;
     }
+    divulge_parser_limits_t limits = {
+        .max_line_size = divulge->configuration.max_request_line_size,
+        .max_header_size = divulge->configuration.max_request_header_size,
+    };
+    divulge_parser_initialize(parser, &limits);
 }
-const char* divulge_find_request_header_key(divulge_request_t* request, const char* key) {
-    return strstr(request->header, key);
+
+static bool has_connection_option(divulge_slice_t value, const char* option) {
+    size_t start = 0;
+    while (start < value.size) {
+        size_t end = start;
+        while ((end < value.size) && (value.data[end] != ',')) {
+            end++;
+        }
+        size_t next = end + 1;
+        while ((start < end) && ((value.data[start] == ' ') || (value.data[start] == '\t'))) {
+            start++;
+        }
+        while ((end > start) && ((value.data[end - 1] == ' ') || (value.data[end - 1] == '\t'))) {
+            end--;
+        }
+        divulge_slice_t token = {.data = value.data + start, .size = end - start};
+        if (is_slice_equal_ignoring_case(token, option)) {
+            return true;
+        }
+        start = next;
+    }
+    return false;
 }
 
-const char* divulge_get_request_header_entry_value(const char* header_entry) {
-    char* value = strstr(header_entry, ": ") + 2;
-    char* end = strstr(value, "\r\n");
-    *end = '\0';
-    return value;
+static bool is_keep_alive_requested(divulge_request_t* request, const divulge_parser_t* parser) {
+    bool is_keep_alive = (parser->version_minor >= 1);
+    divulge_slice_t value;
+    size_t cursor = 0;
+    while (divulge_find_next_request_header(request, "Connection", &cursor, &value)) {
+        if (has_connection_option(value, "close")) {
+            return false;
+        } else if (has_connection_option(value, "keep-alive")) {
+            is_keep_alive = true;
+        }
+    }
+    return is_keep_alive;
 }
 
-bool divulge_send_status(divulge_request_t* request, int return_code) {
-    if (!request || request->context->was_status_sent) {
-        return false;
+static void record_metrics(divulge_request_context_t* context, divulge_route_method_t method, size_t received_size) {
+    divulge_metrics_sample_t sample = {
+        .route = context->route_pattern,
+        .method = method,
+        .status = context->return_code,
+        .received_size = received_size,
+        .sent_size = context->writer.sent_size,
+    };
+    memcpy(sample.durations_ns, context->durations_ns, sizeof(sample.durations_ns));
+    sample.durations_ns[DIVULGE_METRICS_PHASE_SEND] = context->writer.send_time_ns;
+    uint64_t finished_at = context->handled_at_ns;
+    if (context->writer.sent_at_ns > finished_at) {
+        finished_at = context->writer.sent_at_ns;
     }
-    size_t size = (size_t)sprintf(request->context->response_buffer, "HTTP/1.1 %d %s\r\n", return_code,
-                                  convert_return_code_to_text(return_code));
-    request->context->divulge->configuration.send(request->context->connection_context,
-                                                  request->context->response_buffer, size);
-    request->context->was_status_sent = true;
-    return true;
+    sample.durations_ns[DIVULGE_METRICS_PHASE_TOTAL] = finished_at - context->started_at_ns;
+    divulge_metrics_record(context->divulge->configuration.metrics, &sample);
 }
 
-static void send_header_entry(divulge_request_t* request, const char* key, const char* value) {
-    if (!request->context->was_status_sent) {
+/*
+ * The thread responding to a deferred request fills in the response part of the sample.
+ */
+static void hand_over_metrics(divulge_request_context_t* context, divulge_route_method_t method, size_t received_size) {
+    divulge_metrics_sample_t* sample = &context->deferred->sample;
+    sample->method = method;
+    sample->received_size = received_size;
+    sample->durations_ns[DIVULGE_METRICS_PHASE_PARSE] = context->durations_ns[DIVULGE_METRICS_PHASE_PARSE];
+    sample->durations_ns[DIVULGE_METRICS_PHASE_MIDDLEWARE] = context->durations_ns[DIVULGE_METRICS_PHASE_MIDDLEWARE];
+    sample->durations_ns[DIVULGE_METRICS_PHASE_HANDLER] = context->durations_ns[DIVULGE_METRICS_PHASE_HANDLER];
+}
+
+static void finish_observed_response(divulge_request_context_t* context) {
+    const divulge_response_observer_t* observer = &context->writer.observer;
+    if (!observer->finish) {
         return;
     }
-    size_t size = (size_t)sprintf(request->context->response_buffer, "%s: %s\r\n", key, value);
-    request->context->divulge->configuration.send(request->context->connection_context,
-                                                  request->context->response_buffer, size);
+    bool is_length_known = !context->is_streaming || (context->written_size == context->content_length);
+    observer->finish(observer->context, context->was_payload_sent && !context->deferred && !context->is_chunked &&
+                                            !context->was_file_sent && !context->is_head && is_length_known);
 }
 
-bool divulge_send_header(divulge_request_t* request, divulge_response_t* response) {
-    if (!request || !response || request->context->was_header_sent) {
-        return false;
+/*
+ * Decides whether a request the caller knows nothing about is traced.
+ */
+static inline void begin_trace(divulge_t* divulge, request_timing_t* timing) {
+#ifdef DIVULGE_TRACING
+    timing->trace_id = divulge_tracer_begin_request(divulge->configuration.tracer);
+    timing->received_at_ns = timing->trace_id ? divulge_get_time_ns() : 0;
+    timing->last_received_at_ns = timing->received_at_ns;
+#endif
+}
+
+/*
+ * Records a parser feed that began when the request's latest bytes were received.
+ */
+static inline void trace_parse(divulge_t* divulge, const request_timing_t* timing, uint32_t index) {
+#ifdef DIVULGE_TRACING
+    if (timing->trace_id) {
+        record_trace_event(divulge->configuration.tracer, timing->trace_id, DIVULGE_TRACE_PHASE_PARSE, index,
+                           timing->last_received_at_ns, divulge_get_time_ns());
     }
-    if (!request->context->was_status_sent) {
-        divulge_send_status(request, response->return_code);
+#endif
+}
+
+static inline void start_trace(divulge_request_context_t* context, const request_timing_t* timing) {
+#ifdef DIVULGE_TRACING
+    context->writer.trace_id = timing->trace_id;
+#endif
+}
+
+/*
+ * The request event spans from the first received byte to the end of the response, or to the handler
+ * returning when the response is deferred.
+ */
+static void trace_request(divulge_request_context_t* context,
+                          const request_timing_t* timing,
+                          divulge_slice_t method,
+                          divulge_slice_t path) {
+#ifdef DIVULGE_TRACING
+    if (!timing->trace_id) {
+        return;
     }
-    send_header_entry(request, "Server", DIVULGE_SERVER_NAME);
-    if (response->header.entries && (response->header.count > 0)) {
-        for (size_t i = 0; i < response->header.count; i++) {
-            divulge_header_entry_t* entry = response->header.entries + i;
-            send_header_entry(request, entry->key, entry->value);
+    divulge_tracer_t* tracer = context->writer.tracer;
+    if (timing->last_received_at_ns > timing->received_at_ns) {
+        record_trace_event(tracer, timing->trace_id, DIVULGE_TRACE_PHASE_READ, 0, timing->received_at_ns,
+                           timing->last_received_at_ns);
+    }
+    divulge_trace_event_t event = {
+        .request_id = timing->trace_id,
+        .begin_ns = timing->received_at_ns,
+        .end_ns = divulge_get_time_ns(),
+        .phase = DIVULGE_TRACE_PHASE_REQUEST,
+        .status = context->return_code,
+    };
+    if (context->route_pattern) {
+        snprintf(event.name, sizeof(event.name), "%.*s %s", (int)method.size, method.data, context->route_pattern);
+    } else {
+        snprintf(event.name, sizeof(event.name), "%.*s %.*s", (int)method.size, method.data, (int)path.size,
+                 path.data);
+    }
+    divulge_tracer_record(tracer, &event);
+#endif
+}
+
+/*
+ * Whoever lets go last records the metrics, as both sides have filled in their part of the sample by then.
+ */
+static void release_deferred(divulge_deferred_t* deferred) {
+    pthread_mutex_lock(&deferred->mutex);
+    bool is_last = (--deferred->reference_count == 0);
+    pthread_mutex_unlock(&deferred->mutex);
+    if (is_last) {
+        divulge_metrics_t* metrics = deferred->divulge->configuration.metrics;
+        if (metrics && deferred->was_sent) {
+            uint64_t finished_at = divulge_get_time_ns();
+            deferred->sample.durations_ns[DIVULGE_METRICS_PHASE_TOTAL] = finished_at - deferred->started_at_ns;
+            divulge_metrics_record(metrics, &deferred->sample);
         }
+        if (deferred->is_admitted) {
+            finish_admitted_request(deferred->divulge);
+        }
+        pthread_mutex_destroy(&deferred->mutex);
+        divulge_arena_reset(&deferred->arena);
+        free(deferred->output);
+        free(deferred);
     }
-    request->context->was_header_sent = true;
-    return true;
 }
 
-bool divulge_send_payload(divulge_request_t* request, divulge_response_t* response) {
-    if (!request || !response) {
-        return false;
+/*
+ * Lets go of a deferred response on the side of the request, cancelling it unless it was given already.
+ */
+static void detach_deferred(divulge_deferred_t* deferred) {
+    pthread_mutex_lock(&deferred->mutex);
+    bool is_cancelled = (deferred->state == DIVULGE_DEFERRED_STATE_PENDING);
+    if (is_cancelled) {
+        deferred->state = DIVULGE_DEFERRED_STATE_CANCELLED;
     }
-    if (!request->context->was_header_sent) {
-        divulge_send_header(request, response);
+    deferred->connection = NULL;
+    divulge_deferred_cancel_callback_t cancel = deferred->cancel;
+    void* cancel_context = deferred->cancel_context;
+    pthread_mutex_unlock(&deferred->mutex);
+    if (is_cancelled && cancel) {
+        cancel(cancel_context);
     }
-    size_t response_size =
-        (size_t)snprintf(request->context->response_buffer, request->context->response_buffer_size - 1, "\r\n%*s",
-                         (int)response->payload_size, response->payload);
-
-    request->context->divulge->configuration.send(request->context->connection_context,
-                                                  request->context->response_buffer, response_size);
-    return true;
+    release_deferred(deferred);
 }
 
-bool divulge_respond(divulge_request_t* request, divulge_response_t* response) {
-    if (!request || !response) {
+/*
+ * Hands a body received as a whole to a reader the handler registered.
+ */
+static bool deliver_body(const divulge_body_reader_t* reader, divulge_slice_t payload) {
+    if ((payload.size > 0) && !reader->on_data(reader->context, payload.data, payload.size)) {
         return false;
     }
-    divulge_send_status(request, response->return_code);
-    divulge_send_header(request, response);
-    divulge_send_payload(request, response);
+    reader->on_end(reader->context);
     return true;
 }
 
-bool divulge_redirect(divulge_request_t* request, const char* new_location) {
-    if (!request || !new_location) {
+/*
+ * Answers one request and tells whether the connection may stay open. That requires the client to want it,
+ * the caller to allow it and the handler to have finished a response framed by its Content-Length. A deferred
+ * response is returned through `deferred` instead. `timing` tells the metrics when the caller began parsing
+ * and the tracer whether the request is sampled. A request whose body is still to be received is answered
+ * with the connection closing, unless the handler reads the body.
+ */
+static bool answer_request(divulge_t* divulge,
+                           void* connection_context,
+                           divulge_connection_t* connection,
+                           const divulge_parser_t* parser,
+                           const char* request_buffer,
+                           char* response_buffer,
+                           size_t response_buffer_size,
+                           bool can_keep_alive,
+                           const request_timing_t* timing,
+                           divulge_deferred_t** deferred) {
+    divulge_request_context_t request_context = {
+        .divulge = divulge,
+        .connection_context = connection_context,
+        .connection = connection,
+        .version_minor = parser->version_minor,
+        .request_buffer = request_buffer,
+        .is_keep_alive = false,
+        .is_body_pending = connection && connection->is_body_pending,
+        .was_status_sent = false,
+        .was_header_sent = false,
+        .was_payload_sent = false,
+    };
+    divulge_request_t request = {
+        .context = &request_context,
+        .method = convert_request_method_to_method_type(get_request_slice(request_buffer, parser->method)),
+        .route = get_request_slice(request_buffer, parser->path),
+        .url_query = get_request_slice(request_buffer, parser->query),
+        .header = get_request_slice(request_buffer, parser->header_block),
+        .payload = get_request_slice(request_buffer, parser->body),
+    };
+    request_context.is_head = (request.method == DIVULGE_ROUTE_METHOD_HEAD);
+    *deferred = NULL;
+    divulge_writer_initialize(&request_context.writer, &divulge->configuration, connection_context, response_buffer,
+                              response_buffer_size);
+    start_trace(&request_context, timing);
+    bool is_measuring = request_context.writer.is_measuring;
+    if (is_measuring) {
+        request_context.started_at_ns = timing->started_at_ns ? timing->started_at_ns : divulge_get_time_ns();
+    }
+    size_t request_size = divulge_parser_get_request_size(parser);
+    if (request_size == 0) {
+        if (is_measuring) {
+            request_context.durations_ns[DIVULGE_METRICS_PHASE_PARSE] =
+                divulge_get_time_ns() - request_context.started_at_ns;
+        }
+        respond_with_parser_error(&request, parser);
+        divulge_writer_flush(&request_context.writer);
+        if (is_measuring) {
+            record_metrics(&request_context, request.method, parser->position);
+        }
+        trace_request(&request_context, timing, get_request_slice(request_buffer, parser->method), request.route);
         return false;
     }
-    divulge_header_entry_t header_entries[] = {{.key = "Location", .value = new_location}};
-    divulge_response_t response = {
-        .return_code = 301, .header = {.count = 1, .entries = header_entries}, .payload = "", .payload_size = 0};
-    divulge_respond(request, &response);
-    return true;
-}
\ No newline at end of file
+    divulge_headers_build(&request_context.headers, parser, request_buffer);
+    request_context.is_keep_alive = can_keep_alive && is_keep_alive_requested(&request, parser);
+    if (request_context.is_body_pending) {
+        request_context.is_keep_alive_after_body = request_context.is_keep_alive;
+        request_context.is_keep_alive = false;
+    }
+    D("Received request: [%s] %.*s", divulge_method_name_from_method(request.method), (int)request.route.size,
+      request.route.data);
+    if (is_measuring) {
+        request_context.dispatched_at_ns = divulge_get_time_ns();
+        request_context.durations_ns[DIVULGE_METRICS_PHASE_PARSE] =
+            request_context.dispatched_at_ns - request_context.started_at_ns;
+    }
+    dispatch_request(divulge, &request);
+    if (request_context.is_admitted && !request_context.deferred) {
+        finish_admitted_request(divulge);
+    }
+    divulge_writer_flush(&request_context.writer);
+    finish_observed_response(&request_context);
+    if (request_context.deferred) {
+        request_context.deferred->arena = request_context.arena;
+    } else {
+        divulge_arena_reset(&request_context.arena);
+    }
+    if (request_context.body_reader.on_end && request_context.is_body_pending) {
+        connection->body_reader = request_context.body_reader;
+        connection->is_body_streamed = true;
+    } else if (request_context.body_reader.on_end && !deliver_body(&request_context.body_reader, request.payload)) {
+        detach_deferred(request_context.deferred);
+        request_context.deferred = NULL;
+        request_context.is_keep_alive = false;
+    }
+    if (is_measuring && request_context.deferred) {
+        hand_over_metrics(&request_context, request.method, request_size);
+    } else if (is_measuring) {
+        record_metrics(&request_context, request.method, request_size);
+    }
+    trace_request(&request_context, timing, get_request_slice(request_buffer, parser->method), request.route);
+    *deferred = request_context.deferred;
+    return request_context.is_keep_alive && request_context.was_payload_sent;
+}
+
+static void process_parsed_request(divulge_t* divulge,
+                                   void* connection_context,
+                                   const divulge_parser_t* parser,
+                                   const char* request_buffer,
+                                   char* response_buffer,
+                                   size_t response_buffer_size,
+                                   const request_timing_t* timing) {
+    divulge_deferred_t* deferred = NULL;
+    answer_request(divulge, connection_context, NULL, parser, request_buffer, response_buffer, response_buffer_size,
+                   false, timing, &deferred);
+    if (deferred) {
+        release_deferred(deferred);
+        return;
+    }
+    divulge->configuration.close(connection_context);
+}
+
+void divulge_process_parsed_request(divulge_t* divulge,
+                                    void* connection_context,
+                                    const divulge_parser_t* parser,
+                                    const char* request_buffer,
+                                    char* response_buffer,
+                                    size_t response_buffer_size) {
+    if (!divulge || !parser || !request_buffer || !response_buffer || (response_buffer_size == 0)) {
+        return;
+    }
+    request_timing_t timing = {0};
+    begin_trace(divulge, &timing);
+    process_parsed_request(divulge, connection_context, parser, request_buffer, response_buffer, response_buffer_size,
+                           &timing);
+}
+
+/*
+ * The caller's buffer is read-only, so a chunked body is decoded in a copy of the request. A body that is
+ * incomplete or malformed leaves the request unfinished, which is answered with 400.
+ */
+static char* decode_chunked_request(divulge_t* divulge,
+                                    divulge_parser_t* parser,
+                                    const char* request_buffer,
+                                    size_t request_buffer_size) {
+    char* buffer = malloc(request_buffer_size);
+    if (!buffer) {
+        return NULL;
+    }
+    memcpy(buffer, request_buffer, request_buffer_size);
+    divulge_body_decoder_t decoder;
+    divulge_body_decoder_initialize(&decoder, true, 0, divulge->configuration.max_request_body_size);
+    size_t consumed = 0;
+    size_t produced = 0;
+    divulge_body_status_t status = divulge_body_decode(&decoder, buffer + parser->body.offset,
+                                                       request_buffer_size - parser->body.offset, &consumed, &produced);
+    if (status != DIVULGE_BODY_STATUS_COMPLETE) {
+        free(buffer);
+        return NULL;
+    }
+    divulge_parser_complete_body(parser, produced);
+    return buffer;
+}
+
+void divulge_process_request(divulge_t* divulge,
+                             void* connection_context,
+                             const char* request_buffer,
+                             size_t request_buffer_size,
+                             char* response_buffer,
+                             size_t response_buffer_size) {
+    if (!divulge || !request_buffer || (request_buffer_size == 0) || !response_buffer || (response_buffer_size == 0)) {
+        return;
+    }
+    divulge_parser_t parser;
+    divulge_prepare_parser(divulge, &parser);
+    request_timing_t timing = {0};
+    begin_trace(divulge, &timing);
+    timing.started_at_ns = divulge->configuration.metrics ? divulge_get_time_ns() : 0;
+    divulge_parser_status_t status = divulge_parser_feed(&parser, request_buffer, request_buffer_size);
+    trace_parse(divulge, &timing, 0);
+    char* decoded_buffer = NULL;
+    if ((status == DIVULGE_PARSER_STATUS_INCOMPLETE) && parser.is_chunked && divulge_parser_has_header_block(&parser)) {
+        decoded_buffer = decode_chunked_request(divulge, &parser, request_buffer, request_buffer_size);
+    }
+    process_parsed_request(divulge, connection_context, &parser, decoded_buffer ? decoded_buffer : request_buffer,
+                           response_buffer, response_buffer_size, &timing);
+    free(decoded_buffer);
+}
+
+static void expire_connection(void* context);
+
+divulge_connection_t* divulge_connection_create(divulge_t* divulge, void* connection_context) {
+    if (!divulge) {
+        return NULL;
+    }
+    divulge_connection_t* connection = calloc(1, sizeof(divulge_connection_t));
+    if (!connection) {
+        return NULL;
+    }
+    connection->buffer = malloc(divulge->configuration.connection_buffer_size);
+    connection->response_buffer = malloc(divulge->configuration.response_buffer_size);
+    if (!connection->buffer || !connection->response_buffer) {
+        free(connection->buffer);
+        free(connection->response_buffer);
+        free(connection);
+        return NULL;
+    }
+    connection->divulge = divulge;
+    connection->connection_context = connection_context;
+    connection->buffer_size = divulge->configuration.connection_buffer_size;
+    connection->timer.expire = expire_connection;
+    connection->timer.context = connection;
+    divulge_prepare_parser(divulge, &connection->parser);
+    return connection;
+}
+
+char* divulge_connection_get_receive_buffer(divulge_connection_t* connection, size_t* size) {
+    if (!connection || !size) {
+        return NULL;
+    }
+    *size = connection->is_closed ? 0 : connection->buffer_size - connection->received_size;
+    return connection->buffer + connection->received_size;
+}
+
+static inline uint64_t get_connection_time(const divulge_connection_t* connection) {
+    return connection->timer_wheel ? connection->timer_wheel->now_ms : 0;
+}
+
+static bool close_connection(divulge_connection_t* connection) {
+    if (!connection->is_closed) {
+        connection->is_closed = true;
+        divulge_timer_cancel(connection->timer_wheel, &connection->timer);
+        connection->divulge->configuration.close(connection->connection_context);
+    }
+    return false;
+}
+
+/*
+ * Sampling is decided when the first bytes of a request are received, so that reading it is traced as well.
+ */
+static inline bool trace_receive(divulge_connection_t* connection) {
+#ifdef DIVULGE_TRACING
+    if (connection->parser.position == 0) {
+        connection->trace_id = divulge_tracer_begin_request(connection->divulge->configuration.tracer);
+        connection->trace_feed_count = 0;
+    }
+    return connection->trace_id != 0;
+#else
+    return false;
+#endif
+}
+
+static inline void trace_feed(divulge_connection_t* connection, uint64_t started_at) {
+#ifdef DIVULGE_TRACING
+    if (!connection->trace_id) {
+        return;
+    }
+    if (connection->trace_feed_count == 0) {
+        connection->trace_received_at_ns = started_at;
+    }
+    connection->trace_last_received_at_ns = started_at;
+    record_trace_event(connection->divulge->configuration.tracer, connection->trace_id, DIVULGE_TRACE_PHASE_PARSE,
+                       connection->trace_feed_count++, started_at, divulge_get_time_ns());
+#endif
+}
+
+static inline void hand_over_trace(divulge_connection_t* connection, request_timing_t* timing) {
+#ifdef DIVULGE_TRACING
+    timing->trace_id = connection->trace_id;
+    timing->received_at_ns = connection->trace_received_at_ns;
+    timing->last_received_at_ns = connection->trace_last_received_at_ns;
+    connection->trace_id = 0;
+#endif
+}
+
+static void send_deferred_response(divulge_deferred_t* deferred) {
+    divulge_configuration_t* configuration = &deferred->divulge->configuration;
+    uint64_t started_at = configuration->metrics ? divulge_get_time_ns() : 0;
+    if (deferred->output_size > 0) {
+        configuration->send(deferred->connection_context, deferred->output, deferred->output_size);
+    }
+    if (configuration->metrics) {
+        deferred->sample.durations_ns[DIVULGE_METRICS_PHASE_SEND] = divulge_get_time_ns() - started_at;
+        deferred->sample.sent_size = deferred->output_size;
+        deferred->was_sent = true;
+    }
+}
+
+/*
+ * Detaches the pending deferred response from the connection, cancelling it unless it was given already.
+ */
+static void cancel_deferred(divulge_connection_t* connection) {
+    divulge_deferred_t* deferred = connection->deferred;
+    if (!deferred) {
+        return;
+    }
+    connection->deferred = NULL;
+    detach_deferred(deferred);
+}
+
+static void respond_with_rejected_request(divulge_connection_t* connection, int return_code) {
+    divulge_request_context_t request_context = {
+        .divulge = connection->divulge,
+        .connection_context = connection->connection_context,
+        .version_minor = connection->parser.version_minor,
+        .request_buffer = connection->buffer,
+    };
+    divulge_writer_initialize(&request_context.writer, &connection->divulge->configuration,
+                              connection->connection_context, connection->response_buffer,
+                              connection->divulge->configuration.response_buffer_size);
+    if (request_context.writer.is_measuring) {
+        request_context.started_at_ns = divulge_get_time_ns() - connection->parse_time_ns;
+        request_context.durations_ns[DIVULGE_METRICS_PHASE_PARSE] = connection->parse_time_ns;
+    }
+    divulge_request_t request = {.context = &request_context};
+    bool is_too_large = (return_code == 413) || (return_code == 431);
+    const char* payload = is_too_large ? "Divulge Error: request too large" : "Divulge Error: malformed request";
+    if (return_code == 408) {
+        payload = "Divulge Error: request timeout";
+    }
+    divulge_response_t response = {
+        .return_code = return_code,
+        .payload = payload,
+        .payload_size = strlen(payload),
+    };
+    divulge_respond(&request, &response);
+    divulge_writer_flush(&request_context.writer);
+    if (request_context.writer.is_measuring) {
+        divulge_route_method_t method =
+            convert_request_method_to_method_type(get_request_slice(connection->buffer, connection->parser.method));
+        record_metrics(&request_context, method, connection->received_size);
+    }
+}
+
+static void send_continue(divulge_connection_t* connection) {
+    static const char interim_response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    connection->is_continue_expected = false;
+    connection->divulge->configuration.send(connection->connection_context, interim_response,
+                                            sizeof(interim_response) - 1);
+}
+
+/*
+ * Runs once the header block of a request is parsed. A body announced over the limit is refused before it is
+ * sent; a client waiting for `100 Continue` is told to go on if the body will be buffered, otherwise only once
+ * the handler reads it.
+ */
+static bool prepare_body(divulge_connection_t* connection, divulge_parser_status_t status) {
+    divulge_parser_t* parser = &connection->parser;
+    connection->is_body_prepared = true;
+    connection->body_started_at_ms = get_connection_time(connection);
+    connection->body_received_size = 0;
+    divulge_body_decoder_initialize(&connection->body_decoder, parser->is_chunked, parser->body.size,
+                                    connection->divulge->configuration.max_request_body_size);
+    if (connection->body_decoder.error != DIVULGE_BODY_ERROR_NONE) {
+        respond_with_rejected_request(connection, divulge_body_get_error_status(&connection->body_decoder));
+        return false;
+    }
+    connection->is_continue_expected = (status == DIVULGE_PARSER_STATUS_INCOMPLETE) && parser->expects_continue &&
+                                       (parser->version_minor >= 1);
+    bool is_buffered = parser->is_chunked || ((parser->body.offset + parser->body.size) <= connection->buffer_size);
+    if (connection->is_continue_expected && is_buffered) {
+        send_continue(connection);
+    }
+    return true;
+}
+
+/*
+ * Decodes the chunked body received so far in place, right after the header block, and gives the space the
+ * framing took back to the buffer.
+ */
+static divulge_parser_status_t buffer_chunked_body(divulge_connection_t* connection) {
+    size_t body_end = connection->request_offset + connection->parser.body.offset + connection->body_size;
+    char* data = connection->buffer + body_end;
+    size_t consumed = 0;
+    size_t produced = 0;
+    divulge_body_status_t status = divulge_body_decode(&connection->body_decoder, data,
+                                                       connection->received_size - body_end, &consumed, &produced);
+    if (status == DIVULGE_BODY_STATUS_ERROR) {
+        return DIVULGE_PARSER_STATUS_ERROR;
+    }
+    size_t rest_size = connection->received_size - body_end - consumed;
+    memmove(data + produced, data + consumed, rest_size);
+    connection->received_size = body_end + produced + rest_size;
+    connection->body_size += produced;
+    if (status == DIVULGE_BODY_STATUS_INCOMPLETE) {
+        return DIVULGE_PARSER_STATUS_INCOMPLETE;
+    }
+    divulge_parser_complete_body(&connection->parser, connection->body_size);
+    return DIVULGE_PARSER_STATUS_COMPLETE;
+}
+
+static bool is_body_too_large_to_buffer(divulge_connection_t* connection) {
+    const divulge_parser_t* parser = &connection->parser;
+    if (!parser->is_chunked) {
+        return (parser->body.offset + parser->body.size) > connection->buffer_size;
+    }
+    return connection->received_size == connection->buffer_size;
+}
+
+static bool is_deferred_completed(divulge_deferred_t* deferred) {
+    pthread_mutex_lock(&deferred->mutex);
+    bool is_completed = (deferred->state == DIVULGE_DEFERRED_STATE_COMPLETED);
+    pthread_mutex_unlock(&deferred->mutex);
+    return is_completed;
+}
+
+/*
+ * Ends a body stream before the whole body was read: a response already given is sent, otherwise it is
+ * cancelled and `return_code`, unless 0, is sent instead. The rest of the body is never read, so the connection
+ * is closed.
+ */
+static bool stop_body_stream(divulge_connection_t* connection, int return_code) {
+    connection->is_body_streamed = false;
+    bool was_responded = is_deferred_completed(connection->deferred);
+    if (was_responded) {
+        send_deferred_response(connection->deferred);
+    }
+    cancel_deferred(connection);
+    if (!was_responded && (return_code != 0)) {
+        respond_with_rejected_request(connection, return_code);
+    }
+    return close_connection(connection);
+}
+
+/*
+ * Hands the body bytes received so far to the reader, decoding them in place; whatever follows the body stays
+ * in the buffer for the next request. Chunked bytes decoded before the handler ran are handed over first.
+ */
+static bool stream_body(divulge_connection_t* connection) {
+    char* data = connection->buffer + connection->request_offset;
+    size_t consumed = connection->body_size;
+    size_t produced = connection->body_size;
+    divulge_body_status_t status = DIVULGE_BODY_STATUS_INCOMPLETE;
+    if (connection->body_size == 0) {
+        status = divulge_body_decode(&connection->body_decoder, data,
+                                     connection->received_size - connection->request_offset, &consumed, &produced);
+    }
+    connection->body_size = 0;
+    if (status == DIVULGE_BODY_STATUS_ERROR) {
+        return stop_body_stream(connection, divulge_body_get_error_status(&connection->body_decoder));
+    }
+    connection->request_offset += consumed;
+    const divulge_body_reader_t* reader = &connection->body_reader;
+    if ((produced > 0) && !reader->on_data(reader->context, data, produced)) {
+        return stop_body_stream(connection, 0);
+    }
+    if ((status == DIVULGE_BODY_STATUS_INCOMPLETE) && is_deferred_completed(connection->deferred)) {
+        return stop_body_stream(connection, 0);
+    }
+    if (status == DIVULGE_BODY_STATUS_COMPLETE) {
+        connection->is_body_streamed = false;
+        reader->on_end(reader->context);
+    }
+    return true;
+}
+
+static void compact_buffer(divulge_connection_t* connection) {
+    connection->received_size -= connection->request_offset;
+    memmove(connection->buffer, connection->buffer + connection->request_offset, connection->received_size);
+    connection->request_offset = 0;
+}
+
+static inline uint64_t add_timeout(uint64_t since_ms, uint64_t timeout_ms) {
+    return (timeout_ms > 0) ? since_ms + timeout_ms : UINT64_MAX;
+}
+
+/*
+ * The request deadline runs from the first byte of a request until it is answered; the idle, header and body
+ * ones only while the connection waits for the client.
+ */
+static uint64_t get_deadline(const divulge_connection_t* connection, divulge_timeout_t* timeout) {
+    const divulge_configuration_t* configuration = &connection->divulge->configuration;
+    bool is_request_begun = connection->deferred || connection->is_body_streamed || (connection->received_size > 0);
+    if (!is_request_begun) {
+        *timeout = DIVULGE_TIMEOUT_IDLE;
+        return add_timeout(connection->waiting_since_ms, configuration->idle_timeout_ms);
+    }
+    *timeout = DIVULGE_TIMEOUT_REQUEST;
+    uint64_t deadline = add_timeout(connection->waiting_since_ms, configuration->request_timeout_ms);
+    uint64_t wait_deadline = UINT64_MAX;
+    divulge_timeout_t wait_timeout = DIVULGE_TIMEOUT_HEADER;
+    if (connection->is_body_streamed || (connection->is_body_prepared && !connection->deferred)) {
+        wait_timeout = DIVULGE_TIMEOUT_BODY;
+        if (configuration->min_body_rate > 0) {
+            wait_deadline = connection->body_started_at_ms + DIVULGE_BODY_RATE_GRACE_MS +
+                            (connection->body_received_size * 1000u) / configuration->min_body_rate;
+        }
+    } else if (!connection->deferred) {
+        wait_deadline = add_timeout(connection->waiting_since_ms, configuration->header_timeout_ms);
+    }
+    if (wait_deadline < deadline) {
+        *timeout = wait_timeout;
+        deadline = wait_deadline;
+    }
+    return deadline;
+}
+
+static void update_timer(divulge_connection_t* connection) {
+    if (!connection->timer_wheel || connection->is_closed) {
+        return;
+    }
+    divulge_timeout_t timeout;
+    uint64_t deadline = get_deadline(connection, &timeout);
+    if (deadline == UINT64_MAX) {
+        divulge_timer_cancel(connection->timer_wheel, &connection->timer);
+    } else if ((deadline != connection->deadline_ms) || !divulge_timer_is_scheduled(&connection->timer)) {
+        divulge_timer_schedule(connection->timer_wheel, &connection->timer, deadline);
+    }
+    connection->deadline_ms = deadline;
+}
+
+/*
+ * A client still sending its request is told it took too long; a pending response is given up on.
+ */
+static void expire_connection(void* context) {
+    divulge_connection_t* connection = context;
+    if (connection->is_closed) {
+        return;
+    }
+    divulge_timeout_t timeout;
+    get_deadline(connection, &timeout);
+    atomic_fetch_add(&connection->divulge->timeout_counts[timeout], 1);
+    if (connection->is_body_streamed) {
+        stop_body_stream(connection, 408);
+        return;
+    }
+    bool is_receiving = !connection->deferred && (connection->received_size > 0);
+    cancel_deferred(connection);
+    if (is_receiving) {
+        respond_with_rejected_request(connection, 408);
+    }
+    close_connection(connection);
+}
+
+/*
+ * Bodies are buffered after their header block, chunked ones decoded as they arrive. A body the buffer cannot
+ * hold has its request answered as soon as the buffer is full, or right away when the Content-Length tells, and
+ * is then streamed to the handler's reader.
+ */
+static bool receive_requests(divulge_connection_t* connection, size_t received_size) {
+    divulge_t* divulge = connection->divulge;
+    connection->received_size += received_size;
+    while (connection->request_offset < connection->received_size) {
+        if (connection->is_body_streamed) {
+            if (!stream_body(connection)) {
+                return false;
+            }
+            continue;
+        }
+        if (connection->deferred) {
+            break;
+        }
+        const char* request_buffer = connection->buffer + connection->request_offset;
+        size_t request_buffer_size = connection->received_size - connection->request_offset;
+        bool is_traced = trace_receive(connection);
+        uint64_t started_at = (divulge->configuration.metrics || is_traced) ? divulge_get_time_ns() : 0;
+        divulge_parser_status_t status = divulge_parser_feed(&connection->parser, request_buffer, request_buffer_size);
+        trace_feed(connection, started_at);
+        if ((status != DIVULGE_PARSER_STATUS_ERROR) && !connection->is_body_prepared &&
+            divulge_parser_has_header_block(&connection->parser) && !prepare_body(connection, status)) {
+            return close_connection(connection);
+        }
+        if ((status == DIVULGE_PARSER_STATUS_INCOMPLETE) && connection->is_body_prepared &&
+            connection->parser.is_chunked) {
+            status = buffer_chunked_body(connection);
+            if (status == DIVULGE_PARSER_STATUS_ERROR) {
+                respond_with_rejected_request(connection, divulge_body_get_error_status(&connection->body_decoder));
+                return close_connection(connection);
+            }
+        }
+        if ((status == DIVULGE_PARSER_STATUS_INCOMPLETE) && connection->is_body_prepared &&
+            (connection->request_offset > 0) && (connection->received_size == connection->buffer_size)) {
+            compact_buffer(connection);
+            continue;
+        }
+        if ((status == DIVULGE_PARSER_STATUS_INCOMPLETE) && connection->is_body_prepared &&
+            is_body_too_large_to_buffer(connection)) {
+            connection->is_body_pending = true;
+            divulge_parser_complete_body(&connection->parser, 0);
+            status = DIVULGE_PARSER_STATUS_COMPLETE;
+        }
+        if (status == DIVULGE_PARSER_STATUS_INCOMPLETE) {
+            if (divulge->configuration.metrics) {
+                connection->parse_time_ns += divulge_get_time_ns() - started_at;
+            }
+            break;
+        }
+        connection->request_count++;
+        bool can_keep_alive = connection->request_count < divulge->configuration.max_requests_per_connection;
+        request_timing_t timing = {.started_at_ns = started_at - connection->parse_time_ns};
+        connection->parse_time_ns = 0;
+        hand_over_trace(connection, &timing);
+        bool is_keep_alive = answer_request(divulge, connection->connection_context, connection, &connection->parser,
+                                            request_buffer, connection->response_buffer,
+                                            divulge->configuration.response_buffer_size, can_keep_alive, &timing,
+                                            &connection->deferred);
+        if (!is_keep_alive && !connection->deferred) {
+            return close_connection(connection);
+        }
+        if (!connection->deferred) {
+            connection->waiting_since_ms = get_connection_time(connection);
+        }
+        connection->request_offset += divulge_parser_get_request_size(&connection->parser);
+        divulge_prepare_parser(divulge, &connection->parser);
+        connection->is_body_prepared = false;
+        connection->is_body_pending = false;
+        connection->is_continue_expected = false;
+        connection->body_size = connection->is_body_streamed ? connection->body_size : 0;
+    }
+    if (connection->request_offset > 0) {
+        compact_buffer(connection);
+    }
+    if (!connection->deferred && (connection->received_size == connection->buffer_size)) {
+        respond_with_rejected_request(connection, (connection->parser.body.offset > 0) ? 413 : 431);
+        return close_connection(connection);
+    }
+    return true;
+}
+
+bool divulge_connection_receive(divulge_connection_t* connection, size_t received_size) {
+    if (!connection || connection->is_closed) {
+        return false;
+    }
+    if (received_size > 0) {
+        bool is_idle = !connection->deferred && !connection->is_body_streamed && (connection->received_size == 0);
+        if (is_idle) {
+            connection->waiting_since_ms = get_connection_time(connection);
+        }
+        if (connection->is_body_prepared || connection->is_body_streamed) {
+            connection->body_received_size += received_size;
+        }
+    }
+    bool is_open = receive_requests(connection, received_size);
+    update_timer(connection);
+    return is_open;
+}
+
+bool divulge_connection_resume(divulge_connection_t* connection) {
+    if (!connection || connection->is_closed) {
+        return false;
+    }
+    divulge_deferred_t* deferred = connection->deferred;
+    if (!deferred) {
+        return true;
+    }
+    if (!is_deferred_completed(deferred)) {
+        return true;
+    }
+    if (connection->is_body_streamed) {
+        return stop_body_stream(connection, 0);
+    }
+    bool is_keep_alive = deferred->is_keep_alive && deferred->was_payload_sent;
+    send_deferred_response(deferred);
+    cancel_deferred(connection);
+    if (!is_keep_alive) {
+        return close_connection(connection);
+    }
+    connection->waiting_since_ms = get_connection_time(connection);
+    return divulge_connection_receive(connection, 0);
+}
+
+void divulge_connection_watch(divulge_connection_t* connection, divulge_timer_wheel_t* wheel) {
+    if (!connection) {
+        return;
+    }
+    divulge_timer_cancel(connection->timer_wheel, &connection->timer);
+    connection->timer_wheel = wheel;
+    connection->waiting_since_ms = get_connection_time(connection);
+    update_timer(connection);
+}
+
+uint64_t divulge_get_timeout_count(divulge_t* divulge, divulge_timeout_t timeout) {
+    if (!divulge || (timeout >= DIVULGE_TIMEOUT_COUNT)) {
+        return 0;
+    }
+    return atomic_load(&divulge->timeout_counts[timeout]);
+}
+
+void divulge_connection_destroy(divulge_connection_t* connection) {
+    if (!connection) {
+        return;
+    }
+    cancel_deferred(connection);
+    close_connection(connection);
+    free(connection->buffer);
+    free(connection->response_buffer);
+    free(connection);
+}
+
+bool divulge_get_route_parameter(divulge_request_t* request, const char* name, divulge_slice_t* value) {
+    if (!request || !name || !value) {
+        return false;
+    }
+    size_t name_size = strlen(name);
+    for (size_t i = 0; i < request->parameter_count; i++) {
+        divulge_route_parameter_t* parameter = request->parameters + i;
+        if ((parameter->name.size == name_size) && (memcmp(parameter->name.data, name, name_size) == 0)) {
+            *value = parameter->value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool divulge_find_request_header(divulge_request_t* request, const char* name, divulge_slice_t* value) {
+    size_t cursor = 0;
+    return divulge_find_next_request_header(request, name, &cursor, value);
+}
+
+bool divulge_find_next_request_header(divulge_request_t* request,
+                                      const char* name,
+                                      size_t* cursor,
+                                      divulge_slice_t* value) {
+    if (!request || !name || !cursor || !value) {
+        return false;
+    }
+    const divulge_headers_t* headers = &request->context->headers;
+    size_t index = (*cursor == 0) ? divulge_headers_find(headers, name, strlen(name))
+                                  : divulge_headers_find_next(headers, *cursor - 1);
+    if (index == DIVULGE_HEADERS_NONE) {
+        return false;
+    }
+    *cursor = index + 1;
+    *value = get_request_slice(request->context->request_buffer, headers->fields[index].value);
+    return true;
+}
+
+bool divulge_get_peer_address(divulge_request_t* request, divulge_slice_t* address) {
+    if (!request || !address || !request->context->divulge->configuration.peer_address) {
+        return false;
+    }
+    divulge_request_context_t* context = request->context;
+    *address = context->divulge->configuration.peer_address(context->connection_context);
+    return address->size > 0;
+}
+
+const divulge_url_query_t* divulge_get_url_query(divulge_request_t* request) {
+    if (!request) {
+        return NULL;
+    }
+    divulge_request_context_t* context = request->context;
+    if (!context->url_query) {
+        context->url_query = divulge_arena_allocate(&context->arena, sizeof(divulge_url_query_t));
+        if (context->url_query) {
+            divulge_url_query_parse(context->url_query, request->url_query.data, request->url_query.size);
+        }
+    }
+    return context->url_query;
+}
+
+bool divulge_find_query_parameter(divulge_request_t* request, const char* key, divulge_slice_t* value) {
+    size_t cursor = 0;
+    return divulge_find_next_query_parameter(request, key, &cursor, value);
+}
+
+bool divulge_find_next_query_parameter(divulge_request_t* request,
+                                       const char* key,
+                                       size_t* cursor,
+                                       divulge_slice_t* value) {
+    if (!request || !key || !cursor || !value) {
+        return false;
+    }
+    const divulge_url_query_t* query = divulge_get_url_query(request);
+    if (!query) {
+        return false;
+    }
+    size_t index = (*cursor == 0) ? divulge_url_query_find(query, key, strlen(key))
+                                  : divulge_url_query_find_next(query, *cursor - 1);
+    if (index == DIVULGE_URL_QUERY_NONE) {
+        return false;
+    }
+    *cursor = index + 1;
+    const divulge_url_query_parameter_t* parameter = query->parameters + index;
+    char* buffer = parameter->is_value_encoded ? divulge_arena_allocate(&request->context->arena,
+                                                                          parameter->value.size)
+                                               : NULL;
+    return divulge_url_query_get_value(query, index, buffer, parameter->value.size, value);
+}
+
+void* divulge_request_alloc(divulge_request_t* request, size_t size) {
+    if (!request) {
+        return NULL;
+    }
+    return divulge_arena_allocate(&request->context->arena, size);
+}
+
+size_t divulge_get_request_header_count(divulge_request_t* request) {
+    return request ? request->context->headers.count : 0;
+}
+
+bool divulge_get_request_header(divulge_request_t* request,
+                                size_t index,
+                                divulge_slice_t* name,
+                                divulge_slice_t* value) {
+    if (!request || !name || !value || (index >= request->context->headers.count)) {
+        return false;
+    }
+    const divulge_headers_field_t* field = request->context->headers.fields + index;
+    *name = get_request_slice(request->context->request_buffer, field->name);
+    *value = get_request_slice(request->context->request_buffer, field->value);
+    return true;
+}
+
+bool divulge_send_status(divulge_request_t* request, int return_code) {
+    if (!request || request->context->was_status_sent) {
+        return false;
+    }
+    divulge_writer_print(&request->context->writer, "HTTP/1.1 %d %s\r\n", return_code,
+                         convert_return_code_to_text(return_code));
+    request->context->return_code = return_code;
+    request->context->was_status_sent = true;
+    return true;
+}
+
+static void send_header_entry(divulge_request_t* request, const char* key, const char* value) {
+    if (!request->context->was_status_sent || !key || !value) {
+        return;
+    }
+    divulge_writer_t* writer = &request->context->writer;
+    divulge_writer_copy(writer, key, strlen(key));
+    divulge_writer_copy(writer, ": ", 2);
+    divulge_writer_copy(writer, value, strlen(value));
+    divulge_writer_copy(writer, "\r\n", 2);
+}
+
+/*
+ * The Date and Connection headers depend on when and to which request the response is sent rather than on the
+ * response, so observers do not see them and replayed responses get them anew.
+ */
+static void send_request_headers(divulge_request_t* request) {
+    divulge_request_context_t* context = request->context;
+    divulge_writer_pause_observer(&context->writer, true);
+    if (context->divulge->configuration.is_date_sent) {
+        char date[DIVULGE_DATE_SIZE];
+        divulge_get_date(date);
+        divulge_writer_copy(&context->writer, "Date: ", 6);
+        divulge_writer_copy(&context->writer, date, DIVULGE_DATE_SIZE);
+        divulge_writer_copy(&context->writer, "\r\n", 2);
+    }
+    if (!context->is_keep_alive) {
+        send_header_entry(request, "Connection", "close");
+    } else if (context->version_minor == 0) {
+        send_header_entry(request, "Connection", "keep-alive");
+    }
+    divulge_writer_pause_observer(&context->writer, false);
+}
+
+static void send_header_block(divulge_request_t* request, const divulge_header_t* header, size_t content_length) {
+    divulge_request_context_t* context = request->context;
+    send_header_entry(request, "Server", DIVULGE_SERVER_NAME);
+    bool has_content_length = false;
+    if (header->entries && (header->count > 0)) {
+        for (size_t i = 0; i < header->count; i++) {
+            divulge_header_entry_t* entry = header->entries + i;
+            send_header_entry(request, entry->key, entry->value);
+            divulge_slice_t key = {.data = entry->key, .size = entry->key ? strlen(entry->key) : 0};
+            has_content_length = has_content_length || is_slice_equal_ignoring_case(key, "content-length");
+        }
+    }
+    if (context->is_chunked) {
+        send_header_entry(request, "Transfer-Encoding", "chunked");
+    } else if (!has_content_length && (content_length != DIVULGE_CONTENT_LENGTH_UNKNOWN) &&
+               !is_body_forbidden(context->return_code)) {
+        divulge_writer_print(&context->writer, "Content-Length: %zu\r\n", content_length);
+    }
+    send_request_headers(request);
+    divulge_writer_copy(&context->writer, "\r\n", 2);
+    context->was_header_sent = true;
+}
+
+bool divulge_send_header(divulge_request_t* request, divulge_response_t* response) {
+    if (!request || !response || request->context->was_header_sent) {
+        return false;
+    }
+    if (!request->context->was_status_sent) {
+        divulge_send_status(request, response->return_code);
+    }
+    send_header_block(request, &response->header, response->payload ? response->payload_size : 0);
+    return true;
+}
+
+bool divulge_send_payload(divulge_request_t* request, divulge_response_t* response) {
+    if (!request || !response || request->context->was_payload_sent) {
+        return false;
+    }
+    if (!request->context->was_header_sent) {
+        divulge_send_header(request, response);
+    }
+    bool has_body = !request->context->is_head && !is_body_forbidden(request->context->return_code);
+    if (response->payload && (response->payload_size > 0) && has_body) {
+        divulge_writer_reference(&request->context->writer, response->payload, response->payload_size);
+    }
+    divulge_writer_flush(&request->context->writer);
+    request->context->was_payload_sent = true;
+    return true;
+}
+
+bool divulge_respond(divulge_request_t* request, divulge_response_t* response) {
+    if (!request || !response) {
+        return false;
+    }
+    divulge_send_status(request, response->return_code);
+    divulge_send_header(request, response);
+    divulge_send_payload(request, response);
+    return true;
+}
+
+bool divulge_observe_response(divulge_request_t* request, const divulge_response_observer_t* observer) {
+    if (!request || !observer || !observer->write || !observer->finish || request->context->was_status_sent ||
+        request->context->writer.observer.finish) {
+        return false;
+    }
+    divulge_writer_set_observer(&request->context->writer, observer);
+    return true;
+}
+
+bool divulge_respond_serialized(divulge_request_t* request, const char* data, size_t size, size_t header_size) {
+    if (!request || !data || (header_size > size) || request->context->was_status_sent) {
+        return false;
+    }
+    divulge_request_context_t* context = request->context;
+    context->was_status_sent = true;
+    if ((header_size > 12) && (memcmp(data, "HTTP/1.", 7) == 0)) {
+        context->return_code = atoi(data + 9);
+    }
+    divulge_writer_reference(&context->writer, data, header_size);
+    send_request_headers(request);
+    size_t rest_size = size - header_size;
+    if (context->is_head && (rest_size > 2)) {
+        rest_size = 2; /* the blank line ending the headers */
+    }
+    divulge_writer_reference(&context->writer, data + header_size, rest_size);
+    divulge_writer_flush(&context->writer);
+    context->was_header_sent = true;
+    context->was_payload_sent = true;
+    return true;
+}
+
+typedef struct divulge_response_template {
+    size_t size;
+    size_t header_size;
+    char data[];
+} divulge_response_template_t;
+
+static size_t append(char* output, size_t size, const char* data, size_t data_size) {
+    if (output && (data_size > 0)) {
+        memcpy(output + size, data, data_size);
+    }
+    return size + data_size;
+}
+
+static size_t append_header(char* output, size_t size, const char* key, const char* value) {
+    size = append(output, size, key, strlen(key));
+    size = append(output, size, ": ", 2);
+    size = append(output, size, value, strlen(value));
+    return append(output, size, "\r\n", 2);
+}
+
+/*
+ * Lays out the status line and headers as send_header_block() does, only measuring them when `output` is NULL.
+ */
+static size_t serialize_header(const divulge_response_t* response, char* output) {
+    char line[64];
+    int line_size = snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", response->return_code,
+                             convert_return_code_to_text(response->return_code));
+    size_t size = append(output, 0, line, (size_t)line_size);
+    size = append_header(output, size, "Server", DIVULGE_SERVER_NAME);
+    bool has_content_length = false;
+    for (size_t i = 0; response->header.entries && (i < response->header.count); i++) {
+        const divulge_header_entry_t* entry = response->header.entries + i;
+        if (entry->key && entry->value) {
+            size = append_header(output, size, entry->key, entry->value);
+            divulge_slice_t key = {.data = entry->key, .size = strlen(entry->key)};
+            has_content_length = has_content_length || is_slice_equal_ignoring_case(key, "content-length");
+        }
+    }
+    if (!has_content_length && !is_body_forbidden(response->return_code)) {
+        snprintf(line, sizeof(line), "%zu", response->payload ? response->payload_size : 0);
+        size = append_header(output, size, "Content-Length", line);
+    }
+    return size;
+}
+
+divulge_response_template_t* divulge_response_template_create(const divulge_response_t* response) {
+    if (!response) {
+        return NULL;
+    }
+    size_t header_size = serialize_header(response, NULL);
+    size_t payload_size = (response->payload && !is_body_forbidden(response->return_code)) ? response->payload_size : 0;
+    divulge_response_template_t* response_template =
+        malloc(sizeof(divulge_response_template_t) + header_size + 2 + payload_size);
+    if (!response_template) {
+        return NULL;
+    }
+    serialize_header(response, response_template->data);
+    size_t size = append(response_template->data, header_size, "\r\n", 2);
+    response_template->size = append(response_template->data, size, response->payload, payload_size);
+    response_template->header_size = header_size;
+    return response_template;
+}
+
+void divulge_response_template_destroy(divulge_response_template_t* response_template) {
+    free(response_template);
+}
+
+bool divulge_respond_template(divulge_request_t* request, const divulge_response_template_t* response_template) {
+    if (!response_template) {
+        return false;
+    }
+    return divulge_respond_serialized(request, response_template->data, response_template->size,
+                                      response_template->header_size);
+}
+
+bool divulge_begin_response(divulge_request_t* request,
+                            int return_code,
+                            const divulge_header_t* header,
+                            size_t content_length) {
+    if (!request || request->context->was_status_sent) {
+        return false;
+    }
+    divulge_request_context_t* context = request->context;
+    if (is_body_forbidden(return_code)) {
+        content_length = 0;
+    } else if (content_length == DIVULGE_CONTENT_LENGTH_UNKNOWN) {
+        context->is_chunked = (context->version_minor >= 1);
+        context->is_keep_alive = context->is_keep_alive && context->is_chunked;
+    }
+    context->is_streaming = true;
+    context->content_length = content_length;
+    context->written_size = 0;
+    divulge_header_t no_header = {.entries = NULL, .count = 0};
+    divulge_send_status(request, return_code);
+    send_header_block(request, header ? header : &no_header, content_length);
+    divulge_writer_flush(&context->writer);
+    return true;
+}
+
+static bool can_write_response(divulge_request_t* request, size_t size) {
+    divulge_request_context_t* context = request->context;
+    if (!context->is_streaming || context->was_payload_sent) {
+        return false;
+    }
+    return context->is_chunked || (context->content_length == DIVULGE_CONTENT_LENGTH_UNKNOWN) ||
+           (size <= (context->content_length - context->written_size));
+}
+
+bool divulge_write_response(divulge_request_t* request, const char* data, size_t size) {
+    if (!request || !data || !can_write_response(request, size)) {
+        return false;
+    }
+    divulge_request_context_t* context = request->context;
+    if ((size == 0) || context->is_head) {
+        context->written_size += size;
+        return true;
+    }
+    if (context->is_chunked) {
+        divulge_writer_print(&context->writer, "%zx\r\n", size);
+    }
+    divulge_writer_reference(&context->writer, data, size);
+    if (context->is_chunked) {
+        divulge_writer_copy(&context->writer, "\r\n", 2);
+    }
+    divulge_writer_flush(&context->writer);
+    context->written_size += size;
+    return true;
+}
+
+bool divulge_write_response_file(divulge_request_t* request, int file_descriptor, size_t offset, size_t size) {
+    if (!request || !request->context->divulge->configuration.send_file || !can_write_response(request, size)) {
+        return false;
+    }
+    divulge_request_context_t* context = request->context;
+    if ((size == 0) || context->is_head) {
+        context->written_size += size;
+        return true;
+    }
+    if (context->is_chunked) {
+        divulge_writer_print(&context->writer, "%zx\r\n", size);
+    }
+    divulge_writer_flush(&context->writer);
+    context->was_file_sent = true;
+    uint64_t started_at = context->writer.is_measuring ? divulge_get_time_ns() : 0;
+    bool was_sent = context->divulge->configuration.send_file(context->connection_context, file_descriptor, offset,
+                                                              size);
+    if (context->writer.is_measuring) {
+        context->writer.sent_at_ns = divulge_get_time_ns();
+        context->writer.send_time_ns += context->writer.sent_at_ns - started_at;
+        context->writer.sent_size += was_sent ? size : 0;
+    }
+    if (!was_sent) {
+        context->is_keep_alive = false;
+        return false;
+    }
+    if (context->is_chunked) {
+        divulge_writer_copy(&context->writer, "\r\n", 2);
+        divulge_writer_flush(&context->writer);
+    }
+    context->written_size += size;
+    return true;
+}
+
+bool divulge_end_response(divulge_request_t* request) {
+    if (!request || !request->context->is_streaming || request->context->was_payload_sent) {
+        return false;
+    }
+    divulge_request_context_t* context = request->context;
+    if (context->is_chunked && !context->is_head) {
+        divulge_writer_copy(&context->writer, "0\r\n\r\n", 5);
+        divulge_writer_flush(&context->writer);
+    } else if (context->written_size != context->content_length) {
+        context->is_keep_alive = false;
+    }
+    context->was_payload_sent = true;
+    return true;
+}
+
+bool divulge_redirect(divulge_request_t* request, const char* new_location) {
+    if (!request || !new_location) {
+        return false;
+    }
+    divulge_header_entry_t header_entries[] = {{.key = "Location", .value = new_location}};
+    divulge_response_t response = {
+        .return_code = 301, .header = {.count = 1, .entries = header_entries}, .payload = "", .payload_size = 0};
+    divulge_respond(request, &response);
+    return true;
+}
+
+divulge_deferred_t* divulge_defer(divulge_request_t* request) {
+    if (!request || request->context->was_status_sent) {
+        return NULL;
+    }
+    divulge_request_context_t* context = request->context;
+    divulge_t* divulge = context->divulge;
+    if (context->connection && !divulge->configuration.resume) {
+        return NULL;
+    }
+    bool has_route = divulge->configuration.metrics && context->route_pattern;
+    size_t route_size = has_route ? strlen(context->route_pattern) + 1 : 0;
+    divulge_deferred_t* deferred =
+        calloc(1, sizeof(divulge_deferred_t) + divulge->configuration.response_buffer_size + route_size);
+    if (!deferred) {
+        return NULL;
+    }
+    if (route_size > 0) {
+        char* route = deferred->response_buffer + divulge->configuration.response_buffer_size;
+        memcpy(route, context->route_pattern, route_size);
+        deferred->sample.route = route;
+    }
+    deferred->started_at_ns = context->started_at_ns;
+    pthread_mutex_init(&deferred->mutex, NULL);
+    deferred->reference_count = 2;
+    deferred->state = DIVULGE_DEFERRED_STATE_PENDING;
+    deferred->divulge = divulge;
+    deferred->connection = context->connection;
+    deferred->connection_context = context->connection_context;
+    deferred->version_minor = context->version_minor;
+    deferred->is_keep_alive = context->is_keep_alive;
+    deferred->is_head = context->is_head;
+    deferred->is_admitted = context->is_admitted;
+    context->deferred = deferred;
+    /* Whatever the handler still does with the request must not answer it */
+    context->was_status_sent = true;
+    context->was_header_sent = true;
+    context->was_payload_sent = true;
+    return deferred;
+}
+
+divulge_deferred_t* divulge_read_body(divulge_request_t* request, const divulge_body_reader_t* reader) {
+    if (!request || !reader || !reader->on_data || !reader->on_end || request->context->body_reader.on_end) {
+        return NULL;
+    }
+    divulge_request_context_t* context = request->context;
+    bool is_keep_alive = context->is_keep_alive;
+    if (context->is_body_pending) {
+        context->is_keep_alive = context->is_keep_alive_after_body;
+    }
+    divulge_deferred_t* deferred = divulge_defer(request);
+    if (!deferred) {
+        context->is_keep_alive = is_keep_alive;
+        return NULL;
+    }
+    context->body_reader = *reader;
+    if (context->is_body_pending && context->connection->is_continue_expected) {
+        send_continue(context->connection);
+    }
+    return deferred;
+}
+
+static void capture_output(void* connection_context, const char* data, size_t data_size) {
+    divulge_deferred_t* deferred = connection_context;
+    if (deferred->has_failed) {
+        return;
+    }
+    if ((deferred->output_size + data_size) > deferred->output_capacity) {
+        size_t capacity = deferred->output_capacity ? deferred->output_capacity : 1024;
+        while (capacity < (deferred->output_size + data_size)) {
+            capacity *= 2;
+        }
+        char* output = realloc(deferred->output, capacity);
+        if (!output) {
+            deferred->has_failed = true;
+            return;
+        }
+        deferred->output = output;
+        deferred->output_capacity = capacity;
+    }
+    memcpy(deferred->output + deferred->output_size, data, data_size);
+    deferred->output_size += data_size;
+}
+
+/*
+ * The response is serialized on the responding thread into a buffer of its own, which the connection then sends
+ * from its thread.
+ */
+static void serialize_deferred_response(divulge_deferred_t* deferred, divulge_response_t* response) {
+    divulge_configuration_t configuration = {.send = capture_output};
+    divulge_request_context_t request_context = {
+        .divulge = deferred->divulge,
+        .connection_context = deferred,
+        .version_minor = deferred->version_minor,
+        .is_keep_alive = deferred->is_keep_alive,
+        .is_head = deferred->is_head,
+    };
+    divulge_writer_initialize(&request_context.writer, &configuration, deferred, deferred->response_buffer,
+                              deferred->divulge->configuration.response_buffer_size);
+    divulge_request_t request = {.context = &request_context};
+    divulge_respond(&request, response);
+    divulge_writer_flush(&request_context.writer);
+    deferred->was_payload_sent = request_context.was_payload_sent && !deferred->has_failed;
+    deferred->sample.status = request_context.return_code;
+}
+
+bool divulge_deferred_respond(divulge_deferred_t* deferred, divulge_response_t* response) {
+    if (!deferred || !response) {
+        return false;
+    }
+    pthread_mutex_lock(&deferred->mutex);
+    bool is_pending = (deferred->state == DIVULGE_DEFERRED_STATE_PENDING);
+    bool is_sent_here = is_pending && !deferred->connection;
+    if (is_pending) {
+        serialize_deferred_response(deferred, response);
+        deferred->state = DIVULGE_DEFERRED_STATE_COMPLETED;
+        if (deferred->connection) {
+            deferred->divulge->configuration.resume(deferred->connection_context);
+        }
+    }
+    pthread_mutex_unlock(&deferred->mutex);
+    if (is_sent_here) {
+        send_deferred_response(deferred);
+        deferred->divulge->configuration.close(deferred->connection_context);
+    }
+    release_deferred(deferred);
+    return is_pending;
+}
+
+void divulge_deferred_set_cancel_callback(divulge_deferred_t* deferred,
+                                          divulge_deferred_cancel_callback_t callback,
+                                          void* context) {
+    if (!deferred) {
+        return;
+    }
+    pthread_mutex_lock(&deferred->mutex);
+    deferred->cancel = callback;
+    deferred->cancel_context = context;
+    bool is_cancelled = (deferred->state == DIVULGE_DEFERRED_STATE_CANCELLED);
+    pthread_mutex_unlock(&deferred->mutex);
+    if (is_cancelled && callback) {
+        callback(context);
+    }
+}
+
+bool divulge_deferred_is_cancelled(divulge_deferred_t* deferred) {
+    if (!deferred) {
+        return false;
+    }
+    pthread_mutex_lock(&deferred->mutex);
+    bool is_cancelled = (deferred->state == DIVULGE_DEFERRED_STATE_CANCELLED);
+    pthread_mutex_unlock(&deferred->mutex);
+    return is_cancelled;
+}
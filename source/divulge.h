@@ -26,28 +26,78 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "divulge-parser.h"
 /**
  * @defgroup divulge Divulge
  * @brief Small HTTP router in C
  * @{
  */
 typedef struct divulge divulge_t;
+typedef struct divulge_response_template divulge_response_template_t;
 
 typedef enum divulge_route_method {
     DIVULGE_ROUTE_METHOD_GET,
     DIVULGE_ROUTE_METHOD_POST,
-    DIVULGE_ROUTE_METHOD_ANY,
+    DIVULGE_ROUTE_METHOD_PUT,
+    DIVULGE_ROUTE_METHOD_DELETE,
+    DIVULGE_ROUTE_METHOD_PATCH,
+    DIVULGE_ROUTE_METHOD_HEAD,    /**< also answered by GET routes, without the body */
+    DIVULGE_ROUTE_METHOD_OPTIONS, /**< answered with the allowed methods unless a route handles it */
+    DIVULGE_ROUTE_METHOD_ANY,     /**< any method the path has no route of its own for */
 } divulge_route_method_t;
 
+#define DIVULGE_ROUTE_METHOD_COUNT (DIVULGE_ROUTE_METHOD_ANY + 1)
+
+#define DIVULGE_MAX_ROUTE_PARAMETERS (8)
+#define DIVULGE_CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
 typedef struct divulge_request_context divulge_request_context_t;
 
+typedef struct divulge_connection divulge_connection_t;
+
+typedef struct divulge_deferred divulge_deferred_t;
+
+typedef void (*divulge_deferred_cancel_callback_t)(void* context);
+
+typedef struct divulge_metrics divulge_metrics_t;
+
+typedef struct divulge_tracer divulge_tracer_t;
+
+typedef struct divulge_url_query divulge_url_query_t;
+
+typedef struct divulge_timer_wheel divulge_timer_wheel_t;
+
+/**
+ * @brief Why a connection was closed for taking too long, see divulge_connection_watch()
+ */
+typedef enum divulge_timeout {
+    DIVULGE_TIMEOUT_IDLE,    /**< no request came within `idle_timeout_ms` */
+    DIVULGE_TIMEOUT_HEADER,  /**< the header block took longer than `header_timeout_ms` */
+    DIVULGE_TIMEOUT_BODY,    /**< the body arrived slower than `min_body_rate` */
+    DIVULGE_TIMEOUT_REQUEST, /**< the request was not answered within `request_timeout_ms` */
+    DIVULGE_TIMEOUT_COUNT,
+} divulge_timeout_t;
+
+typedef struct divulge_slice {
+    const char* data;
+    size_t size;
+} divulge_slice_t;
+
+typedef struct divulge_route_parameter {
+    divulge_slice_t name;
+    divulge_slice_t value;
+} divulge_route_parameter_t;
+
 typedef struct divulge_request {
     divulge_request_context_t* context;
     divulge_route_method_t method;
-    const char* route;
-    const char* url_query;
-    const char* header;
-    const char* payload;
+    divulge_slice_t route;
+    divulge_slice_t url_query;
+    divulge_slice_t header;
+    divulge_slice_t payload;
+    divulge_route_parameter_t parameters[DIVULGE_MAX_ROUTE_PARAMETERS];
+    size_t parameter_count;
 } divulge_request_t;
 
 typedef struct divulge_header_entry {
@@ -78,38 +128,318 @@ typedef struct divulge_uri {
     const char* uri;
     divulge_route_method_t method;
     divulge_handler_object_t handler;
+    bool is_streaming_body; /**< accepts bodies larger than the connection buffer, see divulge_read_body() */
 } divulge_uri_t;
 
+/**
+ * @brief Receives a request body in pieces, see divulge_read_body()
+ */
+typedef struct divulge_body_reader {
+    /** called with the next decoded piece of the body, valid during the call only; false aborts the request */
+    bool (*on_data)(void* context, const char* data, size_t size);
+    /** called once the whole body was received */
+    void (*on_end)(void* context);
+    void* context;
+} divulge_body_reader_t;
+
+/**
+ * @brief Receives a copy of a serialized response, e.g. to cache it
+ */
+typedef struct divulge_response_observer {
+    /** called with every piece of the response except the per-connection `Connection` header */
+    void (*write)(void* context, const char* data, size_t size);
+    /** called once the handler returned; `is_complete` tells whether the pieces form a whole, replayable response */
+    void (*finish)(void* context, bool is_complete);
+    void* context;
+} divulge_response_observer_t;
+
 typedef void (*divulge_socket_send_callback_t)(void* connection_context, const char* data, size_t data_size);
 
+/**
+ * @brief Send all segments in order, e.g. with a single writev()
+ */
+typedef void (*divulge_socket_send_vector_callback_t)(void* connection_context,
+                                                      const divulge_slice_t* segments,
+                                                      size_t segment_count);
+
+/**
+ * @brief Send part of a file without copying it through user space, e.g. with sendfile()
+ * @return false if nothing could be sent
+ */
+typedef bool (*divulge_socket_send_file_callback_t)(void* connection_context,
+                                                    int file_descriptor,
+                                                    size_t offset,
+                                                    size_t size);
+
 typedef void (*divulge_socket_close_callback_t)(void* connection_context);
 
+/**
+ * @brief Ask the thread serving the connection to call divulge_connection_resume()
+ * @note Called from the thread completing a deferred response; it must not resume the connection itself.
+ */
+typedef void (*divulge_socket_resume_callback_t)(void* connection_context);
+
+/**
+ * @brief Tell the address of the client, e.g. the bytes of its IP address
+ * @return bytes living as long as the connection, empty if unknown
+ */
+typedef divulge_slice_t (*divulge_socket_peer_address_callback_t)(void* connection_context);
+
 typedef struct divulge_configuration {
     divulge_socket_send_callback_t send;
+    divulge_socket_send_vector_callback_t send_vector; /**< optional, used instead of `send` when set */
+    divulge_socket_send_file_callback_t send_file; /**< optional, enables divulge_write_response_file() */
     divulge_socket_close_callback_t close;
+    divulge_socket_resume_callback_t resume; /**< optional, enables divulge_defer() on persistent connections */
+    divulge_socket_peer_address_callback_t peer_address; /**< optional, enables divulge_get_peer_address() */
+    size_t max_request_line_size;
+    size_t max_request_header_size;
+    size_t max_requests_per_connection; /**< 0 for 100 */
+    size_t connection_buffer_size;      /**< bytes buffered per connection, 0 for 16 KiB */
+    size_t response_buffer_size;        /**< response scratch buffer per connection, 0 for 1 KiB */
+    size_t max_request_body_size;       /**< larger bodies are refused with 413, 0 for 64 MiB */
+    bool is_date_sent;                  /**< add a Date header to every response, see divulge-date.h */
+    size_t max_concurrent_requests;     /**< more are answered 503 before routing, 0 for no limit */
+    uint32_t idle_timeout_ms;           /**< wait for the first byte of a request, 0 for no limit */
+    uint32_t header_timeout_ms;         /**< receive the header block from its first byte, 0 for no limit */
+    uint32_t request_timeout_ms;        /**< answer a request from its first byte, 0 for no limit */
+    size_t min_body_rate;               /**< body bytes per second after a 5 s grace period, 0 for no limit */
+    divulge_metrics_t* metrics;         /**< optional, see divulge-metrics.h */
+#ifdef DIVULGE_TRACING
+    divulge_tracer_t* tracer; /**< optional, see divulge-trace.h */
+#endif
+    divulge_handler_object_t* admission; /**< optional, run on every request before routing, see divulge-admission.h */
 } divulge_configuration_t;
 
 const char* divulge_method_name_from_method(divulge_route_method_t method);
 
 divulge_t* divulge_initialize(divulge_configuration_t* configuration);
 
+/**
+ * @brief Register a route, replacing the handler and options of an already registered method and pattern
+ * @note Routes and middlewares may be changed while requests are processed. Every change publishes a new
+ * route table snapshot; requests already in flight finish on the snapshot they started with.
+ */
 void divulge_register_uri(divulge_t* divulge, divulge_uri_t* uri);
 
+bool divulge_unregister_uri(divulge_t* divulge, divulge_uri_t* uri);
+
 void divulge_add_middleware_to_uri(divulge_t* divulge, divulge_uri_t* uri, divulge_handler_object_t* middleware);
 
+/**
+ * @brief Remove the middleware with the same handler and context from the route
+ */
+bool divulge_remove_middleware_from_uri(divulge_t* divulge, divulge_uri_t* uri, divulge_handler_object_t* middleware);
+
+/**
+ * @brief Group several route changes into a single snapshot
+ *
+ * Changes made until the matching divulge_end_routes_update() are published together, which avoids
+ * recompiling the route table for every route when registering a large number of them.
+ */
+void divulge_begin_routes_update(divulge_t* divulge);
+
+void divulge_end_routes_update(divulge_t* divulge);
+
+unsigned long divulge_get_routes_version(divulge_t* divulge);
+
 void divulge_set_default_404_handler(divulge_t* divulge, divulge_uri_handler_t handler, void* context);
 
+/**
+ * @brief Parse and answer a request that was received as a whole
+ * @note The request buffer is not modified and does not need to be NUL-terminated.
+ */
 void divulge_process_request(divulge_t* divulge,
                              void* connection_context,
-                             char* request_buffer,
+                             const char* request_buffer,
                              size_t request_buffer_size,
                              char* response_buffer,
                              size_t response_buffer_size);
 
-const char* divulge_find_request_header_key(divulge_request_t* request, const char* key);
+/**
+ * @brief Initialize a parser with the request limits from the configuration
+ */
+void divulge_prepare_parser(divulge_t* divulge, divulge_parser_t* parser);
+
+/**
+ * @brief Answer a request parsed incrementally by the caller
+ * @param divulge router
+ * @param connection_context transport connection
+ * @param parser parser that was fed `request_buffer`; an unfinished or failed parse is answered with an error
+ * @param request_buffer request bytes the parser offsets refer to
+ * @param response_buffer scratch buffer for the response
+ * @param response_buffer_size size of the scratch buffer
+ */
+void divulge_process_parsed_request(divulge_t* divulge,
+                                    void* connection_context,
+                                    const divulge_parser_t* parser,
+                                    const char* request_buffer,
+                                    char* response_buffer,
+                                    size_t response_buffer_size);
+
+/**
+ * @brief Start serving a persistent connection
+ *
+ * The connection buffers received bytes and answers every complete request in order, including several
+ * pipelined ones, before asking for more. It stays open while the client asks for keep-alive (the default in
+ * HTTP/1.1), the handlers complete their responses and `max_requests_per_connection` is not reached;
+ * otherwise it is closed with the `close` callback.
+ *
+ * Chunked bodies are decoded in place in the buffer. A body that does not fit in it is only accepted by routes
+ * with `is_streaming_body`, whose handler then runs as soon as the headers are received; others get 413. A
+ * client sending `Expect: 100-continue` is told to go on once the body is known to be accepted.
+ * @param divulge router
+ * @param connection_context transport connection passed to the callbacks
+ * @return connection or NULL on allocation failure
+ */
+divulge_connection_t* divulge_connection_create(divulge_t* divulge, void* connection_context);
+
+/**
+ * @brief Get the place where the transport should write newly received bytes
+ * @param connection connection
+ * @param size free space in the buffer, 0 once the connection is closed, or while it is full of requests waiting
+ *             behind a deferred response, until divulge_connection_resume()
+ */
+char* divulge_connection_get_receive_buffer(divulge_connection_t* connection, size_t* size);
+
+/**
+ * @brief Tell the connection that bytes were written to its receive buffer and answer the requests they complete
+ * @return false once the connection was closed
+ */
+bool divulge_connection_receive(divulge_connection_t* connection, size_t received_size);
+
+/**
+ * @brief Send the deferred response the `resume` callback was called for and answer the requests queued behind it
+ * @return false once the connection was closed
+ */
+bool divulge_connection_resume(divulge_connection_t* connection);
+
+/**
+ * @brief Enforce the configured timeouts on the connection with a timer wheel
+ *
+ * The connection keeps a single timer on the wheel, moved on every call to divulge_connection_receive() or
+ * divulge_connection_resume() to the earliest deadline of what it waits for: the next request, the rest of a
+ * header block, more body bytes or a deferred response. A connection over its deadline gets a 408 if it was still
+ * receiving a request, and is closed; the closes are counted by divulge_get_timeout_count(). Time is read from
+ * the wheel, so the wheel must be advanced by the thread serving the connection before the received bytes are
+ * reported.
+ * @param connection connection
+ * @param wheel timer wheel of the thread serving the connection, NULL to stop enforcing timeouts
+ */
+void divulge_connection_watch(divulge_connection_t* connection, divulge_timer_wheel_t* wheel);
+
+/**
+ * @brief Number of connections closed for the timeout, over all threads
+ */
+uint64_t divulge_get_timeout_count(divulge_t* divulge, divulge_timeout_t timeout);
+
+/**
+ * @brief Close the connection, unless already closed, and release it
+ * @note A deferred response still pending is cancelled.
+ */
+void divulge_connection_destroy(divulge_connection_t* connection);
 
-const char* divulge_get_request_header_entry_value(const char* header_entry);
+/**
+ * @brief Get a parameter captured by the matched route
+ * @param request processed request
+ * @param name parameter name without the leading `:`; `*` for an unnamed trailing wildcard
+ * @param value slice pointing into the request route
+ * @return true if the parameter was captured
+ */
+bool divulge_get_route_parameter(divulge_request_t* request, const char* name, divulge_slice_t* value);
+
+/**
+ * @brief Find a request header by name, compared case-insensitively
+ * @param request processed request
+ * @param name header name
+ * @param value slice pointing into the request buffer, with surrounding whitespace removed
+ * @return true if the request has the header; the value of its first occurrence is returned
+ */
+bool divulge_find_request_header(divulge_request_t* request, const char* name, divulge_slice_t* value);
+
+/**
+ * @brief Iterate over every occurrence of a repeated request header
+ * @param request processed request
+ * @param name header name
+ * @param cursor iteration state, set to 0 before the first call
+ * @param value slice of the next occurrence
+ * @return false once there are no more occurrences
+ */
+bool divulge_find_next_request_header(divulge_request_t* request,
+                                      const char* name,
+                                      size_t* cursor,
+                                      divulge_slice_t* value);
+
+/**
+ * @brief Get the address of the client, as told by the transport
+ * @return false if the transport does not tell it
+ */
+bool divulge_get_peer_address(divulge_request_t* request, divulge_slice_t* address);
+
+/**
+ * @brief Get the index of the URL query (see divulge-url-query.h), built on first use
+ * @param request processed request
+ * @return index living until the request is answered, or NULL if it could not be allocated
+ */
+const divulge_url_query_t* divulge_get_url_query(divulge_request_t* request);
 
+/**
+ * @brief Find a URL query parameter by its decoded key
+ * @param request processed request
+ * @param key decoded key
+ * @param value decoded value: a slice of the query, or of request memory if the value had escapes
+ * @return true if the query has the key; the value of its first occurrence is returned
+ */
+bool divulge_find_query_parameter(divulge_request_t* request, const char* key, divulge_slice_t* value);
+
+/**
+ * @brief Iterate over every occurrence of a repeated URL query key
+ * @param request processed request
+ * @param key decoded key
+ * @param cursor iteration state, set to 0 before the first call
+ * @param value decoded value of the next occurrence
+ * @return false once there are no more occurrences
+ */
+bool divulge_find_next_query_parameter(divulge_request_t* request,
+                                       const char* key,
+                                       size_t* cursor,
+                                       divulge_slice_t* value);
+
+/**
+ * @brief Receive the request body in pieces and answer the request once it is read
+ *
+ * The request is deferred: the reader gets the body after the handler returns, in pieces of at most
+ * `connection_buffer_size` bytes as the transport delivers them, and the response is given with
+ * divulge_deferred_respond(), usually from `on_end`. Nothing more is read from the client while a callback
+ * runs, so a slow consumer slows the upload down instead of growing the memory used. A body already received
+ * as a whole, in `payload`, is handed over in one piece. If the client goes away, the deferred response is
+ * cancelled and the reader is not called anymore.
+ * @note Requires the same as divulge_defer(). Responding before the whole body was read closes the connection.
+ * @return handle to respond with, or NULL if the body is being read already or the request cannot be deferred
+ */
+divulge_deferred_t* divulge_read_body(divulge_request_t* request, const divulge_body_reader_t* reader);
+
+/**
+ * @brief Allocate memory that lives until the request is answered
+ * @note Everything allocated for a request is released at once when it is answered: after its handler returns,
+ * or once a deferred response was given and its body reader is done. The memory must not be freed. Blocks are
+ * pooled per thread.
+ * @return memory aligned for any type, or NULL
+ */
+void* divulge_request_alloc(divulge_request_t* request, size_t size);
+
+size_t divulge_get_request_header_count(divulge_request_t* request);
+
+bool divulge_get_request_header(divulge_request_t* request,
+                                size_t index,
+                                divulge_slice_t* name,
+                                divulge_slice_t* value);
+
+/**
+ * @brief Queue the status line
+ * @note The status line and headers are gathered in the response buffer and sent together with the payload,
+ * in one call of `send_vector` when it is configured. `Content-Length` is added unless the response has it.
+ */
 bool divulge_send_status(divulge_request_t* request, int return_code);
 
 bool divulge_send_header(divulge_request_t* request, divulge_response_t* response);
@@ -119,6 +449,105 @@ bool divulge_send_payload(divulge_request_t* request, divulge_response_t* respon
 bool divulge_respond(divulge_request_t* request, divulge_response_t* response);
 
 bool divulge_redirect(divulge_request_t* request, const char* new_location);
+
+/**
+ * @brief Observe the response about to be produced for the request, e.g. from a middleware
+ * @note Responses sent with chunked transfer encoding, until the connection closes or partly with `send_file` are
+ * reported as incomplete.
+ * @return false if the response was already started or is observed already
+ */
+bool divulge_observe_response(divulge_request_t* request, const divulge_response_observer_t* observer);
+
+/**
+ * @brief Send a response captured earlier by an observer
+ * @param request processed request
+ * @param data complete response, status line to body
+ * @param size size of `data`
+ * @param header_size size of the status line and headers, without the blank line ending them
+ * @note The `Connection` header matching this request, and `Date` when enabled, are inserted after the captured
+ * headers.
+ */
+bool divulge_respond_serialized(divulge_request_t* request, const char* data, size_t size, size_t header_size);
+
+/**
+ * @brief Serialize a fixed response once, to send it with divulge_respond_template()
+ *
+ * The status line, headers, `Content-Length` and body are laid out in a single buffer, so sending the response
+ * takes no formatting and one send. The response is copied and may be freed afterwards.
+ * @return template to destroy with divulge_response_template_destroy(), or NULL
+ */
+divulge_response_template_t* divulge_response_template_create(const divulge_response_t* response);
+
+void divulge_response_template_destroy(divulge_response_template_t* response_template);
+
+/**
+ * @brief Send a serialized response, see divulge_respond_serialized()
+ */
+bool divulge_respond_template(divulge_request_t* request, const divulge_response_template_t* response_template);
+
+/**
+ * @brief Start a response whose body is written in pieces
+ * @param request processed request
+ * @param return_code HTTP status code
+ * @param header additional headers, may be NULL
+ * @param content_length body size, or DIVULGE_CONTENT_LENGTH_UNKNOWN to send it with chunked transfer encoding
+ * (HTTP/1.0 clients get the body until the connection closes)
+ * @return false if a response was already started
+ */
+bool divulge_begin_response(divulge_request_t* request,
+                            int return_code,
+                            const divulge_header_t* header,
+                            size_t content_length);
+
+/**
+ * @brief Send a piece of the body
+ * @note The data goes straight to the send callback and may be reused once the call returns.
+ * @return false if it would exceed the announced content length
+ */
+bool divulge_write_response(divulge_request_t* request, const char* data, size_t size);
+
+/**
+ * @brief Send a piece of the body straight from a file with the `send_file` callback
+ * @return false if `send_file` is not configured, in which case nothing is sent, or if it failed, which closes the
+ * connection
+ */
+bool divulge_write_response_file(divulge_request_t* request, int file_descriptor, size_t offset, size_t size);
+
+/**
+ * @brief Finish the response started by divulge_begin_response()
+ * @note A body shorter than the announced content length closes the connection.
+ */
+bool divulge_end_response(divulge_request_t* request);
+
+/**
+ * @brief Answer the request later, e.g. once a database or an upstream service replied
+ *
+ * The handler returns right after deferring, without blocking its thread, and the response is given from any
+ * thread with divulge_deferred_respond(). Until then the connection answers no further request; pipelined ones
+ * wait in order. The request, its headers and anything allocated for it are released when the handler returns,
+ * so copy what the response needs.
+ * @note On a persistent connection this requires the `resume` callback. For divulge_process_request() the
+ * response is sent and the connection closed by the thread responding.
+ * @return handle to respond with, or NULL if the response was already started or the transport cannot resume
+ */
+divulge_deferred_t* divulge_defer(divulge_request_t* request);
+
+/**
+ * @brief Give the deferred response and release the handle
+ * @note Must be called exactly once for every handle, also after a cancellation.
+ * @return false if the client went away meanwhile
+ */
+bool divulge_deferred_respond(divulge_deferred_t* deferred, divulge_response_t* response);
+
+/**
+ * @brief Be told when the client goes away before the response was given
+ * @note The callback runs on the thread destroying the connection, or right away if it is already gone.
+ */
+void divulge_deferred_set_cancel_callback(divulge_deferred_t* deferred,
+                                          divulge_deferred_cancel_callback_t callback,
+                                          void* context);
+
+bool divulge_deferred_is_cancelled(divulge_deferred_t* deferred);
 /**
  * @}
  */
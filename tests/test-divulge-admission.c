@@ -0,0 +1,182 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "divulge-admission.h"
+#include "test-divulge-transport.h"
+
+static divulge_deferred_t* deferred;
+static const char* peer_address;
+
+static divulge_slice_t socket_peer_address(void* connection_context) {
+    divulge_slice_t address = {.data = peer_address, .size = strlen(peer_address)};
+    return address;
+}
+
+static void process(divulge_t* divulge, connection_t* connection, const char* address, const char* request) {
+    char response_buffer[512];
+    memset(connection, 0, sizeof(*connection));
+    peer_address = address;
+    divulge_process_request(divulge, connection, request, strlen(request), response_buffer, sizeof(response_buffer));
+}
+
+static bool ok_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {.return_code = 200, .payload = "ok", .payload_size = 2};
+    return divulge_respond(request, &response);
+}
+
+static bool defer_handler(divulge_request_t* request, void* context) {
+    deferred = divulge_defer(request);
+    return deferred != NULL;
+}
+
+static divulge_uri_t ok_uri = {
+    .uri = "/ok",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = ok_handler},
+};
+
+static divulge_uri_t slow_uri = {
+    .uri = "/slow",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = defer_handler},
+};
+
+static void test_token_bucket(void** state) {
+    divulge_admission_configuration_t configuration = {.requests_per_second = 10, .burst = 2};
+    divulge_handler_object_t* admission = divulge_admission_create(&configuration);
+    assert_non_null(admission);
+    assert_true(divulge_admission_take_token(admission, "a", 1, 1000));
+    assert_true(divulge_admission_take_token(admission, "a", 1, 1000));
+    assert_false(divulge_admission_take_token(admission, "a", 1, 1050));
+    assert_true(divulge_admission_take_token(admission, "b", 1, 1050));
+    assert_true(divulge_admission_take_token(admission, "a", 1, 1100));
+    assert_false(divulge_admission_take_token(admission, "a", 1, 1100));
+    assert_true(divulge_admission_take_token(admission, "a", 1, 5000));
+    assert_true(divulge_admission_take_token(admission, "a", 1, 5000));
+    assert_false(divulge_admission_take_token(admission, "a", 1, 5000));
+}
+
+static void test_rejects_bad_configuration(void** state) {
+    divulge_admission_configuration_t configuration = {.requests_per_second = 0};
+    assert_null(divulge_admission_create(&configuration));
+    assert_null(divulge_admission_create(NULL));
+}
+
+static void test_evicts_idle_clients(void** state) {
+    divulge_admission_configuration_t configuration = {.requests_per_second = 1, .max_clients = 16};
+    divulge_handler_object_t* admission = divulge_admission_create(&configuration);
+    char address[16];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(address, sizeof(address), "%d", i);
+        assert_true(divulge_admission_take_token(admission, address, strlen(address), 1000 + i));
+    }
+    assert_false(divulge_admission_take_token(admission, address, strlen(address), 1999));
+}
+
+static void test_middleware_limits_clients(void** state) {
+    divulge_admission_configuration_t admission_configuration = {.requests_per_second = 1};
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .close = socket_close,
+        .peer_address = socket_peer_address,
+        .admission = divulge_admission_create(&admission_configuration),
+    };
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_register_uri(divulge, &ok_uri);
+    connection_t connection;
+    process(divulge, &connection, "10.0.0.1", "GET /ok HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+    process(divulge, &connection, "10.0.0.1", "GET /missing HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 429 Too Many Requests\r\n"));
+    assert_non_null(strstr(connection.output, "Retry-After: 1\r\n"));
+    process(divulge, &connection, "10.0.0.2", "GET /ok HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+    process(divulge, &connection, "", "GET /ok HTTP/1.1\r\n\r\n");
+    process(divulge, &connection, "", "GET /ok HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+}
+
+static void test_middleware_on_route(void** state) {
+    divulge_admission_configuration_t admission_configuration = {.requests_per_second = 1};
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .close = socket_close,
+        .peer_address = socket_peer_address,
+    };
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_register_uri(divulge, &ok_uri);
+    divulge_add_middleware_to_uri(divulge, &ok_uri, divulge_admission_create(&admission_configuration));
+    connection_t connection;
+    process(divulge, &connection, "10.0.0.1", "GET /ok HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+    process(divulge, &connection, "10.0.0.1", "GET /ok HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 429"));
+    process(divulge, &connection, "10.0.0.1", "GET /missing HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 404"));
+}
+
+static void test_sheds_concurrent_requests(void** state) {
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .close = socket_close,
+        .max_concurrent_requests = 1,
+    };
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_register_uri(divulge, &ok_uri);
+    divulge_register_uri(divulge, &slow_uri);
+    connection_t slow_connection;
+    connection_t connection;
+    process(divulge, &connection, "", "GET /ok HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+    process(divulge, &slow_connection, "", "GET /slow HTTP/1.1\r\n\r\n");
+    assert_non_null(deferred);
+    process(divulge, &connection, "", "GET /ok HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 503 Service Unavailable\r\n"));
+    assert_non_null(strstr(connection.output, "Connection: close\r\n"));
+    divulge_response_t response = {.return_code = 200, .payload = "later", .payload_size = 5};
+    assert_true(divulge_deferred_respond(deferred, &response));
+    assert_non_null(strstr(slow_connection.output, "\r\n\r\nlater"));
+    process(divulge, &connection, "", "GET /ok HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_token_bucket),
+        cmocka_unit_test(test_rejects_bad_configuration),
+        cmocka_unit_test(test_evicts_idle_clients),
+        cmocka_unit_test(test_middleware_limits_clients),
+        cmocka_unit_test(test_middleware_on_route),
+        cmocka_unit_test(test_sheds_concurrent_requests),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,113 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <stdalign.h>
+#include <stdio.h>
+#include <string.h>
+#include "divulge-arena.h"
+#include "divulge.h"
+#include "test-divulge-transport.h"
+
+static void* previous_allocation;
+
+static bool allocating_handler(divulge_request_t* request, void* context) {
+    char* text = divulge_request_alloc(request, 64);
+    assert_non_null(text);
+    snprintf(text, 64, "%.*s", (int)request->route.size, request->route.data);
+    previous_allocation = text;
+    divulge_response_t response = {.return_code = 200, .payload = text, .payload_size = strlen(text)};
+    return divulge_respond(request, &response);
+}
+
+static void test_allocations_are_aligned_and_distinct(void** state) {
+    divulge_arena_t arena = {0};
+    char* previous = NULL;
+    for (size_t size = 1; size < 200; size++) {
+        char* memory = divulge_arena_allocate(&arena, size);
+        assert_non_null(memory);
+        assert_int_equal((uintptr_t)memory % alignof(max_align_t), 0);
+        memset(memory, 0xaa, size);
+        assert_true(!previous || (memory != previous));
+        previous = memory;
+    }
+    assert_true(arena.block_count > 1);
+    assert_null(divulge_arena_allocate(&arena, 0));
+    divulge_arena_reset(&arena);
+    assert_int_equal(arena.block_count, 0);
+}
+
+static void test_large_allocation_gets_own_block(void** state) {
+    divulge_arena_t arena = {0};
+    char* small = divulge_arena_allocate(&arena, 16);
+    char* large = divulge_arena_allocate(&arena, 3 * DIVULGE_ARENA_BLOCK_SIZE);
+    assert_non_null(small);
+    assert_non_null(large);
+    memset(large, 0x55, 3 * DIVULGE_ARENA_BLOCK_SIZE);
+    assert_int_equal(arena.block_count, 2);
+    divulge_arena_reset(&arena);
+}
+
+static void test_reset_reuses_pooled_blocks(void** state) {
+    divulge_arena_t arena = {0};
+    void* first = divulge_arena_allocate(&arena, 100);
+    divulge_arena_reset(&arena);
+    void* second = divulge_arena_allocate(&arena, 100);
+    assert_ptr_equal(first, second);
+    divulge_arena_reset(&arena);
+}
+
+static void test_request_allocations_are_released_after_response(void** state) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_uri_t uri = {.uri = "/*", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = allocating_handler}};
+    divulge_register_uri(divulge, &uri);
+    char response_buffer[256];
+    connection_t connection = {0};
+    const char* request = "GET /first HTTP/1.1\r\n\r\n";
+    divulge_process_request(divulge, &connection, request, strlen(request), response_buffer, sizeof(response_buffer));
+    assert_non_null(strstr(connection.output, "\r\n\r\n/first"));
+    void* first = previous_allocation;
+    memset(&connection, 0, sizeof(connection));
+    request = "GET /second HTTP/1.1\r\n\r\n";
+    divulge_process_request(divulge, &connection, request, strlen(request), response_buffer, sizeof(response_buffer));
+    assert_non_null(strstr(connection.output, "\r\n\r\n/second"));
+    assert_ptr_equal(previous_allocation, first);
+    assert_null(divulge_request_alloc(NULL, 8));
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_allocations_are_aligned_and_distinct),
+        cmocka_unit_test(test_large_allocation_gets_own_block),
+        cmocka_unit_test(test_reset_reuses_pooled_blocks),
+        cmocka_unit_test(test_request_allocations_are_released_after_response),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
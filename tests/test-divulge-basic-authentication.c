@@ -0,0 +1,185 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "divulge-basic-authentication.h"
+#include "test-divulge-transport.h"
+
+#define USER_CREDENTIALS "dXNlcjpwYXNzOndvcmQ="
+#define WRONG_CREDENTIALS "dXNlcjp3cm9uZw=="
+
+static size_t callback_count;
+static divulge_handler_object_t* forgotten_during_check;
+static const char* valid_password = "pass:word";
+
+static bool ok_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {.return_code = 200, .payload = "ok", .payload_size = 2};
+    return divulge_respond(request, &response);
+}
+
+static bool authenticate_user(void* context, const char* username, const char* password) {
+    callback_count++;
+    if (forgotten_during_check) {
+        divulge_basic_authentication_forget_user(forgotten_during_check, username);
+        forgotten_during_check = NULL;
+    }
+    return (strcmp(username, "user") == 0) && (strcmp(password, valid_password) == 0);
+}
+
+static divulge_t* create_divulge(divulge_handler_object_t* authentication) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_uri_t uri = {.uri = "/private", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = ok_handler}};
+    divulge_register_uri(divulge, &uri);
+    assert_non_null(authentication);
+    divulge_add_middleware_to_uri(divulge, &uri, authentication);
+    callback_count = 0;
+    valid_password = "pass:word";
+    return divulge;
+}
+
+static divulge_handler_object_t* create_cached_authentication(unsigned time_to_live_ms,
+                                                              unsigned rejection_time_to_live_ms) {
+    divulge_basic_authentication_configuration_t configuration = {
+        .realm = "test",
+        .authentication_callback = authenticate_user,
+        .max_cached_credentials = 16,
+        .time_to_live_ms = time_to_live_ms,
+        .rejection_time_to_live_ms = rejection_time_to_live_ms,
+    };
+    return divulge_basic_authentication_create_with_configuration(&configuration);
+}
+
+static int request(divulge_t* divulge, const char* credentials) {
+    char request_text[1024];
+    char response_buffer[256];
+    connection_t connection = {0};
+    snprintf(request_text, sizeof(request_text), "GET /private HTTP/1.1\r\nAuthorization: Basic %s\r\n\r\n",
+             credentials);
+    divulge_process_request(divulge, &connection, request_text, strlen(request_text), response_buffer,
+                            sizeof(response_buffer));
+    return strstr(connection.output, "HTTP/1.1 200") ? 200 : 401;
+}
+
+static void sleep_ms(long milliseconds) {
+    struct timespec duration = {.tv_sec = 0, .tv_nsec = milliseconds * 1000000L};
+    nanosleep(&duration, NULL);
+}
+
+static void test_without_cache_always_calls_back(void** state) {
+    divulge_t* divulge = create_divulge(divulge_basic_authentication_create("test", authenticate_user, NULL));
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    assert_int_equal(request(divulge, WRONG_CREDENTIALS), 401);
+    assert_int_equal(callback_count, 3);
+}
+
+static void test_caches_verified_credentials(void** state) {
+    divulge_t* divulge = create_divulge(create_cached_authentication(20, 0));
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    assert_int_equal(callback_count, 1);
+    assert_int_equal(request(divulge, WRONG_CREDENTIALS), 401);
+    assert_int_equal(request(divulge, WRONG_CREDENTIALS), 401);
+    assert_int_equal(callback_count, 3);
+    sleep_ms(40);
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    assert_int_equal(callback_count, 4);
+}
+
+static void test_caches_rejections(void** state) {
+    divulge_t* divulge = create_divulge(create_cached_authentication(0, 10000));
+    assert_int_equal(request(divulge, WRONG_CREDENTIALS), 401);
+    valid_password = "wrong";
+    assert_int_equal(request(divulge, WRONG_CREDENTIALS), 401);
+    assert_int_equal(callback_count, 1);
+}
+
+static void test_forgets_credentials(void** state) {
+    divulge_handler_object_t* authentication = create_cached_authentication(0, 0);
+    divulge_t* divulge = create_divulge(authentication);
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    divulge_basic_authentication_forget_user(authentication, "other");
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    assert_int_equal(callback_count, 1);
+    valid_password = "changed";
+    divulge_basic_authentication_forget_user(authentication, "user");
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 401);
+    assert_int_equal(callback_count, 2);
+    valid_password = "pass:word";
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    divulge_basic_authentication_forget_all(authentication);
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    assert_int_equal(callback_count, 4);
+}
+
+static void test_forgets_credentials_being_checked(void** state) {
+    divulge_handler_object_t* authentication = create_cached_authentication(10000, 0);
+    divulge_t* divulge = create_divulge(authentication);
+    forgotten_during_check = authentication;
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 200);
+    valid_password = "changed";
+    assert_int_equal(request(divulge, USER_CREDENTIALS), 401);
+    assert_int_equal(callback_count, 2);
+}
+
+static void test_rejects_oversized_credentials(void** state) {
+    divulge_t* divulge = create_divulge(create_cached_authentication(0, 0));
+    char credentials[DIVULGE_BASIC_AUTHENTICATION_MAX_CREDENTIALS_SIZE + 5];
+    memset(credentials, 'A', sizeof(credentials) - 1);
+    credentials[sizeof(credentials) - 1] = '\0';
+    assert_int_equal(request(divulge, credentials), 401);
+    assert_int_equal(callback_count, 0);
+}
+
+static void test_escapes_realm(void** state) {
+    divulge_t* divulge = create_divulge(divulge_basic_authentication_create("a \"b\"", authenticate_user, NULL));
+    char response_buffer[256];
+    connection_t connection = {0};
+    const char* request_text = "GET /private HTTP/1.1\r\n\r\n";
+    divulge_process_request(divulge, &connection, request_text, strlen(request_text), response_buffer,
+                            sizeof(response_buffer));
+    assert_non_null(strstr(connection.output, "WWW-Authenticate: Basic realm=\"a \\\"b\\\"\"\r\n"));
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_without_cache_always_calls_back),
+        cmocka_unit_test(test_caches_verified_credentials),
+        cmocka_unit_test(test_caches_rejections),
+        cmocka_unit_test(test_forgets_credentials),
+        cmocka_unit_test(test_forgets_credentials_being_checked),
+        cmocka_unit_test(test_rejects_oversized_credentials),
+        cmocka_unit_test(test_escapes_realm),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,515 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "divulge-body.h"
+#include "divulge.h"
+#include "test-divulge-transport.h"
+
+typedef struct upload {
+    divulge_deferred_t* deferred;
+    char data[4096];
+    size_t size;
+    size_t piece_count;
+    size_t max_piece_size;
+    size_t abort_after;
+    bool has_ended;
+    bool was_cancelled;
+} upload_t;
+
+static upload_t upload;
+static upload_t* allocated_upload;
+static size_t handler_count;
+
+static bool on_data(void* context, const char* data, size_t size) {
+    upload_t* upload = context;
+    if ((upload->abort_after > 0) && ((upload->size + size) >= upload->abort_after)) {
+        return false;
+    }
+    if ((upload->size + size) <= sizeof(upload->data)) {
+        memcpy(upload->data + upload->size, data, size);
+    }
+    upload->size += size;
+    upload->piece_count++;
+    upload->max_piece_size = (size > upload->max_piece_size) ? size : upload->max_piece_size;
+    return true;
+}
+
+static void on_end(void* context) {
+    upload_t* upload = context;
+    char text[32];
+    snprintf(text, sizeof(text), "received %zu", upload->size);
+    divulge_response_t response = {.return_code = 200, .payload = text, .payload_size = strlen(text)};
+    upload->has_ended = true;
+    divulge_deferred_respond(upload->deferred, &response);
+}
+
+static void on_cancel(void* context) {
+    upload_t* upload = context;
+    upload->was_cancelled = true;
+    divulge_deferred_respond(upload->deferred, &(divulge_response_t){.return_code = 500});
+}
+
+static bool upload_handler(divulge_request_t* request, void* context) {
+    handler_count++;
+    divulge_body_reader_t reader = {.on_data = on_data, .on_end = on_end, .context = &upload};
+    upload.deferred = divulge_read_body(request, &reader);
+    assert_non_null(upload.deferred);
+    divulge_deferred_set_cancel_callback(upload.deferred, on_cancel, &upload);
+    return true;
+}
+
+static bool allocated_upload_handler(divulge_request_t* request, void* context) {
+    handler_count++;
+    allocated_upload = divulge_request_alloc(request, sizeof(upload_t));
+    assert_non_null(allocated_upload);
+    memset(allocated_upload, 0, sizeof(upload_t));
+    divulge_body_reader_t reader = {.on_data = on_data, .on_end = on_end, .context = allocated_upload};
+    allocated_upload->deferred = divulge_read_body(request, &reader);
+    assert_non_null(allocated_upload->deferred);
+    return true;
+}
+
+static bool scribbling_handler(divulge_request_t* request, void* context) {
+    handler_count++;
+    void* memory = divulge_request_alloc(request, sizeof(upload_t));
+    assert_non_null(memory);
+    memset(memory, 0xff, sizeof(upload_t));
+    divulge_response_t response = {.return_code = 200, .payload = "", .payload_size = 0};
+    return divulge_respond(request, &response);
+}
+
+static bool payload_handler(divulge_request_t* request, void* context) {
+    handler_count++;
+    divulge_response_t response = {
+        .return_code = 200,
+        .payload = request->payload.data,
+        .payload_size = request->payload.size,
+    };
+    return divulge_respond(request, &response);
+}
+
+static divulge_uri_t upload_uri = {
+    .uri = "/upload",
+    .method = DIVULGE_ROUTE_METHOD_POST,
+    .handler = {.handler = upload_handler},
+    .is_streaming_body = true,
+};
+
+static divulge_uri_t allocated_upload_uri = {
+    .uri = "/allocated-upload",
+    .method = DIVULGE_ROUTE_METHOD_POST,
+    .handler = {.handler = allocated_upload_handler},
+    .is_streaming_body = true,
+};
+
+static divulge_uri_t scribbling_uri = {
+    .uri = "/scribble",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = scribbling_handler},
+};
+
+static divulge_uri_t payload_uri = {
+    .uri = "/payload",
+    .method = DIVULGE_ROUTE_METHOD_POST,
+    .handler = {.handler = payload_handler},
+};
+
+static divulge_t* create_divulge(size_t connection_buffer_size, size_t max_request_body_size) {
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .close = socket_close,
+        .resume = socket_resume,
+        .connection_buffer_size = connection_buffer_size,
+        .max_request_body_size = max_request_body_size,
+    };
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_register_uri(divulge, &upload_uri);
+    divulge_register_uri(divulge, &payload_uri);
+    divulge_register_uri(divulge, &allocated_upload_uri);
+    divulge_register_uri(divulge, &scribbling_uri);
+    memset(&upload, 0, sizeof(upload));
+    handler_count = 0;
+    return divulge;
+}
+
+/*
+ * Like a transport, writes as much as the receive buffer takes at a time.
+ */
+static bool receive_bytes(divulge_connection_t* divulge_connection, const char* data, size_t data_size) {
+    do {
+        size_t buffer_size = 0;
+        char* buffer = divulge_connection_get_receive_buffer(divulge_connection, &buffer_size);
+        assert_true(buffer_size > 0);
+        size_t size = (data_size < buffer_size) ? data_size : buffer_size;
+        memcpy(buffer, data, size);
+        if (!divulge_connection_receive(divulge_connection, size)) {
+            return false;
+        }
+        data += size;
+        data_size -= size;
+    } while (data_size > 0);
+    return true;
+}
+
+static bool receive(divulge_connection_t* divulge_connection, const char* data) {
+    return receive_bytes(divulge_connection, data, strlen(data));
+}
+
+static divulge_body_status_t decode(divulge_body_decoder_t* decoder,
+                                    char* data,
+                                    const char* text,
+                                    size_t* consumed,
+                                    size_t* produced) {
+    strcpy(data, text);
+    return divulge_body_decode(decoder, data, strlen(text), consumed, produced);
+}
+
+static void test_chunked_body_is_decoded_in_place(void** state) {
+    divulge_body_decoder_t decoder;
+    divulge_body_decoder_initialize(&decoder, true, 0, 1024);
+    char data[128];
+    size_t consumed = 0;
+    size_t produced = 0;
+    const char* text = "4\r\nWiki\r\n5;name=value\r\npedia\r\nE\r\n in\r\n\r\nchunks.\r\n0\r\nX-Trailer: 1\r\n\r\nGET";
+    assert_int_equal(decode(&decoder, data, text, &consumed, &produced), DIVULGE_BODY_STATUS_COMPLETE);
+    assert_int_equal(consumed, strlen(text) - 3);
+    assert_int_equal(produced, 23);
+    assert_memory_equal(data, "Wikipedia in\r\n\r\nchunks.", produced);
+    assert_int_equal(decoder.decoded_size, 23);
+}
+
+static void test_chunked_body_split_anywhere(void** state) {
+    const char* text = "a\r\n0123456789\r\n3\r\nabc\r\n0\r\n\r\n";
+    size_t size = strlen(text);
+    for (size_t split = 1; split < size; split++) {
+        divulge_body_decoder_t decoder;
+        divulge_body_decoder_initialize(&decoder, true, 0, 1024);
+        char data[64];
+        memcpy(data, text, size);
+        size_t consumed = 0;
+        size_t first = 0;
+        size_t second = 0;
+        assert_int_equal(divulge_body_decode(&decoder, data, split, &consumed, &first),
+                         DIVULGE_BODY_STATUS_INCOMPLETE);
+        assert_int_equal(consumed, split);
+        char* rest = data + split;
+        assert_int_equal(divulge_body_decode(&decoder, rest, size - split, &consumed, &second),
+                         DIVULGE_BODY_STATUS_COMPLETE);
+        assert_int_equal(consumed, size - split);
+        assert_int_equal(first + second, 13);
+        memmove(data + first, rest, second);
+        assert_memory_equal(data, "0123456789abc", 13);
+    }
+}
+
+static void test_malformed_chunks(void** state) {
+    const char* texts[] = {"x\r\n", ";a\r\n", "4\nWiki", "4\r\nWikiX\r\n", "4 x\n", "0\r\n\r\r"};
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+        divulge_body_decoder_t decoder;
+        divulge_body_decoder_initialize(&decoder, true, 0, 1024);
+        char data[32];
+        size_t consumed = 0;
+        size_t produced = 0;
+        assert_int_equal(decode(&decoder, data, texts[i], &consumed, &produced), DIVULGE_BODY_STATUS_ERROR);
+        assert_int_equal(decoder.error, DIVULGE_BODY_ERROR_BAD_CHUNK);
+        assert_int_equal(divulge_body_get_error_status(&decoder), 400);
+    }
+}
+
+static void test_body_too_large(void** state) {
+    divulge_body_decoder_t decoder;
+    char data[64];
+    size_t consumed = 0;
+    size_t produced = 0;
+    divulge_body_decoder_initialize(&decoder, false, 100, 10);
+    assert_int_equal(decoder.error, DIVULGE_BODY_ERROR_TOO_LARGE);
+    assert_int_equal(divulge_body_get_error_status(&decoder), 413);
+    divulge_body_decoder_initialize(&decoder, true, 0, 10);
+    assert_int_equal(decode(&decoder, data, "8\r\n01234567\r\n3\r\n", &consumed, &produced),
+                     DIVULGE_BODY_STATUS_ERROR);
+    assert_int_equal(decoder.error, DIVULGE_BODY_ERROR_TOO_LARGE);
+    divulge_body_decoder_initialize(&decoder, true, 0, SIZE_MAX);
+    assert_int_equal(decode(&decoder, data, "fffffffffffffffff\r\n", &consumed, &produced), DIVULGE_BODY_STATUS_ERROR);
+    assert_int_equal(decoder.error, DIVULGE_BODY_ERROR_TOO_LARGE);
+}
+
+static void test_content_length_body(void** state) {
+    divulge_body_decoder_t decoder;
+    char data[64];
+    size_t consumed = 0;
+    size_t produced = 0;
+    divulge_body_decoder_initialize(&decoder, false, 6, 10);
+    assert_int_equal(decode(&decoder, data, "abcd", &consumed, &produced), DIVULGE_BODY_STATUS_INCOMPLETE);
+    assert_int_equal(produced, 4);
+    assert_int_equal(decode(&decoder, data, "efGET", &consumed, &produced), DIVULGE_BODY_STATUS_COMPLETE);
+    assert_int_equal(consumed, 2);
+    assert_int_equal(produced, 2);
+    divulge_body_decoder_initialize(&decoder, false, 0, 10);
+    assert_int_equal(decode(&decoder, data, "GET", &consumed, &produced), DIVULGE_BODY_STATUS_COMPLETE);
+    assert_int_equal(consumed, 0);
+}
+
+static void test_streamed_upload_with_content_length(void** state) {
+    divulge_t* divulge = create_divulge(128, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "POST /upload HTTP/1.1\r\nContent-Length: 1000\r\n\r\n0123456789"));
+    assert_int_equal(handler_count, 1);
+    char piece[100];
+    for (size_t i = 0; i < 9; i++) {
+        memset(piece, 'a' + (char)i, sizeof(piece));
+        assert_true(receive_bytes(divulge_connection, piece, sizeof(piece)));
+    }
+    assert_false(upload.has_ended);
+    assert_true(receive(divulge_connection, "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz"
+                                            "ijklmnopqrstuvwxyzPOST /payload HTTP/1.1\r\n\r\n"));
+    assert_true(upload.has_ended);
+    assert_int_equal(upload.size, 1000);
+    assert_true(upload.max_piece_size <= 128);
+    assert_memory_equal(upload.data, "0123456789aaa", 13);
+    assert_int_equal(upload.data[999], 'z');
+    assert_int_equal(connection.resume_count, 1);
+    assert_null(strstr(connection.output, "HTTP/1.1 200"));
+    assert_true(divulge_connection_resume(divulge_connection));
+    assert_non_null(strstr(connection.output, "received 1000"));
+    assert_non_null(strstr(connection.output, "Content-Length: 0\r\n"));
+    assert_int_equal(handler_count, 2);
+    assert_int_equal(connection.close_count, 0);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_streamed_upload_with_chunked_body(void** state) {
+    divulge_t* divulge = create_divulge(128, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"));
+    assert_int_equal(handler_count, 0);
+    char chunk[64];
+    for (size_t i = 0; i < 40; i++) {
+        snprintf(chunk, sizeof(chunk), "14\r\n%020zu\r\n", i);
+        assert_true(receive(divulge_connection, chunk));
+    }
+    assert_int_equal(handler_count, 1);
+    assert_true(receive(divulge_connection, "0\r\n\r\n"));
+    assert_true(upload.has_ended);
+    assert_int_equal(upload.size, 800);
+    assert_true(upload.max_piece_size <= 128);
+    assert_memory_equal(upload.data + 780, "00000000000000000039", 20);
+    assert_true(divulge_connection_resume(divulge_connection));
+    assert_non_null(strstr(connection.output, "received 800"));
+    assert_int_equal(connection.close_count, 0);
+    divulge_connection_destroy(divulge_connection);
+}
+
+/*
+ * The reader context lives in the request arena, while another request on the same thread takes memory of its own.
+ */
+static void test_reader_context_in_request_memory(void** state) {
+    divulge_t* divulge = create_divulge(128, 0);
+    connection_t connection = {0};
+    connection_t other_connection = {0};
+    divulge_connection_t* uploading = divulge_connection_create(divulge, &connection);
+    divulge_connection_t* other = divulge_connection_create(divulge, &other_connection);
+    assert_true(receive(uploading, "POST /allocated-upload HTTP/1.1\r\nContent-Length: 500\r\n\r\n"));
+    assert_int_equal(handler_count, 1);
+    assert_true(receive(other, "GET /scribble HTTP/1.1\r\n\r\n"));
+    assert_non_null(strstr(other_connection.output, "HTTP/1.1 200"));
+    char piece[100];
+    memset(piece, 'a', sizeof(piece));
+    for (size_t i = 0; i < 5; i++) {
+        assert_true(receive_bytes(uploading, piece, sizeof(piece)));
+    }
+    assert_true(divulge_connection_resume(uploading));
+    assert_non_null(strstr(connection.output, "received 500"));
+    divulge_connection_destroy(other);
+    divulge_connection_destroy(uploading);
+}
+
+static void test_buffered_chunked_body(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "POST /payload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n4\r\nWi"));
+    assert_true(receive(divulge_connection,
+                        "ki\r\n5\r\npedia\r\n0\r\n\r\n"
+                        "POST /payload HTTP/1.1\r\nContent-Length: 2\r\n\r\nok"));
+    assert_int_equal(handler_count, 2);
+    assert_non_null(strstr(connection.output, "Content-Length: 9\r\n\r\nWikipedia"));
+    assert_non_null(strstr(connection.output, "Content-Length: 2\r\n\r\nok"));
+    assert_int_equal(connection.close_count, 0);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_buffered_body_read_in_one_piece(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "POST /upload HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"));
+    assert_true(upload.has_ended);
+    assert_int_equal(upload.piece_count, 1);
+    assert_memory_equal(upload.data, "hello", 5);
+    assert_true(divulge_connection_resume(divulge_connection));
+    assert_non_null(strstr(connection.output, "received 5"));
+    divulge_connection_destroy(divulge_connection);
+    divulge = create_divulge(0, 0);
+    memset(&connection, 0, sizeof(connection));
+    divulge_connection = divulge_connection_create(divulge, &connection);
+    upload.abort_after = 3;
+    assert_false(receive(divulge_connection, "POST /upload HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"));
+    assert_true(upload.was_cancelled);
+    assert_false(upload.has_ended);
+    assert_int_equal(connection.output_size, 0);
+    assert_int_equal(connection.close_count, 1);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_expect_continue(void** state) {
+    divulge_t* divulge = create_divulge(128, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(
+        receive(divulge_connection, "POST /payload HTTP/1.1\r\nContent-Length: 2\r\nExpect: 100-continue\r\n\r\n"));
+    assert_string_equal(connection.output, "HTTP/1.1 100 Continue\r\n\r\n");
+    assert_true(receive(divulge_connection, "ok"));
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+    connection.output_size = 0;
+    connection.output[0] = '\0';
+    assert_true(
+        receive(divulge_connection, "POST /upload HTTP/1.1\r\nContent-Length: 500\r\nExpect: 100-continue\r\n\r\n"));
+    assert_int_equal(handler_count, 2);
+    assert_string_equal(connection.output, "HTTP/1.1 100 Continue\r\n\r\n");
+    divulge_connection_destroy(divulge_connection);
+    assert_true(upload.was_cancelled);
+}
+
+static void test_large_body_refused_before_it_is_sent(void** state) {
+    divulge_t* divulge = create_divulge(128, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_false(
+        receive(divulge_connection, "POST /payload HTTP/1.1\r\nContent-Length: 500\r\nExpect: 100-continue\r\n\r\n"));
+    assert_null(strstr(connection.output, "100 Continue"));
+    assert_non_null(strstr(connection.output, "HTTP/1.1 413"));
+    assert_non_null(strstr(connection.output, "Connection: close\r\n"));
+    assert_int_equal(connection.close_count, 1);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_body_over_limit(void** state) {
+    divulge_t* divulge = create_divulge(128, 300);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_false(receive(divulge_connection, "POST /upload HTTP/1.1\r\nContent-Length: 500\r\n\r\n"));
+    assert_int_equal(handler_count, 0);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 413"));
+    divulge_connection_destroy(divulge_connection);
+    divulge = create_divulge(128, 30);
+    memset(&connection, 0, sizeof(connection));
+    divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"));
+    assert_false(receive(divulge_connection, "14\r\n01234567890123456789\r\n14\r\n"));
+    assert_non_null(strstr(connection.output, "HTTP/1.1 413"));
+    assert_int_equal(connection.close_count, 1);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_unsupported_expectation(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_false(receive(divulge_connection, "POST /payload HTTP/1.1\r\nContent-Length: 2\r\nExpect: later\r\n\r\nok"));
+    assert_non_null(strstr(connection.output, "HTTP/1.1 417"));
+    assert_int_equal(handler_count, 0);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_reader_aborts_upload(void** state) {
+    divulge_t* divulge = create_divulge(128, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    upload.abort_after = 150;
+    assert_true(receive(divulge_connection, "POST /upload HTTP/1.1\r\nContent-Length: 1000\r\n\r\n"));
+    char piece[100];
+    memset(piece, 'a', sizeof(piece));
+    assert_true(receive_bytes(divulge_connection, piece, sizeof(piece)));
+    assert_false(receive_bytes(divulge_connection, piece, sizeof(piece)));
+    assert_true(upload.was_cancelled);
+    assert_int_equal(connection.close_count, 1);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_malformed_streamed_chunk(void** state) {
+    divulge_t* divulge = create_divulge(64, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"));
+    assert_true(receive(divulge_connection, "14\r\n01234567890123456789\r\n"));
+    assert_int_equal(handler_count, 1);
+    assert_false(receive(divulge_connection, "zz\r\n"));
+    assert_true(upload.was_cancelled);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 400"));
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_process_request_with_chunked_body(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    char response_buffer[1024];
+    const char* request =
+        "POST /payload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n";
+    divulge_process_request(divulge, &connection, request, strlen(request), response_buffer, sizeof(response_buffer));
+    assert_non_null(strstr(connection.output, "Content-Length: 5\r\nConnection: close\r\n\r\nabcde"));
+    assert_int_equal(connection.close_count, 1);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_chunked_body_is_decoded_in_place),
+        cmocka_unit_test(test_chunked_body_split_anywhere),
+        cmocka_unit_test(test_malformed_chunks),
+        cmocka_unit_test(test_body_too_large),
+        cmocka_unit_test(test_content_length_body),
+        cmocka_unit_test(test_streamed_upload_with_content_length),
+        cmocka_unit_test(test_streamed_upload_with_chunked_body),
+        cmocka_unit_test(test_reader_context_in_request_memory),
+        cmocka_unit_test(test_buffered_chunked_body),
+        cmocka_unit_test(test_buffered_body_read_in_one_piece),
+        cmocka_unit_test(test_expect_continue),
+        cmocka_unit_test(test_large_body_refused_before_it_is_sent),
+        cmocka_unit_test(test_body_over_limit),
+        cmocka_unit_test(test_unsupported_expectation),
+        cmocka_unit_test(test_reader_aborts_upload),
+        cmocka_unit_test(test_malformed_streamed_chunk),
+        cmocka_unit_test(test_process_request_with_chunked_body),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,340 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "divulge-cache.h"
+#ifdef DIVULGE_COMPRESSION
+#include "divulge-compression.h"
+#include "test-divulge-transport.h"
+#endif
+
+#define CONCURRENT_THREAD_COUNT (8)
+
+static atomic_uint call_count;
+static char large_body[2048];
+#ifdef DIVULGE_COMPRESSION
+static divulge_compressed_payload_t* compressed_payload;
+#endif
+
+static void sleep_ms(long milliseconds) {
+    struct timespec duration = {.tv_sec = 0, .tv_nsec = milliseconds * 1000000L};
+    nanosleep(&duration, NULL);
+}
+
+static bool counting_handler(divulge_request_t* request, void* context) {
+    char body[128];
+    unsigned count = atomic_fetch_add(&call_count, 1) + 1;
+    snprintf(body, sizeof(body), "%.*s?%.*s #%u", (int)request->route.size, request->route.data,
+             (int)request->url_query.size, request->url_query.data, count);
+    divulge_response_t response = {.return_code = 200, .payload = body, .payload_size = strlen(body)};
+    return divulge_respond(request, &response);
+}
+
+static bool slow_handler(divulge_request_t* request, void* context) {
+    sleep_ms(50);
+    return counting_handler(request, context);
+}
+
+static bool missing_handler(divulge_request_t* request, void* context) {
+    atomic_fetch_add(&call_count, 1);
+    divulge_response_t response = {.return_code = 404, .payload = "missing", .payload_size = 7};
+    return divulge_respond(request, &response);
+}
+
+static bool large_handler(divulge_request_t* request, void* context) {
+    atomic_fetch_add(&call_count, 1);
+    divulge_response_t response = {.return_code = 200, .payload = large_body, .payload_size = sizeof(large_body)};
+    return divulge_respond(request, &response);
+}
+
+/*
+ * Responds with the header given as "name:value" in the `header` query parameter.
+ */
+static bool header_handler(divulge_request_t* request, void* context) {
+    atomic_fetch_add(&call_count, 1);
+    char header[64] = "";
+    divulge_slice_t value;
+    if (divulge_find_query_parameter(request, "header", &value)) {
+        snprintf(header, sizeof(header), "%.*s", (int)value.size, value.data);
+    }
+    char* separator = strchr(header, ':');
+    assert_non_null(separator);
+    *separator = '\0';
+    divulge_header_entry_t header_entries[] = {{.key = header, .value = separator + 1}};
+    divulge_response_t response = {
+        .return_code = 200,
+        .header = {.count = 1, .entries = header_entries},
+        .payload = "varying",
+        .payload_size = 7,
+    };
+    return divulge_respond(request, &response);
+}
+
+#ifdef DIVULGE_COMPRESSION
+static bool compressed_handler(divulge_request_t* request, void* context) {
+    atomic_fetch_add(&call_count, 1);
+    return divulge_respond_compressed(request, 200, compressed_payload);
+}
+#endif
+
+static void add_cached_route(divulge_t* divulge,
+                             const char* uri,
+                             divulge_route_method_t method,
+                             divulge_uri_handler_t handler,
+                             divulge_handler_object_t* cache) {
+    divulge_uri_t route = {.uri = uri, .method = method, .handler = {.handler = handler}};
+    divulge_register_uri(divulge, &route);
+    divulge_add_middleware_to_uri(divulge, &route, cache);
+}
+
+static divulge_t* create_divulge(unsigned time_to_live_ms) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_cache_configuration_t cache_configuration = {
+        .time_to_live_ms = time_to_live_ms,
+        .max_entry_size = 1024,
+        .max_wait_ms = 1000,
+    };
+    divulge_handler_object_t* cache = divulge_cache_create(&cache_configuration);
+    assert_non_null(cache);
+    add_cached_route(divulge, "/count", DIVULGE_ROUTE_METHOD_GET, counting_handler, cache);
+    add_cached_route(divulge, "/count", DIVULGE_ROUTE_METHOD_POST, counting_handler, cache);
+    add_cached_route(divulge, "/slow", DIVULGE_ROUTE_METHOD_GET, slow_handler, cache);
+    add_cached_route(divulge, "/missing", DIVULGE_ROUTE_METHOD_GET, missing_handler, cache);
+    add_cached_route(divulge, "/large", DIVULGE_ROUTE_METHOD_GET, large_handler, cache);
+    add_cached_route(divulge, "/header", DIVULGE_ROUTE_METHOD_GET, header_handler, cache);
+#ifdef DIVULGE_COMPRESSION
+    add_cached_route(divulge, "/compressed", DIVULGE_ROUTE_METHOD_GET, compressed_handler, cache);
+#endif
+    atomic_store(&call_count, 0);
+    return divulge;
+}
+
+static void process(divulge_t* divulge, connection_t* connection, const char* request) {
+    char response_buffer[256];
+    memset(connection, 0, sizeof(*connection));
+    divulge_process_request(divulge, connection, request, strlen(request), response_buffer, sizeof(response_buffer));
+}
+
+static void test_replays_cached_response(void** state) {
+    divulge_t* divulge = create_divulge(10000);
+    connection_t first;
+    connection_t second;
+    process(divulge, &first, "GET /count HTTP/1.1\r\n\r\n");
+    process(divulge, &second, "GET /count HTTP/1.1\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 1);
+    assert_non_null(strstr(second.output, "HTTP/1.1 200"));
+    assert_non_null(strstr(second.output, "Connection: close\r\n\r\n/count? #1"));
+    assert_string_equal(first.output, second.output);
+}
+
+static void test_head_uses_get_entries(void** state) {
+    divulge_t* divulge = create_divulge(10000);
+    connection_t connection;
+    process(divulge, &connection, "HEAD /count HTTP/1.1\r\n\r\n");
+    assert_string_equal(strstr(connection.output, "Content-Length"), "Content-Length: 10\r\nConnection: close\r\n\r\n");
+    process(divulge, &connection, "GET /count HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "\r\n\r\n/count? #2"));
+    process(divulge, &connection, "HEAD /count HTTP/1.1\r\n\r\n");
+    assert_string_equal(strstr(connection.output, "Content-Length"), "Content-Length: 10\r\nConnection: close\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 2);
+}
+
+static void test_normalizes_query(void** state) {
+    divulge_t* divulge = create_divulge(10000);
+    connection_t connection;
+    process(divulge, &connection, "GET /count?b=2&a=1 HTTP/1.1\r\n\r\n");
+    process(divulge, &connection, "GET /count?a=1&&b=2 HTTP/1.1\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 1);
+    assert_non_null(strstr(connection.output, "/count?b=2&a=1 #1"));
+    process(divulge, &connection, "GET /count?a=2&b=1 HTTP/1.1\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 2);
+}
+
+static void test_expires_entries(void** state) {
+    divulge_t* divulge = create_divulge(20);
+    connection_t connection;
+    process(divulge, &connection, "GET /count HTTP/1.1\r\n\r\n");
+    process(divulge, &connection, "GET /count HTTP/1.1\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 1);
+    sleep_ms(40);
+    process(divulge, &connection, "GET /count HTTP/1.1\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 2);
+    assert_non_null(strstr(connection.output, "#2"));
+}
+
+static void test_skips_uncacheable_responses(void** state) {
+    divulge_t* divulge = create_divulge(10000);
+    connection_t connection;
+    process(divulge, &connection, "POST /count HTTP/1.1\r\n\r\n");
+    process(divulge, &connection, "POST /count HTTP/1.1\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 2);
+    process(divulge, &connection, "GET /missing HTTP/1.1\r\n\r\n");
+    process(divulge, &connection, "GET /missing HTTP/1.1\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 4);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 404"));
+    process(divulge, &connection, "GET /large HTTP/1.1\r\n\r\n");
+    process(divulge, &connection, "GET /large HTTP/1.1\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 6);
+    process(divulge, &connection, "GET /header?header=Vary:Cookie HTTP/1.1\r\nCookie: a\r\n\r\n");
+    process(divulge, &connection, "GET /header?header=Vary:Cookie HTTP/1.1\r\nCookie: b\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 8);
+}
+
+static void test_skips_private_responses(void** state) {
+    const char* requests[] = {
+        "GET /header?header=Set-Cookie:id=1 HTTP/1.1\r\n\r\n",
+        "GET /header?header=Cache-Control:max-age=60,no-store HTTP/1.1\r\n\r\n",
+        "GET /header?header=Cache-Control:private HTTP/1.1\r\n\r\n",
+        "GET /count HTTP/1.1\r\nAuthorization: Basic dXNlcjpwYXNz\r\n\r\n",
+    };
+    divulge_t* divulge = create_divulge(10000);
+    connection_t connection;
+    for (size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+        process(divulge, &connection, requests[i]);
+        process(divulge, &connection, requests[i]);
+        assert_int_equal(atomic_load(&call_count), 2 * (i + 1));
+    }
+    process(divulge, &connection, "GET /header?header=Cache-Control:public HTTP/1.1\r\n\r\n");
+    process(divulge, &connection, "GET /header?header=Cache-Control:public HTTP/1.1\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 9);
+}
+
+#ifdef DIVULGE_COMPRESSION
+static void test_keys_entries_by_content_coding(void** state) {
+    divulge_t* divulge = create_divulge(10000);
+    connection_t connection;
+    process(divulge, &connection, "GET /compressed HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n");
+    assert_non_null(strstr(connection.output, "Content-Encoding: gzip\r\n"));
+    process(divulge, &connection, "GET /compressed HTTP/1.1\r\n\r\n");
+    assert_null(strstr(connection.output, "Content-Encoding"));
+    assert_non_null(strstr(connection.output, "\r\n\r\nlorem ipsum"));
+    assert_int_equal(atomic_load(&call_count), 2);
+    process(divulge, &connection, "GET /compressed HTTP/1.1\r\nAccept-Encoding: deflate;q=0.5, gzip\r\n\r\n");
+    assert_non_null(strstr(connection.output, "Content-Encoding: gzip\r\n"));
+    process(divulge, &connection, "GET /compressed HTTP/1.1\r\nAccept-Encoding: gzip;q=0\r\n\r\n");
+    assert_null(strstr(connection.output, "Content-Encoding"));
+    assert_int_equal(atomic_load(&call_count), 2);
+    process(divulge, &connection, "GET /compressed HTTP/1.1\r\nAccept-Encoding: deflate\r\n\r\n");
+    assert_non_null(strstr(connection.output, "Content-Encoding: deflate\r\n"));
+    assert_int_equal(atomic_load(&call_count), 3);
+}
+#endif
+
+static void test_connection_header_follows_request(void** state) {
+    divulge_t* divulge = create_divulge(10000);
+    connection_t connection = {0};
+    divulge_connection_t* persistent = divulge_connection_create(divulge, &connection);
+    size_t size = 0;
+    char* buffer = divulge_connection_get_receive_buffer(persistent, &size);
+    const char* request = "GET /count HTTP/1.1\r\n\r\n";
+    memcpy(buffer, request, strlen(request));
+    assert_true(divulge_connection_receive(persistent, strlen(request)));
+    assert_null(strstr(connection.output, "Connection:"));
+    divulge_connection_destroy(persistent);
+
+    process(divulge, &connection, "GET /count HTTP/1.0\r\n\r\n");
+    assert_int_equal(atomic_load(&call_count), 1);
+    assert_non_null(strstr(connection.output, "Connection: close\r\n\r\n/count? #1"));
+}
+
+static void* request_slow_route(void* argument) {
+    connection_t* connection = calloc(1, sizeof(connection_t));
+    process(argument, connection, "GET /slow HTTP/1.1\r\n\r\n");
+    bool is_served = strstr(connection->output, "/slow? #1") != NULL;
+    free(connection);
+    return is_served ? argument : NULL;
+}
+
+static void test_coalesces_concurrent_misses(void** state) {
+    divulge_t* divulge = create_divulge(10000);
+    pthread_t threads[CONCURRENT_THREAD_COUNT];
+    for (size_t i = 0; i < CONCURRENT_THREAD_COUNT; i++) {
+        pthread_create(threads + i, NULL, request_slow_route, divulge);
+    }
+    for (size_t i = 0; i < CONCURRENT_THREAD_COUNT; i++) {
+        void* result = NULL;
+        pthread_join(threads[i], &result);
+        assert_ptr_equal(result, divulge);
+    }
+    assert_int_equal(atomic_load(&call_count), 1);
+}
+
+static void test_stops_waiting_for_slow_responses(void** state) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_cache_configuration_t cache_configuration = {.time_to_live_ms = 10000, .max_wait_ms = 5};
+    divulge_handler_object_t* cache = divulge_cache_create(&cache_configuration);
+    add_cached_route(divulge, "/slow", DIVULGE_ROUTE_METHOD_GET, slow_handler, cache);
+    atomic_store(&call_count, 0);
+    pthread_t filling;
+    pthread_create(&filling, NULL, request_slow_route, divulge);
+    sleep_ms(10);
+    connection_t connection;
+    process(divulge, &connection, "GET /slow HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "/slow? #2"));
+    void* result = NULL;
+    pthread_join(filling, &result);
+    assert_ptr_equal(result, divulge);
+    assert_int_equal(atomic_load(&call_count), 2);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_replays_cached_response),
+        cmocka_unit_test(test_head_uses_get_entries),
+        cmocka_unit_test(test_normalizes_query),
+        cmocka_unit_test(test_expires_entries),
+        cmocka_unit_test(test_skips_uncacheable_responses),
+        cmocka_unit_test(test_skips_private_responses),
+        cmocka_unit_test(test_connection_header_follows_request),
+        cmocka_unit_test(test_coalesces_concurrent_misses),
+        cmocka_unit_test(test_stops_waiting_for_slow_responses),
+#ifdef DIVULGE_COMPRESSION
+        cmocka_unit_test(test_keys_entries_by_content_coding),
+#endif
+    };
+#ifdef DIVULGE_COMPRESSION
+    char text[512];
+    for (size_t i = 0; i < sizeof(text); i++) {
+        text[i] = "lorem ipsum "[i % 12];
+    }
+    compressed_payload = divulge_compressed_payload_create("text/plain", text, sizeof(text));
+#endif
+    int result = cmocka_run_group_tests(tests, NULL, NULL);
+#ifdef DIVULGE_COMPRESSION
+    divulge_compressed_payload_destroy(compressed_payload);
+#endif
+    return result;
+}
@@ -0,0 +1,244 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "divulge-compression.h"
+#include "divulge-static.h"
+#include "test-divulge-transport.h"
+
+static divulge_compressed_payload_t* payload;
+static divulge_content_coding_t negotiated_coding;
+static char directory[64];
+static char text[1024];
+
+static bool negotiate_handler(divulge_request_t* request, void* context) {
+    negotiated_coding = divulge_negotiate_content_coding(request);
+    divulge_response_t response = {.return_code = 200};
+    return divulge_respond(request, &response);
+}
+
+static bool payload_handler(divulge_request_t* request, void* context) {
+    return divulge_respond_compressed(request, 200, payload);
+}
+
+static void make_path(char* path, size_t path_size) {
+    snprintf(path, path_size, "%s/page.html", directory);
+}
+
+static int set_up(void** state) {
+    for (size_t i = 0; i < sizeof(text) - 1; i++) {
+        text[i] = "divulge "[i % 8];
+    }
+    payload = divulge_compressed_payload_create("text/plain", text, strlen(text));
+    strcpy(directory, "/tmp/divulge-compression-XXXXXX");
+    if (!payload || !mkdtemp(directory)) {
+        return -1;
+    }
+    char path[128];
+    make_path(path, sizeof(path));
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        return -1;
+    }
+    fputs(text, f);
+    fclose(f);
+    return 0;
+}
+
+static int tear_down(void** state) {
+    char path[128];
+    make_path(path, sizeof(path));
+    remove(path);
+    remove(directory);
+    divulge_compressed_payload_destroy(payload);
+    return 0;
+}
+
+static divulge_t* create_divulge(void) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_uri_t negotiate_uri = {
+        .uri = "/negotiate", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = negotiate_handler}};
+    divulge_uri_t payload_uri = {
+        .uri = "/payload", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = payload_handler}};
+    divulge_register_uri(divulge, &negotiate_uri);
+    divulge_register_uri(divulge, &payload_uri);
+    divulge_static_configuration_t static_configuration = {
+        .url_prefix = "/static",
+        .directory = directory,
+        .max_cached_file_size = sizeof(text),
+    };
+    divulge_handler_object_t* object = divulge_static_create(&static_configuration);
+    assert_non_null(object);
+    divulge_uri_t static_uri = {.uri = "/static/*", .method = DIVULGE_ROUTE_METHOD_GET, .handler = *object};
+    divulge_register_uri(divulge, &static_uri);
+    return divulge;
+}
+
+static void process(divulge_t* divulge, connection_t* connection, const char* request) {
+    char response_buffer[256];
+    memset(connection, 0, sizeof(*connection));
+    divulge_process_request(divulge, connection, request, strlen(request), response_buffer, sizeof(response_buffer));
+}
+
+static divulge_content_coding_t negotiate(divulge_t* divulge, const char* accept_encoding) {
+    char request[256];
+    connection_t connection;
+    snprintf(request, sizeof(request), "GET /negotiate HTTP/1.1\r\nAccept-Encoding: %s\r\n\r\n", accept_encoding);
+    negotiated_coding = DIVULGE_CONTENT_CODING_COUNT;
+    process(divulge, &connection, request);
+    return negotiated_coding;
+}
+
+static const char* get_body(const connection_t* connection, size_t* size) {
+    const char* body = strstr(connection->output, "\r\n\r\n");
+    assert_non_null(body);
+    body += 4;
+    *size = connection->output_size - (size_t)(body - connection->output);
+    return body;
+}
+
+static void assert_inflates_to_text(const char* data, size_t size, int window_bits) {
+    char inflated[sizeof(text)];
+    z_stream stream = {0};
+    assert_int_equal(inflateInit2(&stream, window_bits), Z_OK);
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = (uInt)size;
+    stream.next_out = (Bytef*)inflated;
+    stream.avail_out = sizeof(inflated);
+    assert_int_equal(inflate(&stream, Z_FINISH), Z_STREAM_END);
+    assert_int_equal(stream.total_out, strlen(text));
+    assert_memory_equal(inflated, text, strlen(text));
+    inflateEnd(&stream);
+}
+
+static void test_negotiates_content_coding(void** state) {
+    divulge_t* divulge = create_divulge();
+    assert_int_equal(negotiate(divulge, "identity"), DIVULGE_CONTENT_CODING_IDENTITY);
+    assert_int_equal(negotiate(divulge, "gzip"), DIVULGE_CONTENT_CODING_GZIP);
+    assert_int_equal(negotiate(divulge, "X-GZIP"), DIVULGE_CONTENT_CODING_GZIP);
+    assert_int_equal(negotiate(divulge, "deflate, gzip"), DIVULGE_CONTENT_CODING_GZIP);
+    assert_int_equal(negotiate(divulge, "gzip;q=0.5, deflate"), DIVULGE_CONTENT_CODING_DEFLATE);
+    assert_int_equal(negotiate(divulge, "gzip; q=0, deflate;q=0.001"), DIVULGE_CONTENT_CODING_DEFLATE);
+    assert_int_equal(negotiate(divulge, "gzip;q=0, deflate;q=0"), DIVULGE_CONTENT_CODING_IDENTITY);
+    assert_int_equal(negotiate(divulge, "*"), DIVULGE_CONTENT_CODING_GZIP);
+    assert_int_equal(negotiate(divulge, "*;q=0.2, gzip;q=0.1"), DIVULGE_CONTENT_CODING_DEFLATE);
+    assert_int_equal(negotiate(divulge, "br"), DIVULGE_CONTENT_CODING_IDENTITY);
+}
+
+static void test_detects_compressible_types(void** state) {
+    assert_true(divulge_is_compressible("text/html", 1024));
+    assert_true(divulge_is_compressible("text/css; charset=utf-8", 1024));
+    assert_true(divulge_is_compressible("application/json", 1024));
+    assert_true(divulge_is_compressible("application/ld+json", 1024));
+    assert_true(divulge_is_compressible("image/svg+xml", 1024));
+    assert_false(divulge_is_compressible("image/png", 1024));
+    assert_false(divulge_is_compressible("application/gzip", 1024));
+    assert_false(divulge_is_compressible("text/html", DIVULGE_COMPRESSION_MIN_SIZE - 1));
+}
+
+static void test_compresses_payload(void** state) {
+    char* data = NULL;
+    size_t size = 0;
+    assert_true(divulge_compress(DIVULGE_CONTENT_CODING_GZIP, text, strlen(text), &data, &size));
+    assert_true(size < strlen(text));
+    assert_inflates_to_text(data, size, 16 + MAX_WBITS);
+    free(data);
+    assert_true(divulge_compress(DIVULGE_CONTENT_CODING_DEFLATE, text, strlen(text), &data, &size));
+    assert_inflates_to_text(data, size, MAX_WBITS);
+    free(data);
+    assert_false(divulge_compress(DIVULGE_CONTENT_CODING_IDENTITY, text, strlen(text), &data, &size));
+}
+
+static void test_responds_with_negotiated_variant(void** state) {
+    divulge_t* divulge = create_divulge();
+    connection_t connection;
+    size_t size = 0;
+    process(divulge, &connection, "GET /payload HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n");
+    assert_non_null(strstr(connection.output, "Content-Encoding: gzip\r\n"));
+    assert_non_null(strstr(connection.output, "Vary: Accept-Encoding\r\n"));
+    const char* body = get_body(&connection, &size);
+    assert_inflates_to_text(body, size, 16 + MAX_WBITS);
+
+    process(divulge, &connection, "GET /payload HTTP/1.1\r\n\r\n");
+    assert_null(strstr(connection.output, "Content-Encoding"));
+    assert_non_null(strstr(connection.output, "Vary: Accept-Encoding\r\n"));
+    body = get_body(&connection, &size);
+    assert_int_equal(size, strlen(text));
+}
+
+static void test_static_file_variants(void** state) {
+    divulge_t* divulge = create_divulge();
+    connection_t connection;
+    size_t size = 0;
+    char request[256];
+    process(divulge, &connection, "GET /static/page.html HTTP/1.1\r\nAccept-Encoding: deflate\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+    assert_non_null(strstr(connection.output, "Content-Encoding: deflate\r\n"));
+    assert_non_null(strstr(connection.output, "Vary: Accept-Encoding\r\n"));
+    assert_non_null(strstr(connection.output, "-deflate\"\r\n"));
+    const char* body = get_body(&connection, &size);
+    assert_inflates_to_text(body, size, MAX_WBITS);
+
+    process(divulge, &connection, "GET /static/page.html HTTP/1.1\r\n\r\n");
+    assert_null(strstr(connection.output, "Content-Encoding"));
+    const char* etag_start = strstr(connection.output, "ETag: ");
+    assert_non_null(etag_start);
+    etag_start += 6;
+    char etag[80];
+    snprintf(etag, sizeof(etag), "%.*s", (int)(strstr(etag_start, "\r\n") - etag_start), etag_start);
+
+    snprintf(request, sizeof(request),
+             "GET /static/page.html HTTP/1.1\r\nAccept-Encoding: gzip\r\nIf-None-Match: %s\r\n\r\n", etag);
+    process(divulge, &connection, request);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+    assert_non_null(strstr(connection.output, "-gzip\"\r\n"));
+
+    snprintf(request, sizeof(request), "GET /static/page.html HTTP/1.1\r\nIf-None-Match: %s\r\n\r\n", etag);
+    process(divulge, &connection, request);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 304"));
+    assert_non_null(strstr(connection.output, "Vary: Accept-Encoding\r\n"));
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_negotiates_content_coding),
+        cmocka_unit_test(test_detects_compressible_types),
+        cmocka_unit_test(test_compresses_payload),
+        cmocka_unit_test(test_responds_with_negotiated_variant),
+        cmocka_unit_test(test_static_file_variants),
+    };
+
+    return cmocka_run_group_tests(tests, set_up, tear_down);
+}
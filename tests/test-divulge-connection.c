@@ -0,0 +1,403 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <string.h>
+#include "divulge-timer.h"
+#include "divulge.h"
+#include "test-divulge-transport.h"
+
+#define TICK_MS (10)
+#define IDLE_TIMEOUT_MS (1000)
+#define HEADER_TIMEOUT_MS (500)
+#define REQUEST_TIMEOUT_MS (10000)
+#define MIN_BODY_RATE (100)
+
+static bool echo_route_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {
+        .return_code = 200,
+        .payload = request->route.data,
+        .payload_size = request->route.size,
+    };
+    return divulge_respond(request, &response);
+}
+
+static bool silent_handler(divulge_request_t* request, void* context) {
+    return divulge_send_status(request, 200);
+}
+
+static divulge_deferred_t* deferred;
+
+static bool deferring_handler(divulge_request_t* request, void* context) {
+    deferred = divulge_defer(request);
+    return true;
+}
+
+static char large_body[5000];
+
+static bool stream_handler(divulge_request_t* request, void* context) {
+    divulge_slice_t mode = {0};
+    divulge_find_request_header(request, "X-Mode", &mode);
+    bool is_chunked = (mode.size > 0) && (mode.data[0] == 'c');
+    bool is_short = (mode.size > 0) && (mode.data[0] == 's');
+    divulge_header_entry_t header_entries[] = {{.key = "Content-Type", .value = "application/octet-stream"}};
+    divulge_header_t header = {.entries = header_entries, .count = 1};
+    divulge_begin_response(request, 200, &header, is_chunked ? DIVULGE_CONTENT_LENGTH_UNKNOWN : sizeof(large_body));
+    for (size_t offset = 0; offset < (is_short ? 1000 : sizeof(large_body)); offset += 1000) {
+        divulge_write_response(request, large_body + offset, 1000);
+    }
+    return divulge_end_response(request);
+}
+
+static divulge_uri_t stream_uri = {
+    .uri = "/stream",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = stream_handler},
+};
+
+static divulge_uri_t echo_uri = {
+    .uri = "/echo/*",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = echo_route_handler},
+};
+
+static divulge_uri_t echo_post_uri = {
+    .uri = "/echo/*",
+    .method = DIVULGE_ROUTE_METHOD_POST,
+    .handler = {.handler = echo_route_handler},
+};
+
+static divulge_uri_t deferred_uri = {
+    .uri = "/deferred",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = deferring_handler},
+};
+
+static divulge_uri_t silent_uri = {
+    .uri = "/silent",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = silent_handler},
+};
+
+static divulge_t* create_divulge(size_t max_requests_per_connection, size_t connection_buffer_size) {
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .close = socket_close,
+        .max_requests_per_connection = max_requests_per_connection,
+        .connection_buffer_size = connection_buffer_size,
+    };
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_register_uri(divulge, &echo_uri);
+    divulge_register_uri(divulge, &echo_post_uri);
+    divulge_register_uri(divulge, &silent_uri);
+    divulge_register_uri(divulge, &stream_uri);
+    return divulge;
+}
+
+static divulge_t* create_timed_divulge(void) {
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .close = socket_close,
+        .resume = socket_resume,
+        .idle_timeout_ms = IDLE_TIMEOUT_MS,
+        .header_timeout_ms = HEADER_TIMEOUT_MS,
+        .request_timeout_ms = REQUEST_TIMEOUT_MS,
+        .min_body_rate = MIN_BODY_RATE,
+    };
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_register_uri(divulge, &echo_uri);
+    divulge_register_uri(divulge, &echo_post_uri);
+    divulge_register_uri(divulge, &deferred_uri);
+    return divulge;
+}
+
+static bool receive(divulge_connection_t* divulge_connection, const char* data) {
+    size_t data_size = strlen(data);
+    size_t buffer_size = 0;
+    char* buffer = divulge_connection_get_receive_buffer(divulge_connection, &buffer_size);
+    assert_true(data_size <= buffer_size);
+    memcpy(buffer, data, data_size);
+    return divulge_connection_receive(divulge_connection, data_size);
+}
+
+static size_t count_responses(const connection_t* connection) {
+    size_t count = 0;
+    for (const char* p = strstr(connection->output, "HTTP/1.1 "); p; p = strstr(p + 1, "HTTP/1.1 ")) {
+        count++;
+    }
+    return count;
+}
+
+static void test_keep_alive_by_default(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /echo/a HTTP/1.1\r\n\r\n"));
+    assert_true(receive(divulge_connection, "GET /echo/bc HTTP/1.1\r\n\r\n"));
+    assert_int_equal(connection.close_count, 0);
+    assert_non_null(strstr(connection.output, "Content-Length: 7\r\n\r\n/echo/a"));
+    assert_non_null(strstr(connection.output, "Content-Length: 8\r\n\r\n/echo/bc"));
+    assert_null(strstr(connection.output, "Connection: close"));
+    divulge_connection_destroy(divulge_connection);
+    assert_int_equal(connection.close_count, 1);
+}
+
+static void test_connection_close(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_false(receive(divulge_connection, "GET /echo/a HTTP/1.1\r\nConnection: Upgrade, Close\r\n\r\n"));
+    assert_non_null(strstr(connection.output, "Connection: close\r\n"));
+    assert_int_equal(connection.close_count, 1);
+    size_t buffer_size = 1;
+    divulge_connection_get_receive_buffer(divulge_connection, &buffer_size);
+    assert_int_equal(buffer_size, 0);
+    assert_false(divulge_connection_receive(divulge_connection, 0));
+    divulge_connection_destroy(divulge_connection);
+    assert_int_equal(connection.close_count, 1);
+}
+
+static void test_http_1_0(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /echo/a HTTP/1.0\r\nConnection: keep-alive\r\n\r\n"));
+    assert_non_null(strstr(connection.output, "Connection: keep-alive\r\n"));
+    assert_false(receive(divulge_connection, "GET /echo/a HTTP/1.0\r\n\r\n"));
+    assert_int_equal(connection.close_count, 1);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_pipelined_requests(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection,
+                        "GET /echo/1 HTTP/1.1\r\n\r\n"
+                        "POST /echo/2 HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"
+                        "GET /echo/3 HTTP/1.1\r\nHo"));
+    assert_int_equal(count_responses(&connection), 2);
+    assert_true(receive(divulge_connection, "st: x\r\n\r\n"));
+    assert_int_equal(count_responses(&connection), 3);
+    const char* first = strstr(connection.output, "/echo/1");
+    const char* second = strstr(connection.output, "/echo/2");
+    const char* third = strstr(connection.output, "/echo/3");
+    assert_true(first && second && third && (first < second) && (second < third));
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_max_requests_per_connection(void** state) {
+    divulge_t* divulge = create_divulge(2, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_false(receive(divulge_connection,
+                         "GET /echo/1 HTTP/1.1\r\n\r\nGET /echo/2 HTTP/1.1\r\n\r\nGET /echo/3 HTTP/1.1\r\n\r\n"));
+    assert_int_equal(count_responses(&connection), 2);
+    assert_non_null(strstr(connection.output, "/echo/2"));
+    assert_null(strstr(connection.output, "/echo/3"));
+    assert_int_equal(connection.close_count, 1);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_unfinished_response_closes(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_false(receive(divulge_connection, "GET /silent HTTP/1.1\r\n\r\n"));
+    assert_int_equal(connection.close_count, 1);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_request_larger_than_buffer(void** state) {
+    divulge_t* divulge = create_divulge(0, 64);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_false(receive(divulge_connection, "POST /echo/1 HTTP/1.1\r\nContent-Length: 100\r\n\r\n"));
+    assert_non_null(strstr(connection.output, "HTTP/1.1 413"));
+    assert_non_null(strstr(connection.output, "Connection: close\r\n"));
+    divulge_connection_destroy(divulge_connection);
+    connection = (connection_t){0};
+    divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /echo/1234567890123456789012345678901234567890"));
+    assert_false(receive(divulge_connection, "12345678901234"));
+    assert_non_null(strstr(connection.output, "HTTP/1.1 431"));
+    divulge_connection_destroy(divulge_connection);
+}
+
+static const char* find_body(const connection_t* connection) {
+    const char* body = strstr(connection->output, "\r\n\r\n");
+    assert_non_null(body);
+    return body + 4;
+}
+
+static void test_streamed_response_with_content_length(void** state) {
+    memset(large_body, 'x', sizeof(large_body));
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /stream HTTP/1.1\r\n\r\n"));
+    assert_non_null(strstr(connection.output, "Content-Length: 5000\r\n"));
+    assert_int_equal(strlen(find_body(&connection)), sizeof(large_body));
+    assert_false(receive(divulge_connection, "GET /stream HTTP/1.1\r\nX-Mode: short\r\n\r\n"));
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_chunked_response(void** state) {
+    memset(large_body, 'y', sizeof(large_body));
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /stream HTTP/1.1\r\nX-Mode: chunked\r\n\r\n"));
+    assert_non_null(strstr(connection.output, "Transfer-Encoding: chunked\r\n"));
+    assert_null(strstr(connection.output, "Content-Length"));
+    const char* body = find_body(&connection);
+    for (size_t i = 0; i < 5; i++) {
+        assert_memory_equal(body, "3e8\r\n", 5);
+        body += 5 + 1000 + 2;
+    }
+    assert_string_equal(body, "0\r\n\r\n");
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_streamed_response_to_http_1_0(void** state) {
+    divulge_t* divulge = create_divulge(0, 0);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_false(
+        receive(divulge_connection, "GET /stream HTTP/1.0\r\nConnection: keep-alive\r\nX-Mode: chunked\r\n\r\n"));
+    assert_null(strstr(connection.output, "Transfer-Encoding"));
+    assert_non_null(strstr(connection.output, "Connection: close\r\n"));
+    assert_int_equal(strlen(find_body(&connection)), sizeof(large_body));
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_idle_timeout(void** state) {
+    divulge_t* divulge = create_timed_divulge();
+    connection_t connection = {0};
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 0);
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    divulge_connection_watch(divulge_connection, &wheel);
+    divulge_timer_wheel_advance(&wheel, 800);
+    assert_true(receive(divulge_connection, "GET /echo/a HTTP/1.1\r\n\r\n"));
+    divulge_timer_wheel_advance(&wheel, 800 + IDLE_TIMEOUT_MS - TICK_MS);
+    assert_int_equal(connection.close_count, 0);
+    divulge_timer_wheel_advance(&wheel, 800 + IDLE_TIMEOUT_MS);
+    assert_int_equal(connection.close_count, 1);
+    assert_int_equal(count_responses(&connection), 1);
+    assert_int_equal(divulge_get_timeout_count(divulge, DIVULGE_TIMEOUT_IDLE), 1);
+    assert_false(receive(divulge_connection, ""));
+    divulge_connection_destroy(divulge_connection);
+    assert_int_equal(connection.close_count, 1);
+}
+
+static void test_header_timeout(void** state) {
+    divulge_t* divulge = create_timed_divulge();
+    connection_t connection = {0};
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 0);
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    divulge_connection_watch(divulge_connection, &wheel);
+    divulge_timer_wheel_advance(&wheel, 100);
+    assert_true(receive(divulge_connection, "GET /echo/a HTTP/1.1\r\nHo"));
+    divulge_timer_wheel_advance(&wheel, 300);
+    assert_true(receive(divulge_connection, "st: example.com\r\n"));
+    divulge_timer_wheel_advance(&wheel, 100 + HEADER_TIMEOUT_MS - TICK_MS);
+    assert_int_equal(connection.close_count, 0);
+    divulge_timer_wheel_advance(&wheel, 100 + HEADER_TIMEOUT_MS);
+    assert_int_equal(connection.close_count, 1);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 408 Request Timeout\r\n"));
+    assert_non_null(strstr(connection.output, "Connection: close\r\n"));
+    assert_int_equal(divulge_get_timeout_count(divulge, DIVULGE_TIMEOUT_HEADER), 1);
+    assert_int_equal(divulge_get_timeout_count(divulge, DIVULGE_TIMEOUT_IDLE), 0);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_slow_body(void** state) {
+    divulge_t* divulge = create_timed_divulge();
+    connection_t connection = {0};
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 0);
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    divulge_connection_watch(divulge_connection, &wheel);
+    assert_true(receive(divulge_connection, "POST /echo/a HTTP/1.1\r\nContent-Length: 1000\r\n\r\n"));
+    divulge_timer_wheel_advance(&wheel, 4000);
+    char body[201] = {0};
+    memset(body, 'x', 200);
+    assert_true(receive(divulge_connection, body));
+    uint64_t deadline_ms = 5000 + 200 * 1000 / MIN_BODY_RATE;
+    divulge_timer_wheel_advance(&wheel, deadline_ms - TICK_MS);
+    assert_int_equal(connection.close_count, 0);
+    divulge_timer_wheel_advance(&wheel, deadline_ms);
+    assert_int_equal(connection.close_count, 1);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 408 "));
+    assert_int_equal(divulge_get_timeout_count(divulge, DIVULGE_TIMEOUT_BODY), 1);
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_request_timeout_cancels_deferred(void** state) {
+    divulge_t* divulge = create_timed_divulge();
+    connection_t connection = {0};
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 0);
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    divulge_connection_watch(divulge_connection, &wheel);
+    assert_true(receive(divulge_connection, "GET /deferred HTTP/1.1\r\n\r\n"));
+    assert_non_null(deferred);
+    divulge_timer_wheel_advance(&wheel, REQUEST_TIMEOUT_MS - TICK_MS);
+    assert_int_equal(connection.close_count, 0);
+    divulge_timer_wheel_advance(&wheel, REQUEST_TIMEOUT_MS);
+    assert_int_equal(connection.close_count, 1);
+    assert_int_equal(connection.output_size, 0);
+    assert_int_equal(divulge_get_timeout_count(divulge, DIVULGE_TIMEOUT_REQUEST), 1);
+    assert_true(divulge_deferred_is_cancelled(deferred));
+    divulge_response_t response = {.return_code = 200};
+    assert_false(divulge_deferred_respond(deferred, &response));
+    divulge_connection_destroy(divulge_connection);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_keep_alive_by_default),
+        cmocka_unit_test(test_connection_close),
+        cmocka_unit_test(test_http_1_0),
+        cmocka_unit_test(test_pipelined_requests),
+        cmocka_unit_test(test_max_requests_per_connection),
+        cmocka_unit_test(test_unfinished_response_closes),
+        cmocka_unit_test(test_request_larger_than_buffer),
+        cmocka_unit_test(test_streamed_response_with_content_length),
+        cmocka_unit_test(test_chunked_response),
+        cmocka_unit_test(test_streamed_response_to_http_1_0),
+        cmocka_unit_test(test_idle_timeout),
+        cmocka_unit_test(test_header_timeout),
+        cmocka_unit_test(test_slow_body),
+        cmocka_unit_test(test_request_timeout_cancels_deferred),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
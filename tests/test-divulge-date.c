@@ -0,0 +1,102 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include "divulge-date.h"
+
+#define THREAD_COUNT (4)
+#define DATES_PER_THREAD (20000)
+
+static void test_formats_imf_fixdate(void** state) {
+    char date[DIVULGE_DATE_SIZE];
+    divulge_format_date(784111777, date);
+    assert_memory_equal(date, "Sun, 06 Nov 1994 08:49:37 GMT", DIVULGE_DATE_SIZE);
+    divulge_format_date(0, date);
+    assert_memory_equal(date, "Thu, 01 Jan 1970 00:00:00 GMT", DIVULGE_DATE_SIZE);
+    divulge_format_date(1709251199, date);
+    assert_memory_equal(date, "Thu, 29 Feb 2024 23:59:59 GMT", DIVULGE_DATE_SIZE);
+}
+
+/*
+ * The date must be one of the seconds between the two readings of the clock.
+ */
+static bool is_current_date(const char* date, time_t before, time_t after) {
+    char expected[DIVULGE_DATE_SIZE];
+    for (time_t second = before; second <= after; second++) {
+        divulge_format_date(second, expected);
+        if (memcmp(date, expected, DIVULGE_DATE_SIZE) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_gets_current_date(void** state) {
+    char date[DIVULGE_DATE_SIZE];
+    time_t before = time(NULL);
+    divulge_get_date(date);
+    divulge_get_date(date);
+    assert_true(is_current_date(date, before, time(NULL)));
+}
+
+static void* get_dates(void* argument) {
+    bool* is_valid = argument;
+    *is_valid = true;
+    for (size_t i = 0; i < DATES_PER_THREAD; i++) {
+        char date[DIVULGE_DATE_SIZE];
+        time_t before = time(NULL);
+        divulge_get_date(date);
+        *is_valid = *is_valid && is_current_date(date, before, time(NULL));
+    }
+    return NULL;
+}
+
+static void test_shared_across_threads(void** state) {
+    pthread_t threads[THREAD_COUNT];
+    bool is_valid[THREAD_COUNT];
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        assert_int_equal(pthread_create(threads + i, NULL, get_dates, is_valid + i), 0);
+    }
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+        assert_true(is_valid[i]);
+    }
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_formats_imf_fixdate),
+        cmocka_unit_test(test_gets_current_date),
+        cmocka_unit_test(test_shared_across_threads),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
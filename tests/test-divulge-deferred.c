@@ -0,0 +1,218 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <pthread.h>
+#include <string.h>
+#include "divulge-metrics.h"
+#include "test-divulge-transport.h"
+
+static divulge_deferred_t* deferred;
+static size_t cancel_count;
+
+static bool echo_route_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {
+        .return_code = 200,
+        .payload = request->route.data,
+        .payload_size = request->route.size,
+    };
+    return divulge_respond(request, &response);
+}
+
+static bool slow_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {.return_code = 503, .payload = "busy", .payload_size = 4};
+    deferred = divulge_defer(request);
+    if (!deferred) {
+        return divulge_respond(request, &response);
+    }
+    divulge_respond(request, &response); /* ignored once deferred */
+    return true;
+}
+
+static void cancel(void* context) {
+    cancel_count++;
+}
+
+static divulge_uri_t echo_uri = {
+    .uri = "/echo/*",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = echo_route_handler},
+};
+
+static divulge_uri_t slow_uri = {
+    .uri = "/slow",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = slow_handler},
+};
+
+static divulge_t* create_divulge(bool can_resume, divulge_metrics_t* metrics) {
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .close = socket_close,
+        .resume = can_resume ? socket_resume : NULL,
+        .metrics = metrics,
+    };
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_register_uri(divulge, &echo_uri);
+    divulge_register_uri(divulge, &slow_uri);
+    deferred = NULL;
+    cancel_count = 0;
+    return divulge;
+}
+
+static bool receive(divulge_connection_t* divulge_connection, const char* data) {
+    size_t data_size = strlen(data);
+    size_t buffer_size = 0;
+    char* buffer = divulge_connection_get_receive_buffer(divulge_connection, &buffer_size);
+    assert_true(data_size <= buffer_size);
+    memcpy(buffer, data, data_size);
+    return divulge_connection_receive(divulge_connection, data_size);
+}
+
+static void* respond_later(void* argument) {
+    divulge_response_t response = {.return_code = 200, .payload = "later", .payload_size = 5};
+    assert_true(divulge_deferred_respond(argument, &response));
+    return NULL;
+}
+
+static void test_one_shot_request(void** state) {
+    divulge_t* divulge = create_divulge(false, NULL);
+    connection_t connection = {0};
+    const char request[] = "GET /slow HTTP/1.1\r\n\r\n";
+    char response_buffer[1024];
+    divulge_process_request(divulge, &connection, request, sizeof(request) - 1, response_buffer,
+                            sizeof(response_buffer));
+    assert_non_null(deferred);
+    assert_int_equal(connection.output_size, 0);
+    assert_int_equal(connection.close_count, 0);
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, respond_later, deferred), 0);
+    pthread_join(thread, NULL);
+    assert_string_equal(connection.output,
+                        "HTTP/1.1 200 OK\r\nServer: Divulge\r\nContent-Length: 5\r\nConnection: close\r\n\r\nlater");
+    assert_int_equal(connection.close_count, 1);
+}
+
+static void test_pipelined_requests_wait(void** state) {
+    divulge_t* divulge = create_divulge(true, NULL);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /slow HTTP/1.1\r\n\r\nGET /echo/a HTTP/1.1\r\n\r\n"));
+    assert_non_null(deferred);
+    assert_int_equal(connection.output_size, 0);
+    assert_true(receive(divulge_connection, "GET /echo/b HTTP/1.1\r\n\r\n"));
+    assert_int_equal(connection.output_size, 0);
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, respond_later, deferred), 0);
+    pthread_join(thread, NULL);
+    assert_int_equal(connection.resume_count, 1);
+    assert_int_equal(connection.output_size, 0);
+    assert_true(divulge_connection_resume(divulge_connection));
+    const char* first = strstr(connection.output, "\r\n\r\nlater");
+    const char* second = strstr(connection.output, "\r\n\r\n/echo/a");
+    const char* third = strstr(connection.output, "\r\n\r\n/echo/b");
+    assert_true(first && second && third && (first < second) && (second < third));
+    assert_null(strstr(connection.output, "busy"));
+    assert_int_equal(connection.close_count, 0);
+    divulge_connection_destroy(divulge_connection);
+    assert_int_equal(connection.close_count, 1);
+}
+
+static void test_connection_close_after_deferred_response(void** state) {
+    divulge_t* divulge = create_divulge(true, NULL);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /slow HTTP/1.1\r\nConnection: close\r\n\r\n"));
+    assert_int_equal(connection.close_count, 0);
+    respond_later(deferred);
+    assert_false(divulge_connection_resume(divulge_connection));
+    assert_non_null(strstr(connection.output, "Connection: close\r\n\r\nlater"));
+    assert_int_equal(connection.close_count, 1);
+    divulge_connection_destroy(divulge_connection);
+    assert_int_equal(connection.close_count, 1);
+}
+
+static void test_cancelled_when_client_goes_away(void** state) {
+    divulge_t* divulge = create_divulge(true, NULL);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /slow HTTP/1.1\r\n\r\n"));
+    divulge_deferred_set_cancel_callback(deferred, cancel, NULL);
+    assert_false(divulge_deferred_is_cancelled(deferred));
+    divulge_connection_destroy(divulge_connection);
+    assert_int_equal(cancel_count, 1);
+    assert_true(divulge_deferred_is_cancelled(deferred));
+    divulge_response_t response = {.return_code = 200};
+    assert_false(divulge_deferred_respond(deferred, &response));
+    assert_int_equal(connection.output_size, 0);
+    assert_int_equal(connection.resume_count, 0);
+    assert_int_equal(cancel_count, 1);
+}
+
+static void test_defer_requires_resume(void** state) {
+    divulge_t* divulge = create_divulge(false, NULL);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /slow HTTP/1.1\r\n\r\n"));
+    assert_null(deferred);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 503 "));
+    assert_non_null(strstr(connection.output, "\r\n\r\nbusy"));
+    divulge_connection_destroy(divulge_connection);
+}
+
+static void test_records_metrics_once_sent(void** state) {
+    divulge_metrics_t* metrics = divulge_metrics_create();
+    divulge_t* divulge = create_divulge(true, metrics);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    assert_true(receive(divulge_connection, "GET /slow HTTP/1.1\r\n\r\n"));
+    assert_int_equal(divulge_metrics_get_request_count(metrics, "/slow", DIVULGE_ROUTE_METHOD_GET, 0), 0);
+    pthread_t thread;
+    assert_int_equal(pthread_create(&thread, NULL, respond_later, deferred), 0);
+    pthread_join(thread, NULL);
+    assert_true(divulge_connection_resume(divulge_connection));
+    assert_int_equal(divulge_metrics_get_request_count(metrics, "/slow", DIVULGE_ROUTE_METHOD_GET, 200), 1);
+    assert_true(receive(divulge_connection, "GET /slow HTTP/1.1\r\n\r\n"));
+    divulge_connection_destroy(divulge_connection);
+    divulge_response_t response = {.return_code = 200};
+    assert_false(divulge_deferred_respond(deferred, &response));
+    assert_int_equal(divulge_metrics_get_request_count(metrics, "/slow", DIVULGE_ROUTE_METHOD_GET, 0), 1);
+    divulge_metrics_destroy(metrics);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_one_shot_request),
+        cmocka_unit_test(test_pipelined_requests_wait),
+        cmocka_unit_test(test_connection_close_after_deferred_response),
+        cmocka_unit_test(test_cancelled_when_client_goes_away),
+        cmocka_unit_test(test_defer_requires_resume),
+        cmocka_unit_test(test_records_metrics_once_sent),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
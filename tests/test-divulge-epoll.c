@@ -0,0 +1,334 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "divulge-epoll.h"
+
+#define LARGE_BODY_SIZE (4 * 1024 * 1024)
+#define HEADER_TIMEOUT_MS (200)
+#define PIPELINED_REQUEST_COUNT (50)
+#define PADDING_SIZE (400)
+#define IDLE_TIMEOUT_MS (100)
+#define BLOCKING_HANDLER_MS (300)
+
+static char* large_body;
+static divulge_t* divulge;
+
+static bool hello_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {.return_code = 200, .payload = "hello", .payload_size = 5};
+    return divulge_respond(request, &response);
+}
+
+static bool large_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {.return_code = 200, .payload = large_body, .payload_size = LARGE_BODY_SIZE};
+    return divulge_respond(request, &response);
+}
+
+static bool peer_handler(divulge_request_t* request, void* context) {
+    char text[INET_ADDRSTRLEN] = "";
+    divulge_slice_t address = {0};
+    if (divulge_get_peer_address(request, &address) && (address.size == 4)) {
+        inet_ntop(AF_INET, address.data, text, sizeof(text));
+    }
+    divulge_response_t response = {.return_code = 200, .payload = text, .payload_size = strlen(text)};
+    return divulge_respond(request, &response);
+}
+
+static bool blocking_handler(divulge_request_t* request, void* context) {
+    usleep(BLOCKING_HANDLER_MS * 1000);
+    return hello_handler(request, context);
+}
+
+static void* respond_later(void* argument) {
+    usleep(10000);
+    divulge_response_t response = {.return_code = 200, .payload = "hello", .payload_size = 5};
+    divulge_deferred_respond(argument, &response);
+    return NULL;
+}
+
+static bool later_handler(divulge_request_t* request, void* context) {
+    divulge_deferred_t* deferred = divulge_defer(request);
+    if (!deferred) {
+        return false;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, respond_later, deferred) != 0) {
+        respond_later(deferred);
+    } else {
+        pthread_detach(thread);
+    }
+    return true;
+}
+
+static divulge_epoll_t* start_server(size_t reactor_count, uint32_t idle_timeout_ms) {
+    divulge_configuration_t configuration = {
+        .header_timeout_ms = HEADER_TIMEOUT_MS,
+        .idle_timeout_ms = idle_timeout_ms,
+    };
+    divulge_epoll_prepare_configuration(&configuration);
+    divulge = divulge_initialize(&configuration);
+    divulge_uri_t hello_uri = {
+        .uri = "/hello", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = hello_handler}};
+    divulge_uri_t large_uri = {
+        .uri = "/large", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = large_handler}};
+    divulge_register_uri(divulge, &hello_uri);
+    divulge_uri_t later_uri = {
+        .uri = "/later", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = later_handler}};
+    divulge_uri_t peer_uri = {.uri = "/peer", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = peer_handler}};
+    divulge_register_uri(divulge, &large_uri);
+    divulge_register_uri(divulge, &later_uri);
+    divulge_register_uri(divulge, &peer_uri);
+    divulge_uri_t blocking_uri = {
+        .uri = "/blocking", .method = DIVULGE_ROUTE_METHOD_GET, .handler = {.handler = blocking_handler}};
+    divulge_register_uri(divulge, &blocking_uri);
+    divulge_epoll_configuration_t epoll_configuration = {.address = "127.0.0.1", .reactor_count = reactor_count};
+    divulge_epoll_t* epoll = divulge_epoll_create(divulge, &epoll_configuration);
+    assert_non_null(epoll);
+    assert_true(divulge_epoll_get_port(epoll) > 0);
+    assert_true(divulge_epoll_start(epoll));
+    return epoll;
+}
+
+static int connect_to(divulge_epoll_t* epoll) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    assert_true(client >= 0);
+    struct timeval timeout = {.tv_sec = 5};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(divulge_epoll_get_port(epoll))};
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    assert_int_equal(connect(client, (struct sockaddr*)&address, sizeof(address)), 0);
+    return client;
+}
+
+static void send_text(int client, const char* text) {
+    assert_int_equal(send(client, text, strlen(text), 0), (ssize_t)strlen(text));
+}
+
+/*
+ * Reads until `size` bytes arrived or the server closed the connection. Sanitizer runtimes may interrupt recv().
+ */
+static size_t receive_all(int client, char* buffer, size_t size) {
+    size_t received = 0;
+    while (received < size) {
+        ssize_t result = recv(client, buffer + received, size - received, 0);
+        if ((result < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        received += (size_t)result;
+    }
+    return received;
+}
+
+static const char* hello_response = "HTTP/1.1 200 OK\r\nServer: Divulge\r\nContent-Length: 5\r\n\r\nhello";
+
+static void test_serves_pipelined_requests(void** state) {
+    divulge_epoll_t* epoll = start_server(1, 0);
+    int client = connect_to(epoll);
+    send_text(client, "GET /hello HTTP/1.1\r\n\r\nGET /hello HTTP/1.1\r\n\r\n");
+    char buffer[256] = {0};
+    size_t expected_size = 2 * strlen(hello_response);
+    assert_int_equal(receive_all(client, buffer, expected_size), expected_size);
+    assert_memory_equal(buffer, hello_response, strlen(hello_response));
+    assert_memory_equal(buffer + strlen(hello_response), hello_response, strlen(hello_response));
+    send_text(client, "GET /hello HTTP/1.1\r\nConnection: close\r\n\r\n");
+    size_t received = receive_all(client, buffer, sizeof(buffer));
+    assert_true(received > strlen(hello_response));
+    assert_non_null(strstr(buffer, "Connection: close"));
+    close(client);
+    divulge_epoll_destroy(epoll);
+}
+
+static void test_tells_peer_address(void** state) {
+    divulge_epoll_t* epoll = start_server(1, 0);
+    int client = connect_to(epoll);
+    send_text(client, "GET /peer HTTP/1.1\r\nConnection: close\r\n\r\n");
+    char buffer[256] = {0};
+    receive_all(client, buffer, sizeof(buffer) - 1);
+    assert_non_null(strstr(buffer, "\r\n\r\n127.0.0.1"));
+    close(client);
+    divulge_epoll_destroy(epoll);
+}
+
+static void test_closes_slow_clients(void** state) {
+    divulge_epoll_t* epoll = start_server(1, 0);
+    int client = connect_to(epoll);
+    send_text(client, "GET /hello HTTP/1.1\r\nHo");
+    char buffer[256] = {0};
+    assert_true(receive_all(client, buffer, sizeof(buffer) - 1) > 0);
+    assert_non_null(strstr(buffer, "HTTP/1.1 408 Request Timeout\r\n"));
+    assert_int_equal(divulge_get_timeout_count(divulge, DIVULGE_TIMEOUT_HEADER), 1);
+    close(client);
+    divulge_epoll_destroy(epoll);
+}
+
+/*
+ * A request arriving before the idle deadline, while another handler holds the reactor past it, is answered.
+ */
+static void test_receives_before_checking_deadlines(void** state) {
+    divulge_epoll_t* epoll = start_server(1, IDLE_TIMEOUT_MS);
+    int idle_client = connect_to(epoll);
+    usleep(20000);
+    int blocking_client = connect_to(epoll);
+    send_text(blocking_client, "GET /blocking HTTP/1.1\r\nConnection: close\r\n\r\n");
+    usleep(50000);
+    send_text(idle_client, "GET /hello HTTP/1.1\r\nConnection: close\r\n\r\n");
+    char buffer[256] = {0};
+    assert_true(receive_all(idle_client, buffer, sizeof(buffer) - 1) > 0);
+    assert_non_null(strstr(buffer, "HTTP/1.1 200 OK\r\n"));
+    memset(buffer, 0, sizeof(buffer));
+    assert_true(receive_all(blocking_client, buffer, sizeof(buffer) - 1) > 0);
+    assert_non_null(strstr(buffer, "HTTP/1.1 200 OK\r\n"));
+    assert_int_equal(divulge_get_timeout_count(divulge, DIVULGE_TIMEOUT_IDLE), 0);
+    close(idle_client);
+    close(blocking_client);
+    divulge_epoll_destroy(epoll);
+}
+
+static void test_queues_large_responses(void** state) {
+    large_body = malloc(LARGE_BODY_SIZE);
+    assert_non_null(large_body);
+    for (size_t i = 0; i < LARGE_BODY_SIZE; i++) {
+        large_body[i] = (char)('a' + (i % 26));
+    }
+    divulge_epoll_t* epoll = start_server(1, 0);
+    int client = connect_to(epoll);
+    send_text(client, "GET /large HTTP/1.1\r\n\r\nGET /hello HTTP/1.1\r\n\r\n");
+    usleep(50000);
+    size_t header_size = strlen("HTTP/1.1 200 OK\r\nServer: Divulge\r\nContent-Length: 4194304\r\n\r\n");
+    size_t expected_size = header_size + LARGE_BODY_SIZE + strlen(hello_response);
+    char* buffer = malloc(expected_size);
+    assert_int_equal(receive_all(client, buffer, expected_size), expected_size);
+    assert_memory_equal(buffer + header_size, large_body, LARGE_BODY_SIZE);
+    assert_memory_equal(buffer + header_size + LARGE_BODY_SIZE, hello_response, strlen(hello_response));
+    free(buffer);
+    close(client);
+    divulge_epoll_destroy(epoll);
+    free(large_body);
+}
+
+static void test_spreads_connections_over_reactors(void** state) {
+    divulge_epoll_t* epoll = start_server(4, 0);
+    int clients[16];
+    for (size_t i = 0; i < 16; i++) {
+        clients[i] = connect_to(epoll);
+        send_text(clients[i], "GET /hello HTTP/1.1\r\n\r\n");
+    }
+    for (size_t i = 0; i < 16; i++) {
+        char buffer[256] = {0};
+        assert_int_equal(receive_all(clients[i], buffer, strlen(hello_response)), strlen(hello_response));
+        assert_string_equal(buffer, hello_response);
+    }
+    divulge_epoll_stop(epoll);
+    for (size_t i = 0; i < 16; i++) {
+        char buffer[16];
+        assert_int_equal(recv(clients[i], buffer, sizeof(buffer), 0), 0);
+        close(clients[i]);
+    }
+    divulge_epoll_destroy(epoll);
+}
+
+static void test_resumes_deferred_responses(void** state) {
+    divulge_epoll_t* epoll = start_server(2, 0);
+    int client = connect_to(epoll);
+    send_text(client, "GET /later HTTP/1.1\r\n\r\nGET /hello HTTP/1.1\r\n\r\nGET /later HTTP/1.1\r\n\r\n");
+    char buffer[256] = {0};
+    size_t expected_size = 3 * strlen(hello_response);
+    assert_int_equal(receive_all(client, buffer, expected_size), expected_size);
+    for (size_t i = 0; i < 3; i++) {
+        assert_memory_equal(buffer + i * strlen(hello_response), hello_response, strlen(hello_response));
+    }
+    close(client);
+    client = connect_to(epoll);
+    send_text(client, "GET /later HTTP/1.1\r\n\r\n");
+    close(client);
+    usleep(50000);
+    divulge_epoll_destroy(epoll);
+}
+
+/*
+ * The requests behind a deferred response overflow the connection buffer: reading waits for the response.
+ */
+static void test_holds_requests_behind_deferred_responses(void** state) {
+    divulge_epoll_t* epoll = start_server(1, 0);
+    int client = connect_to(epoll);
+    char padding[PADDING_SIZE + 1];
+    memset(padding, 'a', PADDING_SIZE);
+    padding[PADDING_SIZE] = '\0';
+    char later_request[PADDING_SIZE + 64];
+    char hello_request[PADDING_SIZE + 64];
+    snprintf(later_request, sizeof(later_request), "GET /later HTTP/1.1\r\nX-Padding: %s\r\n\r\n", padding);
+    snprintf(hello_request, sizeof(hello_request), "GET /hello HTTP/1.1\r\nX-Padding: %s\r\n\r\n", padding);
+    size_t request_size = strlen(hello_request);
+    char* requests = malloc(PIPELINED_REQUEST_COUNT * request_size + 1);
+    assert_non_null(requests);
+    for (size_t i = 0; i < PIPELINED_REQUEST_COUNT; i++) {
+        memcpy(requests + i * request_size, (i == 0) ? later_request : hello_request, request_size);
+    }
+    requests[PIPELINED_REQUEST_COUNT * request_size] = '\0';
+    send_text(client, requests);
+    size_t response_size = strlen(hello_response);
+    char* responses = malloc(PIPELINED_REQUEST_COUNT * response_size);
+    assert_non_null(responses);
+    size_t expected_size = PIPELINED_REQUEST_COUNT * response_size;
+    assert_int_equal(receive_all(client, responses, expected_size), expected_size);
+    for (size_t i = 0; i < PIPELINED_REQUEST_COUNT; i++) {
+        assert_memory_equal(responses + i * response_size, hello_response, response_size);
+    }
+    free(responses);
+    free(requests);
+    close(client);
+    divulge_epoll_destroy(epoll);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_serves_pipelined_requests),
+        cmocka_unit_test(test_tells_peer_address),
+        cmocka_unit_test(test_closes_slow_clients),
+        cmocka_unit_test(test_receives_before_checking_deadlines),
+        cmocka_unit_test(test_queues_large_responses),
+        cmocka_unit_test(test_spreads_connections_over_reactors),
+        cmocka_unit_test(test_resumes_deferred_responses),
+        cmocka_unit_test(test_holds_requests_behind_deferred_responses),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,100 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <string.h>
+#include "divulge-headers.h"
+
+static const char* request =
+    "GET / HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "X-Forwarded-For: 10.0.0.1\r\n"
+    "Referer: http://example.com/?Authorization: Basic abc\r\n"
+    "x-forwarded-for: 10.0.0.2\r\n"
+    "Accept: */*\r\n"
+    "X-FORWARDED-FOR: 10.0.0.3\r\n"
+    "\r\n";
+
+static void build(divulge_headers_t* headers, divulge_parser_t* parser) {
+    divulge_parser_initialize(parser, NULL);
+    assert_int_equal(divulge_parser_feed(parser, request, strlen(request)), DIVULGE_PARSER_STATUS_COMPLETE);
+    divulge_headers_build(headers, parser, request);
+}
+
+static size_t find(const divulge_headers_t* headers, const char* name) {
+    return divulge_headers_find(headers, name, strlen(name));
+}
+
+static void assert_value(const divulge_headers_t* headers, size_t index, const char* expected) {
+    assert_true(index < headers->count);
+    assert_int_equal(headers->fields[index].value.size, strlen(expected));
+    assert_memory_equal(request + headers->fields[index].value.offset, expected, strlen(expected));
+}
+
+static void test_case_insensitive_lookup(void** state) {
+    divulge_parser_t parser;
+    divulge_headers_t headers;
+    build(&headers, &parser);
+    assert_int_equal(headers.count, 6);
+    assert_value(&headers, find(&headers, "host"), "example.com");
+    assert_value(&headers, find(&headers, "HOST"), "example.com");
+    assert_value(&headers, find(&headers, "Accept"), "*/*");
+}
+
+static void test_missing_header(void** state) {
+    divulge_parser_t parser;
+    divulge_headers_t headers;
+    build(&headers, &parser);
+    assert_int_equal(find(&headers, "Authorization"), DIVULGE_HEADERS_NONE);
+    assert_int_equal(find(&headers, "Hos"), DIVULGE_HEADERS_NONE);
+    assert_int_equal(find(&headers, "Hosts"), DIVULGE_HEADERS_NONE);
+    assert_int_equal(find(&headers, ""), DIVULGE_HEADERS_NONE);
+}
+
+static void test_repeated_headers(void** state) {
+    divulge_parser_t parser;
+    divulge_headers_t headers;
+    build(&headers, &parser);
+    size_t index = find(&headers, "x-forwarded-for");
+    assert_value(&headers, index, "10.0.0.1");
+    index = divulge_headers_find_next(&headers, index);
+    assert_value(&headers, index, "10.0.0.2");
+    index = divulge_headers_find_next(&headers, index);
+    assert_value(&headers, index, "10.0.0.3");
+    assert_int_equal(divulge_headers_find_next(&headers, index), DIVULGE_HEADERS_NONE);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_case_insensitive_lookup),
+        cmocka_unit_test(test_missing_header),
+        cmocka_unit_test(test_repeated_headers),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,201 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "divulge-metrics.h"
+#include "test-divulge-transport.h"
+
+#define THREAD_COUNT (4)
+#define SAMPLES_PER_THREAD (1000)
+
+static bool echo_route_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {
+        .return_code = 200,
+        .payload = request->route.data,
+        .payload_size = request->route.size,
+    };
+    return divulge_respond(request, &response);
+}
+
+static divulge_uri_t echo_uri = {
+    .uri = "/echo/*",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = echo_route_handler},
+};
+
+static divulge_uri_t metrics_uri = {
+    .uri = "/metrics",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = divulge_metrics_handler},
+};
+
+static divulge_t* create_divulge(divulge_metrics_t* metrics) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close, .metrics = metrics};
+    divulge_t* divulge = divulge_initialize(&configuration);
+    metrics_uri.handler.context = metrics;
+    divulge_register_uri(divulge, &echo_uri);
+    divulge_register_uri(divulge, &metrics_uri);
+    return divulge;
+}
+
+static void receive(divulge_connection_t* divulge_connection, const char* data) {
+    size_t data_size = strlen(data);
+    size_t buffer_size = 0;
+    char* buffer = divulge_connection_get_receive_buffer(divulge_connection, &buffer_size);
+    assert_true(data_size <= buffer_size);
+    memcpy(buffer, data, data_size);
+    divulge_connection_receive(divulge_connection, data_size);
+}
+
+static void test_counts_requests_per_route_and_status(void** state) {
+    divulge_metrics_t* metrics = divulge_metrics_create();
+    divulge_t* divulge = create_divulge(metrics);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    const char* requests = "GET /echo/a HTTP/1.1\r\n\r\nGET /echo/b HTTP/1.1\r\n\r\nGET /missing HTTP/1.1\r\n\r\n";
+    receive(divulge_connection, requests);
+    divulge_connection_destroy(divulge_connection);
+    assert_int_equal(divulge_metrics_get_request_count(metrics, "/echo/*", DIVULGE_ROUTE_METHOD_GET, 200), 2);
+    assert_int_equal(divulge_metrics_get_request_count(metrics, "/echo/*", DIVULGE_ROUTE_METHOD_GET, 404), 0);
+    assert_int_equal(divulge_metrics_get_request_count(metrics, NULL, DIVULGE_ROUTE_METHOD_GET, 404), 1);
+    assert_int_equal(divulge_metrics_get_request_count(metrics, NULL, DIVULGE_ROUTE_METHOD_GET, 0), 1);
+    char* text = divulge_metrics_render(metrics, NULL);
+    assert_non_null(text);
+    assert_non_null(strstr(text, "divulge_requests_total{route=\"/echo/*\",method=\"GET\",status=\"200\"} 2\n"));
+    assert_non_null(strstr(text, "divulge_requests_total{route=\"\",method=\"GET\",status=\"404\"} 1\n"));
+    assert_non_null(strstr(text, "divulge_request_bytes_total{route=\"/echo/*\",method=\"GET\"} 48\n"));
+    char line[128];
+    const char* not_found = strstr(connection.output, "HTTP/1.1 404");
+    assert_non_null(not_found);
+    snprintf(line, sizeof(line), "divulge_response_bytes_total{route=\"/echo/*\",method=\"GET\"} %zu\n",
+             (size_t)(not_found - connection.output));
+    assert_non_null(strstr(text, line));
+    assert_non_null(strstr(text,
+                           "divulge_request_duration_seconds_count{route=\"/echo/*\",method=\"GET\",phase=\"handler\"}"
+                           " 2\n"));
+    free(text);
+    divulge_metrics_destroy(metrics);
+}
+
+static void test_estimates_quantiles(void** state) {
+    divulge_metrics_t* metrics = divulge_metrics_create();
+    for (uint64_t i = 1; i <= 1000; i++) {
+        divulge_metrics_sample_t sample = {.route = "/a", .status = 200};
+        sample.durations_ns[DIVULGE_METRICS_PHASE_TOTAL] = i * 1000;
+        divulge_metrics_record(metrics, &sample);
+    }
+    uint64_t median = divulge_metrics_get_duration_quantile(metrics, "/a", DIVULGE_ROUTE_METHOD_GET,
+                                                            DIVULGE_METRICS_PHASE_TOTAL, 0.5);
+    uint64_t p99 = divulge_metrics_get_duration_quantile(metrics, "/a", DIVULGE_ROUTE_METHOD_GET,
+                                                         DIVULGE_METRICS_PHASE_TOTAL, 0.99);
+    assert_true((median > 500000 * 7 / 8) && (median < 500000 * 9 / 8));
+    assert_true((p99 > 990000 * 7 / 8) && (p99 < 990000 * 9 / 8));
+    assert_int_equal(divulge_metrics_get_duration_quantile(metrics, "/a", DIVULGE_ROUTE_METHOD_POST,
+                                                           DIVULGE_METRICS_PHASE_TOTAL, 0.5),
+                     0);
+    char* text = divulge_metrics_render(metrics, NULL);
+    assert_non_null(strstr(text, "phase=\"total\",le=\"0.001048576\"} 1000\n"));
+    assert_non_null(strstr(text, "phase=\"total\",le=\"0.000262144\"} 262\n"));
+    assert_non_null(strstr(text, "divulge_request_duration_seconds_sum{route=\"/a\",method=\"GET\",phase=\"total\"} "
+                                 "0.500500000\n"));
+    free(text);
+    divulge_metrics_destroy(metrics);
+}
+
+static void* record_samples(void* metrics) {
+    for (size_t i = 0; i < SAMPLES_PER_THREAD; i++) {
+        divulge_metrics_sample_t sample = {.route = (i % 2) ? "/odd" : "/even", .status = 200, .sent_size = 10};
+        divulge_metrics_record(metrics, &sample);
+    }
+    return NULL;
+}
+
+static void test_merges_thread_shards(void** state) {
+    divulge_metrics_t* metrics = divulge_metrics_create();
+    for (size_t round = 0; round < 2; round++) {
+        pthread_t threads[THREAD_COUNT];
+        for (size_t i = 0; i < THREAD_COUNT; i++) {
+            assert_int_equal(pthread_create(threads + i, NULL, record_samples, metrics), 0);
+        }
+        for (size_t i = 0; i < THREAD_COUNT; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    uint64_t expected = 2 * THREAD_COUNT * SAMPLES_PER_THREAD / 2;
+    assert_int_equal(divulge_metrics_get_request_count(metrics, "/odd", DIVULGE_ROUTE_METHOD_GET, 200), expected);
+    assert_int_equal(divulge_metrics_get_request_count(metrics, "/even", DIVULGE_ROUTE_METHOD_GET, 0), expected);
+    char* text = divulge_metrics_render(metrics, NULL);
+    char line[128];
+    snprintf(line, sizeof(line), "divulge_response_bytes_total{route=\"/odd\",method=\"GET\"} %llu\n",
+             (unsigned long long)expected * 10);
+    assert_non_null(strstr(text, line));
+    free(text);
+    divulge_metrics_destroy(metrics);
+}
+
+static void test_escapes_labels(void** state) {
+    divulge_metrics_t* metrics = divulge_metrics_create();
+    divulge_metrics_sample_t sample = {.route = "/a\"b\\c", .method = DIVULGE_ROUTE_METHOD_POST, .status = 201};
+    divulge_metrics_record(metrics, &sample);
+    char* text = divulge_metrics_render(metrics, NULL);
+    assert_non_null(strstr(text, "divulge_requests_total{route=\"/a\\\"b\\\\c\",method=\"POST\",status=\"201\"} 1\n"));
+    free(text);
+    divulge_metrics_destroy(metrics);
+}
+
+static void test_serves_prometheus_text(void** state) {
+    divulge_metrics_t* metrics = divulge_metrics_create();
+    divulge_t* divulge = create_divulge(metrics);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    receive(divulge_connection, "GET /echo/a HTTP/1.1\r\n\r\n");
+    connection.output_size = 0;
+    receive(divulge_connection, "GET /metrics HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200 OK\r\n"));
+    assert_non_null(strstr(connection.output, "Content-Type: text/plain; version=0.0.4\r\n"));
+    assert_non_null(strstr(connection.output, "# TYPE divulge_request_duration_seconds histogram\n"));
+    assert_non_null(strstr(connection.output, "phase=\"parse\",le=\"+Inf\"} 1\n"));
+    assert_null(strstr(connection.output, "route=\"/metrics\""));
+    divulge_connection_destroy(divulge_connection);
+    assert_int_equal(divulge_metrics_get_request_count(metrics, "/metrics", DIVULGE_ROUTE_METHOD_GET, 200), 1);
+    divulge_metrics_destroy(metrics);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_counts_requests_per_route_and_status),
+        cmocka_unit_test(test_estimates_quantiles),
+        cmocka_unit_test(test_merges_thread_shards),
+        cmocka_unit_test(test_escapes_labels),
+        cmocka_unit_test(test_serves_prometheus_text),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,160 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <string.h>
+#include "divulge-parser.h"
+
+static const char* simple_request =
+    "POST /submit/form?a=1&b=2 HTTP/1.1\r\n"
+    "Host: example.com\r\n"
+    "Content-Type:   text/plain  \r\n"
+    "content-length: 5\r\n"
+    "X-Empty:\r\n"
+    "\r\n"
+    "hello";
+
+static void assert_span(const char* buffer, divulge_span_t span, const char* expected) {
+    assert_int_equal(span.size, strlen(expected));
+    assert_memory_equal(buffer + span.offset, expected, span.size);
+}
+
+static void assert_simple_request(const char* buffer, divulge_parser_t* parser) {
+    assert_span(buffer, parser->method, "POST");
+    assert_span(buffer, parser->target, "/submit/form?a=1&b=2");
+    assert_span(buffer, parser->path, "/submit/form");
+    assert_span(buffer, parser->query, "a=1&b=2");
+    assert_span(buffer, parser->version, "HTTP/1.1");
+    assert_int_equal(parser->version_minor, 1);
+    assert_int_equal(parser->header_count, 4);
+    assert_span(buffer, parser->headers[0].key, "Host");
+    assert_span(buffer, parser->headers[0].value, "example.com");
+    assert_span(buffer, parser->headers[1].value, "text/plain");
+    assert_span(buffer, parser->headers[3].key, "X-Empty");
+    assert_span(buffer, parser->headers[3].value, "");
+    assert_true(parser->has_content_length);
+    assert_span(buffer, parser->body, "hello");
+    assert_int_equal(divulge_parser_get_request_size(parser), strlen(buffer));
+}
+
+static void test_whole_request(void** state) {
+    divulge_parser_t parser;
+    divulge_parser_initialize(&parser, NULL);
+    assert_int_equal(divulge_parser_feed(&parser, simple_request, strlen(simple_request)),
+                     DIVULGE_PARSER_STATUS_COMPLETE);
+    assert_simple_request(simple_request, &parser);
+}
+
+static void test_byte_by_byte(void** state) {
+    divulge_parser_t parser;
+    divulge_parser_initialize(&parser, NULL);
+    size_t size = strlen(simple_request);
+    for (size_t i = 1; i < size; i++) {
+        assert_int_equal(divulge_parser_feed(&parser, simple_request, i), DIVULGE_PARSER_STATUS_INCOMPLETE);
+    }
+    assert_int_equal(divulge_parser_feed(&parser, simple_request, size), DIVULGE_PARSER_STATUS_COMPLETE);
+    assert_simple_request(simple_request, &parser);
+}
+
+static void test_pipelined_bytes_are_not_consumed(void** state) {
+    const char* buffer = "GET / HTTP/1.0\r\n\r\nGET /next HTTP/1.1\r\n\r\n";
+    divulge_parser_t parser;
+    divulge_parser_initialize(&parser, NULL);
+    assert_int_equal(divulge_parser_feed(&parser, buffer, strlen(buffer)), DIVULGE_PARSER_STATUS_COMPLETE);
+    assert_int_equal(parser.version_minor, 0);
+    assert_span(buffer, parser.path, "/");
+    assert_span(buffer, parser.query, "");
+    assert_int_equal(divulge_parser_get_request_size(&parser), strlen("GET / HTTP/1.0\r\n\r\n"));
+}
+
+static void expect_error(const char* buffer, const divulge_parser_limits_t* limits, int status) {
+    divulge_parser_t parser;
+    divulge_parser_initialize(&parser, limits);
+    assert_int_equal(divulge_parser_feed(&parser, buffer, strlen(buffer)), DIVULGE_PARSER_STATUS_ERROR);
+    assert_int_equal(divulge_parser_get_error_status(&parser), status);
+    assert_int_equal(divulge_parser_get_request_size(&parser), 0);
+}
+
+static void test_malformed_requests(void** state) {
+    expect_error("GET\r\n\r\n", NULL, 400);
+    expect_error(" / HTTP/1.1\r\n\r\n", NULL, 400);
+    expect_error("GET / HTTP/1.1\n\n", NULL, 400);
+    expect_error("GET / HTTP/2.0\r\n\r\n", NULL, 505);
+    expect_error("GET / HTTP/1.1\r\nNo-Colon\r\n\r\n", NULL, 400);
+    expect_error("GET / HTTP/1.1\r\n Folded: value\r\n\r\n", NULL, 400);
+    expect_error("GET / HTTP/1.1\r\nBad\x01: value\r\n\r\n", NULL, 400);
+    expect_error("POST / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n", NULL, 400);
+    expect_error("POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n", NULL, 400);
+    expect_error("POST / HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n", NULL, 400);
+    expect_error("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n", NULL, 501);
+    expect_error("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 1\r\n\r\n", NULL, 400);
+    expect_error("POST / HTTP/1.1\r\nExpect: 200-ok\r\n\r\n", NULL, 417);
+}
+
+static void test_chunked_body_is_left_to_the_caller(void** state) {
+    const char* buffer =
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nExpect: 100-Continue\r\n\r\n5\r\nhello\r\n0\r\n\r\n";
+    divulge_parser_t parser;
+    divulge_parser_initialize(&parser, NULL);
+    assert_int_equal(divulge_parser_feed(&parser, buffer, strlen(buffer)), DIVULGE_PARSER_STATUS_INCOMPLETE);
+    assert_true(divulge_parser_has_header_block(&parser));
+    assert_true(parser.is_chunked);
+    assert_true(parser.expects_continue);
+    assert_memory_equal(buffer + parser.body.offset, "5\r\n", 3);
+    assert_int_equal(divulge_parser_get_request_size(&parser), 0);
+    divulge_parser_complete_body(&parser, 5);
+    assert_int_equal(divulge_parser_get_request_size(&parser), parser.body.offset + 5);
+}
+
+static void test_limits(void** state) {
+    divulge_parser_limits_t limits = {.max_line_size = 32, .max_header_size = 64};
+    expect_error("GET /aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa HTTP/1.1\r\n\r\n", &limits, 414);
+    expect_error("GET / HTTP/1.1\r\nX-Long: aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\r\n\r\n", &limits, 431);
+    expect_error("GET / HTTP/1.1\r\nA: 1234567890\r\nB: 1234567890\r\nC: 1234567890\r\nD: 1234567890\r\n"
+                 "E: 1234567890\r\n\r\n",
+                 &limits, 431);
+    char buffer[2048] = "GET / HTTP/1.1\r\n";
+    for (size_t i = 0; i <= DIVULGE_PARSER_MAX_HEADERS; i++) {
+        strcat(buffer, "A: b\r\n");
+    }
+    strcat(buffer, "\r\n");
+    expect_error(buffer, NULL, 431);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_whole_request),
+        cmocka_unit_test(test_byte_by_byte),
+        cmocka_unit_test(test_pipelined_bytes_are_not_consumed),
+        cmocka_unit_test(test_malformed_requests),
+        cmocka_unit_test(test_chunked_body_is_left_to_the_caller),
+        cmocka_unit_test(test_limits),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
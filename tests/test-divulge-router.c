@@ -0,0 +1,142 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <string.h>
+#include "divulge-router.h"
+
+static int values[8];
+
+static void* lookup(divulge_router_t* router,
+                    divulge_route_method_t method,
+                    const char* path,
+                    divulge_route_parameter_t* parameters,
+                    size_t* parameter_count) {
+    return divulge_router_lookup(router, method, path, strlen(path), parameters, parameter_count);
+}
+
+static void test_static_routes(void** state) {
+    divulge_router_t* router = divulge_router_create();
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/", values + 0));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/users", values + 1));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/users/", values + 2));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_POST, "/users", values + 3));
+    assert_false(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/users", values + 4));
+    divulge_route_parameter_t parameters[DIVULGE_MAX_ROUTE_PARAMETERS];
+    size_t count = 0;
+    assert_ptr_equal(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/", parameters, &count), values + 0);
+    assert_ptr_equal(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/users", parameters, &count), values + 1);
+    assert_ptr_equal(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/users/", parameters, &count), values + 2);
+    assert_ptr_equal(lookup(router, DIVULGE_ROUTE_METHOD_POST, "/users", parameters, &count), values + 3);
+    assert_null(lookup(router, DIVULGE_ROUTE_METHOD_ANY, "/users", parameters, &count));
+    assert_null(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/user", parameters, &count));
+    assert_null(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/users/x", parameters, &count));
+    assert_ptr_equal(divulge_router_find(router, DIVULGE_ROUTE_METHOD_GET, "/users/"), values + 2);
+    divulge_router_destroy(router);
+}
+
+static void test_parameters_and_wildcards(void** state) {
+    divulge_router_t* router = divulge_router_create();
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/users/:id", values + 0));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/users/me", values + 1));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/users/:id/posts/:post", values + 2));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/static/*", values + 3));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/files/*path", values + 4));
+    assert_false(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_POST, "/users/:name", values + 5));
+    assert_false(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/bad/*/tail", values + 5));
+    assert_false(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "relative", values + 5));
+
+    divulge_route_parameter_t parameters[DIVULGE_MAX_ROUTE_PARAMETERS];
+    size_t count = 0;
+    assert_ptr_equal(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/users/42", parameters, &count), values + 0);
+    assert_int_equal(count, 1);
+    assert_memory_equal(parameters[0].name.data, "id", 2);
+    assert_int_equal(parameters[0].value.size, 2);
+    assert_memory_equal(parameters[0].value.data, "42", 2);
+
+    assert_ptr_equal(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/users/me", parameters, &count), values + 1);
+    assert_int_equal(count, 0);
+
+    assert_ptr_equal(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/users/me/posts/7", parameters, &count), values + 2);
+    assert_int_equal(count, 2);
+    assert_memory_equal(parameters[0].value.data, "me", 2);
+    assert_memory_equal(parameters[1].name.data, "post", 4);
+    assert_memory_equal(parameters[1].value.data, "7", 1);
+
+    assert_null(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/users/", parameters, &count));
+
+    assert_ptr_equal(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/static/css/site.css", parameters, &count), values + 3);
+    assert_int_equal(count, 1);
+    assert_memory_equal(parameters[0].name.data, "*", 1);
+    assert_int_equal(parameters[0].value.size, strlen("css/site.css"));
+    assert_memory_equal(parameters[0].value.data, "css/site.css", parameters[0].value.size);
+
+    assert_ptr_equal(lookup(router, DIVULGE_ROUTE_METHOD_GET, "/files/a/b", parameters, &count), values + 4);
+    assert_memory_equal(parameters[0].name.data, "path", 4);
+    assert_memory_equal(parameters[0].value.data, "a/b", 3);
+    divulge_router_destroy(router);
+}
+
+static void test_path_is_not_nul_terminated(void** state) {
+    divulge_router_t* router = divulge_router_create();
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/a/:b", values + 0));
+    divulge_route_parameter_t parameters[DIVULGE_MAX_ROUTE_PARAMETERS];
+    size_t count = 0;
+    const char* buffer = "/a/xyz HTTP/1.1";
+    assert_ptr_equal(divulge_router_lookup(router, DIVULGE_ROUTE_METHOD_GET, buffer, 6, parameters, &count),
+                     values + 0);
+    assert_int_equal(parameters[0].value.size, 3);
+    divulge_router_destroy(router);
+}
+
+static void test_methods_of_path(void** state) {
+    divulge_router_t* router = divulge_router_create();
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_GET, "/users/:id", values + 0));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_DELETE, "/users/:id", values + 1));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_PATCH, "/users/me", values + 2));
+    assert_true(divulge_router_insert(router, DIVULGE_ROUTE_METHOD_OPTIONS, "/*", values + 3));
+    assert_int_equal(divulge_router_get_methods(router, "/users/1", 8),
+                     (1u << DIVULGE_ROUTE_METHOD_GET) | (1u << DIVULGE_ROUTE_METHOD_DELETE) |
+                         (1u << DIVULGE_ROUTE_METHOD_OPTIONS));
+    assert_int_equal(divulge_router_get_methods(router, "/users/me", 9),
+                     (1u << DIVULGE_ROUTE_METHOD_GET) | (1u << DIVULGE_ROUTE_METHOD_DELETE) |
+                         (1u << DIVULGE_ROUTE_METHOD_PATCH) | (1u << DIVULGE_ROUTE_METHOD_OPTIONS));
+    assert_int_equal(divulge_router_get_methods(router, "/posts", 6), 1u << DIVULGE_ROUTE_METHOD_OPTIONS);
+    divulge_router_destroy(router);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_static_routes),
+        cmocka_unit_test(test_parameters_and_wildcards),
+        cmocka_unit_test(test_path_is_not_nul_terminated),
+        cmocka_unit_test(test_methods_of_path),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,196 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include "divulge.h"
+
+#define READER_THREADS (20)
+#define UPDATES (2000)
+#define TENANTS (16)
+
+typedef struct reader_state {
+    divulge_t* divulge;
+    int status;
+    size_t stable_requests;
+    size_t failures;
+} reader_state_t;
+
+static atomic_bool are_updates_running;
+
+static void socket_send(void* connection_context, const char* data, size_t data_size) {
+    reader_state_t* state = connection_context;
+    int status = 0;
+    if (sscanf(data, "HTTP/1.1 %d", &status) == 1) {
+        state->status = status;
+    }
+}
+
+static void socket_close(void* connection_context) {}
+
+static bool ok_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {.return_code = 200, .payload = "ok", .payload_size = 2};
+    return divulge_respond(request, &response);
+}
+
+static bool status_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {.return_code = *(const int*)context, .payload = "", .payload_size = 0};
+    return divulge_respond(request, &response);
+}
+
+static bool pass_middleware(divulge_request_t* request, void* context) {
+    return true;
+}
+
+static divulge_uri_t stable_uri = {
+    .uri = "/stable/:id",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = ok_handler},
+};
+
+static char tenant_patterns[TENANTS][32];
+
+static divulge_t* create_divulge(void) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    return divulge_initialize(&configuration);
+}
+
+static void dispatch(reader_state_t* state, const char* route) {
+    char request[128];
+    snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: test\r\n\r\n", route);
+    char response[256];
+    state->status = 0;
+    divulge_process_request(state->divulge, state, request, strlen(request), response, sizeof(response));
+}
+
+static void* reader_thread(void* argument) {
+    reader_state_t* state = argument;
+    char route[64];
+    for (size_t i = 0; atomic_load(&are_updates_running); i++) {
+        dispatch(state, "/stable/42");
+        state->stable_requests++;
+        if (state->status != 200) {
+            state->failures++;
+        }
+        snprintf(route, sizeof(route), "/tenant%zu/items", i % TENANTS);
+        dispatch(state, route);
+        if ((state->status != 200) && (state->status != 404) && (state->status != 410)) {
+            state->failures++;
+        }
+    }
+    return NULL;
+}
+
+static void test_unregister_and_versions(void** state) {
+    divulge_t* divulge = create_divulge();
+    reader_state_t reader = {.divulge = divulge};
+    unsigned long version = divulge_get_routes_version(divulge);
+    divulge_register_uri(divulge, &stable_uri);
+    assert_true(divulge_get_routes_version(divulge) > version);
+    dispatch(&reader, "/stable/1");
+    assert_int_equal(reader.status, 200);
+
+    divulge_handler_object_t middleware = {.handler = pass_middleware};
+    divulge_add_middleware_to_uri(divulge, &stable_uri, &middleware);
+    assert_true(divulge_remove_middleware_from_uri(divulge, &stable_uri, &middleware));
+    assert_false(divulge_remove_middleware_from_uri(divulge, &stable_uri, &middleware));
+
+    assert_true(divulge_unregister_uri(divulge, &stable_uri));
+    assert_false(divulge_unregister_uri(divulge, &stable_uri));
+    dispatch(&reader, "/stable/1");
+    assert_int_equal(reader.status, 404);
+
+    version = divulge_get_routes_version(divulge);
+    divulge_begin_routes_update(divulge);
+    divulge_register_uri(divulge, &stable_uri);
+    divulge_add_middleware_to_uri(divulge, &stable_uri, &middleware);
+    assert_int_equal(divulge_get_routes_version(divulge), version);
+    dispatch(&reader, "/stable/1");
+    assert_int_equal(reader.status, 404);
+    divulge_end_routes_update(divulge);
+    assert_int_equal(divulge_get_routes_version(divulge), version + 1);
+    dispatch(&reader, "/stable/1");
+    assert_int_equal(reader.status, 200);
+}
+
+static void test_readers_dispatch_during_updates(void** state) {
+    divulge_t* divulge = create_divulge();
+    divulge_register_uri(divulge, &stable_uri);
+    divulge_uri_t tenant_uris[TENANTS];
+    divulge_handler_object_t middleware = {.handler = pass_middleware};
+    static const int not_found_statuses[] = {404, 410};
+    for (size_t i = 0; i < TENANTS; i++) {
+        snprintf(tenant_patterns[i], sizeof(tenant_patterns[i]), "/tenant%zu/items", i);
+        tenant_uris[i] = (divulge_uri_t){
+            .uri = tenant_patterns[i],
+            .method = DIVULGE_ROUTE_METHOD_GET,
+            .handler = {.handler = ok_handler},
+        };
+    }
+
+    atomic_store(&are_updates_running, true);
+    pthread_t threads[READER_THREADS];
+    reader_state_t readers[READER_THREADS];
+    for (size_t i = 0; i < READER_THREADS; i++) {
+        readers[i] = (reader_state_t){.divulge = divulge};
+        pthread_create(threads + i, NULL, reader_thread, readers + i);
+    }
+    for (size_t i = 0; i < UPDATES; i++) {
+        divulge_uri_t* uri = tenant_uris + (i % TENANTS);
+        if ((i / TENANTS) % 2 == 0) {
+            divulge_register_uri(divulge, uri);
+            divulge_add_middleware_to_uri(divulge, uri, &middleware);
+            divulge_add_middleware_to_uri(divulge, &stable_uri, &middleware);
+        } else {
+            divulge_unregister_uri(divulge, uri);
+            divulge_remove_middleware_from_uri(divulge, &stable_uri, &middleware);
+        }
+        divulge_set_default_404_handler(divulge, status_handler, (void*)(not_found_statuses + (i % 2)));
+    }
+    atomic_store(&are_updates_running, false);
+
+    size_t stable_requests = 0;
+    for (size_t i = 0; i < READER_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        assert_int_equal(readers[i].failures, 0);
+        stable_requests += readers[i].stable_requests;
+    }
+    assert_true(stable_requests > 0);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_unregister_and_versions),
+        cmocka_unit_test(test_readers_dispatch_during_updates),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,123 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "divulge-scan.h"
+
+#define FUZZ_BUFFER_SIZE (256)
+#define FUZZ_ITERATIONS (20000)
+
+static const divulge_scan_implementation_t implementations[] = {
+    DIVULGE_SCAN_IMPLEMENTATION_SCALAR,
+    DIVULGE_SCAN_IMPLEMENTATION_SSE42,
+    DIVULGE_SCAN_IMPLEMENTATION_AVX2,
+};
+
+static const unsigned class_bits[] = {
+    DIVULGE_SCAN_CLASS_TOKEN_BIT,
+    DIVULGE_SCAN_CLASS_TARGET_BIT,
+    DIVULGE_SCAN_CLASS_VALUE_BIT,
+    DIVULGE_SCAN_CLASS_PATH_BIT,
+};
+
+static size_t scan_reference(unsigned class_bit, const char* data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (!divulge_scan_is_in_class((unsigned char)data[i], class_bit)) {
+            return i;
+        }
+    }
+    return size;
+}
+
+static void test_character_classes(void** state) {
+    assert_true(divulge_scan_is_in_class('!', DIVULGE_SCAN_CLASS_TOKEN_BIT));
+    assert_true(divulge_scan_is_in_class('|', DIVULGE_SCAN_CLASS_TOKEN_BIT));
+    assert_true(divulge_scan_is_in_class('~', DIVULGE_SCAN_CLASS_TOKEN_BIT));
+    assert_false(divulge_scan_is_in_class(':', DIVULGE_SCAN_CLASS_TOKEN_BIT));
+    assert_false(divulge_scan_is_in_class(' ', DIVULGE_SCAN_CLASS_TARGET_BIT));
+    assert_true(divulge_scan_is_in_class('?', DIVULGE_SCAN_CLASS_TARGET_BIT));
+    assert_false(divulge_scan_is_in_class('?', DIVULGE_SCAN_CLASS_PATH_BIT));
+    assert_true(divulge_scan_is_in_class('\t', DIVULGE_SCAN_CLASS_VALUE_BIT));
+    assert_true(divulge_scan_is_in_class(0x80, DIVULGE_SCAN_CLASS_VALUE_BIT));
+    assert_false(divulge_scan_is_in_class('\r', DIVULGE_SCAN_CLASS_VALUE_BIT));
+    assert_false(divulge_scan_is_in_class(0x7f, DIVULGE_SCAN_CLASS_VALUE_BIT));
+}
+
+static void test_every_byte_stops_the_scan(void** state) {
+    char buffer[64];
+    for (size_t i = 0; i < sizeof(implementations) / sizeof(implementations[0]); i++) {
+        if (!divulge_scan_select_implementation(implementations[i])) {
+            continue;
+        }
+        for (divulge_scan_class_t scan_class = DIVULGE_SCAN_CLASS_TOKEN; scan_class <= DIVULGE_SCAN_CLASS_PATH;
+             scan_class++) {
+            for (int c = 0; c < 256; c++) {
+                memset(buffer, 'a', sizeof(buffer));
+                buffer[40] = (char)c;
+                size_t expected = divulge_scan_is_in_class((unsigned char)c, class_bits[scan_class]) ? 64 : 40;
+                assert_int_equal(divulge_scan(scan_class, buffer, sizeof(buffer)), expected);
+            }
+        }
+    }
+    divulge_scan_select_implementation(DIVULGE_SCAN_IMPLEMENTATION_SCALAR);
+}
+
+static void test_implementations_match_scalar(void** state) {
+    char buffer[FUZZ_BUFFER_SIZE];
+    srand(1234);
+    for (size_t i = 0; i < sizeof(implementations) / sizeof(implementations[0]); i++) {
+        if (!divulge_scan_select_implementation(implementations[i])) {
+            continue;
+        }
+        assert_int_equal(divulge_scan_get_implementation(), implementations[i]);
+        for (size_t iteration = 0; iteration < FUZZ_ITERATIONS; iteration++) {
+            for (size_t j = 0; j < sizeof(buffer); j++) {
+                // Mostly accepted bytes, so the runs are long enough to reach the vector loops
+                buffer[j] = (rand() % 64) ? (char)('a' + rand() % 26) : (char)(rand() % 256);
+            }
+            size_t offset = (size_t)rand() % 32;
+            size_t size = (size_t)rand() % (sizeof(buffer) - offset);
+            divulge_scan_class_t scan_class = (divulge_scan_class_t)(rand() % 4);
+            assert_int_equal(divulge_scan(scan_class, buffer + offset, size),
+                             scan_reference(class_bits[scan_class], buffer + offset, size));
+        }
+    }
+    divulge_scan_select_implementation(DIVULGE_SCAN_IMPLEMENTATION_SCALAR);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_character_classes),
+        cmocka_unit_test(test_every_byte_stops_the_scan),
+        cmocka_unit_test(test_implementations_match_scalar),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
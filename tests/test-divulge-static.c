@@ -0,0 +1,241 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "divulge-static.h"
+#include "test-divulge-transport.h"
+
+static char directory[64];
+static atomic_size_t send_file_count;
+
+static bool socket_send_file(void* connection_context, int file_descriptor, size_t offset, size_t size) {
+    char buffer[4096];
+    if ((size > sizeof(buffer)) || (pread(file_descriptor, buffer, size, (off_t)offset) != (ssize_t)size)) {
+        return false;
+    }
+    socket_send(connection_context, buffer, size);
+    atomic_fetch_add(&send_file_count, 1);
+    return true;
+}
+
+static void write_file(const char* name, const char* content) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE* f = fopen(path, "w");
+    assert_non_null(f);
+    fputs(content, f);
+    fclose(f);
+}
+
+static int set_up(void** state) {
+    strcpy(directory, "/tmp/divulge-static-XXXXXX");
+    if (!mkdtemp(directory)) {
+        return -1;
+    }
+    char path[128];
+    snprintf(path, sizeof(path), "%s/css", directory);
+    mkdir(path, 0700);
+    write_file("index.html", "<h1>index</h1>");
+    write_file("css/site.css", "body{}");
+    write_file("large.txt", "0123456789012345678901234567890123456789");
+    return 0;
+}
+
+static void remove_file(const char* name) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    remove(path);
+}
+
+static int tear_down(void** state) {
+    remove_file("index.html");
+    remove_file("css/site.css");
+    remove_file("css");
+    remove_file("large.txt");
+    remove_file("changing.txt");
+    remove(directory);
+    return 0;
+}
+
+static divulge_t* create_divulge(unsigned revalidate_interval_ms, bool has_send_file) {
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .send_file = has_send_file ? socket_send_file : NULL,
+        .close = socket_close,
+    };
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_static_configuration_t static_configuration = {
+        .url_prefix = "/static",
+        .directory = directory,
+        .index_file_name = "index.html",
+        .max_cached_file_size = 32,
+        .revalidate_interval_ms = revalidate_interval_ms,
+    };
+    divulge_handler_object_t* object = divulge_static_create(&static_configuration);
+    assert_non_null(object);
+    divulge_uri_t uri = {.uri = "/static/*", .method = DIVULGE_ROUTE_METHOD_GET, .handler = *object};
+    divulge_register_uri(divulge, &uri);
+    return divulge;
+}
+
+static void process(divulge_t* divulge, connection_t* connection, const char* request) {
+    char response_buffer[256];
+    memset(connection, 0, sizeof(*connection));
+    divulge_process_request(divulge, connection, request, strlen(request), response_buffer, sizeof(response_buffer));
+}
+
+static void get_header(const connection_t* connection, const char* name, char* value, size_t value_size) {
+    const char* start = strstr(connection->output, name);
+    assert_non_null(start);
+    start += strlen(name) + 2;
+    size_t size = (size_t)(strstr(start, "\r\n") - start);
+    assert_true(size < value_size);
+    memcpy(value, start, size);
+    value[size] = '\0';
+}
+
+static void test_serves_cached_file(void** state) {
+    divulge_t* divulge = create_divulge(0, false);
+    connection_t connection;
+    process(divulge, &connection, "GET /static/css/site.css HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+    assert_non_null(strstr(connection.output, "Content-Type: text/css\r\n"));
+    assert_non_null(strstr(connection.output, "Content-Length: 6\r\n"));
+    assert_non_null(strstr(connection.output, "ETag: \""));
+    assert_non_null(strstr(connection.output, " GMT\r\n"));
+    assert_non_null(strstr(connection.output, "\r\n\r\nbody{}"));
+    process(divulge, &connection, "GET /static/ HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "Content-Type: text/html\r\n"));
+    assert_non_null(strstr(connection.output, "\r\n\r\n<h1>index</h1>"));
+}
+
+static void test_conditional_requests(void** state) {
+    divulge_t* divulge = create_divulge(0, false);
+    connection_t connection;
+    char etag[64];
+    char last_modified[64];
+    char request[256];
+    process(divulge, &connection, "GET /static/index.html HTTP/1.1\r\n\r\n");
+    get_header(&connection, "ETag", etag, sizeof(etag));
+    get_header(&connection, "Last-Modified", last_modified, sizeof(last_modified));
+
+    snprintf(request, sizeof(request), "GET /static/index.html HTTP/1.1\r\nIf-None-Match: \"x\", %s\r\n\r\n", etag);
+    process(divulge, &connection, request);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 304"));
+    assert_non_null(strstr(connection.output, "Content-Length: 14\r\n"));
+    assert_null(strstr(connection.output, "<h1>"));
+
+    snprintf(request, sizeof(request), "GET /static/index.html HTTP/1.1\r\nIf-Modified-Since: %s\r\n\r\n",
+             last_modified);
+    process(divulge, &connection, request);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 304"));
+
+    process(divulge, &connection, "GET /static/index.html HTTP/1.1\r\nIf-None-Match: \"x\"\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200"));
+}
+
+static void test_rejects_missing_and_unsafe_paths(void** state) {
+    divulge_t* divulge = create_divulge(0, false);
+    connection_t connection;
+    process(divulge, &connection, "GET /static/missing.html HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 404"));
+    process(divulge, &connection, "GET /static/../etc/passwd HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 404"));
+    process(divulge, &connection, "GET /static/css HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "HTTP/1.1 404"));
+}
+
+static void test_reloads_changed_file(void** state) {
+    divulge_t* divulge = create_divulge(1, false);
+    connection_t connection;
+    write_file("changing.txt", "first");
+    process(divulge, &connection, "GET /static/changing.txt HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "\r\n\r\nfirst"));
+    write_file("changing.txt", "second");
+    struct timespec delay = {.tv_sec = 0, .tv_nsec = 5000000};
+    nanosleep(&delay, NULL);
+    process(divulge, &connection, "GET /static/changing.txt HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "\r\n\r\nsecond"));
+}
+
+static void test_large_file_is_sent_from_disk(void** state) {
+    connection_t connection;
+    process(create_divulge(0, false), &connection, "GET /static/large.txt HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "Content-Length: 40\r\n"));
+    assert_non_null(strstr(connection.output, "\r\n\r\n0123456789012345678901234567890123456789"));
+    atomic_store(&send_file_count, 0);
+    process(create_divulge(0, true), &connection, "GET /static/large.txt HTTP/1.1\r\n\r\n");
+    assert_non_null(strstr(connection.output, "\r\n\r\n0123456789012345678901234567890123456789"));
+    assert_int_equal(atomic_load(&send_file_count), 1);
+}
+
+#define CONCURRENT_THREAD_COUNT (4)
+#define CONCURRENT_REQUEST_COUNT (500)
+
+static void* request_repeatedly(void* argument) {
+    divulge_t* divulge = argument;
+    connection_t* connection = calloc(1, sizeof(connection_t));
+    for (size_t i = 0; i < CONCURRENT_REQUEST_COUNT; i++) {
+        process(divulge, connection, "GET /static/index.html HTTP/1.1\r\n\r\n");
+        assert_non_null(strstr(connection->output, "\r\n\r\n<h1>index</h1>"));
+    }
+    free(connection);
+    return NULL;
+}
+
+static void test_concurrent_requests(void** state) {
+    divulge_t* divulge = create_divulge(1, false);
+    pthread_t threads[CONCURRENT_THREAD_COUNT];
+    for (size_t i = 0; i < CONCURRENT_THREAD_COUNT; i++) {
+        pthread_create(threads + i, NULL, request_repeatedly, divulge);
+    }
+    for (size_t i = 0; i < CONCURRENT_THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_serves_cached_file),
+        cmocka_unit_test(test_conditional_requests),
+        cmocka_unit_test(test_rejects_missing_and_unsafe_paths),
+        cmocka_unit_test(test_reloads_changed_file),
+        cmocka_unit_test(test_large_file_is_sent_from_disk),
+        cmocka_unit_test(test_concurrent_requests),
+    };
+
+    return cmocka_run_group_tests(tests, set_up, tear_down);
+}
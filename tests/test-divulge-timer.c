@@ -0,0 +1,203 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include "divulge-timer.h"
+
+#define TICK_MS (10)
+#define RANDOM_TIMER_COUNT (2000)
+
+typedef struct expiry {
+    divulge_timer_wheel_t* wheel;
+    divulge_timer_t timer;
+    uint64_t due_ms;
+    uint64_t expired_at_ms; /**< time of the advance that expired the timer, 0 until then */
+    size_t expire_count;
+    uint64_t rescheduled_ms; /**< rescheduled from the callback while not 0 */
+} expiry_t;
+
+static void expire(void* context) {
+    expiry_t* expiry = context;
+    expiry->expired_at_ms = expiry->wheel->now_ms;
+    expiry->expire_count++;
+    if (expiry->rescheduled_ms) {
+        divulge_timer_schedule(expiry->wheel, &expiry->timer, expiry->rescheduled_ms);
+        expiry->rescheduled_ms = 0;
+    }
+}
+
+static void schedule(divulge_timer_wheel_t* wheel, expiry_t* expiry, uint64_t due_ms) {
+    expiry->wheel = wheel;
+    expiry->timer.expire = expire;
+    expiry->timer.context = expiry;
+    expiry->due_ms = due_ms;
+    divulge_timer_schedule(wheel, &expiry->timer, due_ms);
+}
+
+static void test_expires_when_due(void** state) {
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 1000);
+    expiry_t expiry = {0};
+    schedule(&wheel, &expiry, 1025);
+    assert_true(divulge_timer_is_scheduled(&expiry.timer));
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 1020), 0);
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 1029), 0);
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 1030), 1);
+    assert_int_equal(expiry.expired_at_ms, 1030);
+    assert_false(divulge_timer_is_scheduled(&expiry.timer));
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 5000), 0);
+    assert_int_equal(expiry.expire_count, 1);
+}
+
+static void test_cancel_and_reschedule(void** state) {
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 0);
+    expiry_t cancelled = {0};
+    expiry_t rescheduled = {0};
+    schedule(&wheel, &cancelled, 100);
+    schedule(&wheel, &rescheduled, 100);
+    divulge_timer_cancel(&wheel, &cancelled.timer);
+    divulge_timer_cancel(&wheel, &cancelled.timer);
+    divulge_timer_schedule(&wheel, &rescheduled.timer, 50000);
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 49990), 0);
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 50000), 1);
+    assert_int_equal(cancelled.expire_count, 0);
+    assert_int_equal(rescheduled.expire_count, 1);
+    assert_int_equal(divulge_timer_wheel_get_timeout(&wheel), -1);
+}
+
+static void test_past_expiry(void** state) {
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 1000);
+    expiry_t expiry = {0};
+    schedule(&wheel, &expiry, 10);
+    assert_int_equal(divulge_timer_wheel_get_timeout(&wheel), 0);
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 1000), 1);
+}
+
+/*
+ * Timers beyond the first levels are moved down as the wheel turns, and those beyond its span wait in its last
+ * slot, without expiring early.
+ */
+static void test_distant_timers(void** state) {
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, 1, 0);
+    uint64_t due_times_ms[] = {63, 64, 4095, 4096, 262143, 262144, 16777215, 16777216, 50000000};
+    size_t count = sizeof(due_times_ms) / sizeof(due_times_ms[0]);
+    expiry_t expiries[sizeof(due_times_ms) / sizeof(due_times_ms[0])] = {0};
+    for (size_t i = 0; i < count; i++) {
+        schedule(&wheel, expiries + i, due_times_ms[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        divulge_timer_wheel_advance(&wheel, due_times_ms[i] - 1);
+        assert_int_equal(expiries[i].expire_count, 0);
+        divulge_timer_wheel_advance(&wheel, due_times_ms[i]);
+        assert_int_equal(expiries[i].expire_count, 1);
+        assert_int_equal(expiries[i].expired_at_ms, due_times_ms[i]);
+    }
+}
+
+static void test_schedule_from_callback(void** state) {
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 0);
+    expiry_t expiry = {.rescheduled_ms = 640};
+    schedule(&wheel, &expiry, 0);
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 0), 1);
+    assert_true(divulge_timer_is_scheduled(&expiry.timer));
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 630), 0);
+    assert_int_equal(divulge_timer_wheel_advance(&wheel, 640), 1);
+    assert_int_equal(expiry.expire_count, 2);
+}
+
+static void test_timeout_until_next_timer(void** state) {
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 1005);
+    assert_int_equal(divulge_timer_wheel_get_timeout(&wheel), -1);
+    expiry_t near = {0};
+    schedule(&wheel, &near, 1050);
+    assert_int_equal(divulge_timer_wheel_get_timeout(&wheel), 45);
+    divulge_timer_cancel(&wheel, &near.timer);
+    expiry_t far = {0};
+    schedule(&wheel, &far, 100000);
+    int timeout = divulge_timer_wheel_get_timeout(&wheel);
+    assert_true((timeout > 0) && (timeout <= 64 * TICK_MS));
+}
+
+/*
+ * Every timer expires on the first advance reaching the tick its due time rounds up to.
+ */
+static void test_random_timers(void** state) {
+    divulge_timer_wheel_t wheel;
+    divulge_timer_wheel_initialize(&wheel, TICK_MS, 0);
+    expiry_t* expiries = calloc(RANDOM_TIMER_COUNT, sizeof(expiry_t));
+    assert_non_null(expiries);
+    srand(25);
+    for (size_t i = 0; i < RANDOM_TIMER_COUNT; i++) {
+        schedule(&wheel, expiries + i, (uint64_t)rand() % 3000000);
+    }
+    for (size_t i = 0; i < RANDOM_TIMER_COUNT; i += 7) {
+        divulge_timer_cancel(&wheel, &expiries[i].timer);
+    }
+    uint64_t now_ms = 0;
+    uint64_t previous_ms = 0;
+    while (now_ms <= 3000000) {
+        divulge_timer_wheel_advance(&wheel, now_ms);
+        for (size_t i = 0; i < RANDOM_TIMER_COUNT; i++) {
+            uint64_t due_tick_ms = (expiries[i].due_ms + TICK_MS - 1) / TICK_MS * TICK_MS;
+            bool is_due = (i % 7 != 0) && (due_tick_ms <= now_ms);
+            assert_int_equal(expiries[i].expire_count, is_due ? 1 : 0);
+            if (is_due && (due_tick_ms > previous_ms)) {
+                assert_int_equal(expiries[i].expired_at_ms, now_ms);
+            }
+        }
+        previous_ms = now_ms;
+        now_ms += (uint64_t)rand() % 20000;
+    }
+    divulge_timer_wheel_advance(&wheel, now_ms);
+    for (size_t i = 0; i < RANDOM_TIMER_COUNT; i++) {
+        assert_int_equal(expiries[i].expire_count, (i % 7 != 0) ? 1 : 0);
+    }
+    assert_int_equal(divulge_timer_wheel_get_timeout(&wheel), -1);
+    free(expiries);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_expires_when_due),
+        cmocka_unit_test(test_cancel_and_reschedule),
+        cmocka_unit_test(test_past_expiry),
+        cmocka_unit_test(test_distant_timers),
+        cmocka_unit_test(test_schedule_from_callback),
+        cmocka_unit_test(test_timeout_until_next_timer),
+        cmocka_unit_test(test_random_timers),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
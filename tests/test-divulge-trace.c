@@ -0,0 +1,292 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "divulge-trace.h"
+#include "test-divulge-transport.h"
+
+#define MAX_EVENTS (256)
+#define THREAD_COUNT (3)
+#define EVENTS_PER_THREAD (10)
+#define TRACE_PATH "test-divulge-trace.json"
+
+static bool echo_route_handler(divulge_request_t* request, void* context) {
+    divulge_response_t response = {
+        .return_code = 200,
+        .payload = request->route.data,
+        .payload_size = request->route.size,
+    };
+    return divulge_respond(request, &response);
+}
+
+static bool pass_middleware(divulge_request_t* request, void* context) {
+    return true;
+}
+
+static divulge_uri_t echo_uri = {
+    .uri = "/echo/*",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = echo_route_handler},
+};
+
+static divulge_uri_t trace_uri = {
+    .uri = "/trace",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = divulge_tracer_handler},
+};
+
+static divulge_handler_object_t middleware = {.handler = pass_middleware};
+
+static divulge_t* create_divulge(divulge_tracer_t* tracer) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close, .tracer = tracer};
+    divulge_t* divulge = divulge_initialize(&configuration);
+    trace_uri.handler.context = tracer;
+    divulge_register_uri(divulge, &echo_uri);
+    divulge_register_uri(divulge, &trace_uri);
+    return divulge;
+}
+
+static void receive(divulge_connection_t* divulge_connection, const char* data) {
+    size_t data_size = strlen(data);
+    size_t buffer_size = 0;
+    char* buffer = divulge_connection_get_receive_buffer(divulge_connection, &buffer_size);
+    assert_true(data_size <= buffer_size);
+    memcpy(buffer, data, data_size);
+    divulge_connection_receive(divulge_connection, data_size);
+}
+
+static size_t count_phase(const divulge_trace_event_t* events, size_t count, divulge_trace_phase_t phase) {
+    size_t matching = 0;
+    for (size_t i = 0; i < count; i++) {
+        matching += (events[i].phase == phase) ? 1 : 0;
+    }
+    return matching;
+}
+
+static const divulge_trace_event_t* find_phase(const divulge_trace_event_t* events,
+                                               size_t count,
+                                               divulge_trace_phase_t phase) {
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].phase == phase) {
+            return events + i;
+        }
+    }
+    return NULL;
+}
+
+static void test_traces_every_phase_of_a_sampled_request(void** state) {
+    divulge_tracer_configuration_t configuration = {.sample_period = 1};
+    divulge_tracer_t* tracer = divulge_tracer_create(&configuration);
+    divulge_t* divulge = create_divulge(tracer);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    receive(divulge_connection, "GET /echo/a HTTP/1.1\r\n");
+    receive(divulge_connection, "\r\n");
+    divulge_connection_destroy(divulge_connection);
+    divulge_trace_event_t events[MAX_EVENTS];
+    size_t count = divulge_tracer_collect(tracer, events, NULL, MAX_EVENTS);
+    assert_int_equal(count_phase(events, count, DIVULGE_TRACE_PHASE_REQUEST), 1);
+    assert_int_equal(count_phase(events, count, DIVULGE_TRACE_PHASE_READ), 1);
+    assert_int_equal(count_phase(events, count, DIVULGE_TRACE_PHASE_PARSE), 2);
+    assert_int_equal(count_phase(events, count, DIVULGE_TRACE_PHASE_HANDLER), 1);
+    assert_true(count_phase(events, count, DIVULGE_TRACE_PHASE_SEND) >= 1);
+    const divulge_trace_event_t* request = find_phase(events, count, DIVULGE_TRACE_PHASE_REQUEST);
+    assert_string_equal(request->name, "GET /echo/*");
+    assert_int_equal(request->status, 200);
+    for (size_t i = 0; i < count; i++) {
+        assert_int_equal(events[i].request_id, request->request_id);
+        assert_true(events[i].begin_ns <= events[i].end_ns);
+        assert_true(events[i].begin_ns >= request->begin_ns);
+        assert_true(events[i].end_ns <= request->end_ns);
+    }
+    divulge_tracer_destroy(tracer);
+}
+
+static void test_samples_one_request_per_period(void** state) {
+    divulge_tracer_configuration_t configuration = {.sample_period = 3};
+    divulge_tracer_t* tracer = divulge_tracer_create(&configuration);
+    divulge_t* divulge = create_divulge(tracer);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    for (size_t i = 0; i < 6; i++) {
+        receive(divulge_connection, "GET /echo/a HTTP/1.1\r\n\r\n");
+    }
+    divulge_trace_event_t events[MAX_EVENTS];
+    size_t count = divulge_tracer_collect(tracer, events, NULL, MAX_EVENTS);
+    assert_int_equal(count_phase(events, count, DIVULGE_TRACE_PHASE_REQUEST), 2);
+    divulge_tracer_set_sample_period(tracer, 0);
+    receive(divulge_connection, "GET /echo/a HTTP/1.1\r\n\r\n");
+    assert_int_equal(divulge_tracer_collect(tracer, NULL, NULL, 0), count);
+    divulge_connection_destroy(divulge_connection);
+    divulge_tracer_destroy(tracer);
+}
+
+static void test_traces_middlewares_by_position(void** state) {
+    divulge_tracer_configuration_t configuration = {.sample_period = 1};
+    divulge_tracer_t* tracer = divulge_tracer_create(&configuration);
+    divulge_t* divulge = create_divulge(tracer);
+    divulge_add_middleware_to_uri(divulge, &echo_uri, &middleware);
+    divulge_add_middleware_to_uri(divulge, &echo_uri, &middleware);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    receive(divulge_connection, "GET /echo/a HTTP/1.1\r\n\r\n");
+    divulge_connection_destroy(divulge_connection);
+    divulge_trace_event_t events[MAX_EVENTS];
+    size_t count = divulge_tracer_collect(tracer, events, NULL, MAX_EVENTS);
+    assert_int_equal(count_phase(events, count, DIVULGE_TRACE_PHASE_MIDDLEWARE), 2);
+    uint32_t indices = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].phase == DIVULGE_TRACE_PHASE_MIDDLEWARE) {
+            indices |= 1u << events[i].index;
+        }
+    }
+    assert_int_equal(indices, 3);
+    divulge_remove_middleware_from_uri(divulge, &echo_uri, &middleware);
+    divulge_remove_middleware_from_uri(divulge, &echo_uri, &middleware);
+    divulge_tracer_destroy(tracer);
+}
+
+static void test_keeps_the_newest_events(void** state) {
+    divulge_tracer_configuration_t configuration = {.events_per_thread = 5};
+    divulge_tracer_t* tracer = divulge_tracer_create(&configuration);
+    for (uint32_t i = 0; i < 20; i++) {
+        divulge_trace_event_t event = {.request_id = i + 1, .phase = DIVULGE_TRACE_PHASE_HANDLER};
+        divulge_tracer_record(tracer, &event);
+    }
+    divulge_trace_event_t events[MAX_EVENTS];
+    assert_int_equal(divulge_tracer_collect(tracer, events, NULL, MAX_EVENTS), 8);
+    for (size_t i = 0; i < 8; i++) {
+        assert_int_equal(events[i].request_id, 13 + i);
+    }
+    assert_int_equal(divulge_tracer_collect(tracer, events, NULL, 2), 8);
+    divulge_tracer_destroy(tracer);
+}
+
+static void* record_events(void* tracer) {
+    for (uint32_t i = 0; i < EVENTS_PER_THREAD; i++) {
+        divulge_trace_event_t event = {.request_id = i + 1, .phase = DIVULGE_TRACE_PHASE_PARSE};
+        divulge_tracer_record(tracer, &event);
+    }
+    return NULL;
+}
+
+static void test_gives_each_thread_its_own_ring(void** state) {
+    divulge_tracer_configuration_t configuration = {0};
+    divulge_tracer_t* tracer = divulge_tracer_create(&configuration);
+    pthread_t threads[THREAD_COUNT];
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        assert_int_equal(pthread_create(threads + i, NULL, record_events, tracer), 0);
+        pthread_join(threads[i], NULL);
+    }
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        assert_int_equal(pthread_create(threads + i, NULL, record_events, tracer), 0);
+    }
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    divulge_trace_event_t events[MAX_EVENTS];
+    uint32_t thread_numbers[MAX_EVENTS];
+    size_t count = divulge_tracer_collect(tracer, events, thread_numbers, MAX_EVENTS);
+    assert_int_equal(count, 2 * THREAD_COUNT * EVENTS_PER_THREAD);
+    for (size_t i = 0; i < count; i++) {
+        assert_true((thread_numbers[i] >= 1) && (thread_numbers[i] <= THREAD_COUNT));
+    }
+    divulge_tracer_destroy(tracer);
+}
+
+static void test_serves_chrome_trace_json(void** state) {
+    divulge_tracer_configuration_t configuration = {.sample_period = 1};
+    divulge_tracer_t* tracer = divulge_tracer_create(&configuration);
+    divulge_t* divulge = create_divulge(tracer);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    receive(divulge_connection, "GET /echo/a HTTP/1.1\r\n\r\n");
+    connection.output_size = 0;
+    receive(divulge_connection, "GET /trace HTTP/1.1\r\n\r\n");
+    divulge_connection_destroy(divulge_connection);
+    assert_non_null(strstr(connection.output, "HTTP/1.1 200 OK\r\n"));
+    assert_non_null(strstr(connection.output, "Content-Type: application/json\r\n"));
+    const char* body = strstr(connection.output, "\r\n\r\n");
+    assert_non_null(body);
+    assert_non_null(strstr(body, "\"traceEvents\":["));
+    assert_non_null(strstr(body, "\"name\":\"GET /echo/*\""));
+    assert_non_null(strstr(body, "\"ph\":\"X\""));
+    assert_non_null(strstr(body, "\"cat\":\"handler\""));
+    size_t size = 0;
+    char* text = divulge_tracer_render(tracer, &size);
+    assert_non_null(text);
+    assert_int_equal(strlen(text), size);
+    assert_int_equal(text[0], '{');
+    assert_string_equal(text + size - 4, "\n]}\n");
+    free(text);
+    divulge_tracer_destroy(tracer);
+}
+
+static void test_dumps_on_signal(void** state) {
+    divulge_tracer_configuration_t configuration = {0};
+    divulge_tracer_t* tracer = divulge_tracer_create(&configuration);
+    divulge_trace_event_t event = {.request_id = 7, .phase = DIVULGE_TRACE_PHASE_HANDLER, .end_ns = 1500};
+    divulge_tracer_record(tracer, &event);
+    unlink(TRACE_PATH);
+    assert_true(divulge_tracer_dump_on_signal(tracer, SIGUSR2, TRACE_PATH));
+    raise(SIGUSR2);
+    char text[4096] = {0};
+    for (size_t attempt = 0; (attempt < 500) && !strstr(text, "\n]}\n"); attempt++) {
+        struct timespec delay = {.tv_nsec = 10000000};
+        nanosleep(&delay, NULL);
+        FILE* file = fopen(TRACE_PATH, "r");
+        if (file) {
+            text[fread(text, 1, sizeof(text) - 1, file)] = '\0';
+            fclose(file);
+        }
+    }
+    assert_non_null(strstr(text, "\"name\":\"handler\",\"cat\":\"handler\",\"ph\":\"X\""));
+    assert_non_null(strstr(text, "\"ts\":0.000,\"dur\":1.500,\"args\":{\"request\":7}"));
+    divulge_tracer_destroy(tracer);
+    unlink(TRACE_PATH);
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_traces_every_phase_of_a_sampled_request),
+        cmocka_unit_test(test_samples_one_request_per_period),
+        cmocka_unit_test(test_traces_middlewares_by_position),
+        cmocka_unit_test(test_keeps_the_newest_events),
+        cmocka_unit_test(test_gives_each_thread_its_own_ring),
+        cmocka_unit_test(test_serves_chrome_trace_json),
+        cmocka_unit_test(test_dumps_on_signal),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
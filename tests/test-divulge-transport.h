@@ -0,0 +1,60 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef TEST_DIVULGE_TRANSPORT_H
+#define TEST_DIVULGE_TRANSPORT_H
+
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Transport for tests feeding connections by hand: what is sent is kept as a NUL-terminated string, dropping what
+ * does not fit, and closes and resumes are counted.
+ */
+typedef struct connection {
+    char output[65536];
+    size_t output_size;
+    size_t close_count;
+    size_t resume_count;
+} connection_t;
+
+static inline void socket_send(void* connection_context, const char* data, size_t data_size) {
+    connection_t* connection = connection_context;
+    if (connection->output_size + data_size < sizeof(connection->output)) {
+        memcpy(connection->output + connection->output_size, data, data_size);
+        connection->output_size += data_size;
+        connection->output[connection->output_size] = '\0';
+    }
+}
+
+static inline void socket_close(void* connection_context) {
+    connection_t* connection = connection_context;
+    connection->close_count++;
+}
+
+static inline void socket_resume(void* connection_context) {
+    connection_t* connection = connection_context;
+    connection->resume_count++;
+}
+
+#endif  // TEST_DIVULGE_TRANSPORT_H
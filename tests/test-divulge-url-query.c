@@ -0,0 +1,224 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "divulge-url-query.h"
+#include "test-divulge-transport.h"
+
+static void parse(divulge_url_query_t* query, const char* text) {
+    divulge_url_query_parse(query, text, strlen(text));
+}
+
+static size_t find(const divulge_url_query_t* query, const char* key) {
+    return divulge_url_query_find(query, key, strlen(key));
+}
+
+static void assert_value(const divulge_url_query_t* query, size_t index, const char* expected) {
+    char buffer[64];
+    divulge_slice_t value;
+    assert_true(divulge_url_query_get_value(query, index, buffer, sizeof(buffer), &value));
+    assert_int_equal(value.size, strlen(expected));
+    assert_memory_equal(value.data, expected, value.size);
+}
+
+static void test_splits_keys_and_values(void** state) {
+    divulge_url_query_t query;
+    const char* text = "a=1&bb=22&&flag&empty=&c=3";
+    parse(&query, text);
+    assert_int_equal(query.count, 5);
+    assert_false(query.is_truncated);
+    assert_value(&query, find(&query, "a"), "1");
+    assert_value(&query, find(&query, "bb"), "22");
+    assert_value(&query, find(&query, "c"), "3");
+    size_t flag = find(&query, "flag");
+    assert_false(query.parameters[flag].has_value);
+    size_t empty = find(&query, "empty");
+    assert_true(query.parameters[empty].has_value);
+    assert_value(&query, empty, "");
+    assert_ptr_equal(query.parameters[find(&query, "bb")].value.data, text + 7);
+    assert_int_equal(find(&query, "b"), DIVULGE_URL_QUERY_NONE);
+    assert_int_equal(find(&query, "missing"), DIVULGE_URL_QUERY_NONE);
+}
+
+static void test_decodes_only_on_access(void** state) {
+    divulge_url_query_t query;
+    parse(&query, "q=hello+world%21&path=%2Fa%2fb&bad=100%&odd=%zz%4&plain=x");
+    assert_true(query.parameters[find(&query, "q")].is_value_encoded);
+    assert_false(query.parameters[find(&query, "plain")].is_value_encoded);
+    assert_value(&query, find(&query, "q"), "hello world!");
+    assert_value(&query, find(&query, "path"), "/a/b");
+    assert_value(&query, find(&query, "bad"), "100%");
+    assert_value(&query, find(&query, "odd"), "%zz%4");
+    char small[4];
+    divulge_slice_t value;
+    assert_false(divulge_url_query_get_value(&query, find(&query, "q"), small, sizeof(small), &value));
+    assert_true(divulge_url_query_get_value(&query, find(&query, "plain"), NULL, 0, &value));
+}
+
+static void test_matches_decoded_keys(void** state) {
+    divulge_url_query_t query;
+    parse(&query, "first+name=Ada&user%5Bid%5D=7&user[id]=8");
+    assert_value(&query, find(&query, "first name"), "Ada");
+    size_t index = find(&query, "user[id]");
+    assert_value(&query, index, "7");
+    index = divulge_url_query_find_next(&query, index);
+    assert_value(&query, index, "8");
+    assert_int_equal(divulge_url_query_find_next(&query, index), DIVULGE_URL_QUERY_NONE);
+    assert_int_equal(find(&query, "first+name"), DIVULGE_URL_QUERY_NONE);
+}
+
+static void test_chains_repeated_keys(void** state) {
+    divulge_url_query_t query;
+    parse(&query, "tag=a&x=1&tag=b&y=2&tag=c");
+    const char* expected[] = {"a", "b", "c"};
+    size_t index = find(&query, "tag");
+    for (size_t i = 0; i < 3; i++) {
+        assert_value(&query, index, expected[i]);
+        index = divulge_url_query_find_next(&query, index);
+    }
+    assert_int_equal(index, DIVULGE_URL_QUERY_NONE);
+}
+
+static void test_reads_integers(void** state) {
+    divulge_url_query_t query;
+    parse(&query,
+          "a=42&b=-17&max=9223372036854775807&min=-9223372036854775808&over=9223372036854775808"
+          "&under=-9223372036854775809&text=12a&empty=&minus=-&encoded=%2D5&plus=+5");
+    int64_t value = 0;
+    assert_true(divulge_url_query_get_integer(&query, "a", &value));
+    assert_int_equal(value, 42);
+    assert_true(divulge_url_query_get_integer(&query, "b", &value));
+    assert_int_equal(value, -17);
+    assert_true(divulge_url_query_get_integer(&query, "max", &value));
+    assert_true(value == INT64_MAX);
+    assert_true(divulge_url_query_get_integer(&query, "min", &value));
+    assert_true(value == INT64_MIN);
+    assert_true(divulge_url_query_get_integer(&query, "encoded", &value));
+    assert_int_equal(value, -5);
+    assert_false(divulge_url_query_get_integer(&query, "over", &value));
+    assert_false(divulge_url_query_get_integer(&query, "under", &value));
+    assert_false(divulge_url_query_get_integer(&query, "text", &value));
+    assert_false(divulge_url_query_get_integer(&query, "empty", &value));
+    assert_false(divulge_url_query_get_integer(&query, "minus", &value));
+    assert_false(divulge_url_query_get_integer(&query, "plus", &value));
+    assert_false(divulge_url_query_get_integer(&query, "missing", &value));
+}
+
+static void test_reads_booleans(void** state) {
+    divulge_url_query_t query;
+    parse(&query, "a=1&b=TRUE&c=yes&d=On&e=0&f=false&g=No&h=off&flag&bad=maybe&empty=");
+    const char* true_keys[] = {"a", "b", "c", "d", "flag"};
+    const char* false_keys[] = {"e", "f", "g", "h"};
+    bool value = false;
+    for (size_t i = 0; i < sizeof(true_keys) / sizeof(true_keys[0]); i++) {
+        value = false;
+        assert_true(divulge_url_query_get_boolean(&query, true_keys[i], &value));
+        assert_true(value);
+    }
+    for (size_t i = 0; i < sizeof(false_keys) / sizeof(false_keys[0]); i++) {
+        value = true;
+        assert_true(divulge_url_query_get_boolean(&query, false_keys[i], &value));
+        assert_false(value);
+    }
+    assert_false(divulge_url_query_get_boolean(&query, "bad", &value));
+    assert_false(divulge_url_query_get_boolean(&query, "empty", &value));
+    assert_false(divulge_url_query_get_boolean(&query, "missing", &value));
+}
+
+static void test_truncates_long_queries(void** state) {
+    static char text[DIVULGE_URL_QUERY_MAX_PARAMETERS * 16];
+    size_t size = 0;
+    for (size_t i = 0; i <= DIVULGE_URL_QUERY_MAX_PARAMETERS; i++) {
+        size += (size_t)snprintf(text + size, sizeof(text) - size, "%sk%zu=%zu", i ? "&" : "", i, i);
+    }
+    divulge_url_query_t query;
+    assert_false(divulge_url_query_parse(&query, text, size));
+    assert_true(query.is_truncated);
+    assert_int_equal(query.count, DIVULGE_URL_QUERY_MAX_PARAMETERS);
+    assert_value(&query, find(&query, "k127"), "127");
+    assert_int_equal(find(&query, "k128"), DIVULGE_URL_QUERY_NONE);
+    assert_true(divulge_url_query_parse(&query, NULL, 0));
+    assert_int_equal(query.count, 0);
+}
+
+static bool search_handler(divulge_request_t* request, void* context) {
+    char body[256] = {0};
+    size_t size = 0;
+    divulge_slice_t value;
+    if (divulge_find_query_parameter(request, "q", &value)) {
+        size += (size_t)snprintf(body + size, sizeof(body) - size, "q=%.*s;", (int)value.size, value.data);
+    }
+    size_t cursor = 0;
+    while (divulge_find_next_query_parameter(request, "tag", &cursor, &value)) {
+        size += (size_t)snprintf(body + size, sizeof(body) - size, "tag=%.*s;", (int)value.size, value.data);
+    }
+    int64_t page = 0;
+    if (divulge_url_query_get_integer(divulge_get_url_query(request), "page", &page)) {
+        size += (size_t)snprintf(body + size, sizeof(body) - size, "page=%lld;", (long long)page);
+    }
+    assert_ptr_equal(divulge_get_url_query(request), divulge_get_url_query(request));
+    divulge_response_t response = {.return_code = 200, .payload = body, .payload_size = size};
+    return divulge_respond(request, &response);
+}
+
+static divulge_uri_t search_uri = {
+    .uri = "/search",
+    .method = DIVULGE_ROUTE_METHOD_GET,
+    .handler = {.handler = search_handler},
+};
+
+static void test_finds_request_query_parameters(void** state) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    divulge_t* divulge = divulge_initialize(&configuration);
+    divulge_register_uri(divulge, &search_uri);
+    connection_t connection = {0};
+    divulge_connection_t* divulge_connection = divulge_connection_create(divulge, &connection);
+    const char* request = "GET /search?q=red+shoes%21&tag=a&page=3&tag=b%26c HTTP/1.1\r\n\r\n";
+    size_t buffer_size = 0;
+    char* buffer = divulge_connection_get_receive_buffer(divulge_connection, &buffer_size);
+    memcpy(buffer, request, strlen(request));
+    divulge_connection_receive(divulge_connection, strlen(request));
+    divulge_connection_destroy(divulge_connection);
+    assert_non_null(strstr(connection.output, "\r\n\r\nq=red shoes!;tag=a;tag=b&c;page=3;"));
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_splits_keys_and_values),
+        cmocka_unit_test(test_decodes_only_on_access),
+        cmocka_unit_test(test_matches_decoded_keys),
+        cmocka_unit_test(test_chains_repeated_keys),
+        cmocka_unit_test(test_reads_integers),
+        cmocka_unit_test(test_reads_booleans),
+        cmocka_unit_test(test_truncates_long_queries),
+        cmocka_unit_test(test_finds_request_query_parameters),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
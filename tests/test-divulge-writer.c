@@ -0,0 +1,147 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Grzegorz Grzęda
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cmocka.h"
+
+#include <string.h>
+#include "divulge-writer.h"
+
+typedef struct connection {
+    char output[1024];
+    size_t output_size;
+    size_t send_count;
+    size_t segment_count;
+} connection_t;
+
+static void socket_send(void* connection_context, const char* data, size_t data_size) {
+    connection_t* connection = connection_context;
+    memcpy(connection->output + connection->output_size, data, data_size);
+    connection->output_size += data_size;
+    connection->output[connection->output_size] = '\0';
+    connection->send_count++;
+}
+
+static void socket_send_vector(void* connection_context, const divulge_slice_t* segments, size_t segment_count) {
+    connection_t* connection = connection_context;
+    for (size_t i = 0; i < segment_count; i++) {
+        memcpy(connection->output + connection->output_size, segments[i].data, segments[i].size);
+        connection->output_size += segments[i].size;
+    }
+    connection->output[connection->output_size] = '\0';
+    connection->segment_count += segment_count;
+    connection->send_count++;
+}
+
+static void socket_close(void* connection_context) {}
+
+static const char* body = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+static void write_response(divulge_writer_t* writer) {
+    divulge_writer_print(writer, "HTTP/1.1 %d OK\r\n", 200);
+    divulge_writer_copy(writer, "A: b\r\n\r\n", 8);
+    divulge_writer_reference(writer, body, strlen(body));
+    divulge_writer_flush(writer);
+}
+
+static void test_vectored_send(void** state) {
+    divulge_configuration_t configuration = {
+        .send = socket_send,
+        .send_vector = socket_send_vector,
+        .close = socket_close,
+    };
+    connection_t connection = {0};
+    char buffer[64];
+    divulge_writer_t writer;
+    divulge_writer_initialize(&writer, &configuration, &connection, buffer, sizeof(buffer));
+    write_response(&writer);
+    assert_string_equal(connection.output, "HTTP/1.1 200 OK\r\nA: b\r\n\r\n0123456789abcdefghijklmnopqrstuvwxyz");
+    assert_int_equal(connection.send_count, 1);
+    assert_int_equal(connection.segment_count, 2);
+}
+
+static void test_plain_send_coalesces(void** state) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    connection_t connection = {0};
+    char buffer[128];
+    divulge_writer_t writer;
+    divulge_writer_initialize(&writer, &configuration, &connection, buffer, sizeof(buffer));
+    write_response(&writer);
+    assert_string_equal(connection.output, "HTTP/1.1 200 OK\r\nA: b\r\n\r\n0123456789abcdefghijklmnopqrstuvwxyz");
+    assert_int_equal(connection.send_count, 1);
+}
+
+static void test_small_buffer(void** state) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    const char* expected = "HTTP/1.1 200 OK\r\nA: b\r\n\r\n0123456789abcdefghijklmnopqrstuvwxyz";
+    for (size_t buffer_size = 1; buffer_size < 64; buffer_size++) {
+        connection_t connection = {0};
+        char buffer[64];
+        divulge_writer_t writer;
+        divulge_writer_initialize(&writer, &configuration, &connection, buffer, buffer_size);
+        write_response(&writer);
+        assert_string_equal(connection.output, expected);
+        configuration.send_vector = (buffer_size % 2) ? socket_send_vector : NULL;
+    }
+}
+
+static void observe(void* context, const char* data, size_t size) {
+    connection_t* observed = context;
+    memcpy(observed->output + observed->output_size, data, size);
+    observed->output_size += size;
+    observed->output[observed->output_size] = '\0';
+}
+
+static void test_observer_sees_unpaused_pieces(void** state) {
+    divulge_configuration_t configuration = {.send = socket_send, .close = socket_close};
+    for (int is_vectored = 0; is_vectored < 2; is_vectored++) {
+        configuration.send_vector = is_vectored ? socket_send_vector : NULL;
+        connection_t connection = {0};
+        connection_t observed = {0};
+        char buffer[128];
+        divulge_writer_t writer;
+        divulge_writer_initialize(&writer, &configuration, &connection, buffer, sizeof(buffer));
+        divulge_response_observer_t observer = {.write = observe, .context = &observed};
+        divulge_writer_set_observer(&writer, &observer);
+        divulge_writer_pause_observer(&writer, true);
+        divulge_writer_copy(&writer, "X", 1);
+        divulge_writer_pause_observer(&writer, false);
+        write_response(&writer);
+        assert_string_equal(observed.output, "HTTP/1.1 200 OK\r\nA: b\r\n\r\n0123456789abcdefghijklmnopqrstuvwxyz");
+        assert_int_equal(connection.output_size, observed.output_size + 1);
+    }
+}
+
+int main(int argc, char** argv) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_vectored_send),
+        cmocka_unit_test(test_plain_send_coalesces),
+        cmocka_unit_test(test_small_buffer),
+        cmocka_unit_test(test_observer_sees_unpaused_pieces),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}